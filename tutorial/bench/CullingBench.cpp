@@ -0,0 +1,202 @@
+// Timing for the CPU frustum culling. Builds a scene of random boxes, a fifth of them dynamic,
+// and culls it from a camera spinning around in the middle, with 1 to N threads.
+// Also checks the tree gives exactly the same answer as testing every box on its own.
+#include "VpeCullingScene.hpp"
+#include "VpeJobSystem.hpp"
+#include "VpeSceneBvh.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    constexpr int REPEATS = 5;
+    constexpr int VIEW_COUNT = 64;
+    // What we're aiming for with 100k objects.
+    constexpr double BUDGET_MS = 0.5;
+
+    // Best of a few runs, in milliseconds.
+    double timeBest(const std::function<void()> &fn)
+    {
+        double best = 1e30;
+        for (int r = 0; r < REPEATS; r++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            fn();
+            auto end = std::chrono::steady_clock::now();
+            best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+        }
+        return best;
+    }
+
+    vpe::VpeFrustum viewFrustum(int view, float farPlane)
+    {
+        float angle = glm::radians(360.0f) * static_cast<float>(view) / VIEW_COUNT;
+        glm::vec3 forward{std::cos(angle), 0.2f * std::sin(3.0f * angle), std::sin(angle)};
+        glm::mat4 viewMatrix = glm::lookAt(glm::vec3{0.0f}, forward, glm::vec3{0.0f, 1.0f, 0.0f});
+        glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, farPlane);
+        return vpe::VpeFrustum::fromViewProjection(projection * viewMatrix);
+    }
+
+    // The same test the tree does, one box at a time.
+    bool touchesFrustum(const vpe::VpeAabb &box, const vpe::VpeFrustum &frustum)
+    {
+        for (const auto &plane : frustum.planes)
+        {
+            glm::vec3 farCorner{
+                plane.x >= 0.0f ? box.max.x : box.min.x,
+                plane.y >= 0.0f ? box.max.y : box.min.y,
+                plane.z >= 0.0f ? box.max.z : box.min.z};
+            if (glm::dot(glm::vec3{plane}, farCorner) + plane.w < 0.0f)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    uint32_t objectCount = argc > 1 ? static_cast<uint32_t>(std::atoi(argv[1])) : 100000;
+
+    std::mt19937 rng{1234};
+    float side = std::cbrt(static_cast<float>(objectCount)) * 3.0f;
+    std::uniform_real_distribution<float> coordinate{-side * 0.5f, side * 0.5f};
+    std::uniform_real_distribution<float> size{0.2f, 1.5f};
+    std::uniform_real_distribution<float> unit{0.0f, 1.0f};
+
+    std::vector<vpe::VpeAabb> boxes(objectCount);
+    std::vector<bool> dynamic(objectCount);
+    for (uint32_t i = 0; i < objectCount; i++)
+    {
+        glm::vec3 center{coordinate(rng), coordinate(rng), coordinate(rng)};
+        glm::vec3 halfSize = glm::vec3{size(rng), size(rng), size(rng)} * 0.5f;
+        boxes[i] = vpe::VpeAabb{center - halfSize, center + halfSize};
+        dynamic[i] = unit(rng) < 0.2f;
+    }
+    float farPlane = side * 0.5f;
+
+    // Every dynamic box drifts a little each frame.
+    auto moveDynamic = [&](vpe::VpeCullingScene &scene, int frame)
+    {
+        glm::vec3 offset{0.01f * std::sin(0.1f * frame), 0.01f, 0.01f * std::cos(0.1f * frame)};
+        for (uint32_t i = 0; i < objectCount; i++)
+        {
+            if (dynamic[i])
+            {
+                vpe::VpeAabb box = scene.bounds(i);
+                scene.setBounds(i, vpe::VpeAabb{box.min + offset, box.max + offset});
+            }
+        }
+    };
+
+    // Correctness first, against the brute force answer for every view.
+    {
+        vpe::VpeJobSystem jobSystem{maxThreads};
+        vpe::VpeCullingScene scene{jobSystem};
+        for (uint32_t i = 0; i < objectCount; i++)
+        {
+            scene.addObject(boxes[i], dynamic[i]);
+        }
+        scene.update();
+        moveDynamic(scene, 1);
+        scene.update();
+
+        std::vector<uint32_t> visible;
+        std::vector<uint32_t> expected;
+        for (int view = 0; view < VIEW_COUNT; view++)
+        {
+            vpe::VpeFrustum frustum = viewFrustum(view, farPlane);
+            scene.cull(frustum, visible);
+            expected.clear();
+            for (uint32_t i = 0; i < objectCount; i++)
+            {
+                if (touchesFrustum(scene.bounds(i), frustum))
+                {
+                    expected.push_back(i);
+                }
+            }
+            std::sort(visible.begin(), visible.end());
+            if (visible != expected)
+            {
+                std::printf("view %d: tree found %zu visible, brute force %zu\n", view, visible.size(), expected.size());
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    double bruteMs = timeBest([&]()
+                              {
+        volatile size_t visibleCount = 0;
+        for (int view = 0; view < VIEW_COUNT; view++)
+        {
+            vpe::VpeFrustum frustum = viewFrustum(view, farPlane);
+            size_t count = 0;
+            for (const auto &box : boxes)
+            {
+                count += touchesFrustum(box, frustum) ? 1 : 0;
+            }
+            visibleCount = visibleCount + count;
+        } }) / VIEW_COUNT;
+
+    // Tree build and refit over everything, both single threaded.
+    std::vector<uint32_t> ids(objectCount);
+    for (uint32_t i = 0; i < objectCount; i++)
+    {
+        ids[i] = i;
+    }
+    vpe::VpeSceneBvh bvh;
+    double buildMs = timeBest([&]()
+                              { bvh.build(boxes.data(), ids.data(), objectCount); });
+    double refitMs = timeBest([&]()
+                              { bvh.refit(boxes.data()); });
+
+    std::printf("%u objects, %u nodes\n", objectCount, bvh.nodeCount());
+    std::printf("build %.3f ms, refit %.3f ms, brute force cull %.3f ms\n", buildMs, refitMs, bruteMs);
+    std::printf("%-8s %10s %10s %8s\n", "threads", "cull ms", "visible", "speedup");
+
+    double baseCull = 0.0;
+    double bestCull = 1e30;
+    for (uint32_t threads = 1; threads <= maxThreads; threads++)
+    {
+        vpe::VpeJobSystem jobSystem{threads};
+        vpe::VpeCullingScene scene{jobSystem};
+        for (uint32_t i = 0; i < objectCount; i++)
+        {
+            scene.addObject(boxes[i], dynamic[i]);
+        }
+        scene.update();
+
+        std::vector<uint32_t> visible;
+        size_t visibleTotal = 0;
+        double cullMs = timeBest([&]()
+                                 {
+            visibleTotal = 0;
+            for (int view = 0; view < VIEW_COUNT; view++)
+            {
+                scene.cull(viewFrustum(view, farPlane), visible);
+                visibleTotal += visible.size();
+            } }) / VIEW_COUNT;
+
+        if (threads == 1)
+        {
+            baseCull = cullMs;
+        }
+        bestCull = std::min(bestCull, cullMs);
+        std::printf("%-8u %10.4f %10zu %8.2f\n", threads, cullMs, visibleTotal / VIEW_COUNT, baseCull / cullMs);
+    }
+
+    std::printf("best cull %.4f ms, budget %.1f ms for 100k objects\n", bestCull, BUDGET_MS);
+    return 0;
+}
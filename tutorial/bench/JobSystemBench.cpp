@@ -0,0 +1,102 @@
+// Scaling check for the job system. Runs the same workloads with 1 to N threads
+// and prints the time and the speedup over a single thread.
+#include "VpeJobSystem.hpp"
+#include "VpeSpatialHashGrid.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    constexpr int REPEATS = 5;
+
+    // Best of a few runs, in milliseconds.
+    double timeBest(const std::function<void()> &fn)
+    {
+        double best = 1e30;
+        for (int r = 0; r < REPEATS; r++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            fn();
+            auto end = std::chrono::steady_clock::now();
+            best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+        }
+        return best;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    uint32_t particleCount = argc > 1 ? static_cast<uint32_t>(std::atoi(argv[1])) : 1000000;
+
+    // Particles of radius 0.5 in a box that gives a few neighbors each.
+    std::mt19937 rng{1234};
+    float side = std::cbrt(static_cast<float>(particleCount)) * 1.2f;
+    std::uniform_real_distribution<float> coordinate{0.0f, side};
+    std::vector<glm::vec3> positions(particleCount);
+    for (auto &position : positions)
+    {
+        position = glm::vec3{coordinate(rng), coordinate(rng), coordinate(rng)};
+    }
+
+    std::vector<float> values(1 << 24, 1.0f);
+
+    std::printf("%-8s %12s %8s %12s %8s %12s %8s\n",
+                "threads", "math ms", "speedup", "grid ms", "speedup", "tasks ms", "speedup");
+
+    double baseMath = 0.0, baseGrid = 0.0, baseTasks = 0.0;
+    for (uint32_t threads = 1; threads <= maxThreads; threads++)
+    {
+        vpe::VpeJobSystem jobSystem{threads};
+
+        // Plain data parallel loop, should scale almost perfectly.
+        double mathMs = timeBest([&]()
+                                 { jobSystem.parallelFor(static_cast<uint32_t>(values.size()), [&](uint32_t begin, uint32_t end)
+                                                         {
+                for (uint32_t i = begin; i < end; i++)
+                {
+                    values[i] = std::sqrt(values[i] * 1.0001f + 0.5f);
+                } }); });
+
+        // The particle broadphase, memory bound so expect it to flatten out early.
+        vpe::VpeSpatialHashGrid grid{jobSystem, 1.0f};
+        std::vector<vpe::VpeSpatialHashGrid::Pair> pairs;
+        double gridMs = timeBest([&]()
+                                 {
+            grid.rebuild(positions.data(), particleCount);
+            grid.findPairs(1.0f, pairs); });
+
+        // Lots of tiny dependent tasks, this is mostly scheduler overhead.
+        double tasksMs = timeBest([&]()
+                                  {
+            std::vector<vpe::VpeJobSystem::TaskHandle> tails;
+            for (int chain = 0; chain < 1000; chain++)
+            {
+                auto task = jobSystem.run([]() {});
+                for (int link = 0; link < 10; link++)
+                {
+                    task = jobSystem.then(task, []() {});
+                }
+                tails.push_back(task);
+            }
+            jobSystem.wait(tails); });
+
+        if (threads == 1)
+        {
+            baseMath = mathMs;
+            baseGrid = gridMs;
+            baseTasks = tasksMs;
+        }
+        std::printf("%-8u %12.3f %8.2f %12.3f %8.2f %12.3f %8.2f\n",
+                    threads, mathMs, baseMath / mathMs, gridMs, baseGrid / gridMs, tasksMs, baseTasks / tasksMs);
+    }
+
+    return 0;
+}
@@ -0,0 +1,816 @@
+// Micro benchmarks for the CPU side hot paths, one small piece of code each, no window or GPU needed.
+// Works like Google Benchmark: every benchmark runs enough iterations to fill the minimum time,
+// a few repetitions of that, and the median per iteration time is what gets reported.
+// With --benchmark_out the results are written as JSON in Google Benchmark's layout,
+// so its compare.py (or anything else that reads that) can diff two commits.
+//
+// Options:
+//   --benchmark_filter=TEXT        only benchmarks whose name contains TEXT
+//   --benchmark_min_time=SECONDS   per repetition, 0.2 by default
+//   --benchmark_repetitions=N      3 by default
+//   --benchmark_out=PATH           JSON results
+//   --threads=N                    job system threads, 1 by default so the numbers are stable
+#include "VpeCullingScene.hpp"
+#include "VpeJobSystem.hpp"
+#include "VpeModel.hpp"
+#include "VpePhysicsWorld.hpp"
+#include "VpePipeline.hpp"
+#include "VpeSceneBvh.hpp"
+#include "VpeSpatialHashGrid.hpp"
+#include "VpeTransformStream.hpp"
+#include "VpeWorldSnapshot.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    // What a benchmark body loops over, for (auto _ : state) { ... }.
+    // The clock starts when the loop does, so setup before it isn't counted.
+    class State
+    {
+    public:
+        explicit State(uint64_t iterations) : iterations_{iterations} {}
+
+        struct Iterator
+        {
+            State *state;
+            uint64_t remaining;
+
+            bool operator!=(const Iterator &) const
+            {
+                if (remaining != 0)
+                {
+                    return true;
+                }
+                state->stop();
+                return false;
+            }
+            void operator++() { remaining--; }
+            // Not a plain int, so the unused loop variable doesn't get warned about.
+            struct Value
+            {
+                ~Value() {}
+            };
+            Value operator*() const { return {}; }
+        };
+
+        Iterator begin()
+        {
+            startCpu_ = std::clock();
+            start_ = std::chrono::steady_clock::now();
+            return Iterator{this, iterations_};
+        }
+        Iterator end() { return Iterator{this, 0}; }
+
+        uint64_t iterations() const { return iterations_; }
+        // Per iteration, for the items/s and bytes/s columns.
+        void setItemsPerIteration(uint64_t items) { itemsPerIteration_ = items; }
+        void setBytesPerIteration(uint64_t bytes) { bytesPerIteration_ = bytes; }
+
+        double seconds() const { return seconds_; }
+        double cpuSeconds() const { return cpuSeconds_; }
+        uint64_t itemsPerIteration() const { return itemsPerIteration_; }
+        uint64_t bytesPerIteration() const { return bytesPerIteration_; }
+
+    private:
+        void stop()
+        {
+            auto end = std::chrono::steady_clock::now();
+            std::clock_t endCpu = std::clock();
+            seconds_ = std::chrono::duration<double>(end - start_).count();
+            cpuSeconds_ = static_cast<double>(endCpu - startCpu_) / CLOCKS_PER_SEC;
+        }
+
+        uint64_t iterations_;
+        std::chrono::steady_clock::time_point start_;
+        std::clock_t startCpu_ = 0;
+        double seconds_ = 0.0;
+        double cpuSeconds_ = 0.0;
+        uint64_t itemsPerIteration_ = 0;
+        uint64_t bytesPerIteration_ = 0;
+    };
+
+    // Stops the compiler from throwing away a result nobody reads.
+    template <typename T>
+    void doNotOptimize(const T &value)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        asm volatile("" : : "r,m"(value) : "memory");
+#else
+        static volatile const T *sink;
+        sink = &value;
+#endif
+    }
+
+    struct Benchmark
+    {
+        std::string name;
+        std::function<void(State &)> run;
+    };
+
+    struct Result
+    {
+        std::string name;
+        uint64_t iterations;
+        // Nanoseconds per iteration, medians over the repetitions.
+        double realNs;
+        double cpuNs;
+        double itemsPerSecond;
+        double bytesPerSecond;
+    };
+
+    struct Options
+    {
+        std::string filter;
+        double minTime = 0.2;
+        int repetitions = 3;
+        std::string outPath;
+        uint32_t threads = 1;
+    };
+
+    double median(std::vector<double> values)
+    {
+        std::sort(values.begin(), values.end());
+        return values[values.size() / 2];
+    }
+
+    Result runBenchmark(const Benchmark &benchmark, const Options &options)
+    {
+        // Grow the iteration count until one run takes at least the minimum time,
+        // never more than 10x at a time so a slow first guess doesn't overshoot by ages.
+        uint64_t iterations = 1;
+        while (true)
+        {
+            State state{iterations};
+            benchmark.run(state);
+            if (state.seconds() >= options.minTime || iterations >= 1000000000ull)
+            {
+                break;
+            }
+            double factor = state.seconds() > 0.0 ? 1.4 * options.minTime / state.seconds() : 10.0;
+            iterations = std::max(iterations + 1, static_cast<uint64_t>(static_cast<double>(iterations) * std::min(factor, 10.0)));
+        }
+
+        std::vector<double> realNs;
+        std::vector<double> cpuNs;
+        uint64_t items = 0;
+        uint64_t bytes = 0;
+        for (int repetition = 0; repetition < options.repetitions; repetition++)
+        {
+            State state{iterations};
+            benchmark.run(state);
+            realNs.push_back(state.seconds() * 1e9 / static_cast<double>(iterations));
+            cpuNs.push_back(state.cpuSeconds() * 1e9 / static_cast<double>(iterations));
+            items = state.itemsPerIteration();
+            bytes = state.bytesPerIteration();
+        }
+
+        Result result{benchmark.name, iterations, median(realNs), median(cpuNs), 0.0, 0.0};
+        if (result.realNs > 0.0)
+        {
+            result.itemsPerSecond = static_cast<double>(items) * 1e9 / result.realNs;
+            result.bytesPerSecond = static_cast<double>(bytes) * 1e9 / result.realNs;
+        }
+        return result;
+    }
+
+    void writeJson(const std::string &path, const Options &options, const std::vector<Result> &results)
+    {
+        std::ofstream out(path);
+        if (!out)
+        {
+            throw std::runtime_error("Can't write " + path);
+        }
+        std::time_t now = std::time(nullptr);
+        char date[64];
+        std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+        out.precision(10);
+        out << "{\n  \"context\": {\n"
+            << "    \"date\": \"" << date << "\",\n"
+            << "    \"executable\": \"MicroBench\",\n"
+            << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n"
+            << "    \"job_system_threads\": " << options.threads << ",\n"
+#ifdef NDEBUG
+            << "    \"library_build_type\": \"release\"\n"
+#else
+            << "    \"library_build_type\": \"debug\"\n"
+#endif
+            << "  },\n  \"benchmarks\": [\n";
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const Result &result = results[i];
+            out << "    {\n"
+                << "      \"name\": \"" << result.name << "\",\n"
+                << "      \"run_name\": \"" << result.name << "\",\n"
+                << "      \"run_type\": \"iteration\",\n"
+                << "      \"repetitions\": " << options.repetitions << ",\n"
+                << "      \"iterations\": " << result.iterations << ",\n"
+                << "      \"real_time\": " << result.realNs << ",\n"
+                << "      \"cpu_time\": " << result.cpuNs << ",\n"
+                << "      \"time_unit\": \"ns\"";
+            if (result.itemsPerSecond > 0.0)
+            {
+                out << ",\n      \"items_per_second\": " << result.itemsPerSecond;
+            }
+            if (result.bytesPerSecond > 0.0)
+            {
+                out << ",\n      \"bytes_per_second\": " << result.bytesPerSecond;
+            }
+            out << "\n    }" << (i + 1 < results.size() ? ",\n" : "\n");
+        }
+        out << "  ]\n}\n";
+    }
+
+    std::vector<glm::vec3> randomPositions(uint32_t count, float side, uint32_t seed)
+    {
+        std::mt19937 rng{seed};
+        std::uniform_real_distribution<float> coordinate{0.0f, side};
+        std::vector<glm::vec3> positions(count);
+        for (auto &position : positions)
+        {
+            position = glm::vec3{coordinate(rng), coordinate(rng), coordinate(rng)};
+        }
+        return positions;
+    }
+
+    // Shader loading: straight off the disk, and out of the preload cache.
+    void addShaderBenchmarks(std::vector<Benchmark> &benchmarks)
+    {
+        for (uint32_t kilobytes : {16u, 256u})
+        {
+            benchmarks.push_back({"ReadFile/" + std::to_string(kilobytes) + "KiB", [kilobytes](State &state)
+                                  {
+                fs::path path = fs::temp_directory_path() / ("vpe_microbench_" + std::to_string(kilobytes) + ".spv");
+                {
+                    std::ofstream file(path, std::ios::binary);
+                    std::vector<char> contents(kilobytes * 1024, 'x');
+                    file.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+                }
+                for (auto _ : state)
+                {
+                    auto code = vpe::VpePipeline::readFile(path);
+                    doNotOptimize(code.data());
+                }
+                state.setBytesPerIteration(kilobytes * 1024);
+                fs::remove(path); }});
+
+            benchmarks.push_back({"ReadFile/preloaded/" + std::to_string(kilobytes) + "KiB", [kilobytes](State &state)
+                                  {
+                fs::path path = fs::temp_directory_path() / ("vpe_microbench_preload_" + std::to_string(kilobytes) + ".spv");
+                {
+                    std::ofstream file(path, std::ios::binary);
+                    std::vector<char> contents(kilobytes * 1024, 'x');
+                    file.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+                }
+                // The preload itself is part of it, that's the disk read moved to another thread.
+                for (auto _ : state)
+                {
+                    vpe::VpePipeline::preloadFile(path);
+                    auto code = vpe::VpePipeline::readFile(path);
+                    doNotOptimize(code.data());
+                }
+                state.setBytesPerIteration(kilobytes * 1024);
+                fs::remove(path); }});
+        }
+    }
+
+    void addModelBenchmarks(std::vector<Benchmark> &benchmarks)
+    {
+        for (uint32_t count : {3000u, 300000u})
+        {
+            benchmarks.push_back({"PackVertices/" + std::to_string(count), [count](State &state)
+                                  {
+                std::vector<vpe::VpeModel::Vertex> vertices(count);
+                auto positions = randomPositions(count, 10.0f, 5);
+                for (uint32_t i = 0; i < count; i++)
+                {
+                    vertices[i].position = positions[i];
+                }
+                std::vector<char> destination(sizeof(vpe::VpeModel::Vertex) * count);
+                for (auto _ : state)
+                {
+                    vpe::VpeModel::packVertices(vertices, destination.data());
+                    doNotOptimize(destination.data());
+                }
+                state.setItemsPerIteration(count);
+                state.setBytesPerIteration(destination.size()); }});
+        }
+    }
+
+    // A frame of 100k body transforms into a transform stream's slot, plain memcpy against the streaming copy.
+    // There's no device here, so the destination is ordinary cached memory. Mapped write-combined memory
+    // is slower for both, and much slower for anything that isn't whole lines written front to back.
+    void addUploadBenchmarks(std::vector<Benchmark> &benchmarks)
+    {
+        constexpr uint32_t COUNT = 100000;
+        for (bool streaming : {false, true})
+        {
+            benchmarks.push_back({std::string{"Upload/"} + (streaming ? "streamCopy/" : "memcpy/") + std::to_string(COUNT), [streaming](State &state)
+                                  {
+                auto positions = randomPositions(COUNT, 10.0f, 21);
+                std::vector<glm::vec4> transforms;
+                transforms.reserve(COUNT);
+                for (const auto &position : positions)
+                {
+                    transforms.emplace_back(position, 0.05f);
+                }
+                std::vector<glm::vec4> destination(COUNT);
+                size_t bytes = sizeof(glm::vec4) * COUNT;
+                for (auto _ : state)
+                {
+                    if (streaming)
+                    {
+                        vpe::VpeTransformStream::streamCopy(destination.data(), transforms.data(), bytes);
+                    }
+                    else
+                    {
+                        memcpy(destination.data(), transforms.data(), bytes);
+                    }
+                    doNotOptimize(destination.data());
+                }
+                state.setItemsPerIteration(COUNT);
+                state.setBytesPerIteration(bytes); }});
+        }
+    }
+
+    // There's no allocator of our own yet, the hottest alloc/free is the job system's task:
+    // a shared_ptr'd Task with a std::function in it, for every run() and every parallelFor range.
+    void addAllocationBenchmarks(std::vector<Benchmark> &benchmarks, vpe::VpeJobSystem &jobSystem)
+    {
+        benchmarks.push_back({"TaskAlloc/createTask", [&jobSystem](State &state)
+                              {
+            int counter = 0;
+            for (auto _ : state)
+            {
+                auto task = jobSystem.createTask([&counter]()
+                                                 { counter++; });
+                doNotOptimize(task.get());
+            }
+            state.setItemsPerIteration(1); }});
+
+        benchmarks.push_back({"TaskAlloc/runAndWait", [&jobSystem](State &state)
+                              {
+            int counter = 0;
+            for (auto _ : state)
+            {
+                jobSystem.wait(jobSystem.run([&counter]()
+                                             { counter++; }));
+            }
+            doNotOptimize(counter);
+            state.setItemsPerIteration(1); }});
+
+        benchmarks.push_back({"TaskAlloc/parallelFor/4096", [&jobSystem](State &state)
+                              {
+            std::vector<float> values(4096, 1.0f);
+            for (auto _ : state)
+            {
+                jobSystem.parallelFor(static_cast<uint32_t>(values.size()), [&](uint32_t begin, uint32_t end)
+                                      {
+                    for (uint32_t i = begin; i < end; i++)
+                    {
+                        values[i] = values[i] * 0.5f + 1.0f;
+                    } }, 256);
+            }
+            doNotOptimize(values.data());
+            state.setItemsPerIteration(values.size()); }});
+    }
+
+    void addBroadphaseBenchmarks(std::vector<Benchmark> &benchmarks, vpe::VpeJobSystem &jobSystem)
+    {
+        for (uint32_t count : {10000u, 100000u})
+        {
+            // Radius 0.5 particles in a box that gives a few neighbors each, like JobSystemBench.
+            float side = std::cbrt(static_cast<float>(count)) * 1.2f;
+            benchmarks.push_back({"Broadphase/rebuild/" + std::to_string(count), [&jobSystem, count, side](State &state)
+                                  {
+                auto positions = randomPositions(count, side, 1234);
+                vpe::VpeSpatialHashGrid grid{jobSystem, 1.0f};
+                grid.rebuild(positions.data(), count);
+                for (auto _ : state)
+                {
+                    grid.rebuild(positions.data(), count);
+                }
+                state.setItemsPerIteration(count); }});
+
+            benchmarks.push_back({"Broadphase/findPairs/" + std::to_string(count), [&jobSystem, count, side](State &state)
+                                  {
+                auto positions = randomPositions(count, side, 1234);
+                vpe::VpeSpatialHashGrid grid{jobSystem, 1.0f};
+                grid.rebuild(positions.data(), count);
+                std::vector<vpe::VpeSpatialHashGrid::Pair> pairs;
+                grid.findPairs(1.0f, pairs);
+                for (auto _ : state)
+                {
+                    grid.findPairs(1.0f, pairs);
+                    doNotOptimize(pairs.data());
+                }
+                state.setItemsPerIteration(count); }});
+        }
+    }
+
+    // The kernels are private to the world, so each one gets a scene where it's nearly all of the step.
+    void addPhysicsBenchmarks(std::vector<Benchmark> &benchmarks, vpe::VpeJobSystem &jobSystem)
+    {
+        // No gravity, no floor in reach and everything drifting the same way: nothing ever touches,
+        // so a step is the integrator plus an empty broadphase.
+        benchmarks.push_back({"Integrate/10000", [&jobSystem](State &state)
+                              {
+            vpe::VpePhysicsSettings settings;
+            settings.gravity = glm::vec3{0.0f};
+            settings.groundHeight = -1e9f;
+            vpe::VpePhysicsWorld world{jobSystem, settings};
+            auto positions = randomPositions(10000, 200.0f, 77);
+            for (const auto &position : positions)
+            {
+                uint32_t body = world.addBody(position, 0.1f, 1.0f);
+                world.setVelocity(body, glm::vec3{1.0f, 0.0f, 0.0f});
+            }
+            for (auto _ : state)
+            {
+                world.step(1.0f / 60.0f);
+            }
+            state.setItemsPerIteration(10000); }});
+
+        // Columns of spheres standing on the floor, kept awake, so every step solves the same
+        // few thousand resting contacts.
+        benchmarks.push_back({"Solve/stacks/4096", [&jobSystem](State &state)
+                              {
+            vpe::VpePhysicsSettings settings;
+            settings.sleepVelocity = 0.0f;
+            vpe::VpePhysicsWorld world{jobSystem, settings};
+            constexpr uint32_t COLUMNS = 16;
+            constexpr uint32_t HEIGHT = 16;
+            constexpr float RADIUS = 0.25f;
+            for (uint32_t x = 0; x < COLUMNS; x++)
+            {
+                for (uint32_t z = 0; z < COLUMNS; z++)
+                {
+                    for (uint32_t y = 0; y < HEIGHT; y++)
+                    {
+                        world.addBody(glm::vec3{x * 3.0f * RADIUS, RADIUS + y * 2.0f * RADIUS, z * 3.0f * RADIUS}, RADIUS, 1.0f);
+                    }
+                }
+            }
+            // Let the stacks settle first, the first steps are all about pushing overlaps out.
+            for (int i = 0; i < 60; i++)
+            {
+                world.step(1.0f / 60.0f);
+            }
+            for (auto _ : state)
+            {
+                world.step(1.0f / 60.0f);
+            }
+            state.setItemsPerIteration(COLUMNS * COLUMNS * HEIGHT); }});
+
+        // Same idea with boxes: every pair is SAT plus face clipping into a four point manifold,
+        // and the solver gets four points per contact instead of one.
+        benchmarks.push_back({"Solve/boxStacks/1024", [&jobSystem](State &state)
+                              {
+            vpe::VpePhysicsSettings settings;
+            settings.sleepVelocity = 0.0f;
+            vpe::VpePhysicsWorld world{jobSystem, settings};
+            constexpr uint32_t COLUMNS = 8;
+            constexpr uint32_t HEIGHT = 16;
+            constexpr float HALF = 0.25f;
+            uint32_t box = world.addBoxShape(glm::vec3{HALF});
+            for (uint32_t x = 0; x < COLUMNS; x++)
+            {
+                for (uint32_t z = 0; z < COLUMNS; z++)
+                {
+                    for (uint32_t y = 0; y < HEIGHT; y++)
+                    {
+                        world.addShapeBody(glm::vec3{x * 3.0f * HALF, HALF + y * 2.0f * HALF, z * 3.0f * HALF}, box, 1.0f);
+                    }
+                }
+            }
+            for (int i = 0; i < 60; i++)
+            {
+                world.step(1.0f / 60.0f);
+            }
+            for (auto _ : state)
+            {
+                world.step(1.0f / 60.0f);
+            }
+            state.setItemsPerIteration(COLUMNS * COLUMNS * HEIGHT); }});
+
+        // A heap of small convex hulls, nearly every contact goes through GJK and EPA.
+        benchmarks.push_back({"Narrowphase/hulls/1024", [&jobSystem](State &state)
+                              {
+            vpe::VpePhysicsSettings settings;
+            settings.sleepVelocity = 0.0f;
+            vpe::VpePhysicsWorld world{jobSystem, settings};
+            std::vector<glm::vec3> points;
+            std::mt19937 rng{5};
+            std::uniform_real_distribution<float> spread{-0.2f, 0.2f};
+            for (int i = 0; i < 12; i++)
+            {
+                points.push_back(glm::vec3{spread(rng), spread(rng), spread(rng)});
+            }
+            uint32_t hull = world.addConvexHullShape(points);
+            auto positions = randomPositions(1024, 4.0f, 13);
+            for (const auto &position : positions)
+            {
+                world.addShapeBody(position + glm::vec3{0.0f, 0.3f, 0.0f}, hull, 1.0f);
+            }
+            for (int i = 0; i < 120; i++)
+            {
+                world.step(1.0f / 60.0f);
+            }
+            for (auto _ : state)
+            {
+                world.step(1.0f / 60.0f);
+            }
+            state.setItemsPerIteration(1024); }});
+
+        // The sphere columns again, with 256 small projectiles shot back and forth at 60 m/s through
+        // the lanes between them, a metre per step, right past the columns without touching. Same scene
+        // three ways: no CCD (the baseline), speculative contacts, and four substeps instead (the
+        // usual way to buy the same safety without CCD).
+        struct CcdVariant
+        {
+            const char *name;
+            float continuousThreshold;
+            uint32_t substeps;
+        };
+        for (const CcdVariant &variant : {CcdVariant{"off", 0.0f, 1}, CcdVariant{"speculative", 0.5f, 1}, CcdVariant{"substeps4", 0.0f, 4}})
+        {
+            benchmarks.push_back({std::string{"Ccd/"} + variant.name + "/4096", [&jobSystem, variant](State &state)
+                                  {
+                vpe::VpePhysicsSettings settings;
+                settings.sleepVelocity = 0.0f;
+                settings.continuousThreshold = variant.continuousThreshold;
+                vpe::VpePhysicsWorld world{jobSystem, settings};
+                constexpr uint32_t COLUMNS = 16;
+                constexpr uint32_t HEIGHT = 16;
+                constexpr float RADIUS = 0.25f;
+                constexpr float SPACING = 3.0f * RADIUS;
+                constexpr float PROJECTILE_RADIUS = 0.05f;
+                for (uint32_t x = 0; x < COLUMNS; x++)
+                {
+                    for (uint32_t z = 0; z < COLUMNS; z++)
+                    {
+                        for (uint32_t y = 0; y < HEIGHT; y++)
+                        {
+                            world.addBody(glm::vec3{x * SPACING, RADIUS + y * 2.0f * RADIUS, z * SPACING}, RADIUS, 1.0f);
+                        }
+                    }
+                }
+                std::vector<uint32_t> projectiles;
+                for (uint32_t x = 0; x < COLUMNS; x++)
+                {
+                    for (uint32_t z = 0; z < COLUMNS; z++)
+                    {
+                        glm::vec3 lane{(x + 0.5f) * SPACING, PROJECTILE_RADIUS, (z + 0.5f) * SPACING};
+                        projectiles.push_back(world.addBody(lane, PROJECTILE_RADIUS, 0.1f));
+                    }
+                }
+                for (int i = 0; i < 60; i++)
+                {
+                    world.step(1.0f / 60.0f);
+                }
+                float direction = 1.0f;
+                for (auto _ : state)
+                {
+                    for (uint32_t projectile : projectiles)
+                    {
+                        world.setVelocity(projectile, glm::vec3{0.0f, 0.0f, 60.0f * direction});
+                    }
+                    direction = -direction;
+                    for (uint32_t substep = 0; substep < variant.substeps; substep++)
+                    {
+                        world.step(1.0f / 60.0f / static_cast<float>(variant.substeps));
+                    }
+                }
+                state.setItemsPerIteration(COLUMNS * COLUMNS * (HEIGHT + 1)); }});
+        }
+    }
+
+    // A million bodies to disk and back. Both should run at about the speed of the disk (or the page cache).
+    void addSnapshotBenchmarks(std::vector<Benchmark> &benchmarks, vpe::VpeJobSystem &jobSystem)
+    {
+        constexpr uint32_t BODY_COUNT = 1000000;
+        auto fillWorld = [](vpe::VpePhysicsWorld &world)
+        {
+            auto positions = randomPositions(BODY_COUNT, 400.0f, 99);
+            for (const auto &position : positions)
+            {
+                world.addBody(position, 0.2f, 1.0f);
+            }
+        };
+
+        benchmarks.push_back({"Snapshot/save/1000000", [&jobSystem, fillWorld](State &state)
+                              {
+            vpe::VpePhysicsWorld world{jobSystem};
+            fillWorld(world);
+            fs::path path = fs::temp_directory_path() / "vpe_microbench.snapshot";
+            for (auto _ : state)
+            {
+                world.saveSnapshot(path);
+            }
+            state.setBytesPerIteration(fs::file_size(path));
+            fs::remove(path); }});
+
+        benchmarks.push_back({"Snapshot/restore/1000000", [&jobSystem, fillWorld](State &state)
+                              {
+            fs::path path = fs::temp_directory_path() / "vpe_microbench.snapshot";
+            {
+                vpe::VpePhysicsWorld world{jobSystem};
+                fillWorld(world);
+                world.saveSnapshot(path);
+            }
+            vpe::VpePhysicsWorld world{jobSystem};
+            for (auto _ : state)
+            {
+                vpe::VpeWorldSnapshot snapshot{path};
+                world.restoreSnapshot(snapshot);
+            }
+            state.setBytesPerIteration(fs::file_size(path));
+            fs::remove(path); }});
+    }
+
+    void addCullingBenchmarks(std::vector<Benchmark> &benchmarks, vpe::VpeJobSystem &jobSystem)
+    {
+        // Same scene as CullingBench, random boxes with a fifth of them dynamic.
+        constexpr uint32_t OBJECT_COUNT = 100000;
+        constexpr int VIEW_COUNT = 64;
+        auto makeBoxes = []()
+        {
+            std::mt19937 rng{1234};
+            float side = std::cbrt(static_cast<float>(OBJECT_COUNT)) * 3.0f;
+            std::uniform_real_distribution<float> coordinate{-side * 0.5f, side * 0.5f};
+            std::uniform_real_distribution<float> size{0.2f, 1.5f};
+            std::vector<vpe::VpeAabb> boxes(OBJECT_COUNT);
+            for (auto &box : boxes)
+            {
+                glm::vec3 center{coordinate(rng), coordinate(rng), coordinate(rng)};
+                glm::vec3 halfSize = glm::vec3{size(rng), size(rng), size(rng)} * 0.5f;
+                box = vpe::VpeAabb{center - halfSize, center + halfSize};
+            }
+            return boxes;
+        };
+
+        benchmarks.push_back({"Bvh/build/100000", [makeBoxes](State &state)
+                              {
+            auto boxes = makeBoxes();
+            std::vector<uint32_t> ids(OBJECT_COUNT);
+            for (uint32_t i = 0; i < OBJECT_COUNT; i++)
+            {
+                ids[i] = i;
+            }
+            vpe::VpeSceneBvh bvh;
+            for (auto _ : state)
+            {
+                bvh.build(boxes.data(), ids.data(), OBJECT_COUNT);
+            }
+            state.setItemsPerIteration(OBJECT_COUNT); }});
+
+        benchmarks.push_back({"Bvh/refit/100000", [makeBoxes](State &state)
+                              {
+            auto boxes = makeBoxes();
+            std::vector<uint32_t> ids(OBJECT_COUNT);
+            for (uint32_t i = 0; i < OBJECT_COUNT; i++)
+            {
+                ids[i] = i;
+            }
+            vpe::VpeSceneBvh bvh;
+            bvh.build(boxes.data(), ids.data(), OBJECT_COUNT);
+            for (auto _ : state)
+            {
+                bvh.refit(boxes.data());
+            }
+            state.setItemsPerIteration(OBJECT_COUNT); }});
+
+        benchmarks.push_back({"Cull/100000", [makeBoxes, &jobSystem](State &state)
+                              {
+            auto boxes = makeBoxes();
+            float farPlane = std::cbrt(static_cast<float>(OBJECT_COUNT)) * 1.5f;
+            vpe::VpeCullingScene scene{jobSystem};
+            for (uint32_t i = 0; i < OBJECT_COUNT; i++)
+            {
+                scene.addObject(boxes[i], i % 5 == 0);
+            }
+            scene.update();
+
+            // A camera spinning in the middle, one view per iteration.
+            std::vector<vpe::VpeFrustum> frustums;
+            for (int view = 0; view < VIEW_COUNT; view++)
+            {
+                float angle = glm::radians(360.0f) * static_cast<float>(view) / VIEW_COUNT;
+                glm::vec3 forward{std::cos(angle), 0.2f * std::sin(3.0f * angle), std::sin(angle)};
+                glm::mat4 viewMatrix = glm::lookAt(glm::vec3{0.0f}, forward, glm::vec3{0.0f, 1.0f, 0.0f});
+                glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, farPlane);
+                frustums.push_back(vpe::VpeFrustum::fromViewProjection(projection * viewMatrix));
+            }
+            std::vector<uint32_t> visible;
+            size_t view = 0;
+            for (auto _ : state)
+            {
+                scene.cull(frustums[view++ % frustums.size()], visible);
+                doNotOptimize(visible.data());
+            }
+            state.setItemsPerIteration(OBJECT_COUNT); }});
+    }
+
+    bool parseOption(const std::string &argument, const char *name, std::string &value)
+    {
+        std::string prefix = std::string(name) + "=";
+        if (argument.rfind(prefix, 0) != 0)
+        {
+            return false;
+        }
+        value = argument.substr(prefix.size());
+        return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        std::string value;
+        if (parseOption(argument, "--benchmark_filter", value))
+        {
+            options.filter = value;
+        }
+        else if (parseOption(argument, "--benchmark_min_time", value))
+        {
+            options.minTime = std::atof(value.c_str());
+        }
+        else if (parseOption(argument, "--benchmark_repetitions", value))
+        {
+            options.repetitions = std::max(1, std::atoi(value.c_str()));
+        }
+        else if (parseOption(argument, "--benchmark_out", value))
+        {
+            options.outPath = value;
+        }
+        else if (parseOption(argument, "--threads", value))
+        {
+            options.threads = static_cast<uint32_t>(std::max(1, std::atoi(value.c_str())));
+        }
+        else
+        {
+            std::fprintf(stderr, "Unknown option %s\n", argument.c_str());
+            return EXIT_FAILURE;
+        }
+    }
+
+    vpe::VpeJobSystem jobSystem{options.threads};
+    std::vector<Benchmark> benchmarks;
+    addShaderBenchmarks(benchmarks);
+    addModelBenchmarks(benchmarks);
+    addUploadBenchmarks(benchmarks);
+    addAllocationBenchmarks(benchmarks, jobSystem);
+    addBroadphaseBenchmarks(benchmarks, jobSystem);
+    addPhysicsBenchmarks(benchmarks, jobSystem);
+    addSnapshotBenchmarks(benchmarks, jobSystem);
+    addCullingBenchmarks(benchmarks, jobSystem);
+
+    std::printf("%-32s %14s %14s %12s %16s\n", "benchmark", "time ns", "cpu ns", "iterations", "rate");
+    std::vector<Result> results;
+    for (const Benchmark &benchmark : benchmarks)
+    {
+        if (!options.filter.empty() && benchmark.name.find(options.filter) == std::string::npos)
+        {
+            continue;
+        }
+        Result result = runBenchmark(benchmark, options);
+        bool items = result.itemsPerSecond > 0.0;
+        std::printf("%-32s %14.1f %14.1f %12llu %10.4g %s\n", result.name.c_str(), result.realNs, result.cpuNs,
+                    static_cast<unsigned long long>(result.iterations),
+                    items ? result.itemsPerSecond : result.bytesPerSecond, items ? "items/s" : "B/s");
+        std::fflush(stdout);
+        results.push_back(result);
+    }
+
+    if (!options.outPath.empty())
+    {
+        try
+        {
+            writeJson(options.outPath, options, results);
+        }
+        catch (const std::exception &e)
+        {
+            std::fprintf(stderr, "%s\n", e.what());
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,127 @@
+// Plays a physics replay log back, headless and as fast as it goes. Checks every step lands on
+// exactly the recorded state and lists the steps that were slowest when recorded next to what
+// they take now, so a spike from the field can be run again under a profiler.
+//
+//   PhysicsReplay run.vpereplay [--threads N] [--stop-at FRAME] [--top K]
+//
+// --stop-at quits right after that frame, so the profile ends at the spike instead of burying it.
+// Logs come from VpePhysicsWorld::setRecorder, VulkanPhysicsBench --record writes one for its falling bodies scene.
+#include "VpeJobSystem.hpp"
+#include "VpeReplayLog.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct StepTime
+    {
+        uint64_t frame;
+        float recordedMs;
+        float replayedMs;
+        uint32_t awakeBodies;
+    };
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "Usage: %s LOG [--threads N] [--stop-at FRAME] [--top K]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    std::string logPath = argv[1];
+    uint32_t threads = 0;
+    uint64_t stopAt = UINT64_MAX;
+    size_t top = 10;
+    for (int i = 2; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (argument == "--threads" && hasValue)
+        {
+            threads = static_cast<uint32_t>(std::max(0, std::atoi(argv[++i])));
+        }
+        else if (argument == "--stop-at" && hasValue)
+        {
+            stopAt = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (argument == "--top" && hasValue)
+        {
+            top = static_cast<size_t>(std::max(0, std::atoi(argv[++i])));
+        }
+        else
+        {
+            std::fprintf(stderr, "Unknown option %s\n", argument.c_str());
+            return EXIT_FAILURE;
+        }
+    }
+
+    try
+    {
+        vpe::VpeJobSystem jobSystem{threads};
+        vpe::VpeReplayPlayer player{logPath, jobSystem};
+
+        std::vector<StepTime> steps;
+        uint64_t firstMismatchFrame = UINT64_MAX;
+        uint32_t firstMismatchBody = 0;
+        auto start = std::chrono::steady_clock::now();
+        while (player.frame() <= stopAt && player.stepFrame())
+        {
+            uint64_t frame = player.frame() - 1;
+            steps.push_back({frame, player.recordedStepMilliseconds(), player.replayedStepMilliseconds(), player.world().awakeBodyCount()});
+            if (!player.matchesRecording() && firstMismatchFrame == UINT64_MAX)
+            {
+                firstMismatchFrame = frame;
+                firstMismatchBody = player.firstMismatchBody();
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        double totalMs = std::chrono::duration<double, std::milli>(end - start).count();
+
+        double recordedTotal = 0.0;
+        double replayedTotal = 0.0;
+        for (const StepTime &step : steps)
+        {
+            recordedTotal += step.recordedMs;
+            replayedTotal += step.replayedMs;
+        }
+        std::printf("%zu steps, %u bodies, %u job threads\n", steps.size(), player.world().bodyCount(), jobSystem.threadCount());
+        std::printf("stepping took %.1f ms when recorded, %.1f ms now (%.1f ms with reading the log)\n",
+                    recordedTotal, replayedTotal, totalMs);
+
+        std::vector<StepTime> slowest = steps;
+        std::sort(slowest.begin(), slowest.end(), [](const StepTime &a, const StepTime &b)
+                  { return a.recordedMs > b.recordedMs; });
+        slowest.resize(std::min(top, slowest.size()));
+        if (!slowest.empty())
+        {
+            std::printf("\nslowest recorded steps:\n%10s %14s %14s %10s\n", "frame", "recorded ms", "replayed ms", "awake");
+            for (const StepTime &step : slowest)
+            {
+                std::printf("%10llu %14.3f %14.3f %10u\n", static_cast<unsigned long long>(step.frame),
+                            step.recordedMs, step.replayedMs, step.awakeBodies);
+            }
+        }
+
+        if (firstMismatchFrame != UINT64_MAX)
+        {
+            // Usually a different build (compiler, flags, FMA) or a change to the solver since recording.
+            std::printf("\nDIVERGED at frame %llu, body %u is the first one off the recording\n",
+                        static_cast<unsigned long long>(firstMismatchFrame), firstMismatchBody);
+            return EXIT_FAILURE;
+        }
+        std::printf("\nevery step matched the recording bit for bit\n");
+    }
+    catch (const std::exception &e)
+    {
+        std::fprintf(stderr, "%s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
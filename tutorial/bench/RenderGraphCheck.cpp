@@ -0,0 +1,358 @@
+// Declares a frame shaped like BasicApp's (GPU culling, a shadow pass, the indirect draw, the depth pyramid) as a render
+// graph on a headless device and checks what compile() made of it: the pass order, the pass that should
+// be culled, the barriers in front of each pass and which transients ended up sharing memory.
+// Then records and submits the frame once, so in a debug build the validation layers see the barriers too.
+//
+//   RenderGraphCheck
+//
+// No window or display needed:
+//   VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json ./RenderGraphCheck
+#include "VpeDevice.hpp"
+#include "VpeRenderGraph.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+    using vpe::VpeRenderGraph;
+    using vpe::VpeRgAccess;
+    using vpe::VpeRgPassType;
+    using ResourceId = VpeRenderGraph::ResourceId;
+
+    constexpr uint32_t SIZE = 256;
+    constexpr uint32_t OBJECT_COUNT = 1024;
+
+    // What BasicApp gets from outside the graph: the swapchain image, its depth buffer,
+    // last frame's depth pyramid and the particle spheres.
+    struct Imports
+    {
+        VkImage color = VK_NULL_HANDLE;
+        VkImage depth = VK_NULL_HANDLE;
+        VkImage pyramid = VK_NULL_HANDLE;
+        VkBuffer spheres = VK_NULL_HANDLE;
+        std::vector<VkDeviceMemory> memory;
+    };
+
+    struct Frame
+    {
+        ResourceId color;
+        ResourceId depth;
+        ResourceId pyramid;
+        ResourceId spheres;
+        ResourceId visible;
+        ResourceId drawCommand;
+        ResourceId heatmap;
+        ResourceId shadowMap;
+        ResourceId levels[3];
+    };
+
+    VkImage createImage(vpe::VpeDevice &device, Imports &imports, VkFormat format, uint32_t size, VkImageUsageFlags usage)
+    {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = format;
+        imageInfo.extent = {size, size, 1};
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = usage;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkImage image;
+        VkDeviceMemory memory;
+        device.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, memory);
+        imports.memory.push_back(memory);
+        return image;
+    }
+
+    Frame declare(VpeRenderGraph &graph, const Imports &imports)
+    {
+        auto nothing = [](VkCommandBuffer) {};
+        Frame frame{};
+        // TRANSFER_SRC stands in for PRESENT_SRC, which needs a swapchain.
+        frame.color = graph.importImage(
+            "color", imports.color, VK_NULL_HANDLE, VK_IMAGE_ASPECT_COLOR_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0);
+        frame.depth = graph.importImage(
+            "depth", imports.depth, VK_NULL_HANDLE, VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+        // Built at the end of last frame, culling reads it before this frame's build overwrites it.
+        frame.pyramid = graph.importImage(
+            "pyramid", imports.pyramid, VK_NULL_HANDLE, VK_IMAGE_ASPECT_COLOR_BIT,
+            VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+        // Written by the GPU particle step.
+        frame.spheres = graph.importBuffer(
+            "spheres", imports.spheres, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+        frame.visible = graph.createBuffer("visible", {OBJECT_COUNT * 16});
+        frame.drawCommand = graph.createBuffer("drawCommand", {16});
+        frame.heatmap = graph.createImage("heatmap", {VK_FORMAT_R8G8B8A8_UNORM, {SIZE, SIZE}});
+        frame.shadowMap = graph.createImage(
+            "shadowMap", {VK_FORMAT_D16_UNORM, {SIZE, SIZE}, VK_IMAGE_ASPECT_DEPTH_BIT});
+        // The pyramid goes through three smaller images here. The first and the last are never
+        // alive at the same time, so they can share memory.
+        for (uint32_t level = 0; level < 3; level++)
+        {
+            uint32_t size = SIZE >> (level + 1);
+            frame.levels[level] = graph.createImage("level" + std::to_string(level), {VK_FORMAT_R32_SFLOAT, {size, size}});
+        }
+
+        graph.addPass("cull", VpeRgPassType::Compute, nothing)
+            .read(frame.spheres, VpeRgAccess::StorageRead)
+            .read(frame.pyramid, VpeRgAccess::StorageRead)
+            .write(frame.visible, VpeRgAccess::StorageWrite)
+            .write(frame.drawCommand, VpeRgAccess::StorageWrite);
+        // Nothing reads the heatmap, so this one should go.
+        graph.addPass("heatmap", VpeRgPassType::Compute, nothing)
+            .read(frame.visible, VpeRgAccess::StorageRead)
+            .write(frame.heatmap, VpeRgAccess::StorageWrite);
+        // Draws the same objects, but pulls them from the shader instead of as vertex input.
+        graph.addPass("shadow", VpeRgPassType::Graphics, nothing)
+            .read(frame.drawCommand, VpeRgAccess::IndirectRead)
+            .read(frame.visible, VpeRgAccess::StorageRead)
+            .write(frame.shadowMap, VpeRgAccess::DepthAttachmentWrite);
+        graph.addPass("draw", VpeRgPassType::Graphics, nothing)
+            .read(frame.drawCommand, VpeRgAccess::IndirectRead)
+            .read(frame.visible, VpeRgAccess::VertexRead)
+            .read(frame.shadowMap, VpeRgAccess::SampledRead)
+            .write(frame.color, VpeRgAccess::ColorAttachmentWrite)
+            .write(frame.depth, VpeRgAccess::DepthAttachmentWrite);
+        graph.addPass("reduce0", VpeRgPassType::Compute, nothing)
+            .read(frame.depth, VpeRgAccess::SampledRead)
+            .write(frame.levels[0], VpeRgAccess::StorageWrite);
+        graph.addPass("reduce1", VpeRgPassType::Compute, nothing)
+            .read(frame.levels[0], VpeRgAccess::StorageRead)
+            .write(frame.levels[1], VpeRgAccess::StorageWrite);
+        graph.addPass("reduce2", VpeRgPassType::Compute, nothing)
+            .read(frame.levels[1], VpeRgAccess::StorageRead)
+            .write(frame.levels[2], VpeRgAccess::StorageWrite);
+        graph.addPass("pyramid", VpeRgPassType::Compute, nothing)
+            .read(frame.levels[2], VpeRgAccess::StorageRead)
+            .write(frame.pyramid, VpeRgAccess::StorageWrite);
+        return frame;
+    }
+
+    uint32_t failures = 0;
+
+    void expect(bool condition, const std::string &what)
+    {
+        if (!condition)
+        {
+            std::fprintf(stderr, "FAILED: %s\n", what.c_str());
+            failures++;
+        }
+    }
+
+    bool hasAll(VkFlags flags, VkFlags wanted)
+    {
+        return (flags & wanted) == wanted;
+    }
+
+    const VpeRenderGraph::Barrier &barrierBefore(const VpeRenderGraph &graph, const std::string &pass)
+    {
+        std::vector<std::string> order = graph.passOrder();
+        auto found = std::find(order.begin(), order.end(), pass);
+        if (found == order.end())
+        {
+            throw std::runtime_error("Pass " + pass + " didn't get scheduled.");
+        }
+        return graph.barriers()[found - order.begin()];
+    }
+
+    // Null when the barrier doesn't touch the image's layout.
+    const VpeRenderGraph::ImageBarrier *findTransition(const VpeRenderGraph::Barrier &barrier, ResourceId resource)
+    {
+        for (const VpeRenderGraph::ImageBarrier &image : barrier.images)
+        {
+            if (image.resource == resource)
+            {
+                return &image;
+            }
+        }
+        return nullptr;
+    }
+
+    void expectTransition(
+        const VpeRenderGraph::Barrier &barrier,
+        ResourceId resource,
+        VkImageLayout oldLayout,
+        VkImageLayout newLayout,
+        const std::string &what)
+    {
+        const VpeRenderGraph::ImageBarrier *transition = findTransition(barrier, resource);
+        expect(transition != nullptr && transition->oldLayout == oldLayout && transition->newLayout == newLayout, what);
+    }
+
+    void checkPlan(const VpeRenderGraph &graph, const Frame &frame)
+    {
+        const std::vector<std::string> expectedOrder{"cull", "shadow", "draw", "reduce0", "reduce1", "reduce2", "pyramid"};
+        expect(graph.passOrder() == expectedOrder, "passes run as cull, shadow, draw, reduce0-2, pyramid");
+        expect(graph.stats().culledPassCount == 1, "the heatmap pass is culled");
+        expect(graph.image(frame.heatmap) == VK_NULL_HANDLE, "the culled pass' output gets no memory");
+        expect(graph.barriers().size() == expectedOrder.size() + 1, "one barrier slot per pass plus the final one");
+
+        // Last frame's particle step and pyramid build have to be done before culling reads them.
+        // Both stay in the layout they're in.
+        const VpeRenderGraph::Barrier &cull = barrierBefore(graph, "cull");
+        expect(hasAll(cull.srcStages, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT) &&
+                   hasAll(cull.dstStages, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT) &&
+                   hasAll(cull.srcAccess, VK_ACCESS_SHADER_WRITE_BIT) &&
+                   hasAll(cull.dstAccess, VK_ACCESS_SHADER_READ_BIT),
+               "cull waits for last frame's compute writes");
+        expect(findTransition(cull, frame.pyramid) == nullptr, "the pyramid stays in GENERAL for cull");
+
+        // The culling results go to the shadow pass' indirect draw and vertex shader.
+        const VpeRenderGraph::Barrier &shadow = barrierBefore(graph, "shadow");
+        expect(hasAll(shadow.srcStages, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT) &&
+                   hasAll(shadow.dstStages, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT) &&
+                   hasAll(shadow.srcAccess, VK_ACCESS_SHADER_WRITE_BIT) &&
+                   hasAll(shadow.dstAccess, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT),
+               "shadow waits for cull's writes as indirect and shader reads");
+        expectTransition(shadow, frame.shadowMap, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                         "the shadow map goes UNDEFINED -> DEPTH_STENCIL_ATTACHMENT_OPTIMAL before shadow");
+
+        // Reading the culling results again, now as vertex input, still needs cull's writes made visible
+        // there. The indirect command was already made visible for shadow.
+        const VpeRenderGraph::Barrier &draw = barrierBefore(graph, "draw");
+        expect(hasAll(draw.srcStages, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT) &&
+                   hasAll(draw.dstStages, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT) &&
+                   hasAll(draw.srcAccess, VK_ACCESS_SHADER_WRITE_BIT) &&
+                   hasAll(draw.dstAccess, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT),
+               "draw waits for cull's writes as vertex reads, after shadow already read them");
+        expect((draw.dstAccess & VK_ACCESS_INDIRECT_COMMAND_READ_BIT) == 0, "draw doesn't make the indirect command visible twice");
+        expect(draw.images.size() == 3, "draw transitions the shadow map and the two attachments");
+        expectTransition(draw, frame.shadowMap, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                         VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+                         "the shadow map goes DEPTH_STENCIL_ATTACHMENT -> DEPTH_STENCIL_READ_ONLY before draw");
+        expectTransition(draw, frame.color, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                         "color goes UNDEFINED -> COLOR_ATTACHMENT_OPTIMAL before draw");
+        expectTransition(draw, frame.depth, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                         "depth goes UNDEFINED -> DEPTH_STENCIL_ATTACHMENT_OPTIMAL before draw");
+
+        // Depth written by the draw, sampled by the first reduction.
+        const VpeRenderGraph::Barrier &reduce = barrierBefore(graph, "reduce0");
+        expectTransition(reduce, frame.depth, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                         VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+                         "depth goes DEPTH_STENCIL_ATTACHMENT -> DEPTH_STENCIL_READ_ONLY before reduce0");
+        const VpeRenderGraph::ImageBarrier *depth = findTransition(reduce, frame.depth);
+        expect(depth != nullptr && hasAll(depth->srcAccess, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT) &&
+                   hasAll(depth->dstAccess, VK_ACCESS_SHADER_READ_BIT),
+               "the depth transition makes the depth writes visible to shader reads");
+        expect(hasAll(reduce.srcStages, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT) &&
+                   hasAll(reduce.dstStages, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT),
+               "reduce0 waits for the fragment tests");
+        expectTransition(reduce, frame.levels[0], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+                         "level0 goes UNDEFINED -> GENERAL before reduce0");
+
+        // Writing the pyramid has to wait for cull to be done reading the old one.
+        const VpeRenderGraph::Barrier &pyramid = barrierBefore(graph, "pyramid");
+        expect(findTransition(pyramid, frame.pyramid) == nullptr, "the pyramid stays in GENERAL for its build");
+        expect(hasAll(pyramid.srcStages, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT) &&
+                   hasAll(pyramid.srcAccess, VK_ACCESS_SHADER_WRITE_BIT) &&
+                   hasAll(pyramid.dstAccess, VK_ACCESS_SHADER_READ_BIT),
+               "pyramid waits for reduce2's writes");
+
+        // At the end only the color image goes where the outside wants it.
+        const VpeRenderGraph::Barrier &final = graph.barriers().back();
+        expect(final.images.size() == 1, "the final barrier only moves the color image");
+        expectTransition(final, frame.color, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                         "color ends up in its final layout");
+
+        const VpeRenderGraph::Stats &stats = graph.stats();
+        expect(graph.sharesMemory(frame.levels[0], frame.levels[2]), "level0 and level2 share memory");
+        expect(!graph.sharesMemory(frame.levels[0], frame.levels[1]), "level0 and level1 (both alive in reduce1) don't");
+        expect(!graph.sharesMemory(frame.levels[1], frame.levels[2]), "level1 and level2 (both alive in reduce2) don't");
+        expect(!graph.sharesMemory(frame.visible, frame.drawCommand), "the two culling outputs don't");
+        expect(stats.allocatedBytes < stats.transientBytes, "aliasing takes less memory than separate allocations");
+    }
+}
+
+int main()
+{
+    try
+    {
+        vpe::VpeDevice device{static_cast<vpe::VpeWindow *>(nullptr)};
+        Imports imports;
+        imports.color = createImage(
+            device, imports, VK_FORMAT_R8G8B8A8_UNORM, SIZE,
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+        imports.depth = createImage(
+            device, imports, VK_FORMAT_D16_UNORM, SIZE,
+            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+        imports.pyramid = createImage(device, imports, VK_FORMAT_R32_SFLOAT, SIZE / 16, VK_IMAGE_USAGE_STORAGE_BIT);
+        VkDeviceMemory sphereMemory;
+        device.createBuffer(
+            OBJECT_COUNT * 16, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            imports.spheres, sphereMemory);
+        imports.memory.push_back(sphereMemory);
+
+        {
+            VpeRenderGraph graph{device};
+            Frame frame = declare(graph, imports);
+            graph.compile();
+            checkPlan(graph, frame);
+
+            // Same declarations again, the way BasicApp would each frame. Nothing should get redone.
+            VkImage level0 = graph.image(frame.levels[0]);
+            uint32_t barrierCount = graph.stats().barrierCount;
+            graph.reset();
+            frame = declare(graph, imports);
+            graph.compile();
+            expect(graph.image(frame.levels[0]) == level0, "declaring the same graph again keeps its transients");
+            expect(graph.stats().barrierCount == barrierCount, "declaring the same graph again plans the same barriers");
+
+            VkCommandBuffer commandBuffer = device.beginSingleTimeCommands();
+            // The graph expects last frame's pyramid build to have left it in GENERAL.
+            VkImageMemoryBarrier toGeneral{};
+            toGeneral.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            toGeneral.srcAccessMask = 0;
+            toGeneral.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            toGeneral.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            toGeneral.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+            toGeneral.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            toGeneral.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            toGeneral.image = imports.pyramid;
+            toGeneral.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+            vkCmdPipelineBarrier(
+                commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                0, 0, nullptr, 0, nullptr, 1, &toGeneral);
+            graph.execute(commandBuffer);
+            device.endSingleTimeCommands(commandBuffer);
+
+            const vpe::VpeRenderGraph::Stats &stats = graph.stats();
+            std::printf("%u passes (%u culled), %u barriers (%u image), transients %.1f KB in %.1f KB\n",
+                        stats.passCount, stats.culledPassCount, stats.barrierCount, stats.imageBarrierCount,
+                        stats.transientBytes / 1024.0, stats.allocatedBytes / 1024.0);
+        }
+
+        vkDestroyImage(device.device(), imports.color, nullptr);
+        vkDestroyImage(device.device(), imports.depth, nullptr);
+        vkDestroyImage(device.device(), imports.pyramid, nullptr);
+        vkDestroyBuffer(device.device(), imports.spheres, nullptr);
+        for (VkDeviceMemory memory : imports.memory)
+        {
+            vkFreeMemory(device.device(), memory, nullptr);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::fprintf(stderr, "%s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    if (failures > 0)
+    {
+        std::printf("\n%u render graph checks FAILED\n", failures);
+        return EXIT_FAILURE;
+    }
+    std::printf("\nrender graph plan is as expected\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,153 @@
+// Reads a VpeSimulationThread the way the renderer does, a frame at a time at a fixed rate, and checks
+// the blended positions move smoothly across snapshot handovers instead of stalling and jumping.
+//
+//   SimulationThreadCheck [--bodies N] [--rate HZ] [--seconds S]
+//
+// One marker body flies along x at a constant speed next to a pile of N falling spheres (the load).
+// Every frame gets turned into a lag: how far the shown x is behind where the marker really is on the
+// simulation clock. Smooth means the lag hardly changes from one frame to the next, handovers included.
+// Stalling until the next snapshot and then jumping shows up as most of a step at every handover.
+// Steps taking longer or shorter than the one before still move it by the difference, that's expected.
+#include "VpeJobSystem.hpp"
+#include "VpeSimulationThread.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main(int argc, char **argv)
+{
+    uint32_t bodies = 2000;
+    double rate = 144.0;
+    double seconds = 3.0;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (argument == "--bodies" && hasValue)
+        {
+            bodies = static_cast<uint32_t>(std::max(0, std::atoi(argv[++i])));
+        }
+        else if (argument == "--rate" && hasValue)
+        {
+            rate = std::max(1.0, std::atof(argv[++i]));
+        }
+        else if (argument == "--seconds" && hasValue)
+        {
+            seconds = std::max(0.1, std::atof(argv[++i]));
+        }
+        else
+        {
+            std::fprintf(stderr, "Unknown option %s\n", argument.c_str());
+            return EXIT_FAILURE;
+        }
+    }
+
+    constexpr float DT = 1.0f / 60.0f;
+    constexpr float SPEED = 1.0f;
+    constexpr float START_X = -1.0f;
+    try
+    {
+        vpe::VpeJobSystem jobSystem{vpe::VpeSimulationThread::poolThreadCount()};
+        vpe::VpeSimulationThread simulation{jobSystem, vpe::VpePhysicsSettings{}, DT, [bodies](vpe::VpePhysicsWorld &world)
+                                            {
+            // High enough that it doesn't reach the floor. Gravity only pulls on y, x stays exactly linear.
+            uint32_t marker = world.addBody(glm::vec3{START_X, 500.0f, 0.0f}, 0.05f, 1.0f);
+            world.setVelocity(marker, glm::vec3{SPEED, 0.0f, 0.0f});
+            constexpr float RADIUS = 0.05f;
+            constexpr uint32_t SIDE = 20;
+            for (uint32_t i = 0; i < bodies; i++)
+            {
+                world.addBody(
+                    glm::vec3{((i % SIDE) - SIDE * 0.5f) * 2.5f * RADIUS,
+                              1.0f + (i / (SIDE * SIDE)) * 2.5f * RADIUS,
+                              (((i / SIDE) % SIDE) - SIDE * 0.5f) * 2.5f * RADIUS},
+                    RADIUS, 1.0f);
+            } }};
+
+        std::vector<glm::vec4> shown;
+        std::vector<double> lagChanges;
+        std::vector<double> handoverChanges;
+        double previousLag = 0.0;
+        bool hasPrevious = false;
+        uint64_t previousSkipped = 0;
+        uint32_t handovers = 0;
+        uint32_t frames = 0;
+        auto frameTime = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / rate));
+        auto next = std::chrono::steady_clock::now();
+        while (simulation.clock() < seconds && !simulation.failed())
+        {
+            next += frameTime;
+            std::this_thread::sleep_until(next);
+
+            bool fresh = simulation.acquire();
+            const vpe::VpeTransformSnapshot &snapshot = simulation.snapshot();
+            if (snapshot.positions.empty())
+            {
+                continue;
+            }
+            double clock = simulation.clock();
+            snapshot.interpolate(simulation.alpha(), shown);
+            frames++;
+            handovers += fresh ? 1 : 0;
+
+            double lag = clock - (static_cast<double>(shown[0].x) - START_X) / SPEED;
+            // Skipping ahead jumps on purpose, those frames don't count.
+            uint64_t skipped = simulation.skippedSteps();
+            if (hasPrevious && skipped == previousSkipped)
+            {
+                lagChanges.push_back(std::abs(lag - previousLag));
+                if (fresh)
+                {
+                    handoverChanges.push_back(lagChanges.back());
+                }
+            }
+            previousLag = lag;
+            previousSkipped = skipped;
+            hasPrevious = true;
+        }
+        if (simulation.failed())
+        {
+            std::fprintf(stderr, "the simulation thread stopped, a step threw\n");
+            return EXIT_FAILURE;
+        }
+        if (handoverChanges.empty())
+        {
+            std::fprintf(stderr, "no frames saw a snapshot handover\n");
+            return EXIT_FAILURE;
+        }
+
+        std::sort(lagChanges.begin(), lagChanges.end());
+        std::sort(handoverChanges.begin(), handoverChanges.end());
+        double median = lagChanges[lagChanges.size() / 2];
+        double handoverMedian = handoverChanges[handoverChanges.size() / 2];
+        double worst = lagChanges.back();
+        std::printf("%u bodies, %u job threads + the simulation thread, %.0f Hz reader\n",
+                    bodies + 1, jobSystem.threadCount(), rate);
+        std::printf("%u frames, %u snapshot handovers, %llu steps, %llu skipped, last step %.2f ms\n",
+                    frames, handovers, static_cast<unsigned long long>(simulation.stepCount()),
+                    static_cast<unsigned long long>(simulation.skippedSteps()), simulation.snapshot().stepMilliseconds);
+        std::printf("lag change per frame: median %.3f ms, at handovers %.3f ms, worst %.3f ms (a step is %.3f ms)\n",
+                    median * 1000.0, handoverMedian * 1000.0, worst * 1000.0, DT * 1000.0);
+
+        // The worst one is whatever the scheduler did to a step, the typical handover is the design.
+        if (handoverMedian > DT * 0.25)
+        {
+            std::printf("\nNOT SMOOTH, the shown positions stall and jump around snapshot handovers\n");
+            return EXIT_FAILURE;
+        }
+        std::printf("\npositions stay continuous across snapshot handovers\n");
+    }
+    catch (const std::exception &e)
+    {
+        std::fprintf(stderr, "%s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
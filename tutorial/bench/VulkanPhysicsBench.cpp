@@ -0,0 +1,987 @@
+// Scripted scenes on a headless device, to keep an eye on performance from one change to the next.
+// Every scene runs a fixed number of frames (or physics steps) and its frame times, GPU times,
+// step times, memory and heap allocations go out as JSON. Given the JSON of an earlier run as a
+// baseline, it fails when anything got slower than the threshold allows.
+//
+// No window or display needed, so it runs on lavapipe in CI:
+//   VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json ./VulkanPhysicsBench --scale 0.1
+//
+// Options:
+//   --frames N         frames (or steps) per scene, 300 by default
+//   --scale S          multiplies every scene's size, for slow devices
+//   --scene NAME       only run this scene, can be given more than once
+//   --json PATH        where the results go, stdout if not given
+//   --baseline PATH    compare against these results
+//   --threshold T      allowed slowdown against the baseline, 0.15 is 15% (the default)
+//   --record PATH      write a replay log of the falling bodies scene for PhysicsReplay (adds to its step times)
+// Has to run from the build folder, the shaders are loaded from shaders/.
+#include "VpeDevice.hpp"
+#include "VpeGpuTimestamps.hpp"
+#include "VpeJobSystem.hpp"
+#include "VpeModel.hpp"
+#include "VpePhysicsWorld.hpp"
+#include "VpePipeline.hpp"
+#include "VpeReplayLog.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <new>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Every heap allocation in the process goes through here, so a scene can say how many it made per frame.
+namespace
+{
+    std::atomic<uint64_t> heapAllocations{0};
+}
+
+void *operator new(std::size_t size)
+{
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *memory = std::malloc(size > 0 ? size : 1))
+    {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+namespace
+{
+    constexpr uint32_t TARGET_WIDTH = 1280;
+    constexpr uint32_t TARGET_HEIGHT = 720;
+
+    // Has to match the Push block in ParticleVertex.vert (same as BasicApp's).
+    struct ParticlePushConstants
+    {
+        glm::mat4 viewProjection;
+        glm::vec4 cameraRight;
+        glm::vec4 cameraUp;
+    };
+
+    struct Summary
+    {
+        double mean = 0.0;
+        double p50 = 0.0;
+        double p95 = 0.0;
+        double p99 = 0.0;
+        double max = 0.0;
+    };
+
+    Summary summarize(std::vector<double> samples)
+    {
+        Summary summary;
+        if (samples.empty())
+        {
+            return summary;
+        }
+        std::sort(samples.begin(), samples.end());
+        auto percentile = [&](double p)
+        {
+            size_t index = static_cast<size_t>(p * static_cast<double>(samples.size() - 1) + 0.5);
+            return samples[std::min(index, samples.size() - 1)];
+        };
+        for (double sample : samples)
+        {
+            summary.mean += sample;
+        }
+        summary.mean /= static_cast<double>(samples.size());
+        summary.p50 = percentile(0.5);
+        summary.p95 = percentile(0.95);
+        summary.p99 = percentile(0.99);
+        summary.max = samples.back();
+        return summary;
+    }
+
+    // Resident memory of the whole process right now, in MiB. Linux only, zero elsewhere.
+    double residentMegabytes()
+    {
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line))
+        {
+            if (line.rfind("VmRSS:", 0) == 0)
+            {
+                return std::atof(line.c_str() + 6) / 1024.0;
+            }
+        }
+        return 0.0;
+    }
+
+    struct SceneResult
+    {
+        std::string name;
+        uint32_t count = 0;
+        uint32_t frames = 0;
+        std::vector<double> frameMs;
+        std::vector<double> gpuMs;
+        std::vector<double> stepMs;
+        double allocationsPerFrame = 0.0;
+        double residentMb = 0.0;
+        double deviceMemoryMb = 0.0;
+    };
+
+    // The device, an offscreen color target to draw into, and one command buffer that gets
+    // recorded, submitted and waited on once per frame.
+    class Bench
+    {
+    public:
+        Bench() : device_{static_cast<vpe::VpeWindow *>(nullptr), &jobSystem_}
+        {
+            createTarget();
+            createCommands();
+            timestamps_ = std::make_unique<vpe::VpeGpuTimestamps>(
+                device_, device_.findPhysicalQueueFamilies().graphicsFamily, 2);
+        }
+
+        ~Bench()
+        {
+            VkDevice device = device_.device();
+            vkDeviceWaitIdle(device);
+            timestamps_.reset();
+            vkDestroyFence(device, fence_, nullptr);
+            vkDestroyCommandPool(device, commandPool_, nullptr);
+            vkDestroyFramebuffer(device, framebuffer_, nullptr);
+            vkDestroyRenderPass(device, renderPass_, nullptr);
+            vkDestroyImageView(device, colorView_, nullptr);
+            vkDestroyImage(device, colorImage_, nullptr);
+            vkFreeMemory(device, colorMemory_, nullptr);
+        }
+
+        Bench(const Bench &) = delete;
+        Bench &operator=(const Bench &) = delete;
+
+        vpe::VpeDevice &device() { return device_; }
+        vpe::VpeJobSystem &jobSystem() { return jobSystem_; }
+
+        // Empty unless --record was given.
+        std::string recordPath;
+
+        vpe::PipelineConfigInfo pipelineConfig(VkPipelineLayout layout) const
+        {
+            auto config = vpe::VpePipeline::defaultPipelineConfigInfo(TARGET_WIDTH, TARGET_HEIGHT);
+            config.renderPass = renderPass_;
+            config.colorAttachmentFormats = {VK_FORMAT_R8G8B8A8_UNORM};
+            config.pipelineLayout = layout;
+            return config;
+        }
+
+        VkPipelineLayout createLayout(uint32_t pushConstantSize)
+        {
+            VkPushConstantRange pushRange{VK_SHADER_STAGE_VERTEX_BIT, 0, pushConstantSize};
+            VkPipelineLayoutCreateInfo layoutInfo{};
+            layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+            layoutInfo.pushConstantRangeCount = pushConstantSize > 0 ? 1 : 0;
+            layoutInfo.pPushConstantRanges = pushConstantSize > 0 ? &pushRange : nullptr;
+            VkPipelineLayout layout;
+            if (vkCreatePipelineLayout(device_.device(), &layoutInfo, nullptr, &layout) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to create bench pipeline layout.");
+            }
+            return layout;
+        }
+
+        // Records record() frames times, inside the render pass if drawing, and times each one from
+        // the start of recording until the fence says the GPU is done.
+        void runFrames(SceneResult &result, uint32_t frames, bool drawing, const std::function<void(VkCommandBuffer)> &record)
+        {
+            result.frames = frames;
+            uint64_t allocationsBefore = heapAllocations.load(std::memory_order_relaxed);
+            for (uint32_t frame = 0; frame < frames; frame++)
+            {
+                auto start = std::chrono::steady_clock::now();
+
+                vkResetCommandBuffer(commandBuffer_, 0);
+                VkCommandBufferBeginInfo beginInfo{};
+                beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+                beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+                vkBeginCommandBuffer(commandBuffer_, &beginInfo);
+                timestamps_->reset(commandBuffer_, 0, 2);
+                timestamps_->write(commandBuffer_, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0);
+                if (drawing)
+                {
+                    VkClearValue clear{};
+                    clear.color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+                    VkRenderPassBeginInfo passInfo{};
+                    passInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+                    passInfo.renderPass = renderPass_;
+                    passInfo.framebuffer = framebuffer_;
+                    passInfo.renderArea = {{0, 0}, {TARGET_WIDTH, TARGET_HEIGHT}};
+                    passInfo.clearValueCount = 1;
+                    passInfo.pClearValues = &clear;
+                    vkCmdBeginRenderPass(commandBuffer_, &passInfo, VK_SUBPASS_CONTENTS_INLINE);
+                    record(commandBuffer_);
+                    vkCmdEndRenderPass(commandBuffer_);
+                }
+                else
+                {
+                    record(commandBuffer_);
+                }
+                timestamps_->write(commandBuffer_, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 1);
+                if (vkEndCommandBuffer(commandBuffer_) != VK_SUCCESS)
+                {
+                    throw std::runtime_error("Failed to record bench frame.");
+                }
+
+                VkSubmitInfo submitInfo{};
+                submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+                submitInfo.commandBufferCount = 1;
+                submitInfo.pCommandBuffers = &commandBuffer_;
+                if (vkQueueSubmit(device_.graphicsQueue(), 1, &submitInfo, fence_) != VK_SUCCESS)
+                {
+                    throw std::runtime_error("Failed to submit bench frame.");
+                }
+                vkWaitForFences(device_.device(), 1, &fence_, VK_TRUE, UINT64_MAX);
+                vkResetFences(device_.device(), 1, &fence_);
+
+                auto end = std::chrono::steady_clock::now();
+                result.frameMs.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+                uint64_t ticks[2];
+                if (timestamps_->read(0, 2, ticks))
+                {
+                    result.gpuMs.push_back(timestamps_->ticksToMilliseconds(ticks[1] - ticks[0]));
+                }
+            }
+            uint64_t allocations = heapAllocations.load(std::memory_order_relaxed) - allocationsBefore;
+            result.allocationsPerFrame = static_cast<double>(allocations) / std::max(frames, 1u);
+        }
+
+    private:
+        void createTarget()
+        {
+            VkImageCreateInfo imageInfo{};
+            imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+            imageInfo.extent = {TARGET_WIDTH, TARGET_HEIGHT, 1};
+            imageInfo.mipLevels = 1;
+            imageInfo.arrayLayers = 1;
+            imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+            imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+            imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            device_.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, colorImage_, colorMemory_);
+
+            VkImageViewCreateInfo viewInfo{};
+            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.image = colorImage_;
+            viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+            viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+            if (vkCreateImageView(device_.device(), &viewInfo, nullptr, &colorView_) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to create bench target view.");
+            }
+
+            VkAttachmentDescription colorAttachment{};
+            colorAttachment.format = VK_FORMAT_R8G8B8A8_UNORM;
+            colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+            colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+            colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+            colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+            VkAttachmentReference colorReference{0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+            VkSubpassDescription subpass{};
+            subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+            subpass.colorAttachmentCount = 1;
+            subpass.pColorAttachments = &colorReference;
+            // Last frame's writes have to be done before this one clears.
+            VkSubpassDependency dependency{};
+            dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+            dependency.dstSubpass = 0;
+            dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+            dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+            dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+            dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+            VkRenderPassCreateInfo passInfo{};
+            passInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+            passInfo.attachmentCount = 1;
+            passInfo.pAttachments = &colorAttachment;
+            passInfo.subpassCount = 1;
+            passInfo.pSubpasses = &subpass;
+            passInfo.dependencyCount = 1;
+            passInfo.pDependencies = &dependency;
+            if (vkCreateRenderPass(device_.device(), &passInfo, nullptr, &renderPass_) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to create bench render pass.");
+            }
+
+            VkFramebufferCreateInfo framebufferInfo{};
+            framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            framebufferInfo.renderPass = renderPass_;
+            framebufferInfo.attachmentCount = 1;
+            framebufferInfo.pAttachments = &colorView_;
+            framebufferInfo.width = TARGET_WIDTH;
+            framebufferInfo.height = TARGET_HEIGHT;
+            framebufferInfo.layers = 1;
+            if (vkCreateFramebuffer(device_.device(), &framebufferInfo, nullptr, &framebuffer_) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to create bench framebuffer.");
+            }
+        }
+
+        void createCommands()
+        {
+            VkCommandPoolCreateInfo poolInfo{};
+            poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            poolInfo.queueFamilyIndex = device_.findPhysicalQueueFamilies().graphicsFamily;
+            poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+            if (vkCreateCommandPool(device_.device(), &poolInfo, nullptr, &commandPool_) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to create bench command pool.");
+            }
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocInfo.commandPool = commandPool_;
+            allocInfo.commandBufferCount = 1;
+            if (vkAllocateCommandBuffers(device_.device(), &allocInfo, &commandBuffer_) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to allocate bench command buffer.");
+            }
+            VkFenceCreateInfo fenceInfo{};
+            fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+            if (vkCreateFence(device_.device(), &fenceInfo, nullptr, &fence_) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to create bench fence.");
+            }
+        }
+
+        vpe::VpeJobSystem jobSystem_{};
+        vpe::VpeDevice device_;
+        VkImage colorImage_;
+        VkDeviceMemory colorMemory_;
+        VkImageView colorView_;
+        VkRenderPass renderPass_;
+        VkFramebuffer framebuffer_;
+        VkCommandPool commandPool_;
+        VkCommandBuffer commandBuffer_;
+        VkFence fence_;
+        std::unique_ptr<vpe::VpeGpuTimestamps> timestamps_;
+    };
+
+    void finishScene(Bench &bench, SceneResult &result)
+    {
+        result.residentMb = residentMegabytes();
+        result.deviceMemoryMb = static_cast<double>(bench.device().deviceLocalMemoryUsage()) / (1024.0 * 1024.0);
+    }
+
+    // count small random triangles in one model, one draw. Goes through vertex pulling when the device has it.
+    SceneResult runTriangles(Bench &bench, uint32_t count, uint32_t frames)
+    {
+        SceneResult result;
+        result.name = "triangles";
+        result.count = count;
+
+        std::mt19937 rng{42};
+        std::uniform_real_distribution<float> coordinate{-1.0f, 1.0f};
+        std::uniform_real_distribution<float> offset{-0.02f, 0.02f};
+        std::vector<vpe::VpeModel::Vertex> vertices;
+        vertices.reserve(count * 3);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            glm::vec3 center{coordinate(rng), coordinate(rng), 0.5f};
+            for (int corner = 0; corner < 3; corner++)
+            {
+                vertices.push_back({center + glm::vec3{offset(rng), offset(rng), 0.0f}});
+            }
+        }
+        vpe::VpeModel model{bench.device(), vertices};
+
+        bool pulling = model.usesVertexPulling();
+        VkPipelineLayout layout = bench.createLayout(pulling ? sizeof(vpe::VpeModel::PullConstants) : 0);
+        auto config = bench.pipelineConfig(layout);
+        if (!pulling)
+        {
+            config.bindingDescriptions = vpe::VpeModel::Vertex::getBindingDescriptions();
+            config.attributeDescriptions = vpe::VpeModel::Vertex::getAttributeDescriptions();
+        }
+        vpe::VpePipeline pipeline{
+            bench.device(),
+            pulling ? "shaders/PulledVertex.vert.spv" : "shaders/SimpleVertex.vert.spv",
+            "shaders/SimpleFragment.frag.spv",
+            config};
+
+        bench.runFrames(result, frames, true, [&](VkCommandBuffer commandBuffer)
+                        {
+            pipeline.bind(commandBuffer);
+            model.bind(commandBuffer);
+            if (pulling)
+            {
+                model.pushConstants(commandBuffer, layout, glm::mat4{1.0f});
+            }
+            model.draw(commandBuffer); });
+        finishScene(bench, result);
+        vkDestroyPipelineLayout(bench.device().device(), layout, nullptr);
+        return result;
+    }
+
+    // count camera facing quads from one instance buffer, the way the particles are drawn.
+    SceneResult runInstanced(Bench &bench, uint32_t count, uint32_t frames)
+    {
+        SceneResult result;
+        result.name = "instanced";
+        result.count = count;
+
+        VkDeviceSize bufferSize = sizeof(glm::vec4) * count;
+        VkBuffer instanceBuffer;
+        VkDeviceMemory instanceMemory;
+        bench.device().createBuffer(
+            bufferSize,
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            instanceBuffer,
+            instanceMemory);
+        void *data;
+        vkMapMemory(bench.device().device(), instanceMemory, 0, bufferSize, 0, &data);
+        std::mt19937 rng{7};
+        std::uniform_real_distribution<float> coordinate{-1.0f, 1.0f};
+        auto *instances = static_cast<glm::vec4 *>(data);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            instances[i] = glm::vec4{coordinate(rng), coordinate(rng), 0.5f, 0.01f};
+        }
+        vkUnmapMemory(bench.device().device(), instanceMemory);
+
+        VkPipelineLayout layout = bench.createLayout(sizeof(ParticlePushConstants));
+        auto config = bench.pipelineConfig(layout);
+        config.bindingDescriptions = {{0, sizeof(glm::vec4), VK_VERTEX_INPUT_RATE_INSTANCE}};
+        config.attributeDescriptions = {{0, 0, VK_FORMAT_R32G32B32A32_SFLOAT, 0}};
+        vpe::VpePipeline pipeline{
+            bench.device(), "shaders/ParticleVertex.vert.spv", "shaders/ParticleFragment.frag.spv", config};
+
+        ParticlePushConstants push{glm::mat4{1.0f}, glm::vec4{1.0f, 0.0f, 0.0f, 0.0f}, glm::vec4{0.0f, 1.0f, 0.0f, 0.0f}};
+        bench.runFrames(result, frames, true, [&](VkCommandBuffer commandBuffer)
+                        {
+            pipeline.bind(commandBuffer);
+            vkCmdPushConstants(commandBuffer, layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(push), &push);
+            VkDeviceSize offsets[] = {0};
+            vkCmdBindVertexBuffers(commandBuffer, 0, 1, &instanceBuffer, offsets);
+            vkCmdDraw(commandBuffer, 6, count, 0, 0); });
+        finishScene(bench, result);
+
+        vkDestroyPipelineLayout(bench.device().device(), layout, nullptr);
+        vkDestroyBuffer(bench.device().device(), instanceBuffer, nullptr);
+        vkFreeMemory(bench.device().device(), instanceMemory, nullptr);
+        return result;
+    }
+
+    // count spheres dropped in a loose block onto the floor, on the CPU world. Steps, no frames.
+    SceneResult runFallingBodies(Bench &bench, uint32_t count, uint32_t steps)
+    {
+        SceneResult result;
+        result.name = "falling_bodies";
+        result.count = count;
+        result.frames = steps;
+
+        vpe::VpePhysicsWorld world{bench.jobSystem()};
+        std::unique_ptr<vpe::VpeReplayRecorder> recorder;
+        if (!bench.recordPath.empty())
+        {
+            recorder = std::make_unique<vpe::VpeReplayRecorder>(bench.recordPath, world.settings());
+            world.setRecorder(recorder.get());
+        }
+        uint32_t side = std::max(1u, static_cast<uint32_t>(std::cbrt(static_cast<double>(count))));
+        constexpr float RADIUS = 0.1f;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint32_t x = i % side;
+            uint32_t z = (i / side) % side;
+            uint32_t y = i / (side * side);
+            // A little shift per layer so they don't land in perfect stacks.
+            float shift = 0.03f * static_cast<float>(y % 3);
+            world.addBody(
+                glm::vec3{(static_cast<float>(x) - side * 0.5f) * 2.4f * RADIUS + shift,
+                          0.5f + static_cast<float>(y) * 2.4f * RADIUS,
+                          (static_cast<float>(z) - side * 0.5f) * 2.4f * RADIUS + shift},
+                RADIUS, 1.0f);
+        }
+
+        uint64_t allocationsBefore = heapAllocations.load(std::memory_order_relaxed);
+        for (uint32_t step = 0; step < steps; step++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            world.step(1.0f / 60.0f);
+            auto end = std::chrono::steady_clock::now();
+            result.stepMs.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+        }
+        uint64_t allocations = heapAllocations.load(std::memory_order_relaxed) - allocationsBefore;
+        result.allocationsPerFrame = static_cast<double>(allocations) / std::max(steps, 1u);
+        finishScene(bench, result);
+        return result;
+    }
+
+    // count MiB a frame written into a mapped staging buffer and copied to device local memory.
+    SceneResult runUploads(Bench &bench, uint32_t count, uint32_t frames)
+    {
+        SceneResult result;
+        result.name = "uploads";
+        result.count = count;
+
+        VkDeviceSize bufferSize = static_cast<VkDeviceSize>(std::max(count, 1u)) * 1024 * 1024;
+        VkBuffer stagingBuffer;
+        VkDeviceMemory stagingMemory;
+        bench.device().createBuffer(
+            bufferSize,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            stagingBuffer,
+            stagingMemory);
+        VkBuffer deviceBuffer;
+        VkDeviceMemory deviceMemory;
+        bench.device().createBuffer(
+            bufferSize,
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            deviceBuffer,
+            deviceMemory);
+        void *mapped;
+        vkMapMemory(bench.device().device(), stagingMemory, 0, bufferSize, 0, &mapped);
+        std::vector<uint8_t> source(static_cast<size_t>(bufferSize));
+        for (size_t i = 0; i < source.size(); i++)
+        {
+            source[i] = static_cast<uint8_t>(i * 31);
+        }
+
+        uint32_t frame = 0;
+        bench.runFrames(result, frames, false, [&](VkCommandBuffer commandBuffer)
+                        {
+            // Something different each frame, so nothing can be skipped.
+            source[frame % source.size()]++;
+            frame++;
+            std::memcpy(mapped, source.data(), source.size());
+            VkBufferCopy region{0, 0, bufferSize};
+            vkCmdCopyBuffer(commandBuffer, stagingBuffer, deviceBuffer, 1, &region);
+            VkMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            vkCmdPipelineBarrier(
+                commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+                0, 1, &barrier, 0, nullptr, 0, nullptr); });
+        finishScene(bench, result);
+
+        vkUnmapMemory(bench.device().device(), stagingMemory);
+        vkDestroyBuffer(bench.device().device(), stagingBuffer, nullptr);
+        vkFreeMemory(bench.device().device(), stagingMemory, nullptr);
+        vkDestroyBuffer(bench.device().device(), deviceBuffer, nullptr);
+        vkFreeMemory(bench.device().device(), deviceMemory, nullptr);
+        return result;
+    }
+
+    void writeSummary(std::ostream &out, const char *name, const std::vector<double> &samples)
+    {
+        if (samples.empty())
+        {
+            out << "\"" << name << "\": null";
+            return;
+        }
+        Summary summary = summarize(samples);
+        out << "\"" << name << "\": {\"mean\": " << summary.mean << ", \"p50\": " << summary.p50
+            << ", \"p95\": " << summary.p95 << ", \"p99\": " << summary.p99 << ", \"max\": " << summary.max << "}";
+    }
+
+    std::string toJson(const std::string &deviceName, const std::vector<SceneResult> &results)
+    {
+        std::ostringstream out;
+        out.precision(6);
+        out << "{\n  \"device\": \"" << deviceName << "\",\n  \"scenes\": [\n";
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const SceneResult &result = results[i];
+            out << "    {\"name\": \"" << result.name << "\", \"count\": " << result.count
+                << ", \"frames\": " << result.frames << ",\n     ";
+            writeSummary(out, "frame_ms", result.frameMs);
+            out << ",\n     ";
+            writeSummary(out, "gpu_ms", result.gpuMs);
+            out << ",\n     ";
+            writeSummary(out, "step_ms", result.stepMs);
+            out << ",\n     \"allocations_per_frame\": " << result.allocationsPerFrame
+                << ", \"resident_mb\": " << result.residentMb
+                << ", \"device_memory_mb\": " << result.deviceMemoryMb << "}"
+                << (i + 1 < results.size() ? ",\n" : "\n");
+        }
+        out << "  ]\n}\n";
+        return out.str();
+    }
+
+    // Just enough JSON to read our own output back in as a baseline.
+    struct JsonValue
+    {
+        enum class Type
+        {
+            Null,
+            Bool,
+            Number,
+            String,
+            Array,
+            Object
+        };
+        Type type = Type::Null;
+        double number = 0.0;
+        std::string string;
+        std::vector<JsonValue> array;
+        std::map<std::string, JsonValue> object;
+
+        const JsonValue *find(const std::string &key) const
+        {
+            auto found = object.find(key);
+            return found != object.end() ? &found->second : nullptr;
+        }
+    };
+
+    class JsonParser
+    {
+    public:
+        explicit JsonParser(const std::string &text) : text_{text} {}
+
+        JsonValue parse()
+        {
+            JsonValue value = parseValue();
+            skipSpace();
+            if (position_ != text_.size())
+            {
+                throw std::runtime_error("Trailing characters in JSON.");
+            }
+            return value;
+        }
+
+    private:
+        void skipSpace()
+        {
+            while (position_ < text_.size() && std::isspace(static_cast<unsigned char>(text_[position_])))
+            {
+                position_++;
+            }
+        }
+
+        void expect(char c)
+        {
+            skipSpace();
+            if (position_ >= text_.size() || text_[position_] != c)
+            {
+                throw std::runtime_error(std::string("Expected '") + c + "' in JSON.");
+            }
+            position_++;
+        }
+
+        JsonValue parseValue()
+        {
+            skipSpace();
+            if (position_ >= text_.size())
+            {
+                throw std::runtime_error("Unexpected end of JSON.");
+            }
+            JsonValue value;
+            char c = text_[position_];
+            if (c == '{')
+            {
+                value.type = JsonValue::Type::Object;
+                position_++;
+                skipSpace();
+                if (text_[position_] == '}')
+                {
+                    position_++;
+                    return value;
+                }
+                do
+                {
+                    skipSpace();
+                    std::string key = parseString();
+                    expect(':');
+                    value.object[key] = parseValue();
+                    skipSpace();
+                } while (text_[position_++] == ',');
+                if (text_[position_ - 1] != '}')
+                {
+                    throw std::runtime_error("Expected '}' in JSON.");
+                }
+            }
+            else if (c == '[')
+            {
+                value.type = JsonValue::Type::Array;
+                position_++;
+                skipSpace();
+                if (text_[position_] == ']')
+                {
+                    position_++;
+                    return value;
+                }
+                do
+                {
+                    value.array.push_back(parseValue());
+                    skipSpace();
+                } while (text_[position_++] == ',');
+                if (text_[position_ - 1] != ']')
+                {
+                    throw std::runtime_error("Expected ']' in JSON.");
+                }
+            }
+            else if (c == '"')
+            {
+                value.type = JsonValue::Type::String;
+                value.string = parseString();
+            }
+            else if (text_.compare(position_, 4, "null") == 0)
+            {
+                position_ += 4;
+            }
+            else if (text_.compare(position_, 4, "true") == 0 || text_.compare(position_, 5, "false") == 0)
+            {
+                value.type = JsonValue::Type::Bool;
+                value.number = c == 't' ? 1.0 : 0.0;
+                position_ += c == 't' ? 4 : 5;
+            }
+            else
+            {
+                value.type = JsonValue::Type::Number;
+                char *end = nullptr;
+                value.number = std::strtod(text_.c_str() + position_, &end);
+                if (end == text_.c_str() + position_)
+                {
+                    throw std::runtime_error("Bad number in JSON.");
+                }
+                position_ = static_cast<size_t>(end - text_.c_str());
+            }
+            return value;
+        }
+
+        // No escapes beyond \" and \\, we never write any others.
+        std::string parseString()
+        {
+            expect('"');
+            std::string result;
+            while (position_ < text_.size() && text_[position_] != '"')
+            {
+                if (text_[position_] == '\\' && position_ + 1 < text_.size())
+                {
+                    position_++;
+                }
+                result += text_[position_++];
+            }
+            expect('"');
+            return result;
+        }
+
+        const std::string &text_;
+        size_t position_ = 0;
+    };
+
+    // Every metric where lower is better, compared scene by scene. Tiny absolute differences are
+    // noise whatever the ratio says, so those never count.
+    bool compareWithBaseline(const std::vector<SceneResult> &results, const JsonValue &baseline, double threshold)
+    {
+        struct Metric
+        {
+            const char *group;
+            const char *field;
+            double absoluteSlack;
+        };
+        const Metric metrics[] = {
+            {"frame_ms", "p50", 0.05},
+            {"frame_ms", "p95", 0.05},
+            {"gpu_ms", "p50", 0.05},
+            {"step_ms", "p50", 0.05},
+            {"step_ms", "p95", 0.05},
+            {"allocations_per_frame", nullptr, 1.0},
+        };
+
+        const JsonValue *baselineScenes = baseline.find("scenes");
+        if (baselineScenes == nullptr)
+        {
+            throw std::runtime_error("Baseline has no scenes.");
+        }
+        JsonValue current = JsonParser{toJson("", results)}.parse();
+
+        bool passed = true;
+        std::printf("\n%-16s %-28s %12s %12s %9s\n", "scene", "metric", "baseline", "current", "change");
+        for (const JsonValue &scene : current.find("scenes")->array)
+        {
+            const std::string &name = scene.find("name")->string;
+            const JsonValue *old = nullptr;
+            for (const JsonValue &candidate : baselineScenes->array)
+            {
+                const JsonValue *candidateName = candidate.find("name");
+                if (candidateName != nullptr && candidateName->string == name)
+                {
+                    old = &candidate;
+                }
+            }
+            if (old == nullptr)
+            {
+                std::printf("%-16s not in the baseline\n", name.c_str());
+                continue;
+            }
+            for (const Metric &metric : metrics)
+            {
+                const JsonValue *now = scene.find(metric.group);
+                const JsonValue *then = old->find(metric.group);
+                if (metric.field != nullptr)
+                {
+                    now = now != nullptr ? now->find(metric.field) : nullptr;
+                    then = then != nullptr ? then->find(metric.field) : nullptr;
+                }
+                if (now == nullptr || then == nullptr ||
+                    now->type != JsonValue::Type::Number || then->type != JsonValue::Type::Number)
+                {
+                    continue;
+                }
+                double change = then->number > 0.0 ? now->number / then->number - 1.0 : 0.0;
+                bool regressed = now->number > then->number * (1.0 + threshold) &&
+                                 now->number - then->number > metric.absoluteSlack;
+                passed = passed && !regressed;
+                std::string label = std::string(metric.group) + (metric.field != nullptr ? std::string(".") + metric.field : "");
+                std::printf("%-16s %-28s %12.4f %12.4f %+8.1f%%%s\n", name.c_str(), label.c_str(),
+                            then->number, now->number, change * 100.0, regressed ? "  REGRESSED" : "");
+            }
+        }
+        return passed;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t frames = 300;
+    double scale = 1.0;
+    double threshold = 0.15;
+    std::vector<std::string> onlyScenes;
+    std::string jsonPath;
+    std::string baselinePath;
+    std::string recordPath;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (argument == "--frames" && hasValue)
+        {
+            frames = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+        }
+        else if (argument == "--scale" && hasValue)
+        {
+            scale = std::atof(argv[++i]);
+        }
+        else if (argument == "--scene" && hasValue)
+        {
+            onlyScenes.push_back(argv[++i]);
+        }
+        else if (argument == "--json" && hasValue)
+        {
+            jsonPath = argv[++i];
+        }
+        else if (argument == "--baseline" && hasValue)
+        {
+            baselinePath = argv[++i];
+        }
+        else if (argument == "--threshold" && hasValue)
+        {
+            threshold = std::atof(argv[++i]);
+        }
+        else if (argument == "--record" && hasValue)
+        {
+            recordPath = argv[++i];
+        }
+        else
+        {
+            std::fprintf(stderr, "Unknown option %s\n", argument.c_str());
+            return EXIT_FAILURE;
+        }
+    }
+
+    auto scaled = [scale](uint32_t count)
+    {
+        return std::max(1u, static_cast<uint32_t>(static_cast<double>(count) * scale));
+    };
+    struct Scene
+    {
+        const char *name;
+        uint32_t count;
+        SceneResult (*run)(Bench &, uint32_t, uint32_t);
+    };
+    const Scene scenes[] = {
+        {"triangles", scaled(100000), runTriangles},
+        {"instanced", scaled(100000), runInstanced},
+        {"falling_bodies", scaled(10000), runFallingBodies},
+        {"uploads", scaled(64), runUploads},
+    };
+
+    try
+    {
+        Bench bench;
+        bench.recordPath = recordPath;
+        std::vector<SceneResult> results;
+        for (const Scene &scene : scenes)
+        {
+            if (!onlyScenes.empty() && std::find(onlyScenes.begin(), onlyScenes.end(), scene.name) == onlyScenes.end())
+            {
+                continue;
+            }
+            results.push_back(scene.run(bench, scene.count, frames));
+            const SceneResult &result = results.back();
+            Summary frame = summarize(result.frameMs.empty() ? result.stepMs : result.frameMs);
+            std::fprintf(stderr, "%-16s %8u: %s p50 %.3f ms, p95 %.3f ms, %.1f allocations per frame\n",
+                         result.name.c_str(), result.count, result.frameMs.empty() ? "step" : "frame",
+                         frame.p50, frame.p95, result.allocationsPerFrame);
+        }
+
+        std::string json = toJson(bench.device().properties.deviceName, results);
+        if (jsonPath.empty())
+        {
+            std::fputs(json.c_str(), stdout);
+        }
+        else
+        {
+            std::ofstream(jsonPath) << json;
+        }
+
+        if (!baselinePath.empty())
+        {
+            std::ifstream file(baselinePath);
+            if (!file)
+            {
+                std::fprintf(stderr, "Can't read baseline %s\n", baselinePath.c_str());
+                return EXIT_FAILURE;
+            }
+            std::stringstream text;
+            text << file.rdbuf();
+            std::string baselineText = text.str();
+            JsonValue baseline = JsonParser{baselineText}.parse();
+            if (!compareWithBaseline(results, baseline, threshold))
+            {
+                std::printf("\nSlower than the baseline by more than %.0f%%.\n", threshold * 100.0);
+                return EXIT_FAILURE;
+            }
+            std::printf("\nWithin %.0f%% of the baseline.\n", threshold * 100.0);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::fprintf(stderr, "%s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
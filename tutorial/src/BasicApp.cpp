@@ -2,17 +2,75 @@
 #include <stdexcept>
 #include <array>
 
+#include <glm/gtc/matrix_transform.hpp>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <chrono>
+
 namespace vpe
 {
-    BasicApp::BasicApp()
+    BasicApp::BasicApp(VpeStartupTrace &startupTrace, uint32_t simulationBodies)
+        : startupTrace_{startupTrace}, jobSystem_{simulationBodies > 0 ? VpeSimulationThread::poolThreadCount() : 0}
     {
-        createPipelineLayout();
-        createPipeline();
+        // By now the window, device and swapchain are up and the shaders should be in memory.
+        jobSystem_.wait(shaderLoads_);
+        shaderLoads_.clear();
+        createCamera();
+
+        // Building a pipeline is mostly the driver compiling shaders, and none of them depend on each other.
+        // So the two graphics pipelines go to the workers while this thread sets up the particles,
+        // which builds its own compute pipelines and uploads the buffers.
+        std::vector<VpeJobSystem::TaskHandle> pipelines = {
+            jobSystem_.run([this]()
+                           {
+                VpeStartupTrace::Scope phase{&startupTrace_, "scene pipeline"};
+                createPipelineLayout();
+                createPipeline(); }),
+            jobSystem_.run([this]()
+                           {
+                VpeStartupTrace::Scope phase{&startupTrace_, "particle pipeline"};
+                createParticlePipeline(); }),
+        };
+        try
+        {
+            VpeStartupTrace::Scope phase{&startupTrace_, "particle system"};
+            createParticleSystem();
+        }
+        catch (...)
+        {
+            // Those tasks point at us, they have to be done before we unwind.
+            for (const auto &pipeline : pipelines)
+            {
+                try
+                {
+                    jobSystem_.wait(pipeline);
+                }
+                catch (...)
+                {
+                }
+            }
+            throw;
+        }
+        jobSystem_.wait(pipelines);
+
+        // Before the command buffers, they draw straight out of the simulation's transform stream.
+        if (simulationBodies > 0)
+        {
+            VpeStartupTrace::Scope phase{&startupTrace_, "simulation thread"};
+            createSimulation(simulationBodies);
+        }
+        VpeStartupTrace::Scope phase{&startupTrace_, "command buffers"};
         createCommandBuffers();
     }
 
     BasicApp::~BasicApp()
     {
+        for (auto commandPool : commandPools_)
+        {
+            vkDestroyCommandPool(vpeDevice_.device(), commandPool, nullptr);
+        }
+        vkDestroyPipelineLayout(vpeDevice_.device(), particlePipelineLayout_, nullptr);
         vkDestroyPipelineLayout(vpeDevice_.device(), pipelineLayout_, nullptr);
     }
 
@@ -23,6 +81,39 @@ namespace vpe
             glfwPollEvents();
             drawFrame();
         }
+        // Both queues might still be busy, and the destructors are about to pull their buffers away.
+        vkDeviceWaitIdle(vpeDevice_.device());
+    }
+
+    bool BasicApp::validateGpuPhysics()
+    {
+        // Two seconds is plenty for the block to hit the floor and start piling up.
+        // Every step starts both sides from the same state, so all that's left is the order the GPU adds
+        // the contact forces up in: a few ulps, under 1e-6 with the CPU summing in a different order.
+        // A contact that's missed or counted twice moves a resting particle by about 1e-4.
+        bool matches = particleSystem_->validateAgainstCpu(120, 1e-5f);
+        vkDeviceWaitIdle(vpeDevice_.device());
+        return matches;
+    }
+
+    std::vector<VpeJobSystem::TaskHandle> BasicApp::preloadShaders()
+    {
+        std::vector<VpeJobSystem::TaskHandle> loads;
+        // No shaders folder is fine here, the pipelines will complain about the missing file soon enough.
+        std::error_code error;
+        for (const auto &entry : fs::directory_iterator("shaders", error))
+        {
+            if (entry.path().extension() != ".spv")
+            {
+                continue;
+            }
+            fs::path path = entry.path();
+            loads.push_back(jobSystem_.run([this, path]()
+                                           {
+                VpeStartupTrace::Scope phase{&startupTrace_, "load " + path.filename().string()};
+                VpePipeline::preloadFile(path); }));
+        }
+        return loads;
     }
 
     void BasicApp::createPipelineLayout()
@@ -43,9 +134,11 @@ namespace vpe
     {
         // It's important to use the swapchain w,h because it might not match the window's lol
         auto pipelineConfig = VpePipeline::defaultPipelineConfigInfo(vpeSwapChain_.width(), vpeSwapChain_.height());
-        // We'll eventually get a render pass from elsewhere.
-        // It describes the structure and format of the framebuffer and its attachemnts.
+        // The render pass describes the structure and format of the framebuffer and its attachemnts.
+        // With dynamic rendering it's null and the formats are all the pipeline gets.
         pipelineConfig.renderPass = vpeSwapChain_.getRenderPass();
+        pipelineConfig.colorAttachmentFormats = {vpeSwapChain_.getSwapChainImageFormat()};
+        pipelineConfig.depthAttachmentFormat = vpeSwapChain_.findDepthFormat();
         pipelineConfig.pipelineLayout = pipelineLayout_;
         vpePipeline_ = std::make_unique<VpePipeline>(
             vpeDevice_,
@@ -54,70 +147,196 @@ namespace vpe
             pipelineConfig);
     }
 
-    void BasicApp::createCommandBuffers()
+    void BasicApp::createParticleSystem()
     {
-        // A bit unclear still on what exactly these really are.
-        // It seems to be a set of commands that correspond roughly one to one with frambuffers.
-        commandBuffers_.resize(vpeSwapChain_.imageCount());
+        // A loose block of particles a bit above the floor, with a small offset per layer
+        // so they don't land in perfect stacks.
+        constexpr int SIDE = 32;
+        constexpr int LAYERS = 16;
+        constexpr float RADIUS = 0.05f;
+        constexpr float SPACING = 2.4f * RADIUS;
 
-        VkCommandBufferAllocateInfo allocInfo{};
-        // two types of command buffers.
-        // Primary can be submitted for execution but not referenced by other command buffers.
-        // Secondary can be referenced by other buffers but not submitted for execution.
-        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        // This is a section of memory allocated at start so that Vulkan can intelligently reuse the memory.
-        allocInfo.commandPool = vpeDevice_.getCommandPool();
-        allocInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers_.size());
+        std::vector<glm::vec4> particles;
+        particles.reserve(SIDE * SIDE * LAYERS);
+        for (int y = 0; y < LAYERS; y++)
+        {
+            float shift = 0.3f * RADIUS * static_cast<float>(y % 3);
+            for (int z = 0; z < SIDE; z++)
+            {
+                for (int x = 0; x < SIDE; x++)
+                {
+                    particles.emplace_back(
+                        (static_cast<float>(x) - SIDE * 0.5f) * SPACING + shift,
+                        0.5f + static_cast<float>(y) * SPACING,
+                        (static_cast<float>(z) - SIDE * 0.5f) * SPACING + shift,
+                        RADIUS);
+                }
+            }
+        }
+        particleSystem_ = std::make_unique<VpeGpuParticleSystem>(
+            vpeDevice_, jobSystem_, particles, VpeSwapChain::MAX_FRAMES_IN_FLIGHT);
+        graphicsTimestamps_ = std::make_unique<VpeGpuTimestamps>(
+            vpeDevice_, vpeDevice_.findPhysicalQueueFamilies().graphicsFamily, 2 * VpeSwapChain::MAX_FRAMES_IN_FLIGHT);
 
-        if (vkAllocateCommandBuffers(vpeDevice_.device(), &allocInfo, commandBuffers_.data()) != VK_SUCCESS)
+        // Every particle is its own bounding sphere, so the culler reads the render buffers directly.
+        std::vector<VkBuffer> sphereBuffers;
+        for (uint32_t slot = 0; slot < VpeSwapChain::MAX_FRAMES_IN_FLIGHT; slot++)
         {
-            throw std::runtime_error("Failed to allocate command buffers.");
+            sphereBuffers.push_back(particleSystem_->renderBuffer(slot));
         }
+        depthPyramid_ = std::make_unique<VpeDepthPyramid>(vpeDevice_, vpeSwapChain_);
+        // Six corners per quad, one quad per visible particle.
+        particleCuller_ = std::make_unique<VpeGpuCuller>(
+            vpeDevice_, *depthPyramid_, sphereBuffers, particleSystem_->particleCount(), 6);
+    }
+
+    void BasicApp::createCamera()
+    {
+        // Camera sitting back and above the pile. Vulkan's y points down, so flip the projection.
+        projection_ = glm::perspective(glm::radians(45.0f), vpeSwapChain_.extentAspectRatio(), 0.1f, 100.0f);
+        projection_[1][1] *= -1.0f;
+        view_ = glm::lookAt(glm::vec3{0.0f, 3.0f, 6.0f}, glm::vec3{0.0f, 0.5f, 0.0f}, glm::vec3{0.0f, 1.0f, 0.0f});
+    }
 
-        // Now we record our draw commands to the buffers.
-        for (int i = 0; i < commandBuffers_.size(); i++)
+    void BasicApp::createParticlePipeline()
+    {
+        VkPushConstantRange pushRange{};
+        pushRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        pushRange.offset = 0;
+        pushRange.size = sizeof(ParticlePushConstants);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 0;
+        pipelineLayoutInfo.pSetLayouts = nullptr;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushRange;
+        if (vkCreatePipelineLayout(vpeDevice_.device(), &pipelineLayoutInfo, nullptr, &particlePipelineLayout_) != VK_SUCCESS)
         {
-            VkCommandBufferBeginInfo beginInfo{};
-            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            throw std::runtime_error("Failed to create particle pipeline layout.");
+        }
 
-            if (vkBeginCommandBuffer(commandBuffers_[i], &beginInfo) != VK_SUCCESS)
+        auto pipelineConfig = VpePipeline::defaultPipelineConfigInfo(vpeSwapChain_.width(), vpeSwapChain_.height());
+        pipelineConfig.renderPass = vpeSwapChain_.getRenderPass();
+        pipelineConfig.colorAttachmentFormats = {vpeSwapChain_.getSwapChainImageFormat()};
+        pipelineConfig.depthAttachmentFormat = vpeSwapChain_.findDepthFormat();
+        pipelineConfig.pipelineLayout = particlePipelineLayout_;
+        // One vec4 (position + radius) per instance, read straight out of the simulation buffer.
+        pipelineConfig.bindingDescriptions = {{0, sizeof(glm::vec4), VK_VERTEX_INPUT_RATE_INSTANCE}};
+        pipelineConfig.attributeDescriptions = {{0, 0, VK_FORMAT_R32G32B32A32_SFLOAT, 0}};
+        particlePipeline_ = std::make_unique<VpePipeline>(
+            vpeDevice_,
+            "shaders/ParticleVertex.vert.spv",
+            "shaders/ParticleFragment.frag.spv",
+            pipelineConfig);
+    }
+
+    void BasicApp::createCommandBuffers()
+    {
+        // A bit unclear still on what exactly these really are.
+        // It seems to be a set of commands that correspond roughly one to one with frambuffers.
+        // One per swapchain image per frame slot, since each slot draws from its own particle buffer.
+        commandBuffers_.resize(vpeSwapChain_.imageCount() * VpeSwapChain::MAX_FRAMES_IN_FLIGHT);
+        commandPools_.resize(commandBuffers_.size());
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.queueFamilyIndex = vpeDevice_.findPhysicalQueueFamilies().graphicsFamily;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+        for (size_t i = 0; i < commandBuffers_.size(); i++)
+        {
+            // This is a section of memory allocated at start so that Vulkan can intelligently reuse the memory.
+            if (vkCreateCommandPool(vpeDevice_.device(), &poolInfo, nullptr, &commandPools_[i]) != VK_SUCCESS)
             {
-                throw std::runtime_error("Failed to begin recording command buffer");
+                throw std::runtime_error("Failed to create command pool.");
             }
 
-            VkRenderPassBeginInfo renderPassInfo{};
-            renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-            renderPassInfo.renderPass = vpeSwapChain_.getRenderPass();
-            renderPassInfo.framebuffer = vpeSwapChain_.getFrameBuffer(i);
-            renderPassInfo.renderArea.offset = {0, 0};
-            renderPassInfo.renderArea.extent = vpeSwapChain_.getSwapChainExtent();
-
-            // This is the initial value of the frame buffer attachments.
-            // For us, index 0 is the color attachment, index 1 is the depth attachment.
-            std::array<VkClearValue, 2> clearValues{};
-            clearValues[0].color = {0.1f, 0.1f, 0.1f, 1.0f};
-            // Furthest value is one, closest is 0
-            clearValues[1].depthStencil = {1.0f, 0};
-
-            renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-            renderPassInfo.pClearValues = clearValues.data();
-
-            // Vk subpass contents arg says subsequent render pass commands will be directly embedded in the primary cmd buffer. No secondary.
-            // Alernative is to use secondary commands rather than inline.
-            // We CANNOT mix the two. Either all inline, or all secondary.
-            vkCmdBeginRenderPass(commandBuffers_[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-            vpePipeline_->bind(commandBuffers_[i]);
-            vkCmdDraw(commandBuffers_[i], 3, 1, 0, 0);
-
-            // Now we end the render pass.
-            vkCmdEndRenderPass(commandBuffers_[i]);
-            if (vkEndCommandBuffer(commandBuffers_[i]) != VK_SUCCESS)
+            VkCommandBufferAllocateInfo allocInfo{};
+            // two types of command buffers.
+            // Primary can be submitted for execution but not referenced by other command buffers.
+            // Secondary can be referenced by other buffers but not submitted for execution.
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocInfo.commandPool = commandPools_[i];
+            allocInfo.commandBufferCount = 1;
+
+            if (vkAllocateCommandBuffers(vpeDevice_.device(), &allocInfo, &commandBuffers_[i]) != VK_SUCCESS)
             {
-                throw std::runtime_error("Failed to record command buffer.");
+                throw std::runtime_error("Failed to allocate command buffers.");
             }
         }
+
+        // Now we record our draw commands to the buffers, each one on whatever thread grabs it.
+        jobSystem_.parallelFor(static_cast<uint32_t>(commandBuffers_.size()), [this](uint32_t begin, uint32_t end)
+                               {
+            for (uint32_t i = begin; i < end; i++)
+            {
+                recordCommandBuffer(
+                    static_cast<int>(i % vpeSwapChain_.imageCount()),
+                    static_cast<uint32_t>(i / vpeSwapChain_.imageCount()));
+            } });
+    }
+
+    void BasicApp::recordCommandBuffer(int imageIndex, uint32_t frameSlot)
+    {
+        VkCommandBuffer commandBuffer = commandBuffers_[frameSlot * vpeSwapChain_.imageCount() + imageIndex];
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to begin recording command buffer");
+        }
+
+        graphicsTimestamps_->reset(commandBuffer, frameSlot * 2, 2);
+        graphicsTimestamps_->write(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frameSlot * 2);
+
+        // The step itself runs on the compute queue, all we do here is take the result over
+        // and throw away every particle the camera can't see.
+        particleSystem_->recordAcquire(commandBuffer, frameSlot);
+        particleCuller_->recordCull(commandBuffer, frameSlot);
+
+        // Render pass or dynamic rendering, whichever the device has. Both clear color and depth (to 1, the furthest).
+        // Everything in between is recorded inline in this primary buffer, no secondary buffers.
+        vpeSwapChain_.beginRendering(commandBuffer, imageIndex, {{0.1f, 0.1f, 0.1f, 1.0f}});
+
+        vpePipeline_->bind(commandBuffer);
+        vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+
+        ParticlePushConstants push{};
+        push.viewProjection = projection_ * view_;
+        // The rows of the view matrix are the camera axes in world space.
+        push.cameraRight = glm::vec4{view_[0][0], view_[1][0], view_[2][0], 0.0f};
+        push.cameraUp = glm::vec4{view_[0][1], view_[1][1], view_[2][1], 0.0f};
+
+        particlePipeline_->bind(commandBuffer);
+        vkCmdPushConstants(
+            commandBuffer, particlePipelineLayout_, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ParticlePushConstants), &push);
+        VkBuffer particleBuffers[] = {particleCuller_->visibleBuffer()};
+        VkDeviceSize offsets[] = {0};
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, particleBuffers, offsets);
+        particleCuller_->recordDraw(commandBuffer);
+
+        if (simulationStream_)
+        {
+            // The CPU bodies are spheres too, so they go through the same pipeline, straight out of this
+            // slot's part of the stream. No culling, every body gets drawn.
+            VkBuffer bodyBuffers[] = {simulationStream_->buffer()};
+            VkDeviceSize bodyOffsets[] = {simulationStream_->offset(frameSlot)};
+            vkCmdBindVertexBuffers(commandBuffer, 0, 1, bodyBuffers, bodyOffsets);
+            vkCmdDraw(commandBuffer, 6, simulationStream_->capacity(), 0, 0);
+        }
+
+        vpeSwapChain_.endRendering(commandBuffer, imageIndex);
+        // Next frame's culling tests against what we just drew.
+        depthPyramid_->recordBuild(commandBuffer);
+        graphicsTimestamps_->write(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frameSlot * 2 + 1);
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to record command buffer.");
+        }
     }
 
     void BasicApp::drawFrame()
@@ -132,13 +351,131 @@ namespace vpe
             throw std::runtime_error("failed to acqure swap chain image!");
         }
 
+        // Acquiring waited on this slot's fence, so everything the slot did last time is finished.
+        uint32_t frameSlot = static_cast<uint32_t>(vpeSwapChain_.currentFrameIndex());
+        reportFrameTimings(frameSlot);
+        updateSimulationBodies(frameSlot);
+
+        // Physics for this frame goes to the compute queue first. It only waits for the last draw
+        // out of this slot, so on an async queue it overlaps with the frame graphics is still drawing.
+        VkSemaphore stepFinished = particleSystem_->submitStep(frameSlot);
+        particleCuller_->updateCamera(frameSlot, view_, projection_);
+
         // submits the command buffer, handles cpu gpu sync
         // buffer is then executed, and the swapchain presents the associated color attachment imageview to display
         // based on the present mode given
-        result = vpeSwapChain_.submitCommandBuffers(&commandBuffers_[imageIndex], &imageIndex);
+        result = vpeSwapChain_.submitCommandBuffers(
+            &commandBuffers_[frameSlot * vpeSwapChain_.imageCount() + imageIndex],
+            &imageIndex,
+            {stepFinished},
+            {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT},
+            {particleSystem_->drawFinishedSemaphore(frameSlot)});
         if (result != VK_SUCCESS)
         {
             throw std::runtime_error("Failed to present swap chain image.");
         }
+        if (!firstFramePresented_)
+        {
+            firstFramePresented_ = true;
+            startupTrace_.markFirstFrame();
+        }
+    }
+
+    void BasicApp::reportFrameTimings(uint32_t frameSlot)
+    {
+        uint64_t compute[2];
+        uint64_t graphics[2];
+        if (!particleSystem_->stepTimestamps(frameSlot, compute) ||
+            !graphicsTimestamps_->read(frameSlot * 2, 2, graphics))
+        {
+            return;
+        }
+
+        // The step in this slot is for the frame after the draw we saw last time,
+        // so that's the pair that should be running side by side.
+        const auto &clock = particleSystem_->timestamps();
+        if (timings_.havePreviousDraw)
+        {
+            uint64_t overlapBegin = std::max(compute[0], timings_.previousDraw[0]);
+            uint64_t overlapEnd = std::min(compute[1], timings_.previousDraw[1]);
+            if (overlapEnd > overlapBegin)
+            {
+                timings_.overlapMs += clock.ticksToMilliseconds(overlapEnd - overlapBegin);
+            }
+        }
+        timings_.computeMs += clock.ticksToMilliseconds(compute[1] - compute[0]);
+        timings_.graphicsMs += clock.ticksToMilliseconds(graphics[1] - graphics[0]);
+        timings_.previousDraw[0] = graphics[0];
+        timings_.previousDraw[1] = graphics[1];
+        timings_.havePreviousDraw = true;
+
+        if (++timings_.frames == FRAME_TIMING_INTERVAL)
+        {
+            double frames = static_cast<double>(timings_.frames);
+            spdlog::info("GPU ({}): physics {:.3f} ms, graphics {:.3f} ms, overlapped {:.3f} ms per frame",
+                         vpeDevice_.hasAsyncCompute() ? "async compute" : "single queue",
+                         timings_.computeMs / frames, timings_.graphicsMs / frames, timings_.overlapMs / frames);
+            timings_ = FrameTimings{};
+        }
+    }
+
+    void BasicApp::createSimulation(uint32_t bodyCount)
+    {
+        // A loose pile of spheres over the same spot the camera looks at, dropped on the floor.
+        constexpr float RADIUS = 0.05f;
+        constexpr uint32_t SIDE = 20;
+        simulation_ = std::make_unique<VpeSimulationThread>(
+            jobSystem_, VpePhysicsSettings{}, 1.0f / 60.0f, [bodyCount](VpePhysicsWorld &world)
+            {
+                for (uint32_t i = 0; i < bodyCount; i++)
+                {
+                    world.addBody(
+                        glm::vec3{((i % SIDE) - SIDE * 0.5f) * 2.5f * RADIUS,
+                                  1.0f + (i / (SIDE * SIDE)) * 2.5f * RADIUS,
+                                  (((i / SIDE) % SIDE) - SIDE * 0.5f) * 2.5f * RADIUS},
+                        RADIUS, 1.0f);
+                } });
+        simulationStream_ = std::make_unique<VpeTransformStream>(vpeDevice_, bodyCount, VpeSwapChain::MAX_FRAMES_IN_FLIGHT);
+        spdlog::info("Simulation thread stepping {} bodies at 60 Hz, transforms streamed to {} {} memory",
+                     bodyCount,
+                     simulationStream_->isDeviceLocal() ? "device local" : "host",
+                     simulationStream_->isCoherent() ? "coherent" : "non-coherent");
+    }
+
+    void BasicApp::updateSimulationBodies(uint32_t frameSlot)
+    {
+        if (!simulation_)
+        {
+            return;
+        }
+        // Never waits. Without a new step the old snapshot keeps blending towards its after state and holds there.
+        if (simulation_->acquire())
+        {
+            simulationStats_.freshFrames++;
+        }
+        simulation_->snapshot().interpolate(simulation_->alpha(), simulationBodies_);
+        // Acquiring the image waited on this slot's fence, so the GPU is done reading its part.
+        auto uploadStart = std::chrono::steady_clock::now();
+        simulationStream_->write(frameSlot, simulationBodies_.data(), static_cast<uint32_t>(simulationBodies_.size()));
+        simulationStats_.uploadMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - uploadStart).count();
+
+        if (simulationStats_.frames == 0)
+        {
+            simulationStats_.firstStep = simulation_->stepCount();
+            simulationStats_.firstClock = simulation_->clock();
+        }
+        if (++simulationStats_.frames == FRAME_TIMING_INTERVAL)
+        {
+            double seconds = simulation_->clock() - simulationStats_.firstClock;
+            uint64_t steps = simulation_->stepCount() - simulationStats_.firstStep;
+            spdlog::info("CPU physics: {:.0f} steps/s, last step {:.2f} ms, new snapshot in {:.0f}% of frames, upload {:.3f} ms, {} steps skipped{}",
+                         seconds > 0.0 ? static_cast<double>(steps) / seconds : 0.0,
+                         simulation_->snapshot().stepMilliseconds,
+                         100.0 * simulationStats_.freshFrames / simulationStats_.frames,
+                         simulationStats_.uploadMs / simulationStats_.frames,
+                         simulation_->skippedSteps(),
+                         simulation_->failed() ? " (stopped, a step threw)" : "");
+            simulationStats_ = SimulationStats{};
+        }
     }
 }
\ No newline at end of file
@@ -4,11 +4,27 @@
 #include "VpePipeline.hpp"
 #include "VpeDevice.hpp"
 #include "VpeSwapChain.hpp"
+#include "VpeJobSystem.hpp"
+#include "VpeGpuParticleSystem.hpp"
+#include "VpeGpuTimestamps.hpp"
+#include "VpeDepthPyramid.hpp"
+#include "VpeGpuCuller.hpp"
+#include "VpeStartupTrace.hpp"
+#include "VpeSimulationThread.hpp"
+#include "VpeTransformStream.hpp"
 #include <memory>
 #include <vector>
 
 namespace vpe
 {
+    // Has to match the Push block in ParticleVertex.vert.
+    struct ParticlePushConstants
+    {
+        glm::mat4 viewProjection;
+        glm::vec4 cameraRight;
+        glm::vec4 cameraUp;
+    };
+
     class BasicApp
     {
 
@@ -16,25 +32,91 @@ namespace vpe
         static constexpr int WIDTH = 1920;
         static constexpr int HEIGHT = 1080;
 
-        BasicApp();
+        // The trace gets a phase for every startup step and the time to the first frame.
+        // simulationBodies > 0 also starts a CPU physics world of that many spheres on its own thread.
+        explicit BasicApp(VpeStartupTrace &startupTrace, uint32_t simulationBodies = 0);
         ~BasicApp();
 
         BasicApp(const BasicApp &) = delete;
         BasicApp &operator=(const BasicApp &) = delete;
 
         void run();
+        // Runs the GPU particles against the CPU reference, for --validate-gpu-physics.
+        bool validateGpuPhysics();
 
     private:
+        // Starts reading every compiled shader on the job system, before there's even a window.
+        std::vector<VpeJobSystem::TaskHandle> preloadShaders();
         void createPipelineLayout();
         void createPipeline();
+        void createParticleSystem();
+        void createParticlePipeline();
+        void createCamera();
         void createCommandBuffers();
+        void recordCommandBuffer(int imageIndex, uint32_t frameSlot);
         void drawFrame();
+        // Averages the GPU timestamps over a bunch of frames and logs how much compute and graphics overlapped.
+        void reportFrameTimings(uint32_t frameSlot);
+        void createSimulation(uint32_t bodyCount);
+        // Picks up the newest physics snapshot (if there is one), blends it to where the simulation clock
+        // is now and streams it into the slot's part of the transform buffer.
+        void updateSimulationBodies(uint32_t frameSlot);
+
+        static constexpr uint32_t FRAME_TIMING_INTERVAL = 240;
 
-        VpeWindow vpeWindow_{WIDTH, HEIGHT, "FIRST WINDOW!"};
-        VpeDevice vpeDevice_{vpeWindow_};
-        VpeSwapChain vpeSwapChain_{vpeDevice_, vpeWindow_.getExtent()};
+        struct FrameTimings
+        {
+            uint32_t frames = 0;
+            double computeMs = 0.0;
+            double graphicsMs = 0.0;
+            double overlapMs = 0.0;
+            uint64_t previousDraw[2] = {0, 0};
+            bool havePreviousDraw = false;
+        };
+
+        struct SimulationStats
+        {
+            uint32_t frames = 0;
+            uint32_t freshFrames = 0;
+            double uploadMs = 0.0;
+            uint64_t firstStep = 0;
+            double firstClock = 0.0;
+        };
+
+        VpeStartupTrace &startupTrace_;
+        // Declared first so it outlives everything that might still have work queued on it.
+        // A thread short when the simulation thread is on, so the two together stay at one per core.
+        VpeJobSystem jobSystem_;
+        // The order here is the startup order. Shaders load on the workers from the start, the window only
+        // opens inside the device so the instance can be made next to it.
+        std::vector<VpeJobSystem::TaskHandle> shaderLoads_ = preloadShaders();
+        VpeWindow vpeWindow_{WIDTH, HEIGHT, "FIRST WINDOW!", false};
+        VpeDevice vpeDevice_{vpeWindow_, &jobSystem_, &startupTrace_};
+        // The depth pyramid reads the depth buffer after drawing, so it has to be kept.
+        VpeSwapChain vpeSwapChain_{vpeDevice_, vpeWindow_.getExtent(), VpeSwapChain::DepthUsage::Sampled, &startupTrace_};
         std::unique_ptr<VpePipeline> vpePipeline_;
         VkPipelineLayout pipelineLayout_;
+        std::unique_ptr<VpeGpuParticleSystem> particleSystem_;
+        std::unique_ptr<VpePipeline> particlePipeline_;
+        VkPipelineLayout particlePipelineLayout_;
+        std::unique_ptr<VpeGpuTimestamps> graphicsTimestamps_;
+        std::unique_ptr<VpeDepthPyramid> depthPyramid_;
+        std::unique_ptr<VpeGpuCuller> particleCuller_;
+        glm::mat4 view_;
+        glm::mat4 projection_;
+        FrameTimings timings_;
+        bool firstFramePresented_ = false;
+        // One pool per command buffer. Pools can't be used from two threads at once,
+        // so this is what lets us record the buffers in parallel.
+        std::vector<VkCommandPool> commandPools_;
         std::vector<VkCommandBuffer> commandBuffers_;
+
+        // The bodies as this frame sees them, position and radius like the GPU particles.
+        std::vector<glm::vec4> simulationBodies_;
+        // Where they go for drawing, mapped for good.
+        std::unique_ptr<VpeTransformStream> simulationStream_;
+        SimulationStats simulationStats_;
+        // Last, so it stops stepping before anything else goes away. Uses jobSystem_ from its own thread.
+        std::unique_ptr<VpeSimulationThread> simulation_;
     };
 } // namespace vpe
@@ -0,0 +1,34 @@
+#include "VpeBatchSimulation.hpp"
+
+namespace vpe
+{
+    VpeBatchSimulation::VpeBatchSimulation(
+        VpeJobSystem &jobSystem,
+        uint32_t worldCount,
+        const SettingsFn &settingsFor,
+        const PopulateFn &populate) : jobSystem_{jobSystem}, worlds_(worldCount)
+    {
+        jobSystem_.parallelFor(worldCount, [&](uint32_t begin, uint32_t end)
+                               {
+            for (uint32_t i = begin; i < end; i++)
+            {
+                worlds_[i] = std::make_unique<VpePhysicsWorld>(jobSystem_, settingsFor(i));
+                populate(*worlds_[i], i);
+            } });
+    }
+
+    void VpeBatchSimulation::step(float dt, uint32_t stepCount)
+    {
+        // One world is the smallest piece of work, the pool splits the rest as threads run dry.
+        jobSystem_.parallelFor(worldCount(), [this, dt, stepCount](uint32_t begin, uint32_t end)
+                               {
+            for (uint32_t i = begin; i < end; i++)
+            {
+                for (uint32_t s = 0; s < stepCount; s++)
+                {
+                    worlds_[i]->step(dt);
+                }
+            } });
+        worldSteps_ += static_cast<uint64_t>(worldCount()) * stepCount;
+    }
+} // namespace vpe
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "VpeJobSystem.hpp"
+#include "VpePhysicsWorld.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace vpe
+{
+    // Lots of small, completely independent physics worlds, for parameter sweeps. Instead of
+    // splitting one world's step across the pool, every worker takes whole worlds and steps them
+    // on its own, so there's nothing to synchronize and world-steps per second grow with the cores.
+    //
+    // Worlds below VpePhysicsWorld's parallel threshold never fork tasks of their own, so that's the
+    // sweet spot. Bigger ones still work, their inner loops just compete with the other worlds.
+    class VpeBatchSimulation
+    {
+    public:
+        // Settings for world i, so each one can get its own point of the sweep.
+        using SettingsFn = std::function<VpePhysicsSettings(uint32_t world)>;
+        // Fills world i with bodies. Called on whichever worker will most likely step it, so its
+        // memory ends up close to that core. Has to be thread safe, worlds get filled in parallel.
+        using PopulateFn = std::function<void(VpePhysicsWorld &world, uint32_t index)>;
+
+        VpeBatchSimulation(VpeJobSystem &jobSystem, uint32_t worldCount, const SettingsFn &settingsFor, const PopulateFn &populate);
+
+        VpeBatchSimulation(const VpeBatchSimulation &) = delete;
+        VpeBatchSimulation &operator=(const VpeBatchSimulation &) = delete;
+
+        // Steps every world stepCount times. Each task runs all the steps for its worlds in one go,
+        // so a world stays in one core's cache for the whole call instead of bouncing around every step.
+        void step(float dt, uint32_t stepCount = 1);
+
+        uint32_t worldCount() const { return static_cast<uint32_t>(worlds_.size()); }
+        VpePhysicsWorld &world(uint32_t index) { return *worlds_[index]; }
+        const VpePhysicsWorld &world(uint32_t index) const { return *worlds_[index]; }
+        // Total over all worlds since construction.
+        uint64_t worldSteps() const { return worldSteps_; }
+
+    private:
+        VpeJobSystem &jobSystem_;
+        std::vector<std::unique_ptr<VpePhysicsWorld>> worlds_;
+        uint64_t worldSteps_ = 0;
+    };
+} // namespace vpe
@@ -0,0 +1,46 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+namespace vpe
+{
+    // Every shape here is a core grown by a radius. A sphere is a point with a radius, a capsule
+    // a segment with one, boxes and convex hulls are just their points with no radius at all.
+    // That way GJK, EPA and the manifold clipping only ever look at a handful of core points,
+    // whatever the shape.
+    //
+    // Bodies don't rotate yet, so shapes are given in world orientation and keep it.
+    // Plain data on purpose: the world keeps them in one array and snapshots them as raw bytes.
+    struct VpeCollisionShape
+    {
+        enum class Type : uint32_t
+        {
+            Sphere = 0,
+            Capsule = 1,
+            Box = 2,
+            ConvexHull = 3,
+        };
+
+        Type type = Type::Sphere;
+        float radius = 0.0f;
+        // Boxes only: the axes as columns and the half size along each, for the SAT test.
+        glm::mat3 axes{1.0f};
+        glm::vec3 halfExtents{0.0f};
+        // The core points, a range in the world's shared point array, relative to the body position.
+        uint32_t firstPoint = 0;
+        uint32_t pointCount = 0;
+    };
+
+    // A shape placed somewhere, what the narrowphase works on.
+    struct VpeConvex
+    {
+        const VpeCollisionShape *shape;
+        // shape->pointCount of them, already offset to the shape's own range.
+        const glm::vec3 *points;
+        glm::vec3 position;
+    };
+} // namespace vpe
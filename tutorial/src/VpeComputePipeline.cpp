@@ -0,0 +1,69 @@
+#include "VpeComputePipeline.hpp"
+#include "VpePipeline.hpp"
+
+#include <cassert>
+#include <stdexcept>
+
+namespace vpe
+{
+    VpeComputePipeline::VpeComputePipeline(
+        VpeDevice &device,
+        const fs::path &compFilePath,
+        VkPipelineLayout pipelineLayout) : vpeDevice_{device}
+    {
+        createComputePipeline(compFilePath, pipelineLayout);
+    }
+
+    VpeComputePipeline::~VpeComputePipeline()
+    {
+        vkDestroyShaderModule(vpeDevice_.device(), compShaderModule_, nullptr);
+        vkDestroyPipeline(vpeDevice_.device(), computePipeline_, nullptr);
+    }
+
+    void VpeComputePipeline::bind(VkCommandBuffer commandBuffer)
+    {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline_);
+    }
+
+    void VpeComputePipeline::dispatch(VkCommandBuffer commandBuffer, uint32_t invocationCount, uint32_t workgroupSize)
+    {
+        // Round up, the shaders bounds check the last partial group themselves.
+        uint32_t groupCount = (invocationCount + workgroupSize - 1) / workgroupSize;
+        vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+    }
+
+    void VpeComputePipeline::createComputePipeline(const fs::path &compFilePath, VkPipelineLayout pipelineLayout)
+    {
+        assert(pipelineLayout != VK_NULL_HANDLE && "Compute pipeline needs a pipelineLayout.");
+
+        auto compCode = VpePipeline::readFile(compFilePath);
+
+        VkShaderModuleCreateInfo moduleInfo{};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = compCode.size();
+        moduleInfo.pCode = reinterpret_cast<const uint32_t *>(compCode.data());
+
+        if (vkCreateShaderModule(vpeDevice_.device(), &moduleInfo, nullptr, &compShaderModule_) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create shader module.");
+        }
+
+        VkPipelineShaderStageCreateInfo stageInfo{};
+        stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        stageInfo.module = compShaderModule_;
+        stageInfo.pName = "main";
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage = stageInfo;
+        pipelineInfo.layout = pipelineLayout;
+        pipelineInfo.basePipelineIndex = -1;
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+        if (vkCreateComputePipelines(vpeDevice_.device(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &computePipeline_) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create compute pipeline.");
+        }
+    }
+} // namespace vpe
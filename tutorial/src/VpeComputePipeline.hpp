@@ -0,0 +1,36 @@
+#pragma once
+
+#include "VpeDevice.hpp"
+
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace vpe
+{
+    // The compute version of VpePipeline. Way simpler, there's no fixed function state at all,
+    // just one shader and the layout that says what buffers and push constants it gets.
+    class VpeComputePipeline
+    {
+    public:
+        VpeComputePipeline(
+            VpeDevice &device,
+            const fs::path &compFilePath,
+            VkPipelineLayout pipelineLayout);
+        ~VpeComputePipeline();
+
+        VpeComputePipeline(const VpeComputePipeline &) = delete;
+        void operator=(const VpeComputePipeline &) = delete;
+
+        void bind(VkCommandBuffer commandBuffer);
+        // Enough workgroups to cover invocationCount, for shaders with local_size_x = workgroupSize.
+        void dispatch(VkCommandBuffer commandBuffer, uint32_t invocationCount, uint32_t workgroupSize = 256);
+
+    private:
+        void createComputePipeline(const fs::path &compFilePath, VkPipelineLayout pipelineLayout);
+
+        VpeDevice &vpeDevice_;
+        VkPipeline computePipeline_;
+        VkShaderModule compShaderModule_;
+    };
+} // namespace vpe
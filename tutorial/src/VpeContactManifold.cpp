@@ -0,0 +1,53 @@
+#include "VpeContactManifold.hpp"
+
+namespace vpe
+{
+    uint32_t VpeManifoldPool::find(uint32_t bodyA, uint32_t bodyB) const
+    {
+        auto it = index_.find(keyOf(bodyA, bodyB));
+        return it == index_.end() ? NONE : it->second;
+    }
+
+    uint32_t VpeManifoldPool::create(uint32_t bodyA, uint32_t bodyB)
+    {
+        uint32_t index;
+        if (!free_.empty())
+        {
+            index = free_.back();
+            free_.pop_back();
+        }
+        else
+        {
+            index = capacity();
+            manifolds_.emplace_back();
+        }
+        VpeContactManifold &manifold = manifolds_[index];
+        manifold = VpeContactManifold{};
+        manifold.bodyA = bodyA;
+        manifold.bodyB = bodyB;
+        index_.emplace(keyOf(bodyA, bodyB), index);
+        return index;
+    }
+
+    void VpeManifoldPool::releaseOlderThan(uint32_t step)
+    {
+        for (uint32_t index = 0; index < capacity(); index++)
+        {
+            VpeContactManifold &manifold = manifolds_[index];
+            if (manifold.pointCount == 0 || manifold.lastStep >= step)
+            {
+                continue;
+            }
+            index_.erase(keyOf(manifold.bodyA, manifold.bodyB));
+            manifold.pointCount = 0;
+            free_.push_back(index);
+        }
+    }
+
+    void VpeManifoldPool::clear()
+    {
+        manifolds_.clear();
+        free_.clear();
+        index_.clear();
+    }
+} // namespace vpe
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "VpeNarrowphase.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace vpe
+{
+    struct VpeManifoldPoint
+    {
+        // Where the point is relative to body A, that's how it gets found again next step.
+        glm::vec3 anchor;
+        float penetration;
+        // What the solver ended up pushing with last time, the next step starts from there.
+        float normalImpulse;
+        float tangentImpulse1;
+        float tangentImpulse2;
+    };
+
+    // Everything two bodies touch with, up to four points sharing one normal. Lives as long as the
+    // two keep touching, so the impulses of one step can warm start the next.
+    struct VpeContactManifold
+    {
+        uint32_t bodyA;
+        // NO_BODY means the ground.
+        uint32_t bodyB;
+        // Points from B to A, the tangents are VpeNarrowphase::tangentBasis of it.
+        glm::vec3 normal;
+        glm::vec3 tangent1;
+        glm::vec3 tangent2;
+        uint32_t pointCount;
+        // The step that last found this pair touching, anything older gets dropped.
+        uint32_t lastStep;
+        VpeManifoldPoint points[VpeNarrowphase::MAX_POINTS];
+    };
+
+    // All the manifolds in one array, looked up by pair. Slots never move: a manifold keeps its
+    // index for as long as it lives and freed slots get reused, so the array doesn't get rebuilt
+    // or reallocated every step and pointers into it stay good through a step.
+    class VpeManifoldPool
+    {
+    public:
+        static constexpr uint32_t NONE = ~0u;
+
+        // Only reads, so any number of threads can look things up at once (as long as nobody creates or frees).
+        uint32_t find(uint32_t bodyA, uint32_t bodyB) const;
+        // A fresh manifold for a pair that doesn't have one yet.
+        uint32_t create(uint32_t bodyA, uint32_t bodyB);
+        // Frees every manifold that wasn't touched in step.
+        void releaseOlderThan(uint32_t step);
+        void clear();
+
+        VpeContactManifold &operator[](uint32_t index) { return manifolds_[index]; }
+        const VpeContactManifold &operator[](uint32_t index) const { return manifolds_[index]; }
+        // Slots, free ones included.
+        uint32_t capacity() const { return static_cast<uint32_t>(manifolds_.size()); }
+        uint32_t liveCount() const { return static_cast<uint32_t>(index_.size()); }
+        bool isLive(uint32_t index) const { return manifolds_[index].pointCount > 0; }
+
+    private:
+        static uint64_t keyOf(uint32_t bodyA, uint32_t bodyB)
+        {
+            return (static_cast<uint64_t>(bodyA) << 32) | bodyB;
+        }
+
+        std::vector<VpeContactManifold> manifolds_;
+        std::vector<uint32_t> free_;
+        std::unordered_map<uint64_t, uint32_t> index_;
+    };
+} // namespace vpe
@@ -0,0 +1,71 @@
+#include "VpeCullingScene.hpp"
+
+namespace vpe
+{
+    VpeCullingScene::VpeCullingScene(VpeJobSystem &jobSystem) : jobSystem_{jobSystem}
+    {
+    }
+
+    uint32_t VpeCullingScene::addObject(const VpeAabb &bounds, bool dynamic)
+    {
+        Tree &tree = dynamic ? dynamic_ : static_;
+        uint32_t id = static_cast<uint32_t>(objects_.size());
+        objects_.push_back(Object{dynamic, static_cast<uint32_t>(tree.boxes.size())});
+        tree.boxes.push_back(bounds);
+        tree.ids.push_back(id);
+        tree.structureDirty = true;
+        return id;
+    }
+
+    void VpeCullingScene::setBounds(uint32_t id, const VpeAabb &bounds)
+    {
+        const Object &object = objects_[id];
+        Tree &tree = object.dynamic ? dynamic_ : static_;
+        tree.boxes[object.index] = bounds;
+        if (object.dynamic)
+        {
+            tree.boundsDirty = true;
+        }
+        else
+        {
+            tree.structureDirty = true;
+        }
+    }
+
+    const VpeAabb &VpeCullingScene::bounds(uint32_t id) const
+    {
+        const Object &object = objects_[id];
+        return (object.dynamic ? dynamic_ : static_).boxes[object.index];
+    }
+
+    void VpeCullingScene::update()
+    {
+        for (Tree *tree : {&static_, &dynamic_})
+        {
+            if (tree->boundsDirty && tree->refitsSinceBuild >= DYNAMIC_REBUILD_INTERVAL)
+            {
+                tree->structureDirty = true;
+            }
+
+            if (tree->structureDirty)
+            {
+                tree->bvh.build(tree->boxes.data(), tree->ids.data(), static_cast<uint32_t>(tree->boxes.size()));
+                tree->refitsSinceBuild = 0;
+            }
+            else if (tree->boundsDirty)
+            {
+                tree->bvh.refit(tree->boxes.data());
+                tree->refitsSinceBuild++;
+            }
+            tree->structureDirty = false;
+            tree->boundsDirty = false;
+        }
+    }
+
+    void VpeCullingScene::cull(const VpeFrustum &frustum, std::vector<uint32_t> &visible) const
+    {
+        visible.clear();
+        static_.bvh.cull(jobSystem_, frustum, visible);
+        dynamic_.bvh.cull(jobSystem_, frustum, visible);
+    }
+} // namespace vpe
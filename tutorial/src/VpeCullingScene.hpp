@@ -0,0 +1,70 @@
+#pragma once
+
+#include "VpeFrustum.hpp"
+#include "VpeJobSystem.hpp"
+#include "VpeSceneBvh.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace vpe
+{
+    // Flat list of objects with bounds, culled on the CPU. The visible ids come out as one list
+    // that command recording can walk directly.
+    //
+    // Static and dynamic objects live in separate trees. The static one gets built once and then
+    // left alone. The dynamic one is refit every update, and rebuilt from scratch every so often
+    // because refitting only ever stretches the boxes and the tree slowly stops making sense.
+    class VpeCullingScene
+    {
+    public:
+        // Refits between full rebuilds of the dynamic tree.
+        static constexpr uint32_t DYNAMIC_REBUILD_INTERVAL = 60;
+
+        explicit VpeCullingScene(VpeJobSystem &jobSystem);
+
+        VpeCullingScene(const VpeCullingScene &) = delete;
+        VpeCullingScene &operator=(const VpeCullingScene &) = delete;
+
+        // Returns the id cull reports the object as. Ids are handed out in order from 0.
+        uint32_t addObject(const VpeAabb &bounds, bool dynamic);
+        // Cheap for dynamic objects. Moving a static one means rebuilding the static tree.
+        void setBounds(uint32_t id, const VpeAabb &bounds);
+        const VpeAabb &bounds(uint32_t id) const;
+
+        // Brings the trees up to date with everything added and moved since the last one.
+        // Call once a frame before cull.
+        void update();
+
+        // Replaces visible with the ids of every object that touches the frustum.
+        void cull(const VpeFrustum &frustum, std::vector<uint32_t> &visible) const;
+
+        uint32_t objectCount() const { return static_cast<uint32_t>(objects_.size()); }
+
+    private:
+        struct Object
+        {
+            bool dynamic;
+            // Index into the static or dynamic arrays below.
+            uint32_t index;
+        };
+
+        // One tree and the objects in it, boxes[i] belongs to ids[i].
+        struct Tree
+        {
+            VpeSceneBvh bvh;
+            std::vector<VpeAabb> boxes;
+            std::vector<uint32_t> ids;
+            // Something was added, so the tree needs a full build.
+            bool structureDirty = false;
+            // Only bounds changed.
+            bool boundsDirty = false;
+            uint32_t refitsSinceBuild = 0;
+        };
+
+        VpeJobSystem &jobSystem_;
+        std::vector<Object> objects_;
+        Tree static_;
+        Tree dynamic_;
+    };
+} // namespace vpe
@@ -0,0 +1,329 @@
+#include "VpeDepthPyramid.hpp"
+#include "VpeComputePipeline.hpp"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+namespace vpe
+{
+    namespace
+    {
+        uint32_t previousPowerOfTwo(uint32_t value)
+        {
+            uint32_t result = 1;
+            while (result * 2 <= value)
+            {
+                result *= 2;
+            }
+            return result;
+        }
+
+        struct PyramidPushConstants
+        {
+            int32_t sourceWidth;
+            int32_t sourceHeight;
+            int32_t destinationWidth;
+            int32_t destinationHeight;
+        };
+
+        constexpr uint32_t GROUP_SIZE = 8;
+    }
+
+    VpeDepthPyramid::VpeDepthPyramid(VpeDevice &device, VpeSwapChain &swapChain) : vpeDevice_{device},
+                                                                                   vpeSwapChain_{swapChain}
+    {
+        width_ = previousPowerOfTwo(swapChain.width());
+        height_ = previousPowerOfTwo(swapChain.height());
+        levelCount_ = 1;
+        while ((std::max(width_, height_) >> levelCount_) > 0)
+        {
+            levelCount_++;
+        }
+
+        VkFormat depthFormat = swapChain.findDepthFormat();
+        depthHasStencil_ = depthFormat == VK_FORMAT_D32_SFLOAT_S8_UINT || depthFormat == VK_FORMAT_D24_UNORM_S8_UINT;
+
+        createImage();
+        createDescriptors();
+        createPipeline();
+    }
+
+    VpeDepthPyramid::~VpeDepthPyramid()
+    {
+        pipeline_.reset();
+        vkDestroyPipelineLayout(vpeDevice_.device(), pipelineLayout_, nullptr);
+        vkDestroyDescriptorPool(vpeDevice_.device(), descriptorPool_, nullptr);
+        vkDestroyDescriptorSetLayout(vpeDevice_.device(), descriptorSetLayout_, nullptr);
+        vkDestroySampler(vpeDevice_.device(), sampler_, nullptr);
+        for (auto view : levelViews_)
+        {
+            vkDestroyImageView(vpeDevice_.device(), view, nullptr);
+        }
+        vkDestroyImageView(vpeDevice_.device(), fullView_, nullptr);
+        vkDestroyImage(vpeDevice_.device(), image_, nullptr);
+        vkFreeMemory(vpeDevice_.device(), imageMemory_, nullptr);
+    }
+
+    void VpeDepthPyramid::recordBuild(VkCommandBuffer commandBuffer) const
+    {
+        // The depth attachment goes from being drawn into to being read. In the same barrier,
+        // wait for the culling pass that read the pyramid last before we overwrite it.
+        VkImageMemoryBarrier depthBarrier{};
+        depthBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        depthBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        depthBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+        depthBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        depthBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        depthBarrier.image = vpeSwapChain_.getDepthImage();
+        // Layout changes on a depth + stencil image have to cover both aspects.
+        depthBarrier.subresourceRange.aspectMask =
+            VK_IMAGE_ASPECT_DEPTH_BIT | (depthHasStencil_ ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
+        depthBarrier.subresourceRange.baseMipLevel = 0;
+        depthBarrier.subresourceRange.levelCount = 1;
+        depthBarrier.subresourceRange.baseArrayLayer = 0;
+        depthBarrier.subresourceRange.layerCount = 1;
+
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &depthBarrier);
+
+        pipeline_->bind(commandBuffer);
+
+        uint32_t sourceWidth = vpeSwapChain_.width();
+        uint32_t sourceHeight = vpeSwapChain_.height();
+        for (uint32_t level = 0; level < levelCount_; level++)
+        {
+            uint32_t levelWidth = std::max(1u, width_ >> level);
+            uint32_t levelHeight = std::max(1u, height_ >> level);
+
+            vkCmdBindDescriptorSets(
+                commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout_, 0, 1, &levelSets_[level], 0, nullptr);
+
+            PyramidPushConstants push{
+                static_cast<int32_t>(sourceWidth),
+                static_cast<int32_t>(sourceHeight),
+                static_cast<int32_t>(levelWidth),
+                static_cast<int32_t>(levelHeight)};
+            vkCmdPushConstants(
+                commandBuffer, pipelineLayout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PyramidPushConstants), &push);
+            vkCmdDispatch(
+                commandBuffer,
+                (levelWidth + GROUP_SIZE - 1) / GROUP_SIZE,
+                (levelHeight + GROUP_SIZE - 1) / GROUP_SIZE,
+                1);
+
+            // The next level reads this one, and after the last one it's the culling pass that reads.
+            VkMemoryBarrier levelBarrier{};
+            levelBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            vkCmdPipelineBarrier(
+                commandBuffer,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                0, 1, &levelBarrier, 0, nullptr, 0, nullptr);
+
+            sourceWidth = levelWidth;
+            sourceHeight = levelHeight;
+        }
+    }
+
+    void VpeDepthPyramid::createImage()
+    {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent.width = width_;
+        imageInfo.extent.height = height_;
+        imageInfo.extent.depth = 1;
+        imageInfo.mipLevels = levelCount_;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = VK_FORMAT_R32_SFLOAT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        vpeDevice_.createImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image_, imageMemory_);
+
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = image_;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = VK_FORMAT_R32_SFLOAT;
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.baseMipLevel = 0;
+        viewInfo.subresourceRange.levelCount = levelCount_;
+        viewInfo.subresourceRange.baseArrayLayer = 0;
+        viewInfo.subresourceRange.layerCount = 1;
+        if (vkCreateImageView(vpeDevice_.device(), &viewInfo, nullptr, &fullView_) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create depth pyramid view.");
+        }
+
+        levelViews_.resize(levelCount_);
+        for (uint32_t level = 0; level < levelCount_; level++)
+        {
+            viewInfo.subresourceRange.baseMipLevel = level;
+            viewInfo.subresourceRange.levelCount = 1;
+            if (vkCreateImageView(vpeDevice_.device(), &viewInfo, nullptr, &levelViews_[level]) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to create depth pyramid level view.");
+            }
+        }
+
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_NEAREST;
+        samplerInfo.minFilter = VK_FILTER_NEAREST;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.minLod = 0.0f;
+        samplerInfo.maxLod = static_cast<float>(levelCount_);
+        if (vkCreateSampler(vpeDevice_.device(), &samplerInfo, nullptr, &sampler_) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create depth pyramid sampler.");
+        }
+
+        // Start out as "everything is at the far plane", so nothing gets culled
+        // before the first real pyramid exists. It stays in GENERAL from here on.
+        VkCommandBuffer commandBuffer = vpeDevice_.beginSingleTimeCommands();
+        VkImageMemoryBarrier toGeneral{};
+        toGeneral.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        toGeneral.srcAccessMask = 0;
+        toGeneral.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        toGeneral.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        toGeneral.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        toGeneral.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toGeneral.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toGeneral.image = image_;
+        toGeneral.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount_, 0, 1};
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &toGeneral);
+
+        VkClearColorValue farPlane{};
+        farPlane.float32[0] = 1.0f;
+        vkCmdClearColorImage(commandBuffer, image_, VK_IMAGE_LAYOUT_GENERAL, &farPlane, 1, &toGeneral.subresourceRange);
+
+        VkMemoryBarrier clearBarrier{};
+        clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+        vpeDevice_.endSingleTimeCommands(commandBuffer);
+    }
+
+    void VpeDepthPyramid::createDescriptors()
+    {
+        std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+        bindings[0].binding = 0;
+        bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        bindings[0].descriptorCount = 1;
+        bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        bindings[1].binding = 1;
+        bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        bindings[1].descriptorCount = 1;
+        bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+        if (vkCreateDescriptorSetLayout(vpeDevice_.device(), &layoutInfo, nullptr, &descriptorSetLayout_) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create depth pyramid descriptor set layout.");
+        }
+
+        uint32_t setCount = levelCount_;
+
+        std::array<VkDescriptorPoolSize, 2> poolSizes{};
+        poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        poolSizes[0].descriptorCount = setCount;
+        poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        poolSizes[1].descriptorCount = setCount;
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.maxSets = setCount;
+        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.data();
+        if (vkCreateDescriptorPool(vpeDevice_.device(), &poolInfo, nullptr, &descriptorPool_) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create depth pyramid descriptor pool.");
+        }
+
+        std::vector<VkDescriptorSetLayout> layouts(setCount, descriptorSetLayout_);
+        levelSets_.resize(setCount);
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = descriptorPool_;
+        allocInfo.descriptorSetCount = setCount;
+        allocInfo.pSetLayouts = layouts.data();
+        if (vkAllocateDescriptorSets(vpeDevice_.device(), &allocInfo, levelSets_.data()) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to allocate depth pyramid descriptor sets.");
+        }
+
+        auto writeSet = [this](VkDescriptorSet set, VkImageView source, VkImageLayout sourceLayout, VkImageView destination)
+        {
+            VkDescriptorImageInfo sourceInfo{sampler_, source, sourceLayout};
+            VkDescriptorImageInfo destinationInfo{VK_NULL_HANDLE, destination, VK_IMAGE_LAYOUT_GENERAL};
+
+            std::array<VkWriteDescriptorSet, 2> writes{};
+            writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[0].dstSet = set;
+            writes[0].dstBinding = 0;
+            writes[0].descriptorCount = 1;
+            writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            writes[0].pImageInfo = &sourceInfo;
+            writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[1].dstSet = set;
+            writes[1].dstBinding = 1;
+            writes[1].descriptorCount = 1;
+            writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            writes[1].pImageInfo = &destinationInfo;
+            vkUpdateDescriptorSets(vpeDevice_.device(), static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+        };
+
+        writeSet(levelSets_[0], vpeSwapChain_.getDepthImageView(), VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, levelViews_[0]);
+        for (uint32_t level = 1; level < levelCount_; level++)
+        {
+            writeSet(levelSets_[level], levelViews_[level - 1], VK_IMAGE_LAYOUT_GENERAL, levelViews_[level]);
+        }
+    }
+
+    void VpeDepthPyramid::createPipeline()
+    {
+        VkPushConstantRange pushRange{};
+        pushRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushRange.offset = 0;
+        pushRange.size = sizeof(PyramidPushConstants);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout_;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushRange;
+        if (vkCreatePipelineLayout(vpeDevice_.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout_) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create depth pyramid pipeline layout.");
+        }
+
+        pipeline_ = std::make_unique<VpeComputePipeline>(vpeDevice_, "shaders/DepthPyramid.comp.spv", pipelineLayout_);
+    }
+} // namespace vpe
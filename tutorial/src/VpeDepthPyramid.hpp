@@ -0,0 +1,66 @@
+#pragma once
+
+#include "VpeDevice.hpp"
+#include "VpeSwapChain.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace vpe
+{
+    class VpeComputePipeline;
+
+    // Hierarchical depth (HiZ) built from the depth attachment at the end of a frame.
+    // Every level halves the size and keeps the farthest depth of the texels below it,
+    // so the culling pass can ask "is this rectangle completely hidden" with four reads.
+    //
+    // Level 0 is the depth size rounded down to a power of two, which makes all the
+    // other levels an exact 2x2 reduction.
+    class VpeDepthPyramid
+    {
+    public:
+        VpeDepthPyramid(VpeDevice &device, VpeSwapChain &swapChain);
+        ~VpeDepthPyramid();
+
+        VpeDepthPyramid(const VpeDepthPyramid &) = delete;
+        VpeDepthPyramid &operator=(const VpeDepthPyramid &) = delete;
+
+        // Record after the render pass, the swapchain's depth buffer has to have been stored.
+        // Leaves the pyramid readable by compute shaders.
+        void recordBuild(VkCommandBuffer commandBuffer) const;
+
+        // All levels, in VK_IMAGE_LAYOUT_GENERAL. Sample with texelFetch, the sampler is nearest.
+        VkImageView imageView() const { return fullView_; }
+        VkSampler sampler() const { return sampler_; }
+        uint32_t width() const { return width_; }
+        uint32_t height() const { return height_; }
+        uint32_t levelCount() const { return levelCount_; }
+
+    private:
+        void createImage();
+        void createDescriptors();
+        void createPipeline();
+
+        VpeDevice &vpeDevice_;
+        VpeSwapChain &vpeSwapChain_;
+        uint32_t width_;
+        uint32_t height_;
+        uint32_t levelCount_;
+        bool depthHasStencil_;
+
+        VkImage image_;
+        VkDeviceMemory imageMemory_;
+        VkImageView fullView_;
+        // One per level, level i is written through its view and read by level i + 1.
+        std::vector<VkImageView> levelViews_;
+        VkSampler sampler_;
+
+        VkDescriptorSetLayout descriptorSetLayout_;
+        VkDescriptorPool descriptorPool_;
+        // Set i writes level i. Level 0 reads the depth buffer, the rest read the level above.
+        std::vector<VkDescriptorSet> levelSets_;
+        VkPipelineLayout pipelineLayout_;
+        std::unique_ptr<VpeComputePipeline> pipeline_;
+    };
+} // namespace vpe
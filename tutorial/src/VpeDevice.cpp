@@ -4,6 +4,9 @@
 // THIS CODE WAS COPIED FROM THE TUTORIAL
 
 // std headers
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <set>
@@ -57,15 +60,97 @@ namespace vpe
     }
   }
 
+  static const char *deviceTypeName(VkPhysicalDeviceType type)
+  {
+    switch (type)
+    {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+      return "discrete";
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+      return "integrated";
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+      return "virtual";
+    case VK_PHYSICAL_DEVICE_TYPE_CPU:
+      return "cpu";
+    default:
+      return "other";
+    }
+  }
+
+  static std::string toLower(std::string text)
+  {
+    std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c)
+                   { return static_cast<char>(std::tolower(c)); });
+    return text;
+  }
+
   // class member functions
-  VpeDevice::VpeDevice(VpeWindow &window) : window{window}
+  VpeDevice::VpeDevice(VpeWindow &window, VpeJobSystem *jobSystem, VpeStartupTrace *startupTrace)
+      : VpeDevice(&window, jobSystem, startupTrace)
+  {
+  }
+
+  VpeDevice::VpeDevice(VpeWindow *window, VpeJobSystem *jobSystem, VpeStartupTrace *startupTrace) : window{window}
   {
-    createInstance();
-    setupDebugMessenger();
-    createSurface();
-    pickPhysicalDevice();
-    createLogicalDevice();
-    createCommandPool();
+    // The instance only needs GLFW, not the window. Loading the loader, the drivers and the layers
+    // is one of the slowest bits of startup, so it goes to a worker while this thread opens the window.
+    auto setupInstance = [this, startupTrace]()
+    {
+      VpeStartupTrace::Scope phase{startupTrace, "instance"};
+      createInstance();
+      setupDebugMessenger();
+    };
+    VpeJobSystem::TaskHandle instanceTask;
+    if (jobSystem != nullptr)
+    {
+      instanceTask = jobSystem->run(setupInstance);
+    }
+    else
+    {
+      setupInstance();
+    }
+
+    try
+    {
+      if (window != nullptr)
+      {
+        VpeStartupTrace::Scope phase{startupTrace, "window"};
+        window->open();
+      }
+    }
+    catch (...)
+    {
+      // The worker still has this, let it finish before we're gone.
+      if (instanceTask)
+      {
+        try
+        {
+          jobSystem->wait(instanceTask);
+        }
+        catch (...)
+        {
+        }
+      }
+      throw;
+    }
+    if (instanceTask)
+    {
+      jobSystem->wait(instanceTask);
+    }
+
+    {
+      VpeStartupTrace::Scope phase{startupTrace, "surface"};
+      createSurface();
+    }
+    {
+      VpeStartupTrace::Scope phase{startupTrace, "physical device"};
+      pickPhysicalDevice();
+    }
+    {
+      VpeStartupTrace::Scope phase{startupTrace, "logical device"};
+      createLogicalDevice();
+      createCommandPool();
+    }
   }
 
   VpeDevice::~VpeDevice()
@@ -78,7 +163,10 @@ namespace vpe
       DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
     }
 
-    vkDestroySurfaceKHR(instance, surface_, nullptr);
+    if (surface_ != VK_NULL_HANDLE)
+    {
+      vkDestroySurfaceKHR(instance, surface_, nullptr);
+    }
     vkDestroyInstance(instance, nullptr);
   }
 
@@ -95,7 +183,20 @@ namespace vpe
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.pEngineName = "No Engine";
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    // Ask for 1.3, or whatever is the most the loader can do. A 1.0 loader doesn't have
+    // vkEnumerateInstanceVersion and refuses any other apiVersion, so only ask for more when it says it can.
+    auto enumerateInstanceVersion = (PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(
+        nullptr,
+        "vkEnumerateInstanceVersion");
+    uint32_t loaderVersion = VK_API_VERSION_1_0;
+    if (enumerateInstanceVersion != nullptr)
+    {
+      enumerateInstanceVersion(&loaderVersion);
+    }
+    instanceApiVersion = VK_MAKE_API_VERSION(
+        0, VK_API_VERSION_MAJOR(loaderVersion), VK_API_VERSION_MINOR(loaderVersion), 0);
+    instanceApiVersion = std::min<uint32_t>(instanceApiVersion, VK_API_VERSION_1_3);
+    appInfo.apiVersion = instanceApiVersion;
 
     VkInstanceCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -139,30 +240,164 @@ namespace vpe
     std::vector<VkPhysicalDevice> devices(deviceCount);
     vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
 
-    for (const auto &device : devices)
+    // The first suitable one is often the integrated GPU on laptops, so rank them all instead.
+    struct Candidate
     {
-      if (isDeviceSuitable(device))
+      VkPhysicalDevice device;
+      uint32_t index;
+      VkPhysicalDeviceProperties properties;
+      bool suitable;
+      uint64_t score;
+    };
+    std::vector<Candidate> candidates;
+    for (uint32_t i = 0; i < deviceCount; i++)
+    {
+      Candidate candidate{devices[i], i, {}, isDeviceSuitable(devices[i]), 0};
+      vkGetPhysicalDeviceProperties(devices[i], &candidate.properties);
+      if (candidate.suitable)
       {
-        physicalDevice = device;
-        break;
+        candidate.score = rateDevice(devices[i]);
       }
+      candidates.push_back(candidate);
     }
+    std::stable_sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b)
+                     { return a.suitable != b.suitable ? a.suitable : a.score > b.score; });
 
-    if (physicalDevice == VK_NULL_HANDLE)
+    SPDLOG_INFO("Physical devices, best first:");
+    for (const auto &candidate : candidates)
+    {
+      if (candidate.suitable)
+      {
+        SPDLOG_INFO("  [{}] {} ({}), score {}", candidate.index, candidate.properties.deviceName,
+                    deviceTypeName(candidate.properties.deviceType), candidate.score);
+      }
+      else
+      {
+        SPDLOG_INFO("  [{}] {} ({}), not suitable", candidate.index, candidate.properties.deviceName,
+                    deviceTypeName(candidate.properties.deviceType));
+      }
+    }
+
+    const Candidate *chosen = candidates.front().suitable ? &candidates.front() : nullptr;
+    const char *requested = std::getenv(DEVICE_OVERRIDE_VARIABLE);
+    if (requested != nullptr && requested[0] != '\0')
+    {
+      // All digits is an index, anything else is matched against the names, ignoring case.
+      std::string request = requested;
+      bool isIndex = std::all_of(request.begin(), request.end(), [](unsigned char c)
+                                 { return std::isdigit(c) != 0; });
+      const Candidate *match = nullptr;
+      for (const auto &candidate : candidates)
+      {
+        bool matches = isIndex ? std::to_string(candidate.index) == request
+                               : toLower(candidate.properties.deviceName).find(toLower(request)) != std::string::npos;
+        if (matches)
+        {
+          match = &candidate;
+          break;
+        }
+      }
+      if (match != nullptr && match->suitable)
+      {
+        chosen = match;
+      }
+      else
+      {
+        SPDLOG_WARN("{}={} doesn't name a suitable device, using the best ranked one", DEVICE_OVERRIDE_VARIABLE, request);
+      }
+    }
+
+    if (chosen == nullptr)
     {
       throw std::runtime_error("failed to find a suitable GPU!");
     }
+    physicalDevice = chosen->device;
 
+    queueFamilies = findQueueFamilies(physicalDevice);
     vkGetPhysicalDeviceProperties(physicalDevice, &properties);
     SPDLOG_INFO("Physical device: {}", properties.deviceName);
+
+    queryFeatures();
+    SPDLOG_INFO("Rendering with {}", enabledFeatures.dynamicRendering ? "dynamic rendering" : "render passes");
+  }
+
+  void VpeDevice::queryFeatures()
+  {
+    VpeDeviceFeatures &features = enabledFeatures;
+    features = VpeDeviceFeatures{};
+    uint32_t deviceVersion = VK_MAKE_API_VERSION(
+        0, VK_API_VERSION_MAJOR(properties.apiVersion), VK_API_VERSION_MINOR(properties.apiVersion), 0);
+    features.apiVersion = std::min(instanceApiVersion, deviceVersion);
+
+    // Every struct in the chain has to be core in the version we're on, so it only gets as long as that allows.
+    VkPhysicalDeviceVulkan13Features features13 = {};
+    features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    VkPhysicalDeviceVulkan12Features features12 = {};
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    features12.pNext = features.apiVersion >= VK_API_VERSION_1_3 ? &features13 : nullptr;
+    VkPhysicalDeviceFeatures2 features2 = {};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = features.apiVersion >= VK_API_VERSION_1_2 ? &features12 : nullptr;
+    if (features.apiVersion >= VK_API_VERSION_1_1)
+    {
+      vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+    }
+    else
+    {
+      vkGetPhysicalDeviceFeatures(physicalDevice, &features2.features);
+    }
+
+    features.samplerAnisotropy = features2.features.samplerAnisotropy == VK_TRUE;
+    features.timelineSemaphore = features12.timelineSemaphore == VK_TRUE;
+    features.descriptorIndexing = features12.descriptorIndexing && features12.runtimeDescriptorArray &&
+                                  features12.descriptorBindingPartiallyBound &&
+                                  features12.descriptorBindingVariableDescriptorCount &&
+                                  features12.shaderSampledImageArrayNonUniformIndexing &&
+                                  features12.shaderStorageBufferArrayNonUniformIndexing;
+    features.bufferDeviceAddress = features12.bufferDeviceAddress == VK_TRUE;
+    features.synchronization2 = features13.synchronization2 == VK_TRUE;
+    features.dynamicRendering = enableDynamicRendering && features13.dynamicRendering == VK_TRUE;
+    features.maintenance4 = features13.maintenance4 == VK_TRUE;
+
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+    enabledExtensions = requiredDeviceExtensions();
+    // The optional ones all build on 1.1 (properties2 and friends), so a 1.0 device gets none of them.
+    for (const char *optional : optionalDeviceExtensions)
+    {
+      if (features.apiVersion < VK_API_VERSION_1_1)
+      {
+        break;
+      }
+      for (const auto &extension : availableExtensions)
+      {
+        if (strcmp(optional, extension.extensionName) == 0)
+        {
+          enabledExtensions.push_back(optional);
+          break;
+        }
+      }
+    }
+    features.memoryBudget = std::find_if(enabledExtensions.begin(), enabledExtensions.end(), [](const char *name)
+                                         { return strcmp(name, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0; }) !=
+                            enabledExtensions.end();
+
+    SPDLOG_INFO("Vulkan {}.{}: timeline semaphores {}, descriptor indexing {}, buffer device address {}, "
+                "synchronization2 {}, dynamic rendering {}, maintenance4 {}, memory budget {}",
+                VK_API_VERSION_MAJOR(features.apiVersion), VK_API_VERSION_MINOR(features.apiVersion),
+                features.timelineSemaphore, features.descriptorIndexing, features.bufferDeviceAddress,
+                features.synchronization2, features.dynamicRendering, features.maintenance4, features.memoryBudget);
   }
 
   void VpeDevice::createLogicalDevice()
   {
-    QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+    QueueFamilyIndices indices = queueFamilies;
 
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-    std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily, indices.presentFamily};
+    std::set<uint32_t> uniqueQueueFamilies = {
+        indices.graphicsFamily, indices.presentFamily, indices.computeFamily};
 
     float queuePriority = 1.0f;
     for (uint32_t queueFamily : uniqueQueueFamilies)
@@ -175,8 +410,28 @@ namespace vpe
       queueCreateInfos.push_back(queueCreateInfo);
     }
 
-    VkPhysicalDeviceFeatures deviceFeatures = {};
-    deviceFeatures.samplerAnisotropy = VK_TRUE;
+    // Only what queryFeatures found, turning on anything else fails device creation.
+    const VpeDeviceFeatures &features = enabledFeatures;
+    VkPhysicalDeviceVulkan13Features features13 = {};
+    features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    features13.synchronization2 = features.synchronization2;
+    features13.dynamicRendering = features.dynamicRendering;
+    features13.maintenance4 = features.maintenance4;
+    VkPhysicalDeviceVulkan12Features features12 = {};
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    features12.pNext = features.apiVersion >= VK_API_VERSION_1_3 ? &features13 : nullptr;
+    features12.timelineSemaphore = features.timelineSemaphore;
+    features12.bufferDeviceAddress = features.bufferDeviceAddress;
+    features12.descriptorIndexing = features.descriptorIndexing;
+    features12.runtimeDescriptorArray = features.descriptorIndexing;
+    features12.descriptorBindingPartiallyBound = features.descriptorIndexing;
+    features12.descriptorBindingVariableDescriptorCount = features.descriptorIndexing;
+    features12.shaderSampledImageArrayNonUniformIndexing = features.descriptorIndexing;
+    features12.shaderStorageBufferArrayNonUniformIndexing = features.descriptorIndexing;
+    VkPhysicalDeviceFeatures2 features2 = {};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = features.apiVersion >= VK_API_VERSION_1_2 ? &features12 : nullptr;
+    features2.features.samplerAnisotropy = features.samplerAnisotropy;
 
     VkDeviceCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -184,9 +439,20 @@ namespace vpe
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
-    createInfo.pEnabledFeatures = &deviceFeatures;
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+    // A 1.0 device doesn't know VkPhysicalDeviceFeatures2, it gets the plain struct instead.
+    if (features.apiVersion >= VK_API_VERSION_1_1)
+    {
+      createInfo.pNext = &features2;
+      createInfo.pEnabledFeatures = nullptr;
+    }
+    else
+    {
+      createInfo.pNext = nullptr;
+      createInfo.pEnabledFeatures = &features2.features;
+    }
+
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+    createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
     // might not really be necessary anymore because device specific validation layers
     // have been deprecated
@@ -207,6 +473,9 @@ namespace vpe
 
     vkGetDeviceQueue(device_, indices.graphicsFamily, 0, &graphicsQueue_);
     vkGetDeviceQueue(device_, indices.presentFamily, 0, &presentQueue_);
+    vkGetDeviceQueue(device_, indices.computeFamily, 0, &computeQueue_);
+    SPDLOG_INFO("Compute queue family {} ({})", indices.computeFamily,
+                indices.computeFamily == indices.graphicsFamily ? "shared with graphics" : "async");
   }
 
   void VpeDevice::createCommandPool()
@@ -225,7 +494,13 @@ namespace vpe
     }
   }
 
-  void VpeDevice::createSurface() { window.createWindowSurface(instance, &surface_); }
+  void VpeDevice::createSurface()
+  {
+    if (window != nullptr)
+    {
+      window->createWindowSurface(instance, &surface_);
+    }
+  }
 
   bool VpeDevice::isDeviceSuitable(VkPhysicalDevice device)
   {
@@ -233,8 +508,9 @@ namespace vpe
 
     bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-    bool swapChainAdequate = false;
-    if (extensionsSupported)
+    // Headless there's nothing to present to, so any swapchain support is fine.
+    bool swapChainAdequate = window == nullptr;
+    if (extensionsSupported && window != nullptr)
     {
       SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
       swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
@@ -247,6 +523,93 @@ namespace vpe
            supportedFeatures.samplerAnisotropy;
   }
 
+  uint64_t VpeDevice::rateDevice(VkPhysicalDevice device)
+  {
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(device, &deviceProperties);
+
+    // The type is the big one, a discrete GPU beats an integrated one no matter what comes after.
+    uint64_t score = 0;
+    switch (deviceProperties.deviceType)
+    {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+      score += 100000;
+      break;
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+      score += 10000;
+      break;
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+      score += 5000;
+      break;
+    case VK_PHYSICAL_DEVICE_TYPE_CPU:
+      score += 100;
+      break;
+    default:
+      score += 1000;
+      break;
+    }
+
+    // A point per 64 MiB of device local memory. Integrated GPUs tend to report a slice of
+    // system memory here, which is why the type counts for so much more.
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(device, &memoryProperties);
+    for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
+    {
+      if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+      {
+        score += memoryProperties.memoryHeaps[i].size / (64ull * 1024 * 1024);
+      }
+    }
+
+    // Separate compute and transfer families mean the physics and the uploads don't queue up behind drawing.
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilyProperties(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilyProperties.data());
+    bool dedicatedCompute = false;
+    bool dedicatedTransfer = false;
+    for (const auto &family : queueFamilyProperties)
+    {
+      if (family.queueCount == 0 || (family.queueFlags & VK_QUEUE_GRAPHICS_BIT))
+      {
+        continue;
+      }
+      if (family.queueFlags & VK_QUEUE_COMPUTE_BIT)
+      {
+        dedicatedCompute = true;
+      }
+      else if (family.queueFlags & VK_QUEUE_TRANSFER_BIT)
+      {
+        dedicatedTransfer = true;
+      }
+    }
+    score += dedicatedCompute ? 2000 : 0;
+    score += dedicatedTransfer ? 1000 : 0;
+
+    // Features we'd use if they're there.
+    if (deviceProperties.limits.timestampComputeAndGraphics)
+    {
+      score += 500;
+    }
+    if (enableDynamicRendering && instanceApiVersion >= VK_API_VERSION_1_3 &&
+        deviceProperties.apiVersion >= VK_API_VERSION_1_3)
+    {
+      VkPhysicalDeviceVulkan13Features features13 = {};
+      features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+      VkPhysicalDeviceFeatures2 features = {};
+      features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+      features.pNext = &features13;
+      vkGetPhysicalDeviceFeatures2(device, &features);
+      score += features13.dynamicRendering ? 1000 : 0;
+    }
+
+    // And a little for limits that tend to grow with how big the GPU is, mostly to break ties.
+    score += deviceProperties.limits.maxComputeSharedMemorySize / 1024;
+    score += deviceProperties.limits.maxImageDimension2D / 1024;
+
+    return score;
+  }
+
   void VpeDevice::populateDebugMessengerCreateInfo(
       VkDebugUtilsMessengerCreateInfoEXT &createInfo)
   {
@@ -305,11 +668,15 @@ namespace vpe
 
   std::vector<const char *> VpeDevice::getRequiredExtensions()
   {
-    uint32_t glfwExtensionCount = 0;
-    const char **glfwExtensions;
-    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-    std::vector<const char *> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    std::vector<const char *> extensions;
+    // GLFW's are the surface ones, which a headless device doesn't need (and GLFW isn't even up then).
+    if (window != nullptr)
+    {
+      uint32_t glfwExtensionCount = 0;
+      const char **glfwExtensions;
+      glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+      extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
 
     if (enableValidationLayers)
     {
@@ -319,6 +686,11 @@ namespace vpe
     return extensions;
   }
 
+  std::vector<const char *> VpeDevice::requiredDeviceExtensions()
+  {
+    return window != nullptr ? deviceExtensions : std::vector<const char *>{};
+  }
+
   void VpeDevice::hasGflwRequiredInstanceExtensions()
   {
     uint32_t extensionCount = 0;
@@ -358,7 +730,8 @@ namespace vpe
         &extensionCount,
         availableExtensions.data());
 
-    std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
+    std::vector<const char *> required = requiredDeviceExtensions();
+    std::set<std::string> requiredExtensions(required.begin(), required.end());
 
     for (const auto &extension : availableExtensions)
     {
@@ -381,14 +754,33 @@ namespace vpe
     int i = 0;
     for (const auto &queueFamily : queueFamilies)
     {
-      if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+      // Graphics needs compute too, so the single queue fallback can run the particles.
+      // Vulkan promises at least one family that does both whenever there's graphics at all.
+      const VkQueueFlags graphicsAndCompute = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT;
+      if (!indices.graphicsFamilyHasValue && queueFamily.queueCount > 0 &&
+          (queueFamily.queueFlags & graphicsAndCompute) == graphicsAndCompute)
       {
         indices.graphicsFamily = i;
         indices.graphicsFamilyHasValue = true;
       }
+      // A compute family without graphics is the async one, it runs next to the graphics queue.
+      if (!indices.computeFamilyHasValue && queueFamily.queueCount > 0 &&
+          (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) && !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT))
+      {
+        indices.computeFamily = i;
+        indices.computeFamilyHasValue = true;
+      }
+      // Headless, "presenting" is whatever the graphics queue does.
       VkBool32 presentSupport = false;
-      vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
-      if (queueFamily.queueCount > 0 && presentSupport)
+      if (window != nullptr)
+      {
+        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &presentSupport);
+      }
+      else
+      {
+        presentSupport = (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) ? VK_TRUE : VK_FALSE;
+      }
+      if (!indices.presentFamilyHasValue && queueFamily.queueCount > 0 && presentSupport)
       {
         indices.presentFamily = i;
         indices.presentFamilyHasValue = true;
@@ -401,6 +793,13 @@ namespace vpe
       i++;
     }
 
+    // No separate family, so compute just shares the graphics queue.
+    if (!indices.computeFamilyHasValue && indices.graphicsFamilyHasValue)
+    {
+      indices.computeFamily = indices.graphicsFamily;
+      indices.computeFamilyHasValue = true;
+    }
+
     return indices;
   }
 
@@ -454,7 +853,27 @@ namespace vpe
     throw std::runtime_error("failed to find supported format!");
   }
 
+  uint32_t VpeDevice::timestampValidBits(uint32_t queueFamily)
+  {
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+    return queueFamily < queueFamilyCount ? queueFamilies[queueFamily].timestampValidBits : 0;
+  }
+
   uint32_t VpeDevice::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+  {
+    uint32_t typeIndex;
+    if (tryFindMemoryType(typeFilter, properties, typeIndex))
+    {
+      return typeIndex;
+    }
+
+    throw std::runtime_error("failed to find suitable memory type!");
+  }
+
+  bool VpeDevice::tryFindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, uint32_t &typeIndex)
   {
     VkPhysicalDeviceMemoryProperties memProperties;
     vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
@@ -463,19 +882,20 @@ namespace vpe
       if ((typeFilter & (1 << i)) &&
           (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
       {
-        return i;
+        typeIndex = i;
+        return true;
       }
     }
-
-    throw std::runtime_error("failed to find suitable memory type!");
+    return false;
   }
 
-  void VpeDevice::createBuffer(
+  VkMemoryPropertyFlags VpeDevice::createBuffer(
       VkDeviceSize size,
       VkBufferUsageFlags usage,
       VkMemoryPropertyFlags properties,
       VkBuffer &buffer,
-      VkDeviceMemory &bufferMemory)
+      VkDeviceMemory &bufferMemory,
+      VkMemoryPropertyFlags preferredProperties)
   {
     VkBufferCreateInfo bufferInfo{};
     bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -494,7 +914,20 @@ namespace vpe
     VkMemoryAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
     allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+    if (preferredProperties == 0 ||
+        !tryFindMemoryType(memRequirements.memoryTypeBits, properties | preferredProperties, allocInfo.memoryTypeIndex))
+    {
+      allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+    }
+
+    // Buffers that shaders reach through their address need memory that's allowed to have one.
+    VkMemoryAllocateFlagsInfo allocFlagsInfo{};
+    allocFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+    allocFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+    if (usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT)
+    {
+      allocInfo.pNext = &allocFlagsInfo;
+    }
 
     if (vkAllocateMemory(device_, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS)
     {
@@ -502,6 +935,42 @@ namespace vpe
     }
 
     vkBindBufferMemory(device_, buffer, bufferMemory, 0);
+
+    VkPhysicalDeviceMemoryProperties memProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+    return memProperties.memoryTypes[allocInfo.memoryTypeIndex].propertyFlags;
+  }
+
+  VkDeviceSize VpeDevice::deviceLocalMemoryUsage()
+  {
+    if (!enabledFeatures.memoryBudget)
+    {
+      return 0;
+    }
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{};
+    budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    VkPhysicalDeviceMemoryProperties2 memoryProperties{};
+    memoryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    memoryProperties.pNext = &budget;
+    vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &memoryProperties);
+
+    VkDeviceSize usage = 0;
+    for (uint32_t i = 0; i < memoryProperties.memoryProperties.memoryHeapCount; i++)
+    {
+      if (memoryProperties.memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+      {
+        usage += budget.heapUsage[i];
+      }
+    }
+    return usage;
+  }
+
+  VkDeviceAddress VpeDevice::getBufferDeviceAddress(VkBuffer buffer)
+  {
+    VkBufferDeviceAddressInfo addressInfo{};
+    addressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+    addressInfo.buffer = buffer;
+    return vkGetBufferDeviceAddress(device_, &addressInfo);
   }
 
   VkCommandBuffer VpeDevice::beginSingleTimeCommands()
@@ -579,11 +1048,12 @@ namespace vpe
     endSingleTimeCommands(commandBuffer);
   }
 
-  void VpeDevice::createImageWithInfo(
+  VkMemoryPropertyFlags VpeDevice::createImageWithInfo(
       const VkImageCreateInfo &imageInfo,
       VkMemoryPropertyFlags properties,
       VkImage &image,
-      VkDeviceMemory &imageMemory)
+      VkDeviceMemory &imageMemory,
+      VkMemoryPropertyFlags preferredProperties)
   {
     if (vkCreateImage(device_, &imageInfo, nullptr, &image) != VK_SUCCESS)
     {
@@ -596,7 +1066,11 @@ namespace vpe
     VkMemoryAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
     allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+    if (preferredProperties == 0 ||
+        !tryFindMemoryType(memRequirements.memoryTypeBits, properties | preferredProperties, allocInfo.memoryTypeIndex))
+    {
+      allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+    }
 
     if (vkAllocateMemory(device_, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS)
     {
@@ -607,6 +1081,10 @@ namespace vpe
     {
       throw std::runtime_error("failed to bind image memory!");
     }
+
+    VkPhysicalDeviceMemoryProperties memProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+    return memProperties.memoryTypes[allocInfo.memoryTypeIndex].propertyFlags;
   }
 
 } // namespace lve
\ No newline at end of file
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "VpeJobSystem.hpp"
+#include "VpeStartupTrace.hpp"
 #include "VpeWindow.hpp"
 
 // THIS CODE WAS COPIED FROM THE TUTORIAL
@@ -22,9 +24,31 @@ namespace vpe
   {
     uint32_t graphicsFamily;
     uint32_t presentFamily;
+    uint32_t computeFamily;
     bool graphicsFamilyHasValue = false;
     bool presentFamilyHasValue = false;
-    bool isComplete() { return graphicsFamilyHasValue && presentFamilyHasValue; }
+    bool computeFamilyHasValue = false;
+    bool isComplete() { return graphicsFamilyHasValue && presentFamilyHasValue && computeFamilyHasValue; }
+  };
+
+  // What got turned on when the device was made, for the rest of the engine to branch on.
+  // Everything is only set if the device has it, so all false is plain Vulkan 1.0.
+  struct VpeDeviceFeatures
+  {
+    // The version everything can use, the lower of the instance and the device.
+    uint32_t apiVersion = VK_API_VERSION_1_0;
+    bool samplerAnisotropy = false;
+    // Vulkan 1.2
+    bool timelineSemaphore = false;
+    // Runtime sized, partially bound, non uniformly indexed descriptor arrays with a variable count.
+    bool descriptorIndexing = false;
+    bool bufferDeviceAddress = false;
+    // Vulkan 1.3
+    bool synchronization2 = false;
+    bool dynamicRendering = false;
+    bool maintenance4 = false;
+    // Optional extensions
+    bool memoryBudget = false;
   };
 
   class VpeDevice
@@ -35,8 +59,18 @@ namespace vpe
 #else
     const bool enableValidationLayers = true;
 #endif
+#ifdef VPE_DYNAMIC_RENDERING
+    const bool enableDynamicRendering = true;
+#else
+    const bool enableDynamicRendering = false;
+#endif
 
-    VpeDevice(VpeWindow &window);
+    // Opens the window if it isn't yet. With a job system the instance gets made on a worker meanwhile.
+    // The startup trace is optional, it just gets a phase per step.
+    VpeDevice(VpeWindow &window, VpeJobSystem *jobSystem = nullptr, VpeStartupTrace *startupTrace = nullptr);
+    // A null window makes a headless device: no surface, no swapchain, presenting is the graphics queue's
+    // problem and never happens. For benchmarks and tests, lavapipe in CI and the like.
+    explicit VpeDevice(VpeWindow *window, VpeJobSystem *jobSystem = nullptr, VpeStartupTrace *startupTrace = nullptr);
     ~VpeDevice();
 
     // Not copyable or movable
@@ -50,31 +84,58 @@ namespace vpe
     VkSurfaceKHR surface() { return surface_; }
     VkQueue graphicsQueue() { return graphicsQueue_; }
     VkQueue presentQueue() { return presentQueue_; }
+    VkQueue computeQueue() { return computeQueue_; }
+    bool isHeadless() const { return window == nullptr; }
 
     SwapChainSupportDetails getSwapChainSupport() { return querySwapChainSupport(physicalDevice); }
     uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
-    QueueFamilyIndices findPhysicalQueueFamilies() { return findQueueFamilies(physicalDevice); }
+    // Same, but false instead of throwing when no type fits.
+    bool tryFindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, uint32_t &typeIndex);
+    // Looked up once when the device is picked, every query goes to the driver otherwise.
+    QueueFamilyIndices findPhysicalQueueFamilies() { return queueFamilies; }
+    // True when compute got its own family and can run next to graphics.
+    bool hasAsyncCompute()
+    {
+      QueueFamilyIndices indices = findPhysicalQueueFamilies();
+      return indices.computeFamily != indices.graphicsFamily;
+    }
+    // Vulkan 1.3 vkCmdBeginRendering is on, so there's no need for render passes or framebuffers.
+    bool hasDynamicRendering() { return enabledFeatures.dynamicRendering; }
+    const VpeDeviceFeatures &features() const { return enabledFeatures; }
+    // Zero means the queue family can't write timestamps at all.
+    uint32_t timestampValidBits(uint32_t queueFamily);
     VkFormat findSupportedFormat(
         const std::vector<VkFormat> &candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 
     // Buffer Helper Functions
-    void createBuffer(
+    // preferredProperties work like for createImageWithInfo (DEVICE_LOCAL on host visible memory,
+    // for resizable BAR). Gives back the flags of the type it went with.
+    VkMemoryPropertyFlags createBuffer(
         VkDeviceSize size,
         VkBufferUsageFlags usage,
         VkMemoryPropertyFlags properties,
         VkBuffer &buffer,
-        VkDeviceMemory &bufferMemory);
+        VkDeviceMemory &bufferMemory,
+        VkMemoryPropertyFlags preferredProperties = 0);
+    // Bytes the driver says are in use on the device local heaps, by us and everyone else.
+    // Zero without VK_EXT_memory_budget.
+    VkDeviceSize deviceLocalMemoryUsage();
+    // Only for buffers made with VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, on a device with bufferDeviceAddress.
+    VkDeviceAddress getBufferDeviceAddress(VkBuffer buffer);
     VkCommandBuffer beginSingleTimeCommands();
     void endSingleTimeCommands(VkCommandBuffer commandBuffer);
     void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
     void copyBufferToImage(
         VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layerCount);
 
-    void createImageWithInfo(
+    // preferredProperties are added on top of properties when some memory type has them all
+    // (LAZILY_ALLOCATED for transient attachments). Gives back the flags of the type it went with.
+    VkMemoryPropertyFlags createImageWithInfo(
         const VkImageCreateInfo &imageInfo,
         VkMemoryPropertyFlags properties,
         VkImage &image,
-        VkDeviceMemory &imageMemory);
+        VkDeviceMemory &imageMemory,
+        VkMemoryPropertyFlags preferredProperties = 0);
 
     VkPhysicalDeviceProperties properties;
 
@@ -83,12 +144,18 @@ namespace vpe
     void setupDebugMessenger();
     void createSurface();
     void pickPhysicalDevice();
+    // Fills enabledFeatures with what the picked device supports out of what we'd like.
+    void queryFeatures();
     void createLogicalDevice();
     void createCommandPool();
 
     // helper functions
     bool isDeviceSuitable(VkPhysicalDevice device);
+    // Higher is faster, roughly. Device type first, then memory, queues, features and limits.
+    uint64_t rateDevice(VkPhysicalDevice device);
     std::vector<const char *> getRequiredExtensions();
+    // The swapchain one, unless we're headless.
+    std::vector<const char *> requiredDeviceExtensions();
     bool checkValidationLayerSupport();
     QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device);
     void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT &createInfo);
@@ -97,18 +164,30 @@ namespace vpe
     SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
 
     VkInstance instance;
+    uint32_t instanceApiVersion = VK_API_VERSION_1_0;
+    VpeDeviceFeatures enabledFeatures;
+    std::vector<const char *> enabledExtensions;
     VkDebugUtilsMessengerEXT debugMessenger;
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
-    VpeWindow &window;
+    QueueFamilyIndices queueFamilies;
+    // Null when headless.
+    VpeWindow *window;
     VkCommandPool commandPool;
 
     VkDevice device_;
-    VkSurfaceKHR surface_;
+    // Stays null when headless, the destructor goes by that.
+    VkSurfaceKHR surface_ = VK_NULL_HANDLE;
     VkQueue graphicsQueue_;
     VkQueue presentQueue_;
+    VkQueue computeQueue_;
+
+    // Set to a device index or part of a device name to skip the ranking, e.g. VPE_DEVICE=intel.
+    static constexpr const char *DEVICE_OVERRIDE_VARIABLE = "VPE_DEVICE";
 
     const std::vector<const char *> validationLayers = {"VK_LAYER_KHRONOS_validation"};
     const std::vector<const char *> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+    // Turned on when they're there, see VpeDeviceFeatures for which is which.
+    const std::vector<const char *> optionalDeviceExtensions = {VK_EXT_MEMORY_BUDGET_EXTENSION_NAME};
   };
 
 } // namespace lve
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+namespace vpe
+{
+    // Six planes with the normal (xyz) pointing inwards, so dot(plane, vec4(p, 1)) >= 0 means p is on the inside.
+    // Order is left, right, bottom, top, near, far. The normals are unit length, so that dot product is a real distance.
+    struct VpeFrustum
+    {
+        glm::vec4 planes[6];
+
+        // Gribb and Hartmann: the frustum planes are sums and differences of the rows of
+        // viewProjection. The near plane is row 2 alone because depth goes 0..1, not -1..1.
+        static VpeFrustum fromViewProjection(const glm::mat4 &viewProjection)
+        {
+            auto row = [&viewProjection](int i)
+            {
+                return glm::vec4{viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]};
+            };
+
+            VpeFrustum frustum;
+            frustum.planes[0] = row(3) + row(0);
+            frustum.planes[1] = row(3) - row(0);
+            frustum.planes[2] = row(3) + row(1);
+            frustum.planes[3] = row(3) - row(1);
+            frustum.planes[4] = row(2);
+            frustum.planes[5] = row(3) - row(2);
+            for (auto &plane : frustum.planes)
+            {
+                plane /= glm::length(glm::vec3{plane});
+            }
+            return frustum;
+        }
+    };
+} // namespace vpe
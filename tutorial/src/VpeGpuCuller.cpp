@@ -0,0 +1,243 @@
+#include "VpeGpuCuller.hpp"
+#include "VpeComputePipeline.hpp"
+#include "VpeFrustum.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+namespace vpe
+{
+    VpeGpuCuller::VpeGpuCuller(
+        VpeDevice &device,
+        const VpeDepthPyramid &depthPyramid,
+        const std::vector<VkBuffer> &sphereBuffers,
+        uint32_t objectCount,
+        uint32_t vertexCount,
+        const VpeGpuCullSettings &settings) : vpeDevice_{device},
+                                              depthPyramid_{depthPyramid},
+                                              objectCount_{objectCount},
+                                              vertexCount_{vertexCount},
+                                              settings_{settings}
+    {
+        createBuffers(static_cast<uint32_t>(sphereBuffers.size()));
+        createDescriptors(sphereBuffers);
+        createPipeline();
+    }
+
+    VpeGpuCuller::~VpeGpuCuller()
+    {
+        pipeline_.reset();
+        vkDestroyPipelineLayout(vpeDevice_.device(), pipelineLayout_, nullptr);
+        vkDestroyDescriptorPool(vpeDevice_.device(), descriptorPool_, nullptr);
+        vkDestroyDescriptorSetLayout(vpeDevice_.device(), descriptorSetLayout_, nullptr);
+        for (size_t slot = 0; slot < paramBuffers_.size(); slot++)
+        {
+            vkUnmapMemory(vpeDevice_.device(), paramMemories_[slot]);
+            vkDestroyBuffer(vpeDevice_.device(), paramBuffers_[slot], nullptr);
+            vkFreeMemory(vpeDevice_.device(), paramMemories_[slot], nullptr);
+        }
+        vkDestroyBuffer(vpeDevice_.device(), drawCommandBuffer_, nullptr);
+        vkFreeMemory(vpeDevice_.device(), drawCommandMemory_, nullptr);
+        vkDestroyBuffer(vpeDevice_.device(), visibleBuffer_, nullptr);
+        vkFreeMemory(vpeDevice_.device(), visibleMemory_, nullptr);
+    }
+
+    void VpeGpuCuller::updateCamera(uint32_t slot, const glm::mat4 &view, const glm::mat4 &projection)
+    {
+        CullParams params{};
+        params.view = view;
+        params.projection = projection;
+        VpeFrustum frustum = VpeFrustum::fromViewProjection(projection * view);
+        std::copy(std::begin(frustum.planes), std::end(frustum.planes), params.frustumPlanes);
+        params.pyramidSize = glm::vec2{depthPyramid_.width(), depthPyramid_.height()};
+        params.objectCount = objectCount_;
+        params.occlusionSlack = settings_.occlusionSlack;
+        params.occlusionEnabled = settings_.occlusion ? 1u : 0u;
+        memcpy(mappedParams_[slot], &params, sizeof(CullParams));
+    }
+
+    void VpeGpuCuller::recordCull(VkCommandBuffer commandBuffer, uint32_t slot) const
+    {
+        // Last frame's draw might still be reading the visible list and the command.
+        VkMemoryBarrier readsDone{};
+        readsDone.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        readsDone.srcAccessMask = 0;
+        readsDone.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &readsDone, 0, nullptr, 0, nullptr);
+
+        // Start from zero instances, the shader counts them up.
+        VkDrawIndirectCommand emptyDraw{vertexCount_, 0, 0, 0};
+        vkCmdUpdateBuffer(commandBuffer, drawCommandBuffer_, 0, sizeof(emptyDraw), &emptyDraw);
+
+        VkMemoryBarrier resetDone{};
+        resetDone.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        resetDone.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        resetDone.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &resetDone, 0, nullptr, 0, nullptr);
+
+        pipeline_->bind(commandBuffer);
+        vkCmdBindDescriptorSets(
+            commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout_, 0, 1, &descriptorSets_[slot], 0, nullptr);
+        pipeline_->dispatch(commandBuffer, objectCount_);
+
+        VkMemoryBarrier cullDone{};
+        cullDone.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        cullDone.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        cullDone.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+            0, 1, &cullDone, 0, nullptr, 0, nullptr);
+    }
+
+    void VpeGpuCuller::recordDraw(VkCommandBuffer commandBuffer) const
+    {
+        vkCmdDrawIndirect(commandBuffer, drawCommandBuffer_, 0, 1, sizeof(VkDrawIndirectCommand));
+    }
+
+    void VpeGpuCuller::createBuffers(uint32_t slotCount)
+    {
+        static_assert(sizeof(CullParams) == 256, "CullParams has to match the std140 block in CullSpheres.comp.");
+
+        // Worst case everything is visible.
+        vpeDevice_.createBuffer(
+            sizeof(glm::vec4) * objectCount_,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            visibleBuffer_,
+            visibleMemory_);
+        vpeDevice_.createBuffer(
+            sizeof(VkDrawIndirectCommand),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            drawCommandBuffer_,
+            drawCommandMemory_);
+
+        paramBuffers_.resize(slotCount);
+        paramMemories_.resize(slotCount);
+        mappedParams_.resize(slotCount);
+        for (uint32_t slot = 0; slot < slotCount; slot++)
+        {
+            vpeDevice_.createBuffer(
+                sizeof(CullParams),
+                VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                paramBuffers_[slot],
+                paramMemories_[slot]);
+            vkMapMemory(vpeDevice_.device(), paramMemories_[slot], 0, sizeof(CullParams), 0, &mappedParams_[slot]);
+        }
+    }
+
+    void VpeGpuCuller::createDescriptors(const std::vector<VkBuffer> &sphereBuffers)
+    {
+        std::array<VkDescriptorType, 5> types = {
+            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER};
+
+        std::array<VkDescriptorSetLayoutBinding, 5> bindings{};
+        for (uint32_t i = 0; i < bindings.size(); i++)
+        {
+            bindings[i].binding = i;
+            bindings[i].descriptorType = types[i];
+            bindings[i].descriptorCount = 1;
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+        if (vkCreateDescriptorSetLayout(vpeDevice_.device(), &layoutInfo, nullptr, &descriptorSetLayout_) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create cull descriptor set layout.");
+        }
+
+        uint32_t slotCount = static_cast<uint32_t>(sphereBuffers.size());
+        std::array<VkDescriptorPoolSize, 3> poolSizes{};
+        poolSizes[0] = {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, slotCount};
+        poolSizes[1] = {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 * slotCount};
+        poolSizes[2] = {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, slotCount};
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.maxSets = slotCount;
+        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.data();
+        if (vkCreateDescriptorPool(vpeDevice_.device(), &poolInfo, nullptr, &descriptorPool_) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create cull descriptor pool.");
+        }
+
+        std::vector<VkDescriptorSetLayout> layouts(slotCount, descriptorSetLayout_);
+        descriptorSets_.resize(slotCount);
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = descriptorPool_;
+        allocInfo.descriptorSetCount = slotCount;
+        allocInfo.pSetLayouts = layouts.data();
+        if (vkAllocateDescriptorSets(vpeDevice_.device(), &allocInfo, descriptorSets_.data()) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to allocate cull descriptor sets.");
+        }
+
+        // Everything is shared between slots except the params and the spheres.
+        for (uint32_t slot = 0; slot < slotCount; slot++)
+        {
+            std::array<VkDescriptorBufferInfo, 4> bufferInfos{};
+            bufferInfos[0] = {paramBuffers_[slot], 0, sizeof(CullParams)};
+            bufferInfos[1] = {sphereBuffers[slot], 0, VK_WHOLE_SIZE};
+            bufferInfos[2] = {visibleBuffer_, 0, VK_WHOLE_SIZE};
+            bufferInfos[3] = {drawCommandBuffer_, 0, VK_WHOLE_SIZE};
+            VkDescriptorImageInfo pyramidInfo{depthPyramid_.sampler(), depthPyramid_.imageView(), VK_IMAGE_LAYOUT_GENERAL};
+
+            std::array<VkWriteDescriptorSet, 5> writes{};
+            for (uint32_t i = 0; i < writes.size(); i++)
+            {
+                writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                writes[i].dstSet = descriptorSets_[slot];
+                writes[i].dstBinding = i;
+                writes[i].descriptorCount = 1;
+                writes[i].descriptorType = types[i];
+                if (i < bufferInfos.size())
+                {
+                    writes[i].pBufferInfo = &bufferInfos[i];
+                }
+                else
+                {
+                    writes[i].pImageInfo = &pyramidInfo;
+                }
+            }
+            vkUpdateDescriptorSets(vpeDevice_.device(), static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+        }
+    }
+
+    void VpeGpuCuller::createPipeline()
+    {
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout_;
+        pipelineLayoutInfo.pushConstantRangeCount = 0;
+        pipelineLayoutInfo.pPushConstantRanges = nullptr;
+        if (vkCreatePipelineLayout(vpeDevice_.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout_) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create cull pipeline layout.");
+        }
+
+        pipeline_ = std::make_unique<VpeComputePipeline>(vpeDevice_, "shaders/CullSpheres.comp.spv", pipelineLayout_);
+    }
+} // namespace vpe
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "VpeDepthPyramid.hpp"
+#include "VpeDevice.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace vpe
+{
+    class VpeComputePipeline;
+
+    struct VpeGpuCullSettings
+    {
+        bool occlusion = true;
+        // The pyramid is from last frame. Things that moved away from the camera by up to
+        // this much since then still count as visible, instead of being hidden by their own old depth.
+        float occlusionSlack = 0.25f;
+    };
+
+    // Compute pre-pass that culls bounding spheres (xyz + radius) against the frustum and the
+    // depth pyramid, and compacts the survivors into one instance buffer. The draw that follows
+    // is a vkCmdDrawIndirect whose instance count the shader filled in, so the CPU never walks
+    // the objects or even knows how many are visible.
+    //
+    // The instance data is the sphere itself, which is all the particles need to draw.
+    class VpeGpuCuller
+    {
+    public:
+        // sphereBuffers has one buffer per frame slot (they need STORAGE_BUFFER usage),
+        // each with objectCount spheres. vertexCount is what every instance draws.
+        VpeGpuCuller(
+            VpeDevice &device,
+            const VpeDepthPyramid &depthPyramid,
+            const std::vector<VkBuffer> &sphereBuffers,
+            uint32_t objectCount,
+            uint32_t vertexCount,
+            const VpeGpuCullSettings &settings = {});
+        ~VpeGpuCuller();
+
+        VpeGpuCuller(const VpeGpuCuller &) = delete;
+        VpeGpuCuller &operator=(const VpeGpuCuller &) = delete;
+
+        // Host side, once per frame before submitting slot. The slot must not be in flight.
+        void updateCamera(uint32_t slot, const glm::mat4 &view, const glm::mat4 &projection);
+
+        // Outside a render pass, after the spheres for slot are readable by compute.
+        void recordCull(VkCommandBuffer commandBuffer, uint32_t slot) const;
+        // Then bind visibleBuffer() as the instance buffer and draw with this.
+        void recordDraw(VkCommandBuffer commandBuffer) const;
+
+        VkBuffer visibleBuffer() const { return visibleBuffer_; }
+
+    private:
+        // std140, has to match CullParams in CullSpheres.comp.
+        struct CullParams
+        {
+            glm::mat4 view;
+            glm::mat4 projection;
+            glm::vec4 frustumPlanes[6];
+            glm::vec2 pyramidSize;
+            uint32_t objectCount;
+            float occlusionSlack;
+            uint32_t occlusionEnabled;
+            uint32_t padding[3];
+        };
+
+        void createBuffers(uint32_t slotCount);
+        void createDescriptors(const std::vector<VkBuffer> &sphereBuffers);
+        void createPipeline();
+
+        VpeDevice &vpeDevice_;
+        const VpeDepthPyramid &depthPyramid_;
+        uint32_t objectCount_;
+        uint32_t vertexCount_;
+        VpeGpuCullSettings settings_;
+
+        VkBuffer visibleBuffer_;
+        VkDeviceMemory visibleMemory_;
+        VkBuffer drawCommandBuffer_;
+        VkDeviceMemory drawCommandMemory_;
+
+        // Per frame slot, host visible and mapped the whole time.
+        std::vector<VkBuffer> paramBuffers_;
+        std::vector<VkDeviceMemory> paramMemories_;
+        std::vector<void *> mappedParams_;
+
+        VkDescriptorSetLayout descriptorSetLayout_;
+        VkDescriptorPool descriptorPool_;
+        std::vector<VkDescriptorSet> descriptorSets_;
+        VkPipelineLayout pipelineLayout_;
+        std::unique_ptr<VpeComputePipeline> pipeline_;
+    };
+} // namespace vpe
@@ -0,0 +1,655 @@
+#include "VpeGpuParticleSystem.hpp"
+#include "VpeSpatialHashGrid.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace vpe
+{
+    namespace
+    {
+        constexpr uint32_t WORKGROUP_SIZE = 256;
+        constexpr uint32_t MIN_TABLE_SIZE = 1024;
+
+        // Every pass reads what the one before it wrote, so they all get this between them.
+        void computeToComputeBarrier(VkCommandBuffer commandBuffer)
+        {
+            VkMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+            vkCmdPipelineBarrier(
+                commandBuffer,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                0, 1, &barrier, 0, nullptr, 0, nullptr);
+        }
+    }
+
+    VpeGpuParticleSystem::VpeGpuParticleSystem(
+        VpeDevice &device,
+        VpeJobSystem &jobSystem,
+        const std::vector<glm::vec4> &particles,
+        uint32_t frameSlotCount,
+        const VpeGpuParticleSettings &settings) : vpeDevice_{device},
+                                                  jobSystem_{jobSystem},
+                                                  settings_{settings},
+                                                  initialParticles_{particles},
+                                                  computeFamily_{device.findPhysicalQueueFamilies().computeFamily},
+                                                  graphicsFamily_{device.findPhysicalQueueFamilies().graphicsFamily},
+                                                  timestamps_{device, computeFamily_, 2 * frameSlotCount},
+                                                  renderBuffers_(frameSlotCount),
+                                                  renderBufferMemories_(frameSlotCount),
+                                                  stepCommandBuffers_(frameSlotCount),
+                                                  stepFinishedSemaphores_(frameSlotCount),
+                                                  drawFinishedSemaphores_(frameSlotCount),
+                                                  slotDrawn_(frameSlotCount, 0)
+    {
+        assert(!particles.empty() && "Need at least one particle.");
+        particleCount_ = static_cast<uint32_t>(particles.size());
+
+        // Same sizing as the CPU grid: cells fit the biggest pair, about two slots per particle.
+        float maxRadius = 0.0f;
+        for (const auto &particle : particles)
+        {
+            maxRadius = std::max(maxRadius, particle.w);
+        }
+        cellSize_ = 2.0f * maxRadius;
+        tableSize_ = MIN_TABLE_SIZE;
+        while (tableSize_ < 2 * particleCount_)
+        {
+            tableSize_ <<= 1;
+        }
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.queueFamilyIndex = computeFamily_;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        if (vkCreateCommandPool(vpeDevice_.device(), &poolInfo, nullptr, &computeCommandPool_) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create compute command pool.");
+        }
+
+        createBuffers();
+        createDescriptors();
+        createPipelines();
+        createFrameSlots();
+        uploadInitialState();
+    }
+
+    VpeGpuParticleSystem::~VpeGpuParticleSystem()
+    {
+        for (size_t slot = 0; slot < renderBuffers_.size(); slot++)
+        {
+            vkDestroySemaphore(vpeDevice_.device(), stepFinishedSemaphores_[slot], nullptr);
+            vkDestroySemaphore(vpeDevice_.device(), drawFinishedSemaphores_[slot], nullptr);
+            vkDestroyBuffer(vpeDevice_.device(), renderBuffers_[slot], nullptr);
+            vkFreeMemory(vpeDevice_.device(), renderBufferMemories_[slot], nullptr);
+        }
+        // Frees the step command buffers with it.
+        vkDestroyCommandPool(vpeDevice_.device(), computeCommandPool_, nullptr);
+        vkDestroyPipelineLayout(vpeDevice_.device(), pipelineLayout_, nullptr);
+        // Destroying the pool frees the set too.
+        vkDestroyDescriptorPool(vpeDevice_.device(), descriptorPool_, nullptr);
+        vkDestroyDescriptorSetLayout(vpeDevice_.device(), descriptorSetLayout_, nullptr);
+        for (uint32_t i = 0; i < BINDING_COUNT; i++)
+        {
+            vkDestroyBuffer(vpeDevice_.device(), buffers_[i], nullptr);
+            vkFreeMemory(vpeDevice_.device(), bufferMemories_[i], nullptr);
+        }
+    }
+
+    void VpeGpuParticleSystem::recordStep(VkCommandBuffer commandBuffer) const
+    {
+        // The last step copied positions out and uploads might still be landing.
+        // Wait for both before the first pass touches anything. Only transfer and compute
+        // stages in here, a compute only queue doesn't know about the others.
+        VkMemoryBarrier startBarrier{};
+        startBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        startBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        startBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &startBarrier, 0, nullptr, 0, nullptr);
+
+        vkCmdBindDescriptorSets(
+            commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout_, 0, 1, &descriptorSet_, 0, nullptr);
+
+        float dt = settings_.timeStep / static_cast<float>(settings_.substeps);
+        PushConstants push{};
+        push.gravityDt = glm::vec4{settings_.gravity, dt};
+        push.cellSize = cellSize_;
+        push.groundHeight = settings_.groundHeight;
+        push.stiffness = settings_.stiffness;
+        push.damping = settings_.damping;
+        push.particleCount = particleCount_;
+        push.tableMask = tableSize_ - 1;
+        // Same values for every pass, so push once. Compatible layouts keep them across binds.
+        vkCmdPushConstants(
+            commandBuffer, pipelineLayout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &push);
+
+        for (uint32_t substep = 0; substep < settings_.substeps; substep++)
+        {
+            clearGridPipeline_->bind(commandBuffer);
+            clearGridPipeline_->dispatch(commandBuffer, tableSize_, WORKGROUP_SIZE);
+            computeToComputeBarrier(commandBuffer);
+
+            hashPipeline_->bind(commandBuffer);
+            hashPipeline_->dispatch(commandBuffer, particleCount_, WORKGROUP_SIZE);
+            computeToComputeBarrier(commandBuffer);
+
+            // The scan is one workgroup on purpose, see ParticleScan.comp.
+            scanPipeline_->bind(commandBuffer);
+            vkCmdDispatch(commandBuffer, 1, 1, 1);
+            computeToComputeBarrier(commandBuffer);
+
+            scatterPipeline_->bind(commandBuffer);
+            scatterPipeline_->dispatch(commandBuffer, particleCount_, WORKGROUP_SIZE);
+            computeToComputeBarrier(commandBuffer);
+
+            collidePipeline_->bind(commandBuffer);
+            collidePipeline_->dispatch(commandBuffer, particleCount_, WORKGROUP_SIZE);
+            computeToComputeBarrier(commandBuffer);
+
+            integratePipeline_->bind(commandBuffer);
+            integratePipeline_->dispatch(commandBuffer, particleCount_, WORKGROUP_SIZE);
+            if (substep + 1 < settings_.substeps)
+            {
+                computeToComputeBarrier(commandBuffer);
+            }
+        }
+
+        // Whoever copies the positions out next has to wait for the last integrate.
+        VkMemoryBarrier endBarrier{};
+        endBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        endBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        endBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0, 1, &endBarrier, 0, nullptr, 0, nullptr);
+    }
+
+    VkSemaphore VpeGpuParticleSystem::submitStep(uint32_t slot)
+    {
+        // The copy into the render buffer is the only thing that has to wait for the old draw,
+        // the simulation passes themselves can start right away.
+        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        if (slotDrawn_[slot])
+        {
+            submitInfo.waitSemaphoreCount = 1;
+            submitInfo.pWaitSemaphores = &drawFinishedSemaphores_[slot];
+            submitInfo.pWaitDstStageMask = &waitStage;
+        }
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &stepCommandBuffers_[slot];
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &stepFinishedSemaphores_[slot];
+
+        if (vkQueueSubmit(vpeDevice_.computeQueue(), 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to submit particle step.");
+        }
+        // From here on the graphics submit signals drawFinished for this slot every time.
+        slotDrawn_[slot] = 1;
+        return stepFinishedSemaphores_[slot];
+    }
+
+    void VpeGpuParticleSystem::recordAcquire(VkCommandBuffer commandBuffer, uint32_t slot) const
+    {
+        // Same family: the semaphore alone already makes the copy visible.
+        if (computeFamily_ == graphicsFamily_)
+        {
+            return;
+        }
+
+        // Has to match the release in recordFrameSlot exactly, apart from the stages and access.
+        VkBufferMemoryBarrier acquire{};
+        acquire.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        acquire.srcAccessMask = 0;
+        acquire.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+        acquire.srcQueueFamilyIndex = computeFamily_;
+        acquire.dstQueueFamilyIndex = graphicsFamily_;
+        acquire.buffer = renderBuffers_[slot];
+        acquire.offset = 0;
+        acquire.size = VK_WHOLE_SIZE;
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 0, nullptr, 1, &acquire, 0, nullptr);
+    }
+
+    bool VpeGpuParticleSystem::stepTimestamps(uint32_t slot, uint64_t ticks[2]) const
+    {
+        if (!slotDrawn_[slot])
+        {
+            return false;
+        }
+        return timestamps_.read(slot * 2, 2, ticks);
+    }
+
+    bool VpeGpuParticleSystem::validateAgainstCpu(uint32_t steps, float tolerance)
+    {
+        // The GPU adds up contact forces in whatever order the scatter left them, so it can't match
+        // bit for bit. Letting both run on their own doesn't work either: a colliding pile blows
+        // those last bits up into completely different piles within a second. So every step starts
+        // the CPU from exactly where the GPU is, and only that one step gets compared.
+        uploadInitialState();
+        float dt = settings_.timeStep / static_cast<float>(settings_.substeps);
+        float maxError = 0.0f;
+        uint32_t worstParticle = 0;
+        uint32_t worstStep = 0;
+        for (uint32_t step = 0; step < steps; step++)
+        {
+            std::vector<glm::vec4> cpuPositions = readBack(POSITIONS);
+            std::vector<glm::vec4> cpuVelocities = readBack(VELOCITIES);
+
+            VkCommandBuffer commandBuffer = beginComputeCommands();
+            recordStep(commandBuffer);
+            endComputeCommands(commandBuffer);
+            for (uint32_t substep = 0; substep < settings_.substeps; substep++)
+            {
+                stepReference(jobSystem_, settings_, cellSize_, cpuPositions, cpuVelocities, dt);
+            }
+
+            std::vector<glm::vec4> gpuPositions = readBack(POSITIONS);
+            for (uint32_t i = 0; i < particleCount_; i++)
+            {
+                float error = glm::length(glm::vec3{gpuPositions[i]} - glm::vec3{cpuPositions[i]});
+                if (error > maxError)
+                {
+                    maxError = error;
+                    worstParticle = i;
+                    worstStep = step;
+                }
+            }
+        }
+
+        uploadInitialState();
+
+        spdlog::info("GPU physics validation: {} particles, {} steps, max position error after one step {} (particle {}, step {}), tolerance {}",
+                     particleCount_, steps, maxError, worstParticle, worstStep, tolerance);
+        return maxError <= tolerance;
+    }
+
+    void VpeGpuParticleSystem::stepReference(
+        VpeJobSystem &jobSystem,
+        const VpeGpuParticleSettings &settings,
+        float cellSize,
+        std::vector<glm::vec4> &positions,
+        std::vector<glm::vec4> &velocities,
+        float dt)
+    {
+        uint32_t count = static_cast<uint32_t>(positions.size());
+        std::vector<glm::vec3> centers(count);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            centers[i] = glm::vec3{positions[i]};
+        }
+
+        VpeSpatialHashGrid grid{jobSystem, cellSize};
+        grid.rebuild(centers.data(), count);
+
+        // Like the collide shader: everyone reads the old state and writes a new velocity.
+        std::vector<glm::vec3> newVelocities(count);
+        jobSystem.parallelFor(count, [&](uint32_t begin, uint32_t end)
+                              {
+            for (uint32_t i = begin; i < end; i++)
+            {
+                glm::vec3 position = centers[i];
+                float radius = positions[i].w;
+                glm::vec3 velocity = glm::vec3{velocities[i]};
+                glm::vec3 force{0.0f};
+
+                grid.forEachNeighbor(position, cellSize, [&](uint32_t j, float distanceSquared)
+                                     {
+                    float touching = radius + positions[j].w;
+                    if (j == i || distanceSquared >= touching * touching || distanceSquared < 1e-12f)
+                    {
+                        return;
+                    }
+                    float distance = std::sqrt(distanceSquared);
+                    glm::vec3 normal = (position - centers[j]) / distance;
+                    float closing = glm::dot(velocity - glm::vec3{velocities[j]}, normal);
+                    force += normal * (settings.stiffness * (touching - distance) - settings.damping * closing); });
+
+                float groundOverlap = settings.groundHeight - (position.y - radius);
+                if (groundOverlap > 0.0f)
+                {
+                    force.y += settings.stiffness * groundOverlap - settings.damping * velocity.y;
+                }
+
+                newVelocities[i] = velocity + (settings.gravity + force) * dt;
+            } },
+                              1024);
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            velocities[i] = glm::vec4{newVelocities[i], 0.0f};
+            positions[i] += glm::vec4{newVelocities[i] * dt, 0.0f};
+        }
+    }
+
+    void VpeGpuParticleSystem::createBuffers()
+    {
+        VkDeviceSize particleVec4s = sizeof(glm::vec4) * particleCount_;
+        VkDeviceSize particleUints = sizeof(uint32_t) * particleCount_;
+        std::array<VkDeviceSize, BINDING_COUNT> sizes{};
+        sizes[POSITIONS] = particleVec4s;
+        sizes[VELOCITIES] = particleVec4s;
+        sizes[NEW_VELOCITIES] = particleVec4s;
+        sizes[CELL_COUNTS] = sizeof(uint32_t) * tableSize_;
+        // One extra so the last slot has an end too.
+        sizes[CELL_START] = sizeof(uint32_t) * (tableSize_ + 1);
+        sizes[PARTICLE_SLOTS] = particleUints;
+        sizes[SORTED_INDICES] = particleUints;
+
+        for (uint32_t i = 0; i < BINDING_COUNT; i++)
+        {
+            VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+            if (i == POSITIONS || i == VELOCITIES)
+            {
+                // Positions get copied out into the render buffers every step,
+                // and validation reads both back to the CPU.
+                usage |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+            }
+            vpeDevice_.createBuffer(
+                sizes[i],
+                usage,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                buffers_[i],
+                bufferMemories_[i]);
+        }
+    }
+
+    void VpeGpuParticleSystem::createDescriptors()
+    {
+        std::array<VkDescriptorSetLayoutBinding, BINDING_COUNT> bindings{};
+        for (uint32_t i = 0; i < BINDING_COUNT; i++)
+        {
+            bindings[i].binding = i;
+            bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[i].descriptorCount = 1;
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = BINDING_COUNT;
+        layoutInfo.pBindings = bindings.data();
+        if (vkCreateDescriptorSetLayout(vpeDevice_.device(), &layoutInfo, nullptr, &descriptorSetLayout_) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create particle descriptor set layout.");
+        }
+
+        VkDescriptorPoolSize poolSize{};
+        poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSize.descriptorCount = BINDING_COUNT;
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.maxSets = 1;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        if (vkCreateDescriptorPool(vpeDevice_.device(), &poolInfo, nullptr, &descriptorPool_) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create particle descriptor pool.");
+        }
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = descriptorPool_;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &descriptorSetLayout_;
+        if (vkAllocateDescriptorSets(vpeDevice_.device(), &allocInfo, &descriptorSet_) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to allocate particle descriptor set.");
+        }
+
+        // One set, all seven buffers, every pass just uses the bindings it cares about.
+        std::array<VkDescriptorBufferInfo, BINDING_COUNT> bufferInfos{};
+        std::array<VkWriteDescriptorSet, BINDING_COUNT> writes{};
+        for (uint32_t i = 0; i < BINDING_COUNT; i++)
+        {
+            bufferInfos[i].buffer = buffers_[i];
+            bufferInfos[i].offset = 0;
+            bufferInfos[i].range = VK_WHOLE_SIZE;
+
+            writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[i].dstSet = descriptorSet_;
+            writes[i].dstBinding = i;
+            writes[i].descriptorCount = 1;
+            writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[i].pBufferInfo = &bufferInfos[i];
+        }
+        vkUpdateDescriptorSets(vpeDevice_.device(), BINDING_COUNT, writes.data(), 0, nullptr);
+    }
+
+    void VpeGpuParticleSystem::createPipelines()
+    {
+        static_assert(sizeof(PushConstants) == 40, "PushConstants has to match the Params block in the shaders.");
+
+        VkPushConstantRange pushRange{};
+        pushRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushRange.offset = 0;
+        pushRange.size = sizeof(PushConstants);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout_;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushRange;
+        if (vkCreatePipelineLayout(vpeDevice_.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout_) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create particle pipeline layout.");
+        }
+
+        clearGridPipeline_ = std::make_unique<VpeComputePipeline>(vpeDevice_, "shaders/ParticleClearGrid.comp.spv", pipelineLayout_);
+        hashPipeline_ = std::make_unique<VpeComputePipeline>(vpeDevice_, "shaders/ParticleHash.comp.spv", pipelineLayout_);
+        scanPipeline_ = std::make_unique<VpeComputePipeline>(vpeDevice_, "shaders/ParticleScan.comp.spv", pipelineLayout_);
+        scatterPipeline_ = std::make_unique<VpeComputePipeline>(vpeDevice_, "shaders/ParticleScatter.comp.spv", pipelineLayout_);
+        collidePipeline_ = std::make_unique<VpeComputePipeline>(vpeDevice_, "shaders/ParticleCollide.comp.spv", pipelineLayout_);
+        integratePipeline_ = std::make_unique<VpeComputePipeline>(vpeDevice_, "shaders/ParticleIntegrate.comp.spv", pipelineLayout_);
+    }
+
+    void VpeGpuParticleSystem::createFrameSlots()
+    {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = computeCommandPool_;
+        allocInfo.commandBufferCount = static_cast<uint32_t>(stepCommandBuffers_.size());
+        if (vkAllocateCommandBuffers(vpeDevice_.device(), &allocInfo, stepCommandBuffers_.data()) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to allocate particle step command buffers.");
+        }
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        for (uint32_t slot = 0; slot < renderBuffers_.size(); slot++)
+        {
+            // Exclusive to one family at a time, the step hands it to graphics with a release.
+            vpeDevice_.createBuffer(
+                sizeof(glm::vec4) * particleCount_,
+                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                renderBuffers_[slot],
+                renderBufferMemories_[slot]);
+
+            if (vkCreateSemaphore(vpeDevice_.device(), &semaphoreInfo, nullptr, &stepFinishedSemaphores_[slot]) != VK_SUCCESS ||
+                vkCreateSemaphore(vpeDevice_.device(), &semaphoreInfo, nullptr, &drawFinishedSemaphores_[slot]) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to create particle semaphores.");
+            }
+
+            recordFrameSlot(slot);
+        }
+    }
+
+    void VpeGpuParticleSystem::recordFrameSlot(uint32_t slot)
+    {
+        // The step never changes, so like the draw buffers these get recorded once and replayed.
+        VkCommandBuffer commandBuffer = stepCommandBuffers_[slot];
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to begin recording particle step.");
+        }
+
+        timestamps_.reset(commandBuffer, slot * 2, 2);
+        timestamps_.write(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, slot * 2);
+
+        recordStep(commandBuffer);
+
+        // We never care what graphics left in the render buffer, so there's no ownership
+        // transfer back to compute. Without one the old contents are undefined, which is fine
+        // because the copy overwrites all of it.
+        VkBufferCopy copyRegion{0, 0, sizeof(glm::vec4) * particleCount_};
+        vkCmdCopyBuffer(commandBuffer, buffers_[POSITIONS], renderBuffers_[slot], 1, &copyRegion);
+
+        if (computeFamily_ != graphicsFamily_)
+        {
+            // Release half of the hand-off, recordAcquire is the other half on the graphics queue.
+            VkBufferMemoryBarrier release{};
+            release.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            release.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            release.dstAccessMask = 0;
+            release.srcQueueFamilyIndex = computeFamily_;
+            release.dstQueueFamilyIndex = graphicsFamily_;
+            release.buffer = renderBuffers_[slot];
+            release.offset = 0;
+            release.size = VK_WHOLE_SIZE;
+            vkCmdPipelineBarrier(
+                commandBuffer,
+                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                0, 0, nullptr, 1, &release, 0, nullptr);
+        }
+
+        timestamps_.write(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, slot * 2 + 1);
+
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to record particle step.");
+        }
+    }
+
+    void VpeGpuParticleSystem::uploadInitialState()
+    {
+        // Positions first, then zeros for the velocities, through one host visible staging buffer.
+        VkDeviceSize size = sizeof(glm::vec4) * particleCount_;
+        VkBuffer stagingBuffer;
+        VkDeviceMemory stagingMemory;
+        vpeDevice_.createBuffer(
+            size * 2,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            stagingBuffer,
+            stagingMemory);
+
+        void *data;
+        vkMapMemory(vpeDevice_.device(), stagingMemory, 0, size * 2, 0, &data);
+        memcpy(data, initialParticles_.data(), static_cast<size_t>(size));
+        memset(static_cast<char *>(data) + size, 0, static_cast<size_t>(size));
+        vkUnmapMemory(vpeDevice_.device(), stagingMemory);
+
+        VkCommandBuffer commandBuffer = beginComputeCommands();
+        VkBufferCopy positionsCopy{0, 0, size};
+        vkCmdCopyBuffer(commandBuffer, stagingBuffer, buffers_[POSITIONS], 1, &positionsCopy);
+        VkBufferCopy velocitiesCopy{size, 0, size};
+        vkCmdCopyBuffer(commandBuffer, stagingBuffer, buffers_[VELOCITIES], 1, &velocitiesCopy);
+        endComputeCommands(commandBuffer);
+
+        vkDestroyBuffer(vpeDevice_.device(), stagingBuffer, nullptr);
+        vkFreeMemory(vpeDevice_.device(), stagingMemory, nullptr);
+    }
+
+    std::vector<glm::vec4> VpeGpuParticleSystem::readBack(Binding binding)
+    {
+        // Only validation ever does this, the renderer never needs the data on the CPU.
+        VkDeviceSize size = sizeof(glm::vec4) * particleCount_;
+        VkBuffer stagingBuffer;
+        VkDeviceMemory stagingMemory;
+        vpeDevice_.createBuffer(
+            size,
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            stagingBuffer,
+            stagingMemory);
+
+        // recordStep already ended with a barrier that makes everything it wrote readable by transfers.
+        VkCommandBuffer commandBuffer = beginComputeCommands();
+        VkBufferCopy copyRegion{0, 0, size};
+        vkCmdCopyBuffer(commandBuffer, buffers_[binding], stagingBuffer, 1, &copyRegion);
+
+        VkMemoryBarrier hostBarrier{};
+        hostBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_HOST_BIT,
+            0, 1, &hostBarrier, 0, nullptr, 0, nullptr);
+        endComputeCommands(commandBuffer);
+
+        std::vector<glm::vec4> values(particleCount_);
+        void *data;
+        vkMapMemory(vpeDevice_.device(), stagingMemory, 0, size, 0, &data);
+        memcpy(values.data(), data, static_cast<size_t>(size));
+        vkUnmapMemory(vpeDevice_.device(), stagingMemory);
+
+        vkDestroyBuffer(vpeDevice_.device(), stagingBuffer, nullptr);
+        vkFreeMemory(vpeDevice_.device(), stagingMemory, nullptr);
+        return values;
+    }
+
+    VkCommandBuffer VpeGpuParticleSystem::beginComputeCommands()
+    {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = computeCommandPool_;
+        allocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer commandBuffer;
+        vkAllocateCommandBuffers(vpeDevice_.device(), &allocInfo, &commandBuffer);
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+        return commandBuffer;
+    }
+
+    void VpeGpuParticleSystem::endComputeCommands(VkCommandBuffer commandBuffer)
+    {
+        vkEndCommandBuffer(commandBuffer);
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+
+        vkQueueSubmit(vpeDevice_.computeQueue(), 1, &submitInfo, VK_NULL_HANDLE);
+        vkQueueWaitIdle(vpeDevice_.computeQueue());
+
+        vkFreeCommandBuffers(vpeDevice_.device(), computeCommandPool_, 1, &commandBuffer);
+    }
+} // namespace vpe
@@ -0,0 +1,174 @@
+#pragma once
+
+#include "VpeComputePipeline.hpp"
+#include "VpeDevice.hpp"
+#include "VpeGpuTimestamps.hpp"
+#include "VpeJobSystem.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace vpe
+{
+    struct VpeGpuParticleSettings
+    {
+        glm::vec3 gravity{0.0f, -9.81f, 0.0f};
+        float groundHeight = 0.0f;
+        // Spring-damper contacts: the springier, the smaller the steps have to be.
+        float stiffness = 2000.0f;
+        float damping = 8.0f;
+        // One recordStep moves the simulation by timeStep, split into this many substeps.
+        float timeStep = 1.0f / 60.0f;
+        uint32_t substeps = 4;
+    };
+
+    // Particle physics that lives entirely on the GPU. Every substep is six compute passes:
+    // clear the grid, hash, prefix sum, scatter, collide, integrate. Same counting sort as
+    // VpeSpatialHashGrid, just with one thread per particle instead of one per chunk.
+    //
+    // All of it runs on the compute queue. With an async compute family that's a different queue
+    // than graphics, so the step for frame N+1 runs while graphics is still drawing frame N.
+    // To make that work every frame slot gets its own copy of the positions to draw from:
+    // the step ends by copying into the slot's render buffer and handing it over to graphics.
+    // Nothing ever comes back to the CPU (except in validateAgainstCpu).
+    //
+    // Per frame slot the order is:
+    //   submitStep(slot)           compute, waits for the last draw out of this slot
+    //   recordAcquire(cmd, slot)   graphics, before reading renderBuffer(slot)
+    //   graphics submit            waits on stepFinished, has to signal drawFinishedSemaphore(slot)
+    //
+    // Contacts are spring-damper (DEM) and not the impulse solver VpePhysicsWorld uses.
+    // Impulses need iterations that see each other's results, springs only need the last state,
+    // which is what makes every particle its own independent thread.
+    class VpeGpuParticleSystem
+    {
+    public:
+        // Each particle is xyz position + radius in w. frameSlotCount is how many frames
+        // the renderer keeps in flight.
+        VpeGpuParticleSystem(
+            VpeDevice &device,
+            VpeJobSystem &jobSystem,
+            const std::vector<glm::vec4> &particles,
+            uint32_t frameSlotCount,
+            const VpeGpuParticleSettings &settings = {});
+        ~VpeGpuParticleSystem();
+
+        VpeGpuParticleSystem(const VpeGpuParticleSystem &) = delete;
+        VpeGpuParticleSystem &operator=(const VpeGpuParticleSystem &) = delete;
+
+        // Records one timeStep worth of substeps. Only reads our own state,
+        // so several command buffers can record this at the same time.
+        // Compute queue only, it leaves the positions ready for a transfer.
+        void recordStep(VkCommandBuffer commandBuffer) const;
+
+        // Submits the step for this slot on the compute queue. Returns the semaphore the
+        // graphics submit has to wait on (at whichever stage first reads the render buffer).
+        VkSemaphore submitStep(uint32_t slot);
+        // Graphics side of the queue ownership transfer. Does nothing when there's one queue.
+        void recordAcquire(VkCommandBuffer commandBuffer, uint32_t slot) const;
+        // The graphics submit that draws slot has to signal this, every time.
+        VkSemaphore drawFinishedSemaphore(uint32_t slot) const { return drawFinishedSemaphores_[slot]; }
+        // GPU ticks at the start and end of the last finished step for slot, false if there isn't one.
+        bool stepTimestamps(uint32_t slot, uint64_t ticks[2]) const;
+        const VpeGpuTimestamps &timestamps() const { return timestamps_; }
+
+        // Runs steps on the GPU from the initial particles. Before each one the state comes back and the
+        // CPU does the same step from it, and the positions after it have to agree within tolerance.
+        // Puts the initial state back afterwards either way.
+        bool validateAgainstCpu(uint32_t steps, float tolerance);
+
+        // One vec4 per particle. Usable as a per instance vertex buffer or a storage buffer.
+        VkBuffer renderBuffer(uint32_t slot) const { return renderBuffers_[slot]; }
+        uint32_t particleCount() const { return particleCount_; }
+
+        // The CPU version of one substep, same math as the shaders. Positions are xyz + radius.
+        static void stepReference(
+            VpeJobSystem &jobSystem,
+            const VpeGpuParticleSettings &settings,
+            float cellSize,
+            std::vector<glm::vec4> &positions,
+            std::vector<glm::vec4> &velocities,
+            float dt);
+
+    private:
+        // Buffer index == binding index in the shaders.
+        enum Binding : uint32_t
+        {
+            POSITIONS = 0,
+            VELOCITIES,
+            NEW_VELOCITIES,
+            CELL_COUNTS,
+            CELL_START,
+            PARTICLE_SLOTS,
+            SORTED_INDICES,
+            BINDING_COUNT
+        };
+
+        // Has to match the Params block in the Particle*.comp shaders.
+        struct PushConstants
+        {
+            glm::vec4 gravityDt;
+            float cellSize;
+            float groundHeight;
+            float stiffness;
+            float damping;
+            uint32_t particleCount;
+            uint32_t tableMask;
+        };
+
+        void createBuffers();
+        void createDescriptors();
+        void createPipelines();
+        void createFrameSlots();
+        void recordFrameSlot(uint32_t slot);
+        void uploadInitialState();
+        // Positions or velocities (one vec4 per particle) back to the CPU, waits for it.
+        std::vector<glm::vec4> readBack(Binding binding);
+        // Like VpeDevice's single time commands, but on the compute queue that owns our buffers.
+        VkCommandBuffer beginComputeCommands();
+        void endComputeCommands(VkCommandBuffer commandBuffer);
+
+        VpeDevice &vpeDevice_;
+        VpeJobSystem &jobSystem_;
+        VpeGpuParticleSettings settings_;
+        std::vector<glm::vec4> initialParticles_;
+        uint32_t particleCount_;
+        uint32_t tableSize_;
+        float cellSize_;
+
+        std::array<VkBuffer, BINDING_COUNT> buffers_{};
+        std::array<VkDeviceMemory, BINDING_COUNT> bufferMemories_{};
+
+        VkDescriptorSetLayout descriptorSetLayout_;
+        VkDescriptorPool descriptorPool_;
+        VkDescriptorSet descriptorSet_;
+        VkPipelineLayout pipelineLayout_;
+
+        std::unique_ptr<VpeComputePipeline> clearGridPipeline_;
+        std::unique_ptr<VpeComputePipeline> hashPipeline_;
+        std::unique_ptr<VpeComputePipeline> scanPipeline_;
+        std::unique_ptr<VpeComputePipeline> scatterPipeline_;
+        std::unique_ptr<VpeComputePipeline> collidePipeline_;
+        std::unique_ptr<VpeComputePipeline> integratePipeline_;
+
+        uint32_t computeFamily_;
+        uint32_t graphicsFamily_;
+        VkCommandPool computeCommandPool_;
+        VpeGpuTimestamps timestamps_;
+
+        // One of each per frame slot.
+        std::vector<VkBuffer> renderBuffers_;
+        std::vector<VkDeviceMemory> renderBufferMemories_;
+        std::vector<VkCommandBuffer> stepCommandBuffers_;
+        std::vector<VkSemaphore> stepFinishedSemaphores_;
+        std::vector<VkSemaphore> drawFinishedSemaphores_;
+        // The first step into a slot has no draw to wait for.
+        std::vector<uint8_t> slotDrawn_;
+    };
+} // namespace vpe
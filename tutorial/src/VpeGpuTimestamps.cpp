@@ -0,0 +1,92 @@
+#include "VpeGpuTimestamps.hpp"
+
+#include <stdexcept>
+#include <vector>
+
+namespace vpe
+{
+    VpeGpuTimestamps::VpeGpuTimestamps(VpeDevice &device, uint32_t queueFamily, uint32_t queryCount) : vpeDevice_{device},
+                                                                                                       queryCount_{queryCount}
+    {
+        period_ = static_cast<double>(device.properties.limits.timestampPeriod);
+        uint32_t validBits = device.timestampValidBits(queueFamily);
+        validMask_ = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+        if (validBits == 0)
+        {
+            return;
+        }
+
+        VkQueryPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        poolInfo.queryCount = queryCount;
+        if (vkCreateQueryPool(vpeDevice_.device(), &poolInfo, nullptr, &queryPool_) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create timestamp query pool.");
+        }
+    }
+
+    VpeGpuTimestamps::~VpeGpuTimestamps()
+    {
+        if (queryPool_ != VK_NULL_HANDLE)
+        {
+            vkDestroyQueryPool(vpeDevice_.device(), queryPool_, nullptr);
+        }
+    }
+
+    void VpeGpuTimestamps::reset(VkCommandBuffer commandBuffer, uint32_t first, uint32_t count) const
+    {
+        if (queryPool_ != VK_NULL_HANDLE)
+        {
+            vkCmdResetQueryPool(commandBuffer, queryPool_, first, count);
+        }
+    }
+
+    void VpeGpuTimestamps::write(VkCommandBuffer commandBuffer, VkPipelineStageFlagBits stage, uint32_t query) const
+    {
+        if (queryPool_ != VK_NULL_HANDLE)
+        {
+            vkCmdWriteTimestamp(commandBuffer, stage, queryPool_, query);
+        }
+    }
+
+    bool VpeGpuTimestamps::read(uint32_t first, uint32_t count, uint64_t *ticks) const
+    {
+        if (queryPool_ == VK_NULL_HANDLE || first + count > queryCount_)
+        {
+            return false;
+        }
+
+        // Each result comes with an availability word, so half written results just say no
+        // instead of making us wait.
+        std::vector<uint64_t> results(count * 2);
+        VkResult result = vkGetQueryPoolResults(
+            vpeDevice_.device(),
+            queryPool_,
+            first,
+            count,
+            results.size() * sizeof(uint64_t),
+            results.data(),
+            2 * sizeof(uint64_t),
+            VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+        if (result != VK_SUCCESS && result != VK_NOT_READY)
+        {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            if (results[i * 2 + 1] == 0)
+            {
+                return false;
+            }
+            ticks[i] = results[i * 2] & validMask_;
+        }
+        return true;
+    }
+
+    double VpeGpuTimestamps::ticksToMilliseconds(uint64_t ticks) const
+    {
+        return static_cast<double>(ticks) * period_ / 1.0e6;
+    }
+} // namespace vpe
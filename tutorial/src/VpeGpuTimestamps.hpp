@@ -0,0 +1,42 @@
+#pragma once
+
+#include "VpeDevice.hpp"
+
+#include <cstdint>
+
+namespace vpe
+{
+    // A small wrapper around a timestamp query pool. Queries get reset and written inside
+    // command buffers, and read back without waiting once the GPU is done with them.
+    // Timestamps from different queues on the same device share a clock, so intervals
+    // from the compute and graphics queues can be compared directly.
+    class VpeGpuTimestamps
+    {
+    public:
+        // queueFamily is the family the queries get written on. If it can't do timestamps
+        // everything here quietly does nothing and read() always says no.
+        VpeGpuTimestamps(VpeDevice &device, uint32_t queueFamily, uint32_t queryCount);
+        ~VpeGpuTimestamps();
+
+        VpeGpuTimestamps(const VpeGpuTimestamps &) = delete;
+        VpeGpuTimestamps &operator=(const VpeGpuTimestamps &) = delete;
+
+        // Has to be recorded outside a render pass, before the queries get written again.
+        void reset(VkCommandBuffer commandBuffer, uint32_t first, uint32_t count) const;
+        void write(VkCommandBuffer commandBuffer, VkPipelineStageFlagBits stage, uint32_t query) const;
+
+        // Fills ticks[0 .. count) and returns true only if every one of them is available.
+        bool read(uint32_t first, uint32_t count, uint64_t *ticks) const;
+        double ticksToMilliseconds(uint64_t ticks) const;
+
+        bool supported() const { return queryPool_ != VK_NULL_HANDLE; }
+
+    private:
+        VpeDevice &vpeDevice_;
+        VkQueryPool queryPool_ = VK_NULL_HANDLE;
+        uint32_t queryCount_;
+        // Nanoseconds per tick.
+        double period_;
+        uint64_t validMask_;
+    };
+} // namespace vpe
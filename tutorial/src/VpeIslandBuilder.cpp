@@ -0,0 +1,163 @@
+#include "VpeIslandBuilder.hpp"
+
+#include <algorithm>
+
+namespace vpe
+{
+    void VpeIslandBuilder::build(
+        uint32_t bodyCount,
+        const std::vector<uint32_t> &activeBodies,
+        const std::vector<Link> &contactLinks,
+        const std::vector<Link> &constraintLinks)
+    {
+        if (parent_.size() < bodyCount)
+        {
+            parent_.resize(bodyCount);
+            islandIndex_.resize(bodyCount);
+            activeStamp_.resize(bodyCount, 0);
+        }
+        // New stamp instead of clearing, so untouched (sleeping) bodies cost nothing.
+        if (++stamp_ == 0)
+        {
+            std::fill(activeStamp_.begin(), activeStamp_.end(), 0);
+            stamp_ = 1;
+        }
+
+        for (uint32_t body : activeBodies)
+        {
+            parent_[body] = body;
+            islandIndex_[body] = NO_BODY;
+            activeStamp_[body] = stamp_;
+        }
+
+        // Anything touching a static body or the ground doesn't connect through it.
+        for (const auto &link : contactLinks)
+        {
+            if (isActive(link.first) && isActive(link.second))
+            {
+                unite(link.first, link.second);
+            }
+        }
+        for (const auto &link : constraintLinks)
+        {
+            if (isActive(link.first) && isActive(link.second))
+            {
+                unite(link.first, link.second);
+            }
+        }
+
+        // Number the islands in the order their first body shows up, so it's the same every run.
+        uint32_t islandCount = 0;
+        for (uint32_t body : activeBodies)
+        {
+            uint32_t root = find(body);
+            if (islandIndex_[root] == NO_BODY)
+            {
+                islandIndex_[root] = islandCount++;
+            }
+        }
+
+        bodyStart_.assign(islandCount + 1, 0);
+        for (uint32_t body : activeBodies)
+        {
+            bodyStart_[islandIndex_[find(body)] + 1]++;
+        }
+        for (uint32_t i = 0; i < islandCount; i++)
+        {
+            bodyStart_[i + 1] += bodyStart_[i];
+        }
+
+        bodies_.resize(activeBodies.size());
+        std::vector<uint32_t> cursor(bodyStart_.begin(), bodyStart_.end() - 1);
+        for (uint32_t body : activeBodies)
+        {
+            bodies_[cursor[islandIndex_[find(body)]]++] = body;
+        }
+
+        groupLinks(contactLinks, contacts_, contactStart_);
+        groupLinks(constraintLinks, constraints_, constraintStart_);
+    }
+
+    uint32_t VpeIslandBuilder::find(uint32_t body)
+    {
+        // Path halving, keeps the trees flat without recursion.
+        while (parent_[body] != body)
+        {
+            parent_[body] = parent_[parent_[body]];
+            body = parent_[body];
+        }
+        return body;
+    }
+
+    void VpeIslandBuilder::unite(uint32_t a, uint32_t b)
+    {
+        a = find(a);
+        b = find(b);
+        if (a == b)
+        {
+            return;
+        }
+        // Smaller index wins, which keeps the result independent of link order.
+        if (a < b)
+        {
+            parent_[b] = a;
+        }
+        else
+        {
+            parent_[a] = b;
+        }
+    }
+
+    bool VpeIslandBuilder::isActive(uint32_t body) const
+    {
+        return body < activeStamp_.size() && activeStamp_[body] == stamp_;
+    }
+
+    uint32_t VpeIslandBuilder::islandOfLink(const Link &link) const
+    {
+        // find() without the path halving, the trees are already flat from the pass above.
+        uint32_t body = isActive(link.first) ? link.first : link.second;
+        if (!isActive(body))
+        {
+            return NO_BODY;
+        }
+        while (parent_[body] != body)
+        {
+            body = parent_[body];
+        }
+        return islandIndex_[body];
+    }
+
+    void VpeIslandBuilder::groupLinks(
+        const std::vector<Link> &links,
+        std::vector<uint32_t> &grouped,
+        std::vector<uint32_t> &start)
+    {
+        uint32_t islandCount = static_cast<uint32_t>(bodyStart_.size()) - 1;
+        start.assign(islandCount + 1, 0);
+
+        std::vector<uint32_t> linkIsland(links.size());
+        for (size_t i = 0; i < links.size(); i++)
+        {
+            linkIsland[i] = islandOfLink(links[i]);
+            if (linkIsland[i] != NO_BODY)
+            {
+                start[linkIsland[i] + 1]++;
+            }
+        }
+        for (uint32_t i = 0; i < islandCount; i++)
+        {
+            start[i + 1] += start[i];
+        }
+
+        grouped.resize(start[islandCount]);
+        std::vector<uint32_t> cursor(start.begin(), start.end() - 1);
+        for (size_t i = 0; i < links.size(); i++)
+        {
+            if (linkIsland[i] != NO_BODY)
+            {
+                grouped[cursor[linkIsland[i]]++] = static_cast<uint32_t>(i);
+            }
+        }
+    }
+} // namespace vpe
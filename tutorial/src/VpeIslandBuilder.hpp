@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace vpe
+{
+    // Groups bodies into islands: sets of bodies connected through contacts or constraints.
+    // Islands don't share any dynamic body, so each one can be solved on its own thread.
+    // It's a union-find over the links, then a counting sort so every island is just
+    // a range in a few flat arrays (same trick as the hash grid, no per island vectors).
+    class VpeIslandBuilder
+    {
+    public:
+        static constexpr uint32_t NO_BODY = std::numeric_limits<uint32_t>::max();
+
+        // Links between two bodies. Static bodies (and the ground) pass NO_BODY or a body that
+        // isn't in the active list; those don't glue islands together.
+        using Link = std::pair<uint32_t, uint32_t>;
+
+        // activeBodies are the dynamic bodies being simulated this step, bodyCount the total.
+        // contacts and constraints are indexed separately so the solver can find its own data.
+        // Cost is proportional to activeBodies + links, the total body count only matters for sizing.
+        void build(
+            uint32_t bodyCount,
+            const std::vector<uint32_t> &activeBodies,
+            const std::vector<Link> &contactLinks,
+            const std::vector<Link> &constraintLinks);
+
+        uint32_t islandCount() const { return static_cast<uint32_t>(bodyStart_.size()) - 1; }
+
+        // Island i owns bodies()[bodyStart()[i] .. bodyStart()[i + 1]), and the same for the others.
+        const std::vector<uint32_t> &bodies() const { return bodies_; }
+        const std::vector<uint32_t> &bodyStart() const { return bodyStart_; }
+        const std::vector<uint32_t> &contacts() const { return contacts_; }
+        const std::vector<uint32_t> &contactStart() const { return contactStart_; }
+        const std::vector<uint32_t> &constraints() const { return constraints_; }
+        const std::vector<uint32_t> &constraintStart() const { return constraintStart_; }
+
+    private:
+        uint32_t find(uint32_t body);
+        void unite(uint32_t a, uint32_t b);
+        bool isActive(uint32_t body) const;
+        uint32_t islandOfLink(const Link &link) const;
+        void groupLinks(
+            const std::vector<Link> &links,
+            std::vector<uint32_t> &grouped,
+            std::vector<uint32_t> &start);
+
+        // Indexed by body. Only the entries for this step's active bodies are valid,
+        // activeStamp_ says which ones, so we never have to clear the whole thing.
+        std::vector<uint32_t> parent_;
+        std::vector<uint32_t> islandIndex_;
+        std::vector<uint32_t> activeStamp_;
+        uint32_t stamp_ = 0;
+
+        std::vector<uint32_t> bodies_;
+        std::vector<uint32_t> bodyStart_{0};
+        std::vector<uint32_t> contacts_;
+        std::vector<uint32_t> contactStart_{0};
+        std::vector<uint32_t> constraints_;
+        std::vector<uint32_t> constraintStart_{0};
+    };
+} // namespace vpe
@@ -0,0 +1,393 @@
+#include "VpeJobSystem.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace vpe
+{
+    namespace
+    {
+        // Which pool the current thread belongs to, and its slot in that pool.
+        thread_local const VpeJobSystem *tlsJobSystem = nullptr;
+        thread_local int tlsThreadIndex = -1;
+        // Cheap per thread random numbers for picking who to steal from.
+        thread_local uint32_t tlsRandomState = 0x9E3779B9u;
+
+        uint32_t nextRandom()
+        {
+            uint32_t x = tlsRandomState;
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            tlsRandomState = x;
+            return x;
+        }
+
+        // How many times an idle worker looks for work before going to sleep.
+        constexpr int SPIN_COUNT = 64;
+        // Lazy splitting stops cutting a range once this thread already has this much queued up.
+        constexpr int64_t SPLIT_QUEUE_LIMIT = 2;
+    }
+
+    struct VpeJobSystem::ParallelForState
+    {
+        const std::function<void(uint32_t, uint32_t)> *fn;
+        uint32_t grain;
+        std::atomic<uint32_t> pendingRanges{0};
+
+        // First exception thrown by any range, handed back to the caller once everything stopped.
+        std::mutex exceptionMutex;
+        std::exception_ptr exception;
+
+        void capture(std::exception_ptr thrown)
+        {
+            std::lock_guard<std::mutex> lock(exceptionMutex);
+            if (!exception)
+            {
+                exception = thrown;
+            }
+        }
+    };
+
+    VpeJobSystem::VpeJobSystem(uint32_t threadCount)
+    {
+        if (threadCount == 0)
+        {
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        deques_.reserve(threadCount);
+        for (uint32_t i = 0; i < threadCount; i++)
+        {
+            deques_.push_back(std::make_unique<VpeWorkStealingDeque<Task>>());
+        }
+
+        // Slot 0 is us. We don't get a worker loop, we help when we wait.
+        tlsJobSystem = this;
+        tlsThreadIndex = 0;
+
+        workers_.reserve(threadCount - 1);
+        for (uint32_t i = 1; i < threadCount; i++)
+        {
+            workers_.emplace_back([this, i]()
+                                  { workerLoop(i); });
+        }
+    }
+
+    VpeJobSystem::~VpeJobSystem()
+    {
+        stopping_.store(true);
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex_);
+        }
+        wakeCondition_.notify_all();
+        for (auto &worker : workers_)
+        {
+            worker.join();
+        }
+
+        if (tlsJobSystem == this)
+        {
+            tlsJobSystem = nullptr;
+            tlsThreadIndex = -1;
+        }
+    }
+
+    VpeJobSystem::TaskHandle VpeJobSystem::createTask(std::function<void()> work)
+    {
+        auto task = std::make_shared<Task>();
+        task->work = std::move(work);
+        return task;
+    }
+
+    void VpeJobSystem::addDependency(const TaskHandle &before, const TaskHandle &after)
+    {
+        std::lock_guard<std::mutex> lock(before->continuationMutex);
+        // If it's already done there is nothing to wait for.
+        if (before->finished.load(std::memory_order_acquire))
+        {
+            return;
+        }
+        after->pendingCount.fetch_add(1, std::memory_order_relaxed);
+        before->continuations.push_back(after);
+    }
+
+    void VpeJobSystem::submit(const TaskHandle &task)
+    {
+        task->self = task;
+        if (task->pendingCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            schedule(task.get());
+        }
+    }
+
+    VpeJobSystem::TaskHandle VpeJobSystem::run(std::function<void()> work)
+    {
+        auto task = createTask(std::move(work));
+        submit(task);
+        return task;
+    }
+
+    VpeJobSystem::TaskHandle VpeJobSystem::then(const TaskHandle &before, std::function<void()> work)
+    {
+        auto task = createTask(std::move(work));
+        addDependency(before, task);
+        submit(task);
+        return task;
+    }
+
+    bool VpeJobSystem::isDone(const TaskHandle &task) const
+    {
+        return task->finished.load(std::memory_order_acquire);
+    }
+
+    void VpeJobSystem::wait(const TaskHandle &task)
+    {
+        while (!isDone(task))
+        {
+            if (!helpOnce())
+            {
+                std::this_thread::yield();
+            }
+        }
+        if (task->exception)
+        {
+            std::rethrow_exception(task->exception);
+        }
+    }
+
+    void VpeJobSystem::wait(const std::vector<TaskHandle> &tasks)
+    {
+        for (const auto &task : tasks)
+        {
+            wait(task);
+        }
+    }
+
+    void VpeJobSystem::parallelFor(uint32_t count, const std::function<void(uint32_t, uint32_t)> &fn, uint32_t minGrain)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+
+        minGrain = std::max(1u, minGrain);
+        if (threadCount() == 1 || count <= minGrain)
+        {
+            fn(0, count);
+            return;
+        }
+
+        // Don't bother cutting finer than a few ranges per thread, the task overhead would eat it.
+        ParallelForState state;
+        state.fn = &fn;
+        state.grain = std::max(minGrain, count / (threadCount() * 8));
+
+        // The other ranges point at state on our stack, so even if ours throws we have to wait for them.
+        try
+        {
+            splitRange(state, 0, count);
+        }
+        catch (...)
+        {
+            state.capture(std::current_exception());
+        }
+        while (state.pendingRanges.load(std::memory_order_acquire) != 0)
+        {
+            if (!helpOnce())
+            {
+                std::this_thread::yield();
+            }
+        }
+        if (state.exception)
+        {
+            std::rethrow_exception(state.exception);
+        }
+    }
+
+    void VpeJobSystem::parallelForChunks(uint32_t count, uint32_t chunkCount, const std::function<void(uint32_t, uint32_t, uint32_t)> &fn)
+    {
+        if (chunkCount <= 1)
+        {
+            fn(0u, 0u, count);
+            return;
+        }
+
+        uint32_t chunkSize = (count + chunkCount - 1) / chunkCount;
+        parallelFor(chunkCount, [&fn, count, chunkSize](uint32_t first, uint32_t last)
+                    {
+            for (uint32_t chunk = first; chunk < last; chunk++)
+            {
+                uint32_t begin = std::min(count, chunk * chunkSize);
+                uint32_t end = std::min(count, begin + chunkSize);
+                fn(chunk, begin, end);
+            } });
+    }
+
+    uint32_t VpeJobSystem::chunkCountFor(uint32_t count, uint32_t minChunkSize) const
+    {
+        if (count < minChunkSize)
+        {
+            return 1;
+        }
+        return std::min(threadCount(), (count + minChunkSize - 1) / minChunkSize);
+    }
+
+    int VpeJobSystem::currentThreadIndex() const
+    {
+        return tlsJobSystem == this ? tlsThreadIndex : -1;
+    }
+
+    void VpeJobSystem::splitRange(ParallelForState &state, uint32_t begin, uint32_t end)
+    {
+        int index = currentThreadIndex();
+        while (end - begin > state.grain)
+        {
+            // If our deque already has work in it, nobody is starving. Just do the range ourselves.
+            if (index >= 0 && deques_[index]->size() >= SPLIT_QUEUE_LIMIT)
+            {
+                break;
+            }
+
+            uint32_t middle = begin + (end - begin) / 2;
+            state.pendingRanges.fetch_add(1, std::memory_order_relaxed);
+            run([this, &state, middle, end]()
+                {
+                try
+                {
+                    splitRange(state, middle, end);
+                }
+                catch (...)
+                {
+                    state.capture(std::current_exception());
+                }
+                state.pendingRanges.fetch_sub(1, std::memory_order_release); });
+            end = middle;
+        }
+        (*state.fn)(begin, end);
+    }
+
+    void VpeJobSystem::schedule(Task *task)
+    {
+        int index = currentThreadIndex();
+        if (index < 0 || !deques_[index]->push(task))
+        {
+            std::lock_guard<std::mutex> lock(injectionMutex_);
+            injectionQueue_.push_back(task);
+        }
+
+        // Pairs with the check in workerLoop. Either the worker sees the count, or we see the sleeper.
+        queuedTasks_.fetch_add(1);
+        if (sleepingWorkers_.load() > 0)
+        {
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex_);
+            }
+            wakeCondition_.notify_one();
+        }
+    }
+
+    void VpeJobSystem::execute(Task *task)
+    {
+        queuedTasks_.fetch_sub(1, std::memory_order_relaxed);
+        // Exceptions can't cross threads on their own, so they ride along on the task until someone wait()s.
+        try
+        {
+            task->work();
+        }
+        catch (...)
+        {
+            task->exception = std::current_exception();
+        }
+
+        std::vector<TaskHandle> continuations;
+        {
+            std::lock_guard<std::mutex> lock(task->continuationMutex);
+            task->finished.store(true, std::memory_order_release);
+            continuations.swap(task->continuations);
+        }
+
+        for (auto &continuation : continuations)
+        {
+            if (continuation->pendingCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                schedule(continuation.get());
+            }
+        }
+
+        // Drop the queue's reference last, this might delete the task.
+        TaskHandle keepAlive = std::move(task->self);
+    }
+
+    VpeJobSystem::Task *VpeJobSystem::findWork(int index)
+    {
+        if (index >= 0)
+        {
+            if (Task *task = deques_[index]->pop())
+            {
+                return task;
+            }
+        }
+
+        uint32_t count = threadCount();
+        uint32_t start = nextRandom() % count;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint32_t victim = (start + i) % count;
+            if (static_cast<int>(victim) == index)
+            {
+                continue;
+            }
+            if (Task *task = deques_[victim]->steal())
+            {
+                return task;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(injectionMutex_);
+        if (!injectionQueue_.empty())
+        {
+            Task *task = injectionQueue_.front();
+            injectionQueue_.pop_front();
+            return task;
+        }
+        return nullptr;
+    }
+
+    bool VpeJobSystem::helpOnce()
+    {
+        Task *task = findWork(currentThreadIndex());
+        if (task == nullptr)
+        {
+            return false;
+        }
+        execute(task);
+        return true;
+    }
+
+    void VpeJobSystem::workerLoop(uint32_t index)
+    {
+        tlsJobSystem = this;
+        tlsThreadIndex = static_cast<int>(index);
+        tlsRandomState = 0x9E3779B9u * (index + 1);
+
+        while (!stopping_.load(std::memory_order_relaxed))
+        {
+            bool found = false;
+            for (int spin = 0; spin < SPIN_COUNT && !found; spin++)
+            {
+                found = helpOnce();
+            }
+            if (found)
+            {
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleepMutex_);
+            sleepingWorkers_.fetch_add(1);
+            wakeCondition_.wait(lock, [this]()
+                                { return queuedTasks_.load() > 0 || stopping_.load(); });
+            sleepingWorkers_.fetch_sub(1);
+        }
+    }
+} // namespace vpe
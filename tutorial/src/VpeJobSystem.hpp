@@ -0,0 +1,107 @@
+#pragma once
+
+#include "VpeWorkStealingDeque.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vpe
+{
+    // One fixed pool of threads that everything shares (physics, asset loading, command recording).
+    // The thread that creates it counts as thread 0, so threadCount() threads in total and never more than the cores.
+    // Every thread has its own Chase-Lev deque. Idle threads steal from the others.
+    // The creating thread doesn't run a loop, it helps out whenever it wait()s on something.
+    class VpeJobSystem
+    {
+    public:
+        struct Task;
+        using TaskHandle = std::shared_ptr<Task>;
+
+        // 0 means one thread per hardware thread.
+        explicit VpeJobSystem(uint32_t threadCount = 0);
+        // Everything submitted should be waited on before this goes away.
+        ~VpeJobSystem();
+
+        VpeJobSystem(const VpeJobSystem &) = delete;
+        VpeJobSystem &operator=(const VpeJobSystem &) = delete;
+
+        // A task that won't run until submit() is called, so dependencies can be hooked up first.
+        TaskHandle createTask(std::function<void()> work);
+        // after won't start until before has finished. Has to be called before after is submitted.
+        void addDependency(const TaskHandle &before, const TaskHandle &after);
+        void submit(const TaskHandle &task);
+
+        // Shortcuts for the common cases.
+        TaskHandle run(std::function<void()> work);
+        TaskHandle then(const TaskHandle &before, std::function<void()> work);
+
+        bool isDone(const TaskHandle &task) const;
+        // Runs other tasks while waiting instead of sleeping, so the waiting thread isn't wasted.
+        // If the task threw, the exception comes out here.
+        void wait(const TaskHandle &task);
+        void wait(const std::vector<TaskHandle> &tasks);
+
+        // Calls fn(begin, end) over sub ranges of [0, count) and returns when all of them are done.
+        // Ranges get split in half lazily, only while this thread's deque is close to empty,
+        // so the grain adapts to how busy the pool is. Nothing gets smaller than minGrain.
+        // The first exception thrown by fn gets rethrown here once every range has stopped.
+        void parallelFor(uint32_t count, const std::function<void(uint32_t, uint32_t)> &fn, uint32_t minGrain = 1);
+
+        // Like parallelFor, but cut into exactly chunkCount equal pieces and fn(chunk, begin, end) knows which one it got.
+        // For when every piece writes its own output and the pieces get glued back together in order.
+        void parallelForChunks(uint32_t count, uint32_t chunkCount, const std::function<void(uint32_t, uint32_t, uint32_t)> &fn);
+        // A sensible chunk count for that: one per thread, but no chunk smaller than minChunkSize.
+        uint32_t chunkCountFor(uint32_t count, uint32_t minChunkSize) const;
+
+        uint32_t threadCount() const { return static_cast<uint32_t>(deques_.size()); }
+        // Index of the calling thread in this pool, or -1 if it isn't one of ours.
+        int currentThreadIndex() const;
+
+    private:
+        struct ParallelForState;
+
+        void schedule(Task *task);
+        void execute(Task *task);
+        Task *findWork(int index);
+        bool helpOnce();
+        void splitRange(ParallelForState &state, uint32_t begin, uint32_t end);
+        void workerLoop(uint32_t index);
+
+        std::vector<std::unique_ptr<VpeWorkStealingDeque<Task>>> deques_;
+        std::vector<std::thread> workers_;
+
+        // Tasks submitted from threads outside the pool land here.
+        std::mutex injectionMutex_;
+        std::deque<Task *> injectionQueue_;
+
+        // Sleeping. queuedTasks_ counts everything pushed but not yet taken.
+        std::mutex sleepMutex_;
+        std::condition_variable wakeCondition_;
+        std::atomic<int64_t> queuedTasks_{0};
+        std::atomic<uint32_t> sleepingWorkers_{0};
+        std::atomic<bool> stopping_{false};
+    };
+
+    struct VpeJobSystem::Task
+    {
+        std::function<void()> work;
+        // Starts at 1 for the submit() itself, plus one per unfinished dependency.
+        std::atomic<uint32_t> pendingCount{1};
+        std::atomic<bool> finished{false};
+        std::exception_ptr exception;
+
+        std::mutex continuationMutex;
+        std::vector<TaskHandle> continuations;
+
+        // Keeps the task alive while it's sitting in a queue.
+        TaskHandle self;
+    };
+} // namespace vpe
@@ -0,0 +1,72 @@
+#include "VpeLodSelector.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace vpe
+{
+    VpeLodSelector::VpeLodSelector(const glm::mat4 &projection, float viewportHeight, const VpeLodSelectSettings &settings)
+        : settings_{settings}
+    {
+        // projection[1][1] is 1 / tan(fovY / 2), so this is half the viewport over the half height at distance one.
+        pixelsPerUnit_ = std::abs(projection[1][1]) * viewportHeight * 0.5f;
+    }
+
+    uint32_t VpeLodSelector::select(const VpeModel &model, uint32_t currentLod, float distance, float scale) const
+    {
+        uint32_t last = model.lodCount() - 1;
+        currentLod = std::min(currentLod, last);
+        float pixelsPerError = pixelsPerUnit_ * scale / std::max(distance, 1e-4f);
+        auto pixels = [&](uint32_t lod)
+        {
+            return model.lod(lod).error * pixelsPerError;
+        };
+
+        uint32_t target = 0;
+        for (uint32_t lod = last; lod > 0; lod--)
+        {
+            if (pixels(lod) <= settings_.pixelError)
+            {
+                target = lod;
+                break;
+            }
+        }
+
+        if (target > currentLod)
+        {
+            // Going coarser, but only as far as levels that are comfortably under the threshold.
+            float limit = settings_.pixelError * (1.0f - settings_.hysteresis);
+            while (target > currentLod && pixels(target) > limit)
+            {
+                target--;
+            }
+        }
+        else if (target < currentLod)
+        {
+            // Going finer only once the current level is clearly too rough.
+            if (pixels(currentLod) <= settings_.pixelError * (1.0f + settings_.hysteresis))
+            {
+                target = currentLod;
+            }
+        }
+        return target;
+    }
+
+    void VpeLodSelector::selectAll(
+        VpeJobSystem &jobSystem,
+        const VpeModel &model,
+        const glm::vec3 &cameraPosition,
+        const std::vector<glm::vec4> &instances,
+        std::vector<uint32_t> &lods) const
+    {
+        lods.resize(instances.size(), 0);
+        jobSystem.parallelFor(static_cast<uint32_t>(instances.size()), [&](uint32_t begin, uint32_t end)
+                              {
+            for (uint32_t i = begin; i < end; i++)
+            {
+                const glm::vec4 &instance = instances[i];
+                float distance = glm::length(glm::vec3{instance} - cameraPosition);
+                lods[i] = select(model, lods[i], distance, instance.w);
+            } }, 1024);
+    }
+} // namespace vpe
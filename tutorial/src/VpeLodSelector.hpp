@@ -0,0 +1,51 @@
+#pragma once
+
+#include "VpeJobSystem.hpp"
+#include "VpeModel.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace vpe
+{
+    struct VpeLodSelectSettings
+    {
+        // How many pixels a level is allowed to be off by on screen.
+        float pixelError = 1.0f;
+        // To switch to a coarser level it has to be this much under pixelError,
+        // and to switch back the current one has to be this much over. Stops levels
+        // flickering back and forth for things sitting right at the boundary.
+        float hysteresis = 0.25f;
+    };
+
+    // Picks a level of detail per instance from how big the level's error looks on screen:
+    // the error in model units, times the instance scale, projected at the instance's distance.
+    // The coarsest level that stays under the threshold wins.
+    class VpeLodSelector
+    {
+    public:
+        // projection is the one used for drawing (the y flip doesn't matter), viewportHeight in pixels.
+        VpeLodSelector(const glm::mat4 &projection, float viewportHeight, const VpeLodSelectSettings &settings = {});
+
+        // currentLod is what the instance drew with last frame, 0 if it's new.
+        uint32_t select(const VpeModel &model, uint32_t currentLod, float distance, float scale = 1.0f) const;
+
+        // The same over a batch. Instances are xyz position + uniform scale in w.
+        // lods holds last frame's choice going in (resized with zeros if it's short) and this frame's coming out.
+        void selectAll(
+            VpeJobSystem &jobSystem,
+            const VpeModel &model,
+            const glm::vec3 &cameraPosition,
+            const std::vector<glm::vec4> &instances,
+            std::vector<uint32_t> &lods) const;
+
+    private:
+        // How many pixels one unit covers at distance one.
+        float pixelsPerUnit_;
+        VpeLodSelectSettings settings_;
+    };
+} // namespace vpe
@@ -0,0 +1,103 @@
+#include "VpeMappedFile.hpp"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace vpe
+{
+#ifdef _WIN32
+    VpeMappedFile::VpeMappedFile(const std::filesystem::path &path)
+    {
+        file_ = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE)
+        {
+            file_ = nullptr;
+            throw std::runtime_error("Failed to open file: " + path.string());
+        }
+        LARGE_INTEGER fileSize;
+        GetFileSizeEx(file_, &fileSize);
+        size_ = static_cast<size_t>(fileSize.QuadPart);
+        // Empty files can't be mapped, they just stay a null pointer and a size of 0.
+        if (size_ == 0)
+        {
+            return;
+        }
+        mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        void *view = mapping_ != nullptr ? MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (view == nullptr)
+        {
+            if (mapping_ != nullptr)
+            {
+                CloseHandle(mapping_);
+            }
+            CloseHandle(file_);
+            throw std::runtime_error("Failed to map file: " + path.string());
+        }
+        data_ = static_cast<const uint8_t *>(view);
+    }
+
+    VpeMappedFile::~VpeMappedFile()
+    {
+        if (data_ != nullptr)
+        {
+            UnmapViewOfFile(data_);
+        }
+        if (mapping_ != nullptr)
+        {
+            CloseHandle(mapping_);
+        }
+        if (file_ != nullptr)
+        {
+            CloseHandle(file_);
+        }
+    }
+#else
+    VpeMappedFile::VpeMappedFile(const std::filesystem::path &path)
+    {
+        int file = open(path.c_str(), O_RDONLY);
+        if (file < 0)
+        {
+            throw std::runtime_error("Failed to open file: " + path.string());
+        }
+        struct stat status;
+        if (fstat(file, &status) != 0)
+        {
+            close(file);
+            throw std::runtime_error("Failed to stat file: " + path.string());
+        }
+        size_ = static_cast<size_t>(status.st_size);
+        if (size_ > 0)
+        {
+            void *view = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, file, 0);
+            if (view == MAP_FAILED)
+            {
+                close(file);
+                throw std::runtime_error("Failed to map file: " + path.string());
+            }
+            // Read front to back, so let the kernel read ahead as far as it likes.
+            madvise(view, size_, MADV_SEQUENTIAL);
+            data_ = static_cast<const uint8_t *>(view);
+        }
+        // The mapping keeps the file alive on its own.
+        close(file);
+    }
+
+    VpeMappedFile::~VpeMappedFile()
+    {
+        if (data_ != nullptr)
+        {
+            munmap(const_cast<uint8_t *>(data_), size_);
+        }
+    }
+#endif
+} // namespace vpe
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+namespace vpe
+{
+    // A whole file mapped read only into memory. The OS pages it in as it gets touched,
+    // so opening a big log or snapshot is instant and reading it never copies into our own buffers.
+    class VpeMappedFile
+    {
+    public:
+        explicit VpeMappedFile(const std::filesystem::path &path);
+        ~VpeMappedFile();
+
+        VpeMappedFile(const VpeMappedFile &) = delete;
+        VpeMappedFile &operator=(const VpeMappedFile &) = delete;
+
+        const uint8_t *data() const { return data_; }
+        size_t size() const { return size_; }
+
+    private:
+        const uint8_t *data_ = nullptr;
+        size_t size_ = 0;
+#ifdef _WIN32
+        void *file_ = nullptr;
+        void *mapping_ = nullptr;
+#endif
+    };
+} // namespace vpe
@@ -0,0 +1,321 @@
+#include "VpeMeshSimplifier.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace vpe
+{
+    namespace
+    {
+        // Borders have no triangle on the other side to hold them in place, so they get an extra
+        // plane standing up along the edge. This much heavier than a normal triangle.
+        constexpr double BORDER_WEIGHT = 10.0;
+        // Collapses that turn a triangle further than this (cosine between old and new normal) are skipped.
+        constexpr float MIN_NORMAL_COSINE = 0.2f;
+
+        // The symmetric 4x4 matrix of the plane equations, summed up and weighted by area.
+        // Evaluating it at a point gives the weighted sum of squared distances to all of the planes.
+        struct Quadric
+        {
+            double a2 = 0, ab = 0, ac = 0, ad = 0;
+            double b2 = 0, bc = 0, bd = 0;
+            double c2 = 0, cd = 0;
+            double d2 = 0;
+            double weight = 0;
+
+            void addPlane(double a, double b, double c, double d, double w)
+            {
+                a2 += w * a * a;
+                ab += w * a * b;
+                ac += w * a * c;
+                ad += w * a * d;
+                b2 += w * b * b;
+                bc += w * b * c;
+                bd += w * b * d;
+                c2 += w * c * c;
+                cd += w * c * d;
+                d2 += w * d * d;
+                weight += w;
+            }
+
+            Quadric &operator+=(const Quadric &other)
+            {
+                a2 += other.a2;
+                ab += other.ab;
+                ac += other.ac;
+                ad += other.ad;
+                b2 += other.b2;
+                bc += other.bc;
+                bd += other.bd;
+                c2 += other.c2;
+                cd += other.cd;
+                d2 += other.d2;
+                weight += other.weight;
+                return *this;
+            }
+
+            // Mean squared distance, so it comes out in the units of the mesh no matter how big the triangles are.
+            double error(const glm::vec3 &p) const
+            {
+                double x = p.x, y = p.y, z = p.z;
+                double sum = a2 * x * x + b2 * y * y + c2 * z * z +
+                             2.0 * (ab * x * y + ac * x * z + bc * y * z) +
+                             2.0 * (ad * x + bd * y + cd * z) + d2;
+                return weight > 0.0 ? std::max(sum, 0.0) / weight : 0.0;
+            }
+        };
+
+        struct Collapse
+        {
+            uint32_t from;
+            uint32_t to;
+            double cost;
+        };
+
+        struct PositionHash
+        {
+            size_t operator()(const glm::vec3 &p) const
+            {
+                uint32_t bits[3];
+                std::memcpy(bits, &p, sizeof(bits));
+                return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+            }
+        };
+
+        uint64_t edgeKey(uint32_t a, uint32_t b)
+        {
+            return (static_cast<uint64_t>(a) << 32) | b;
+        }
+    }
+
+    VpeMeshSimplifier::Result VpeMeshSimplifier::simplify(
+        const std::vector<glm::vec3> &positions,
+        const std::vector<uint32_t> &indices,
+        size_t targetIndexCount,
+        float maxError)
+    {
+        Result result;
+        result.indices = indices;
+        if (indices.size() <= targetIndexCount)
+        {
+            return result;
+        }
+        uint32_t vertexCount = static_cast<uint32_t>(positions.size());
+
+        // Weld everything at the same position onto its first copy.
+        {
+            std::unordered_map<glm::vec3, uint32_t, PositionHash> firstAt;
+            std::vector<uint32_t> weld(vertexCount);
+            for (uint32_t v = 0; v < vertexCount; v++)
+            {
+                weld[v] = firstAt.emplace(positions[v], v).first->second;
+            }
+            for (auto &index : result.indices)
+            {
+                index = weld[index];
+            }
+        }
+
+        std::vector<Quadric> quadrics(vertexCount);
+        std::unordered_set<uint64_t> directedEdges;
+        for (size_t t = 0; t + 2 < result.indices.size(); t += 3)
+        {
+            const uint32_t *tri = &result.indices[t];
+            glm::vec3 normal = glm::cross(positions[tri[1]] - positions[tri[0]], positions[tri[2]] - positions[tri[0]]);
+            float doubleArea = glm::length(normal);
+            for (int corner = 0; corner < 3; corner++)
+            {
+                directedEdges.insert(edgeKey(tri[corner], tri[(corner + 1) % 3]));
+            }
+            if (doubleArea <= 0.0f)
+            {
+                continue;
+            }
+            normal /= doubleArea;
+            double d = -glm::dot(normal, positions[tri[0]]);
+            for (int corner = 0; corner < 3; corner++)
+            {
+                quadrics[tri[corner]].addPlane(normal.x, normal.y, normal.z, d, 0.5 * doubleArea);
+            }
+        }
+
+        // An edge nobody walks the other way is on the border.
+        for (size_t t = 0; t + 2 < result.indices.size(); t += 3)
+        {
+            const uint32_t *tri = &result.indices[t];
+            glm::vec3 faceNormal = glm::cross(positions[tri[1]] - positions[tri[0]], positions[tri[2]] - positions[tri[0]]);
+            if (glm::length(faceNormal) <= 0.0f)
+            {
+                continue;
+            }
+            for (int corner = 0; corner < 3; corner++)
+            {
+                uint32_t a = tri[corner];
+                uint32_t b = tri[(corner + 1) % 3];
+                if (directedEdges.count(edgeKey(b, a)) != 0)
+                {
+                    continue;
+                }
+                glm::vec3 edge = positions[b] - positions[a];
+                float edgeLength = glm::length(edge);
+                if (edgeLength <= 0.0f)
+                {
+                    continue;
+                }
+                glm::vec3 normal = glm::normalize(glm::cross(edge, faceNormal));
+                double d = -glm::dot(normal, positions[a]);
+                double w = BORDER_WEIGHT * edgeLength * edgeLength;
+                quadrics[a].addPlane(normal.x, normal.y, normal.z, d, w);
+                quadrics[b].addPlane(normal.x, normal.y, normal.z, d, w);
+            }
+        }
+
+        // Passes of: cost every edge, do the cheap ones that don't get in each other's way, rewrite the indices.
+        // A collapse locks everything around it for the rest of the pass, since its costs are stale now.
+        double maxCost = static_cast<double>(maxError) * static_cast<double>(maxError);
+        double worstCollapse = 0.0;
+        std::vector<uint32_t> remap(vertexCount);
+        std::vector<uint8_t> locked(vertexCount);
+        std::vector<uint32_t> triangleStart(vertexCount + 1);
+        std::vector<uint32_t> vertexTriangles;
+        std::vector<uint64_t> edges;
+        std::vector<Collapse> collapses;
+        size_t targetTriangles = targetIndexCount / 3;
+
+        while (result.indices.size() > targetIndexCount)
+        {
+            size_t triangleCount = result.indices.size() / 3;
+
+            // Triangles around every vertex, as offsets into one array.
+            std::fill(triangleStart.begin(), triangleStart.end(), 0u);
+            for (uint32_t index : result.indices)
+            {
+                triangleStart[index + 1]++;
+            }
+            std::partial_sum(triangleStart.begin(), triangleStart.end(), triangleStart.begin());
+            vertexTriangles.resize(result.indices.size());
+            {
+                std::vector<uint32_t> fill(triangleStart.begin(), triangleStart.end() - 1);
+                for (size_t i = 0; i < result.indices.size(); i++)
+                {
+                    vertexTriangles[fill[result.indices[i]]++] = static_cast<uint32_t>(i / 3);
+                }
+            }
+
+            edges.clear();
+            for (size_t t = 0; t < result.indices.size(); t += 3)
+            {
+                for (int corner = 0; corner < 3; corner++)
+                {
+                    uint32_t a = result.indices[t + corner];
+                    uint32_t b = result.indices[t + (corner + 1) % 3];
+                    edges.push_back(edgeKey(std::min(a, b), std::max(a, b)));
+                }
+            }
+            std::sort(edges.begin(), edges.end());
+            edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+            collapses.clear();
+            for (uint64_t key : edges)
+            {
+                uint32_t a = static_cast<uint32_t>(key >> 32);
+                uint32_t b = static_cast<uint32_t>(key);
+                Quadric merged = quadrics[a];
+                merged += quadrics[b];
+                double toB = merged.error(positions[b]);
+                double toA = merged.error(positions[a]);
+                collapses.push_back(toB <= toA ? Collapse{a, b, toB} : Collapse{b, a, toA});
+            }
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse &x, const Collapse &y)
+                      { return x.cost < y.cost; });
+
+            std::iota(remap.begin(), remap.end(), 0u);
+            std::fill(locked.begin(), locked.end(), 0);
+            size_t collapsed = 0;
+            for (const Collapse &collapse : collapses)
+            {
+                if (triangleCount <= targetTriangles || collapse.cost > maxCost)
+                {
+                    break;
+                }
+                if (locked[collapse.from] || locked[collapse.to])
+                {
+                    continue;
+                }
+
+                // Moving from onto to must not fold any of the triangles that stay over.
+                bool folds = false;
+                size_t removed = 0;
+                for (uint32_t i = triangleStart[collapse.from]; i < triangleStart[collapse.from + 1] && !folds; i++)
+                {
+                    const uint32_t *tri = &result.indices[vertexTriangles[i] * 3];
+                    if (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to)
+                    {
+                        removed++;
+                        continue;
+                    }
+                    glm::vec3 corners[3];
+                    for (int corner = 0; corner < 3; corner++)
+                    {
+                        corners[corner] = positions[tri[corner]];
+                    }
+                    glm::vec3 before = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+                    for (int corner = 0; corner < 3; corner++)
+                    {
+                        if (tri[corner] == collapse.from)
+                        {
+                            corners[corner] = positions[collapse.to];
+                        }
+                    }
+                    glm::vec3 after = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+                    float lengths = glm::length(before) * glm::length(after);
+                    folds = lengths <= 0.0f || glm::dot(before, after) < MIN_NORMAL_COSINE * lengths;
+                }
+                if (folds)
+                {
+                    continue;
+                }
+
+                remap[collapse.from] = collapse.to;
+                quadrics[collapse.to] += quadrics[collapse.from];
+                for (uint32_t i = triangleStart[collapse.from]; i < triangleStart[collapse.from + 1]; i++)
+                {
+                    const uint32_t *tri = &result.indices[vertexTriangles[i] * 3];
+                    locked[tri[0]] = locked[tri[1]] = locked[tri[2]] = 1;
+                }
+                locked[collapse.to] = 1;
+                triangleCount -= removed;
+                worstCollapse = std::max(worstCollapse, collapse.cost);
+                collapsed++;
+            }
+            if (collapsed == 0)
+            {
+                break;
+            }
+
+            // Nothing that collapsed this pass was a target of another collapse, so one hop is enough.
+            size_t kept = 0;
+            for (size_t t = 0; t < result.indices.size(); t += 3)
+            {
+                uint32_t a = remap[result.indices[t]];
+                uint32_t b = remap[result.indices[t + 1]];
+                uint32_t c = remap[result.indices[t + 2]];
+                if (a == b || b == c || a == c)
+                {
+                    continue;
+                }
+                result.indices[kept++] = a;
+                result.indices[kept++] = b;
+                result.indices[kept++] = c;
+            }
+            result.indices.resize(kept);
+        }
+
+        result.error = static_cast<float>(std::sqrt(worstCollapse));
+        return result;
+    }
+} // namespace vpe
@@ -0,0 +1,38 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace vpe
+{
+    // Quadric error edge collapse (Garland and Heckbert). Every vertex carries the sum of the
+    // squared distances to the planes of the triangles it started out in, and the collapse that
+    // adds the least to that goes first.
+    //
+    // Vertices only ever collapse onto one of the two ends of the edge, never onto a new point.
+    // So the result is just a new index list into the same vertex buffer, and all the levels
+    // of a model can share one.
+    class VpeMeshSimplifier
+    {
+    public:
+        struct Result
+        {
+            std::vector<uint32_t> indices;
+            // How far the surface moved, roughly, in the same units as the positions.
+            float error = 0.0f;
+        };
+
+        // Collapses edges until there are at most targetIndexCount indices left, or until the
+        // next collapse would move the surface more than maxError. Open borders are kept in place.
+        // Vertices at the same position count as one, so seams don't tear.
+        static Result simplify(
+            const std::vector<glm::vec3> &positions,
+            const std::vector<uint32_t> &indices,
+            size_t targetIndexCount,
+            float maxError = 1e30f);
+    };
+} // namespace vpe
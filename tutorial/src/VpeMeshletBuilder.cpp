@@ -0,0 +1,259 @@
+#include "VpeMeshletBuilder.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+
+namespace vpe
+{
+    namespace
+    {
+        constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+        // Normal cones wider than this (cosine of the half angle) never cull anything, so don't bother.
+        constexpr float MIN_CONE_COSINE = 0.1f;
+    }
+
+    VpeMeshletData VpeMeshletBuilder::build(
+        const std::vector<glm::vec3> &positions,
+        const std::vector<uint32_t> &indices,
+        uint32_t maxVertices,
+        uint32_t maxTriangles)
+    {
+        // The triangles store local indices in a byte.
+        if (maxVertices < 3 || maxVertices > 256 || maxTriangles == 0)
+        {
+            throw std::runtime_error("Meshlet limits out of range.");
+        }
+
+        VpeMeshletData data;
+        uint32_t vertexCount = static_cast<uint32_t>(positions.size());
+        uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+
+        // Triangles around every vertex, as offsets into one array.
+        std::vector<uint32_t> triangleStart(vertexCount + 1, 0);
+        for (uint32_t i = 0; i < triangleCount * 3; i++)
+        {
+            triangleStart[indices[i] + 1]++;
+        }
+        std::partial_sum(triangleStart.begin(), triangleStart.end(), triangleStart.begin());
+        std::vector<uint32_t> vertexTriangles(triangleCount * 3);
+        {
+            std::vector<uint32_t> fill(triangleStart.begin(), triangleStart.end() - 1);
+            for (uint32_t i = 0; i < triangleCount * 3; i++)
+            {
+                vertexTriangles[fill[indices[i]]++] = i / 3;
+            }
+        }
+
+        auto triangleCenter = [&](uint32_t triangle)
+        {
+            const uint32_t *corners = &indices[triangle * 3];
+            return (positions[corners[0]] + positions[corners[1]] + positions[corners[2]]) * (1.0f / 3.0f);
+        };
+
+        std::vector<uint8_t> used(triangleCount, 0);
+        // Where a vertex sits in the meshlet being built, NONE if it isn't in it.
+        std::vector<uint32_t> localIndex(vertexCount, NONE);
+        // Which meshlet last put a triangle on the candidate list, so it only goes on once.
+        std::vector<uint32_t> listedBy(triangleCount, NONE);
+        std::vector<uint32_t> candidates;
+        uint32_t nextSeed = 0;
+        uint32_t seedHint = NONE;
+
+        VpeMeshlet meshlet{0, 0, 0, 0};
+        glm::vec3 centerSum{0.0f};
+
+        auto finish = [&]()
+        {
+            if (meshlet.triangleCount == 0)
+            {
+                return;
+            }
+            data.bounds.push_back(computeBounds(data, meshlet, positions));
+            data.meshlets.push_back(meshlet);
+            for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+            {
+                localIndex[data.vertices[meshlet.vertexOffset + i]] = NONE;
+            }
+            // Start the next one right next to this one if we can.
+            seedHint = NONE;
+            for (uint32_t candidate : candidates)
+            {
+                if (!used[candidate])
+                {
+                    seedHint = candidate;
+                    break;
+                }
+            }
+            candidates.clear();
+            meshlet = VpeMeshlet{
+                static_cast<uint32_t>(data.vertices.size()),
+                static_cast<uint32_t>(data.triangles.size() / 3),
+                0,
+                0};
+            centerSum = glm::vec3{0.0f};
+        };
+
+        for (uint32_t placed = 0; placed < triangleCount; placed++)
+        {
+            uint32_t best = NONE;
+            if (meshlet.triangleCount > 0)
+            {
+                glm::vec3 center = centerSum / static_cast<float>(meshlet.triangleCount);
+                uint32_t bestNewVertices = NONE;
+                float bestDistance = 0.0f;
+                size_t kept = 0;
+                for (size_t c = 0; c < candidates.size(); c++)
+                {
+                    uint32_t triangle = candidates[c];
+                    if (used[triangle])
+                    {
+                        continue;
+                    }
+                    candidates[kept++] = triangle;
+
+                    const uint32_t *corners = &indices[triangle * 3];
+                    uint32_t newVertices = (localIndex[corners[0]] == NONE) +
+                                           (localIndex[corners[1]] == NONE && corners[1] != corners[0]) +
+                                           (localIndex[corners[2]] == NONE && corners[2] != corners[0] && corners[2] != corners[1]);
+                    if (meshlet.vertexCount + newVertices > maxVertices)
+                    {
+                        continue;
+                    }
+                    glm::vec3 offset = triangleCenter(triangle) - center;
+                    float distance = glm::dot(offset, offset);
+                    if (newVertices < bestNewVertices || (newVertices == bestNewVertices && distance < bestDistance))
+                    {
+                        best = triangle;
+                        bestNewVertices = newVertices;
+                        bestDistance = distance;
+                    }
+                }
+                candidates.resize(kept);
+
+                // Nothing around it fits anymore.
+                if (best == NONE)
+                {
+                    finish();
+                }
+            }
+
+            if (best == NONE)
+            {
+                if (seedHint != NONE && !used[seedHint])
+                {
+                    best = seedHint;
+                }
+                else
+                {
+                    while (used[nextSeed])
+                    {
+                        nextSeed++;
+                    }
+                    best = nextSeed;
+                }
+            }
+
+            const uint32_t *corners = &indices[best * 3];
+            for (int corner = 0; corner < 3; corner++)
+            {
+                uint32_t vertex = corners[corner];
+                if (localIndex[vertex] == NONE)
+                {
+                    localIndex[vertex] = meshlet.vertexCount++;
+                    data.vertices.push_back(vertex);
+                }
+                data.triangles.push_back(static_cast<uint8_t>(localIndex[vertex]));
+            }
+            meshlet.triangleCount++;
+            used[best] = 1;
+            centerSum += triangleCenter(best);
+
+            uint32_t meshletIndex = static_cast<uint32_t>(data.meshlets.size());
+            for (int corner = 0; corner < 3; corner++)
+            {
+                uint32_t vertex = corners[corner];
+                for (uint32_t i = triangleStart[vertex]; i < triangleStart[vertex + 1]; i++)
+                {
+                    uint32_t neighbor = vertexTriangles[i];
+                    if (!used[neighbor] && listedBy[neighbor] != meshletIndex)
+                    {
+                        listedBy[neighbor] = meshletIndex;
+                        candidates.push_back(neighbor);
+                    }
+                }
+            }
+
+            if (meshlet.triangleCount == maxTriangles)
+            {
+                finish();
+            }
+        }
+        finish();
+        return data;
+    }
+
+    VpeMeshletBounds VpeMeshletBuilder::computeBounds(const VpeMeshletData &data, const VpeMeshlet &meshlet, const std::vector<glm::vec3> &positions)
+    {
+        VpeMeshletBounds bounds{};
+
+        // Middle of the box around the vertices. Not the smallest sphere, but close enough for culling.
+        glm::vec3 low = positions[data.vertices[meshlet.vertexOffset]];
+        glm::vec3 high = low;
+        for (uint32_t i = 1; i < meshlet.vertexCount; i++)
+        {
+            low = glm::min(low, positions[data.vertices[meshlet.vertexOffset + i]]);
+            high = glm::max(high, positions[data.vertices[meshlet.vertexOffset + i]]);
+        }
+        bounds.center = (low + high) * 0.5f;
+        for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+        {
+            bounds.radius = std::max(bounds.radius, glm::length(positions[data.vertices[meshlet.vertexOffset + i]] - bounds.center));
+        }
+
+        std::vector<glm::vec3> normals;
+        normals.reserve(meshlet.triangleCount);
+        glm::vec3 normalSum{0.0f};
+        for (uint32_t t = 0; t < meshlet.triangleCount; t++)
+        {
+            const uint8_t *corners = &data.triangles[(meshlet.triangleOffset + t) * 3];
+            glm::vec3 a = positions[data.vertices[meshlet.vertexOffset + corners[0]]];
+            glm::vec3 b = positions[data.vertices[meshlet.vertexOffset + corners[1]]];
+            glm::vec3 c = positions[data.vertices[meshlet.vertexOffset + corners[2]]];
+            glm::vec3 normal = glm::cross(b - a, c - a);
+            float length = glm::length(normal);
+            if (length > 0.0f)
+            {
+                normals.push_back(normal / length);
+                normalSum += normals.back();
+            }
+        }
+
+        bounds.coneAxis = glm::vec3{0.0f, 0.0f, 1.0f};
+        bounds.coneCutoff = 1.0f;
+        float sumLength = glm::length(normalSum);
+        if (normals.empty() || sumLength <= 0.0f)
+        {
+            return bounds;
+        }
+        glm::vec3 axis = normalSum / sumLength;
+        float minCosine = 1.0f;
+        for (const auto &normal : normals)
+        {
+            minCosine = std::min(minCosine, glm::dot(normal, axis));
+        }
+        if (minCosine <= MIN_CONE_COSINE)
+        {
+            return bounds;
+        }
+
+        // The normals are within acos(minCosine) of the axis, so the cluster is back facing from
+        // anywhere inside the cone that's 90 degrees wider than that, pointing the other way.
+        // That cone's cosine is -cos(angle + 90) = sin(angle).
+        bounds.coneAxis = axis;
+        bounds.coneCutoff = std::sqrt(1.0f - minCosine * minCosine);
+        return bounds;
+    }
+} // namespace vpe
@@ -0,0 +1,63 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace vpe
+{
+    // A small cluster of triangles. Its vertices are VpeMeshletData::vertices[vertexOffset, + vertexCount).
+    // Its triangles start at triangle triangleOffset in VpeMeshletData::triangles, three bytes each,
+    // and the bytes index into the meshlet's own vertices.
+    struct VpeMeshlet
+    {
+        uint32_t vertexOffset;
+        uint32_t triangleOffset;
+        uint32_t vertexCount;
+        uint32_t triangleCount;
+    };
+
+    struct VpeMeshletBounds
+    {
+        glm::vec3 center;
+        float radius;
+        // Every triangle's normal is within the cone around coneAxis. The cluster is facing away
+        // from a camera at p when dot(center - p, coneAxis) >= coneCutoff * length(center - p) + radius.
+        // A cutoff of 1 means the normals are too spread out to ever cull on.
+        glm::vec3 coneAxis;
+        float coneCutoff;
+    };
+
+    struct VpeMeshletData
+    {
+        std::vector<VpeMeshlet> meshlets;
+        std::vector<VpeMeshletBounds> bounds;
+        // Indices into the mesh's vertex buffer.
+        std::vector<uint32_t> vertices;
+        // Local indices into a meshlet's own vertices, three per triangle.
+        std::vector<uint8_t> triangles;
+    };
+
+    // Cuts an indexed mesh into meshlets. Greedy: a meshlet keeps taking the neighboring triangle
+    // that adds the fewest new vertices (nearest to the middle on ties) until one of the limits is hit,
+    // which keeps them compact and their bounds tight. Meant to run once when a mesh is imported.
+    class VpeMeshletBuilder
+    {
+    public:
+        // The usual mesh shader sizes. VpeMeshletCuller handles up to 128 triangles per meshlet.
+        static constexpr uint32_t MAX_VERTICES = 64;
+        static constexpr uint32_t MAX_TRIANGLES = 124;
+
+        static VpeMeshletData build(
+            const std::vector<glm::vec3> &positions,
+            const std::vector<uint32_t> &indices,
+            uint32_t maxVertices = MAX_VERTICES,
+            uint32_t maxTriangles = MAX_TRIANGLES);
+
+    private:
+        static VpeMeshletBounds computeBounds(const VpeMeshletData &data, const VpeMeshlet &meshlet, const std::vector<glm::vec3> &positions);
+    };
+} // namespace vpe
@@ -0,0 +1,271 @@
+#include "VpeMeshletCuller.hpp"
+#include "VpeComputePipeline.hpp"
+#include "VpeFrustum.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace vpe
+{
+    VpeMeshletCuller::VpeMeshletCuller(VpeDevice &device, const VpeMeshletData &meshlets)
+        : vpeDevice_{device},
+          meshletCount_{static_cast<uint32_t>(meshlets.meshlets.size())},
+          maxIndexCount_{static_cast<uint32_t>(meshlets.triangles.size())}
+    {
+        if (meshletCount_ == 0)
+        {
+            throw std::runtime_error("Meshlet culler needs at least one meshlet.");
+        }
+        for (const auto &meshlet : meshlets.meshlets)
+        {
+            if (meshlet.triangleCount > MAX_TRIANGLES)
+            {
+                throw std::runtime_error("Meshlet has too many triangles for the cull shader.");
+            }
+        }
+        createBuffers(meshlets);
+        createDescriptors();
+        createPipeline();
+    }
+
+    VpeMeshletCuller::~VpeMeshletCuller()
+    {
+        pipeline_.reset();
+        vkDestroyPipelineLayout(vpeDevice_.device(), pipelineLayout_, nullptr);
+        vkDestroyDescriptorPool(vpeDevice_.device(), descriptorPool_, nullptr);
+        vkDestroyDescriptorSetLayout(vpeDevice_.device(), descriptorSetLayout_, nullptr);
+        vkDestroyBuffer(vpeDevice_.device(), drawCommandBuffer_, nullptr);
+        vkFreeMemory(vpeDevice_.device(), drawCommandMemory_, nullptr);
+        vkDestroyBuffer(vpeDevice_.device(), indexBuffer_, nullptr);
+        vkFreeMemory(vpeDevice_.device(), indexMemory_, nullptr);
+        vkDestroyBuffer(vpeDevice_.device(), triangleBuffer_, nullptr);
+        vkFreeMemory(vpeDevice_.device(), triangleMemory_, nullptr);
+        vkDestroyBuffer(vpeDevice_.device(), vertexBuffer_, nullptr);
+        vkFreeMemory(vpeDevice_.device(), vertexMemory_, nullptr);
+        vkDestroyBuffer(vpeDevice_.device(), meshletBuffer_, nullptr);
+        vkFreeMemory(vpeDevice_.device(), meshletMemory_, nullptr);
+    }
+
+    void VpeMeshletCuller::recordCull(
+        VkCommandBuffer commandBuffer,
+        const glm::mat4 &viewProjection,
+        const glm::vec3 &cameraPosition,
+        const glm::mat4 &model) const
+    {
+        // Bring the camera into model space instead of every meshlet into world space.
+        CullPushConstants push{};
+        VpeFrustum frustum = VpeFrustum::fromViewProjection(viewProjection * model);
+        std::copy(std::begin(frustum.planes), std::end(frustum.planes), push.frustumPlanes);
+        push.cameraPosition = glm::inverse(model) * glm::vec4{cameraPosition, 1.0f};
+        push.meshletCount = meshletCount_;
+
+        // Last frame's draw might still be reading the indices and the command.
+        VkMemoryBarrier readsDone{};
+        readsDone.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        readsDone.srcAccessMask = 0;
+        readsDone.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &readsDone, 0, nullptr, 0, nullptr);
+
+        // Start from zero indices, the shader counts them up.
+        VkDrawIndexedIndirectCommand emptyDraw{0, 1, 0, 0, 0};
+        vkCmdUpdateBuffer(commandBuffer, drawCommandBuffer_, 0, sizeof(emptyDraw), &emptyDraw);
+
+        VkMemoryBarrier resetDone{};
+        resetDone.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        resetDone.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        resetDone.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &resetDone, 0, nullptr, 0, nullptr);
+
+        pipeline_->bind(commandBuffer);
+        vkCmdBindDescriptorSets(
+            commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout_, 0, 1, &descriptorSet_, 0, nullptr);
+        vkCmdPushConstants(
+            commandBuffer, pipelineLayout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants), &push);
+        // One workgroup per meshlet.
+        pipeline_->dispatch(commandBuffer, meshletCount_ * MAX_TRIANGLES, MAX_TRIANGLES);
+
+        VkMemoryBarrier cullDone{};
+        cullDone.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        cullDone.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        cullDone.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+            0, 1, &cullDone, 0, nullptr, 0, nullptr);
+    }
+
+    void VpeMeshletCuller::recordDraw(VkCommandBuffer commandBuffer) const
+    {
+        vkCmdBindIndexBuffer(commandBuffer, indexBuffer_, 0, VK_INDEX_TYPE_UINT32);
+        vkCmdDrawIndexedIndirect(commandBuffer, drawCommandBuffer_, 0, 1, sizeof(VkDrawIndexedIndirectCommand));
+    }
+
+    void VpeMeshletCuller::createBuffers(const VpeMeshletData &meshlets)
+    {
+        static_assert(sizeof(GpuMeshlet) == 48, "GpuMeshlet has to match the std430 struct in MeshletCull.comp.");
+        static_assert(sizeof(CullPushConstants) <= 128, "Push constants only have 128 bytes for sure.");
+
+        std::vector<GpuMeshlet> gpuMeshlets(meshletCount_);
+        for (uint32_t i = 0; i < meshletCount_; i++)
+        {
+            const VpeMeshlet &meshlet = meshlets.meshlets[i];
+            const VpeMeshletBounds &bounds = meshlets.bounds[i];
+            gpuMeshlets[i] = GpuMeshlet{
+                glm::vec4{bounds.center, bounds.radius},
+                glm::vec4{bounds.coneAxis, bounds.coneCutoff},
+                meshlet.vertexOffset,
+                meshlet.triangleOffset,
+                meshlet.vertexCount,
+                meshlet.triangleCount};
+        }
+
+        // The shader reads a whole uint per triangle, there's no byte access in plain GLSL 450.
+        size_t triangleCount = meshlets.triangles.size() / 3;
+        std::vector<uint32_t> packedTriangles(triangleCount);
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            const uint8_t *corners = &meshlets.triangles[t * 3];
+            packedTriangles[t] = corners[0] | (corners[1] << 8) | (corners[2] << 16);
+        }
+
+        uploadBuffer(gpuMeshlets.data(), sizeof(GpuMeshlet) * gpuMeshlets.size(), meshletBuffer_, meshletMemory_);
+        uploadBuffer(meshlets.vertices.data(), sizeof(uint32_t) * meshlets.vertices.size(), vertexBuffer_, vertexMemory_);
+        uploadBuffer(packedTriangles.data(), sizeof(uint32_t) * packedTriangles.size(), triangleBuffer_, triangleMemory_);
+
+        // Worst case nothing is culled.
+        vpeDevice_.createBuffer(
+            sizeof(uint32_t) * maxIndexCount_,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            indexBuffer_,
+            indexMemory_);
+        vpeDevice_.createBuffer(
+            sizeof(VkDrawIndexedIndirectCommand),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            drawCommandBuffer_,
+            drawCommandMemory_);
+    }
+
+    void VpeMeshletCuller::uploadBuffer(const void *data, VkDeviceSize size, VkBuffer &buffer, VkDeviceMemory &memory)
+    {
+        VkBuffer stagingBuffer;
+        VkDeviceMemory stagingMemory;
+        vpeDevice_.createBuffer(
+            size,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            stagingBuffer,
+            stagingMemory);
+
+        void *mapped;
+        vkMapMemory(vpeDevice_.device(), stagingMemory, 0, size, 0, &mapped);
+        memcpy(mapped, data, static_cast<size_t>(size));
+        vkUnmapMemory(vpeDevice_.device(), stagingMemory);
+
+        vpeDevice_.createBuffer(
+            size,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            buffer,
+            memory);
+        vpeDevice_.copyBuffer(stagingBuffer, buffer, size);
+
+        vkDestroyBuffer(vpeDevice_.device(), stagingBuffer, nullptr);
+        vkFreeMemory(vpeDevice_.device(), stagingMemory, nullptr);
+    }
+
+    void VpeMeshletCuller::createDescriptors()
+    {
+        std::array<VkDescriptorSetLayoutBinding, 5> bindings{};
+        for (uint32_t i = 0; i < bindings.size(); i++)
+        {
+            bindings[i].binding = i;
+            bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[i].descriptorCount = 1;
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+        if (vkCreateDescriptorSetLayout(vpeDevice_.device(), &layoutInfo, nullptr, &descriptorSetLayout_) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create meshlet cull descriptor set layout.");
+        }
+
+        VkDescriptorPoolSize poolSize{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, static_cast<uint32_t>(bindings.size())};
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.maxSets = 1;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        if (vkCreateDescriptorPool(vpeDevice_.device(), &poolInfo, nullptr, &descriptorPool_) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create meshlet cull descriptor pool.");
+        }
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = descriptorPool_;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &descriptorSetLayout_;
+        if (vkAllocateDescriptorSets(vpeDevice_.device(), &allocInfo, &descriptorSet_) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to allocate meshlet cull descriptor set.");
+        }
+
+        std::array<VkDescriptorBufferInfo, 5> bufferInfos{};
+        bufferInfos[0] = {meshletBuffer_, 0, VK_WHOLE_SIZE};
+        bufferInfos[1] = {vertexBuffer_, 0, VK_WHOLE_SIZE};
+        bufferInfos[2] = {triangleBuffer_, 0, VK_WHOLE_SIZE};
+        bufferInfos[3] = {indexBuffer_, 0, VK_WHOLE_SIZE};
+        bufferInfos[4] = {drawCommandBuffer_, 0, VK_WHOLE_SIZE};
+
+        std::array<VkWriteDescriptorSet, 5> writes{};
+        for (uint32_t i = 0; i < writes.size(); i++)
+        {
+            writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[i].dstSet = descriptorSet_;
+            writes[i].dstBinding = i;
+            writes[i].descriptorCount = 1;
+            writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[i].pBufferInfo = &bufferInfos[i];
+        }
+        vkUpdateDescriptorSets(vpeDevice_.device(), static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+
+    void VpeMeshletCuller::createPipeline()
+    {
+        VkPushConstantRange pushRange{};
+        pushRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushRange.offset = 0;
+        pushRange.size = sizeof(CullPushConstants);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout_;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushRange;
+        if (vkCreatePipelineLayout(vpeDevice_.device(), &pipelineLayoutInfo, nullptr, &pipelineLayout_) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create meshlet cull pipeline layout.");
+        }
+
+        pipeline_ = std::make_unique<VpeComputePipeline>(vpeDevice_, "shaders/MeshletCull.comp.spv", pipelineLayout_);
+    }
+} // namespace vpe
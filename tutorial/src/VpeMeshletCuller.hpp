@@ -0,0 +1,90 @@
+#pragma once
+
+#include "VpeDevice.hpp"
+#include "VpeMeshletBuilder.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <memory>
+
+namespace vpe
+{
+    class VpeComputePipeline;
+
+    // Runtime side of VpeMeshletBuilder. A compute pass culls the meshlets of one mesh against the
+    // frustum and their normal cones, and writes the triangles of the ones left into an index buffer.
+    // The draw that follows is a single vkCmdDrawIndexedIndirect whose index count the shader filled in,
+    // so big dense meshes only rasterize the clusters that can actually be seen.
+    class VpeMeshletCuller
+    {
+    public:
+        // Meshlets can have at most MAX_TRIANGLES triangles, one per thread.
+        static constexpr uint32_t MAX_TRIANGLES = 128;
+
+        VpeMeshletCuller(VpeDevice &device, const VpeMeshletData &meshlets);
+        ~VpeMeshletCuller();
+
+        VpeMeshletCuller(const VpeMeshletCuller &) = delete;
+        VpeMeshletCuller &operator=(const VpeMeshletCuller &) = delete;
+
+        // Outside a render pass. The camera goes in as push constants, so record again when it moves.
+        void recordCull(
+            VkCommandBuffer commandBuffer,
+            const glm::mat4 &viewProjection,
+            const glm::vec3 &cameraPosition,
+            const glm::mat4 &model = glm::mat4{1.0f}) const;
+        // Inside the render pass, after binding the mesh's vertex buffer. Binds its own index buffer.
+        void recordDraw(VkCommandBuffer commandBuffer) const;
+
+        uint32_t meshletCount() const { return meshletCount_; }
+
+    private:
+        // std430, has to match Meshlet in MeshletCull.comp.
+        struct GpuMeshlet
+        {
+            glm::vec4 sphere;
+            glm::vec4 cone;
+            uint32_t vertexOffset;
+            uint32_t triangleOffset;
+            uint32_t vertexCount;
+            uint32_t triangleCount;
+        };
+
+        struct CullPushConstants
+        {
+            glm::vec4 frustumPlanes[6];
+            glm::vec4 cameraPosition;
+            uint32_t meshletCount;
+        };
+
+        void createBuffers(const VpeMeshletData &meshlets);
+        // A device local buffer with data copied in through a staging buffer.
+        void uploadBuffer(const void *data, VkDeviceSize size, VkBuffer &buffer, VkDeviceMemory &memory);
+        void createDescriptors();
+        void createPipeline();
+
+        VpeDevice &vpeDevice_;
+        uint32_t meshletCount_;
+        uint32_t maxIndexCount_;
+
+        VkBuffer meshletBuffer_;
+        VkDeviceMemory meshletMemory_;
+        VkBuffer vertexBuffer_;
+        VkDeviceMemory vertexMemory_;
+        VkBuffer triangleBuffer_;
+        VkDeviceMemory triangleMemory_;
+        VkBuffer indexBuffer_;
+        VkDeviceMemory indexMemory_;
+        VkBuffer drawCommandBuffer_;
+        VkDeviceMemory drawCommandMemory_;
+
+        VkDescriptorSetLayout descriptorSetLayout_;
+        VkDescriptorPool descriptorPool_;
+        VkDescriptorSet descriptorSet_;
+        VkPipelineLayout pipelineLayout_;
+        std::unique_ptr<VpeComputePipeline> pipeline_;
+    };
+} // namespace vpe
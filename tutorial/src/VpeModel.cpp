@@ -1,33 +1,170 @@
 #include "VpeModel.hpp"
+#include "VpeMeshSimplifier.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <cstddef>
 #include <cstring>
 namespace vpe
 {
+    namespace
+    {
+        // A level has to have at most this much of the one before it, or it isn't worth a draw call of its own.
+        constexpr float MIN_LOD_REDUCTION = 0.8f;
+
+#ifdef VPE_VERTEX_PULLING
+        constexpr bool ENABLE_VERTEX_PULLING = true;
+#else
+        constexpr bool ENABLE_VERTEX_PULLING = false;
+#endif
+    }
+
+    // The shader has the address right after the matrix.
+    static_assert(offsetof(VpeModel::PullConstants, vertices) == sizeof(glm::mat4));
+
+    bool VpeModel::supportsVertexPulling(VpeDevice &device)
+    {
+        return ENABLE_VERTEX_PULLING && device.features().bufferDeviceAddress;
+    }
+
     VpeModel::VpeModel(VpeDevice &device, const std::vector<Vertex> &vertices) : vpeDevice_{device}
     {
         createVertexBuffers(vertices);
+        lods_.push_back(Lod{0, vertexCount_, 0.0f});
+    }
+
+    VpeModel::VpeModel(
+        VpeDevice &device,
+        const std::vector<Vertex> &vertices,
+        const std::vector<uint32_t> &indices,
+        const VpeLodSettings &lodSettings) : vpeDevice_{device}
+    {
+        createVertexBuffers(vertices);
+
+        std::vector<glm::vec3> positions;
+        positions.reserve(vertices.size());
+        for (const auto &vertex : vertices)
+        {
+            positions.push_back(vertex.position);
+        }
+
+        // Every level is simplified from the full mesh and not from the level before,
+        // so its error really is the distance to the original.
+        std::vector<uint32_t> allIndices = indices;
+        lods_.push_back(Lod{0, static_cast<uint32_t>(indices.size()), 0.0f});
+        for (float ratio : lodSettings.ratios)
+        {
+            size_t target = static_cast<size_t>(static_cast<float>(indices.size()) * ratio) / 3 * 3;
+            auto simplified = VpeMeshSimplifier::simplify(positions, indices, target);
+            if (simplified.indices.empty() ||
+                static_cast<float>(simplified.indices.size()) > MIN_LOD_REDUCTION * static_cast<float>(lods_.back().indexCount))
+            {
+                continue;
+            }
+            lods_.push_back(Lod{
+                static_cast<uint32_t>(allIndices.size()),
+                static_cast<uint32_t>(simplified.indices.size()),
+                std::max(simplified.error, lods_.back().error)});
+            allIndices.insert(allIndices.end(), simplified.indices.begin(), simplified.indices.end());
+        }
+        createIndexBuffers(allIndices);
     }
 
     VpeModel::~VpeModel()
     {
         vkDestroyBuffer(vpeDevice_.device(), vertexBuffer_, nullptr);
         vkFreeMemory(vpeDevice_.device(), vertexBufferMemory_, nullptr);
+        if (hasIndexBuffer_)
+        {
+            vkDestroyBuffer(vpeDevice_.device(), indexBuffer_, nullptr);
+            vkFreeMemory(vpeDevice_.device(), indexBufferMemory_, nullptr);
+        }
+    }
+
+    std::vector<std::unique_ptr<VpeModel>> VpeModel::createModels(
+        VpeDevice &device,
+        VpeJobSystem &jobSystem,
+        const std::vector<std::vector<Vertex>> &meshes)
+    {
+        // Buffer creation and vkMapMemory on different memory objects are fine from any thread,
+        // so every mesh can just be its own job.
+        std::vector<std::unique_ptr<VpeModel>> models(meshes.size());
+        jobSystem.parallelFor(static_cast<uint32_t>(meshes.size()), [&](uint32_t begin, uint32_t end)
+                              {
+            for (uint32_t i = begin; i < end; i++)
+            {
+                models[i] = std::make_unique<VpeModel>(device, meshes[i]);
+            } });
+        return models;
+    }
+
+    std::vector<std::unique_ptr<VpeModel>> VpeModel::createModels(
+        VpeDevice &device,
+        VpeJobSystem &jobSystem,
+        const std::vector<MeshData> &meshes,
+        const VpeLodSettings &lodSettings)
+    {
+        std::vector<std::unique_ptr<VpeModel>> models(meshes.size());
+        jobSystem.parallelFor(static_cast<uint32_t>(meshes.size()), [&](uint32_t begin, uint32_t end)
+                              {
+            for (uint32_t i = begin; i < end; i++)
+            {
+                models[i] = std::make_unique<VpeModel>(device, meshes[i].vertices, meshes[i].indices, lodSettings);
+            } });
+        return models;
+    }
+
+    std::vector<VkVertexInputBindingDescription> VpeModel::Vertex::getBindingDescriptions()
+    {
+        return {{0, sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX}};
+    }
+
+    std::vector<VkVertexInputAttributeDescription> VpeModel::Vertex::getAttributeDescriptions()
+    {
+        return {{0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, position)}};
     }
 
     void VpeModel::bind(VkCommandBuffer commandBuffer)
     {
+        // The index buffer stays bound even when pulling. Then gl_VertexIndex is already the index
+        // and the GPU still gets to reuse the vertices it just shaded.
+        if (vertexPulling_)
+        {
+            if (hasIndexBuffer_)
+            {
+                vkCmdBindIndexBuffer(commandBuffer, indexBuffer_, 0, VK_INDEX_TYPE_UINT32);
+            }
+            return;
+        }
         // we make an array of buffers (size 1 right now)
         VkBuffer buffers[] = {vertexBuffer_};
         // These are the offsets for those
         VkDeviceSize offsets[] = {0};
         // Then we bind the first one at 0, and only one binding.
         vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
+        if (hasIndexBuffer_)
+        {
+            vkCmdBindIndexBuffer(commandBuffer, indexBuffer_, 0, VK_INDEX_TYPE_UINT32);
+        }
     }
 
-    void VpeModel::draw(VkCommandBuffer commandBuffer)
+    void VpeModel::pushConstants(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, const glm::mat4 &transform)
     {
-        vkCmdDraw(commandBuffer, vertexCount_, 1, 0, 0);
+        assert(vertexPulling_ && "Model has no vertex address to push.");
+        PullConstants push{transform, vertexAddress_};
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PullConstants), &push);
+    }
+
+    void VpeModel::draw(VkCommandBuffer commandBuffer, uint32_t lod)
+    {
+        if (hasIndexBuffer_)
+        {
+            vkCmdDrawIndexed(commandBuffer, lods_[lod].indexCount, 1, lods_[lod].firstIndex, 0, 0);
+        }
+        else
+        {
+            vkCmdDraw(commandBuffer, vertexCount_, 1, 0, 0);
+        }
     }
 
     void VpeModel::createVertexBuffers(const std::vector<Vertex> &vertices)
@@ -42,23 +179,58 @@ namespace vpe
         // the usage vertex bit says this is used to hold vertex data
         // The memory properties visible and coherent are CPU (host) can see and write to them
         // The coherent bit keeps things consistent? If not there we need to VK flush the buffer, idgaf
+        // With vertex pulling the shaders read it as a storage buffer through its address instead.
+        vertexPulling_ = supportsVertexPulling(vpeDevice_);
+        VkBufferUsageFlags usage = vertexPulling_
+                                       ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
+                                       : VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
         vpeDevice_.createBuffer(
             bufferSize,
-            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            usage,
             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
             vertexBuffer_,
             vertexBufferMemory_);
+        if (vertexPulling_)
+        {
+            vertexAddress_ = vpeDevice_.getBufferDeviceAddress(vertexBuffer_);
+        }
 
         void *data;
         vkMapMemory(vpeDevice_.device(), vertexBufferMemory_, 0, bufferSize, 0, &data);
         // this data pointer now has our correspondence with the gpu buffer memory
 
         // We now copy the data from our vertices into the HOST mapped memory region.
-        memcpy(data, vertices.data(), static_cast<size_t>(bufferSize));
+        packVertices(vertices, data);
         // Because it's host coeherent, the memory is auto flushed to its GPU (device) counterpart.
         // Otherwise we would need to call Flush()
 
         // Now we don't care about it anymore?
         vkUnmapMemory(vpeDevice_.device(), vertexBufferMemory_);
     }
-}
\ No newline at end of file
+
+    void VpeModel::packVertices(const std::vector<Vertex> &vertices, void *destination)
+    {
+        // Vertex is already tightly packed floats, which is also what the pulling shader reads,
+        // so this is one straight copy. Anything fancier (quantizing, interleaving) goes here.
+        static_assert(sizeof(Vertex) == 3 * sizeof(float), "PulledVertex.vert reads 3 floats per vertex");
+        memcpy(destination, vertices.data(), sizeof(Vertex) * vertices.size());
+    }
+
+    void VpeModel::createIndexBuffers(const std::vector<uint32_t> &indices)
+    {
+        hasIndexBuffer_ = true;
+        VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+        // Same deal as the vertex buffer, just with the index usage.
+        vpeDevice_.createBuffer(
+            bufferSize,
+            VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            indexBuffer_,
+            indexBufferMemory_);
+
+        void *data;
+        vkMapMemory(vpeDevice_.device(), indexBufferMemory_, 0, bufferSize, 0, &data);
+        memcpy(data, indices.data(), static_cast<size_t>(bufferSize));
+        vkUnmapMemory(vpeDevice_.device(), indexBufferMemory_);
+    }
+}
@@ -1,42 +1,120 @@
 #pragma once
 
 #include "VpeDevice.hpp"
+#include "VpeJobSystem.hpp"
 #define GLM_FORCE_RADIANS
 // The default for OpenGL is -1 to 1
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
+#include <memory>
 #include <vector>
 
 namespace vpe
 {
+    struct VpeLodSettings
+    {
+        // Index count of every level after the first, as a fraction of the full mesh.
+        std::vector<float> ratios{0.5f, 0.25f, 0.1f};
+    };
+
+    // Vertices and (optionally) indices. Indexed models get levels of detail generated at load time.
+    // All the levels share the vertex buffer and live back to back in one index buffer.
     class VpeModel
     {
     public:
         struct Vertex
         {
-            glm::vec2 position;
+            glm::vec3 position;
 
             static std::vector<VkVertexInputBindingDescription> getBindingDescriptions();
             static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions();
         };
 
+        // What PulledVertex.vert gets as push constants. A pipeline for pulled models needs a vertex
+        // stage push constant range of this size and no vertex input at all, whatever the vertex looks like.
+        struct PullConstants
+        {
+            glm::mat4 transform;
+            VkDeviceAddress vertices;
+        };
+
+        struct MeshData
+        {
+            std::vector<Vertex> vertices;
+            std::vector<uint32_t> indices;
+        };
+
+        // One range of the index buffer. error is how far the level strays from the full mesh,
+        // in model units, which is what VpeLodSelector turns into pixels.
+        struct Lod
+        {
+            uint32_t firstIndex;
+            uint32_t indexCount;
+            float error;
+        };
+
+        // Unindexed, one level.
         VpeModel(VpeDevice &device, const std::vector<Vertex> &vertices);
+        // Simplifies the mesh down to every ratio in lodSettings. Levels that barely get smaller are dropped.
+        VpeModel(
+            VpeDevice &device,
+            const std::vector<Vertex> &vertices,
+            const std::vector<uint32_t> &indices,
+            const VpeLodSettings &lodSettings = {});
         ~VpeModel();
 
         VpeModel(const VpeModel &) = delete;
         VpeModel &operator=(const VpeModel &) = delete;
 
+        // Loads a batch of meshes at once, spread over the job system.
+        // Comes back in the same order as meshes.
+        static std::vector<std::unique_ptr<VpeModel>> createModels(
+            VpeDevice &device,
+            VpeJobSystem &jobSystem,
+            const std::vector<std::vector<Vertex>> &meshes);
+        // Same for indexed meshes. The simplification is the slow part, and each mesh does its own.
+        static std::vector<std::unique_ptr<VpeModel>> createModels(
+            VpeDevice &device,
+            VpeJobSystem &jobSystem,
+            const std::vector<MeshData> &meshes,
+            const VpeLodSettings &lodSettings = {});
+
+        // With vertex pulling the shader fetches the vertices itself through the buffer's address,
+        // so there are no vertex buffers to bind. Needs VPE_VERTEX_PULLING and bufferDeviceAddress.
+        static bool supportsVertexPulling(VpeDevice &device);
+        bool usesVertexPulling() const { return vertexPulling_; }
+        VkDeviceAddress vertexAddress() const { return vertexAddress_; }
+
+        // Binds the vertex buffer, or with vertex pulling only the index buffer (if there is one).
         void bind(VkCommandBuffer commandBuffer);
-        void draw(VkCommandBuffer commandBuffer);
+        // For vertex pulling, instead of the vertex buffer bind. Fills PullConstants at offset 0.
+        void pushConstants(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, const glm::mat4 &transform);
+        void draw(VkCommandBuffer commandBuffer, uint32_t lod = 0);
+
+        // Writes vertices in the layout the vertex buffer (and PulledVertex.vert) expects.
+        // destination needs room for sizeof(Vertex) * vertices.size() bytes. No device involved, so the micro bench can time it.
+        static void packVertices(const std::vector<Vertex> &vertices, void *destination);
+
+        uint32_t lodCount() const { return static_cast<uint32_t>(lods_.size()); }
+        const Lod &lod(uint32_t level) const { return lods_[level]; }
 
     private:
         void createVertexBuffers(const std::vector<Vertex> &vertices);
+        void createIndexBuffers(const std::vector<uint32_t> &indices);
 
         VpeDevice &vpeDevice_;
         // Interestingly, the buffer and the memory are seperate objects.
         VkBuffer vertexBuffer_;
         VkDeviceMemory vertexBufferMemory_;
         uint32_t vertexCount_;
+        bool vertexPulling_ = false;
+        VkDeviceAddress vertexAddress_ = 0;
+
+        bool hasIndexBuffer_ = false;
+        VkBuffer indexBuffer_;
+        VkDeviceMemory indexBufferMemory_;
+        // Finest first.
+        std::vector<Lod> lods_;
     };
 
 } // namespace vpe
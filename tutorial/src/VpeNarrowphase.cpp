@@ -0,0 +1,1041 @@
+#include "VpeNarrowphase.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace vpe
+{
+    namespace
+    {
+        constexpr float EPSILON = 1e-6f;
+        constexpr uint32_t MAX_GJK_ITERATIONS = 32;
+        constexpr uint32_t MAX_EPA_ITERATIONS = 48;
+        constexpr uint32_t MAX_EPA_VERTICES = 64;
+        constexpr uint32_t MAX_EPA_FACES = 128;
+        // Core points within this much (relative to the shape's size) of the deepest one still
+        // belong to the feature facing the other shape. Bodies don't rotate, so faces that are
+        // parallel stay exactly parallel and this only has to soak up rounding.
+        constexpr float FEATURE_TOLERANCE = 1e-3f;
+        // A face of a big hull can have lots of points on it. More than this and the rest are ignored,
+        // the four that end up in the manifold are picked from these.
+        constexpr uint32_t MAX_FEATURE_POINTS = 32;
+        constexpr uint32_t MAX_CLIP_POINTS = 2 * MAX_FEATURE_POINTS + 2;
+
+        struct SupportVertex
+        {
+            // Point of the Minkowski difference A - B, and the two points it came from.
+            glm::vec3 w;
+            glm::vec3 a;
+            glm::vec3 b;
+        };
+
+        float cross2(const glm::vec2 &a, const glm::vec2 &b)
+        {
+            return a.x * b.y - a.y * b.x;
+        }
+
+        float dot2(const glm::vec2 &a, const glm::vec2 &b)
+        {
+            return a.x * b.x + a.y * b.y;
+        }
+
+        // Ericson's closest points between segments p1q1 and p2q2, both may be a single point.
+        void closestOnSegments(
+            const glm::vec3 &p1, const glm::vec3 &q1,
+            const glm::vec3 &p2, const glm::vec3 &q2,
+            glm::vec3 &c1, glm::vec3 &c2)
+        {
+            glm::vec3 d1 = q1 - p1;
+            glm::vec3 d2 = q2 - p2;
+            glm::vec3 r = p1 - p2;
+            float a = glm::dot(d1, d1);
+            float e = glm::dot(d2, d2);
+            float f = glm::dot(d2, r);
+            float s = 0.0f;
+            float t = 0.0f;
+            if (a <= EPSILON && e <= EPSILON)
+            {
+                // Both points, nothing to do.
+            }
+            else if (a <= EPSILON)
+            {
+                t = std::clamp(f / e, 0.0f, 1.0f);
+            }
+            else
+            {
+                float c = glm::dot(d1, r);
+                if (e <= EPSILON)
+                {
+                    s = std::clamp(-c / a, 0.0f, 1.0f);
+                }
+                else
+                {
+                    float b = glm::dot(d1, d2);
+                    float denominator = a * e - b * b;
+                    s = denominator > EPSILON ? std::clamp((b * f - c * e) / denominator, 0.0f, 1.0f) : 0.0f;
+                    t = (b * s + f) / e;
+                    if (t < 0.0f)
+                    {
+                        t = 0.0f;
+                        s = std::clamp(-c / a, 0.0f, 1.0f);
+                    }
+                    else if (t > 1.0f)
+                    {
+                        t = 1.0f;
+                        s = std::clamp((b - c) / a, 0.0f, 1.0f);
+                    }
+                }
+            }
+            c1 = p1 + d1 * s;
+            c2 = p2 + d2 * t;
+        }
+
+        // Andrew's monotone chain, counter clockwise. Collinear points collapse to the two ends,
+        // identical ones to one, which is exactly how corners and edges show up here.
+        uint32_t convexHull2(glm::vec2 *points, uint32_t count, glm::vec2 *hull)
+        {
+            std::sort(points, points + count, [](const glm::vec2 &a, const glm::vec2 &b)
+                      { return a.x < b.x || (a.x == b.x && a.y < b.y); });
+            if (count < 3)
+            {
+                uint32_t out = 0;
+                for (uint32_t i = 0; i < count; i++)
+                {
+                    glm::vec2 delta = points[i] - points[0];
+                    if (i == 0 || dot2(delta, delta) > EPSILON * EPSILON)
+                    {
+                        hull[out++] = points[i];
+                    }
+                }
+                return out;
+            }
+
+            uint32_t size = 0;
+            for (uint32_t pass = 0; pass < 2; pass++)
+            {
+                uint32_t lower = size;
+                for (uint32_t k = 0; k < count; k++)
+                {
+                    const glm::vec2 &point = points[pass == 0 ? k : count - 1 - k];
+                    while (size >= lower + 2 && cross2(hull[size - 1] - hull[size - 2], point - hull[size - 2]) <= EPSILON * EPSILON)
+                    {
+                        size--;
+                    }
+                    hull[size++] = point;
+                }
+                // The last point of each half is the first of the other.
+                size--;
+            }
+            // All on one spot or one line comes out doubled up.
+            if (size == 2)
+            {
+                glm::vec2 delta = hull[1] - hull[0];
+                if (dot2(delta, delta) <= EPSILON * EPSILON)
+                {
+                    size = 1;
+                }
+            }
+            return std::max(size, 1u);
+        }
+
+        // Sutherland-Hodgman: what's left of subject inside the counter clockwise convex polygon clip.
+        uint32_t clipPolygon(const glm::vec2 *subject, uint32_t subjectCount, const glm::vec2 *clip, uint32_t clipCount, glm::vec2 *out)
+        {
+            glm::vec2 buffer[2][MAX_CLIP_POINTS];
+            uint32_t count = subjectCount;
+            std::copy(subject, subject + subjectCount, buffer[0]);
+            const glm::vec2 *input = buffer[0];
+            for (uint32_t edge = 0; edge < clipCount && count > 0; edge++)
+            {
+                glm::vec2 *output = buffer[(edge + 1) % 2];
+                const glm::vec2 &e0 = clip[edge];
+                glm::vec2 direction = clip[(edge + 1) % clipCount] - e0;
+                uint32_t written = 0;
+                for (uint32_t i = 0; i < count && written + 2 <= MAX_CLIP_POINTS; i++)
+                {
+                    const glm::vec2 &current = input[i];
+                    const glm::vec2 &next = input[(i + 1) % count];
+                    float currentSide = cross2(direction, current - e0);
+                    float nextSide = cross2(direction, next - e0);
+                    if (currentSide >= 0.0f)
+                    {
+                        output[written++] = current;
+                    }
+                    if ((currentSide >= 0.0f) != (nextSide >= 0.0f))
+                    {
+                        float t = currentSide / (currentSide - nextSide);
+                        output[written++] = current + (next - current) * t;
+                    }
+                }
+                count = written;
+                input = output;
+            }
+            std::copy(input, input + count, out);
+            return count;
+        }
+
+        // The bit of segment pq inside the counter clockwise convex polygon clip (Cyrus-Beck).
+        uint32_t clipSegment(const glm::vec2 &p, const glm::vec2 &q, const glm::vec2 *clip, uint32_t clipCount, glm::vec2 *out)
+        {
+            glm::vec2 direction = q - p;
+            float enter = 0.0f;
+            float exit = 1.0f;
+            for (uint32_t edge = 0; edge < clipCount; edge++)
+            {
+                const glm::vec2 &e0 = clip[edge];
+                glm::vec2 edgeDirection = clip[(edge + 1) % clipCount] - e0;
+                float side = cross2(edgeDirection, p - e0);
+                float rate = cross2(edgeDirection, direction);
+                if (std::abs(rate) < EPSILON)
+                {
+                    if (side < 0.0f)
+                    {
+                        return 0;
+                    }
+                    continue;
+                }
+                float t = -side / rate;
+                if (rate > 0.0f)
+                {
+                    enter = std::max(enter, t);
+                }
+                else
+                {
+                    exit = std::min(exit, t);
+                }
+            }
+            if (enter > exit)
+            {
+                return 0;
+            }
+            out[0] = p + direction * enter;
+            if (exit - enter <= EPSILON)
+            {
+                return 1;
+            }
+            out[1] = p + direction * exit;
+            return 2;
+        }
+
+        // Two edges seen along the normal. Parallel ones give the overlap (two points), crossing
+        // ones the spot where they're closest.
+        uint32_t clipSegments(const glm::vec2 *a, const glm::vec2 *b, glm::vec2 *out)
+        {
+            glm::vec2 directionA = a[1] - a[0];
+            glm::vec2 directionB = b[1] - b[0];
+            float lengthA = std::sqrt(dot2(directionA, directionA));
+            float lengthB = std::sqrt(dot2(directionB, directionB));
+            if (std::abs(cross2(directionA, directionB)) > 1e-3f * lengthA * lengthB)
+            {
+                glm::vec3 c1;
+                glm::vec3 c2;
+                closestOnSegments(
+                    glm::vec3{a[0].x, a[0].y, 0.0f}, glm::vec3{a[1].x, a[1].y, 0.0f},
+                    glm::vec3{b[0].x, b[0].y, 0.0f}, glm::vec3{b[1].x, b[1].y, 0.0f}, c1, c2);
+                out[0] = glm::vec2{0.5f * (c1.x + c2.x), 0.5f * (c1.y + c2.y)};
+                return 1;
+            }
+
+            glm::vec2 axis = directionA * (1.0f / lengthA);
+            float s0 = dot2(b[0] - a[0], axis);
+            float s1 = dot2(b[1] - a[0], axis);
+            float low = std::max(0.0f, std::min(s0, s1));
+            float high = std::min(lengthA, std::max(s0, s1));
+            if (low > high)
+            {
+                // Side by side with a gap between them, the nearest ends it is.
+                low = high = std::clamp(0.5f * (s0 + s1), 0.0f, lengthA);
+            }
+            // Halfway across to B's line, they're only parallel in the projection.
+            glm::vec2 across = (b[0] - a[0]) - axis * s0;
+            out[0] = a[0] + axis * low + across * 0.5f;
+            if (high - low <= EPSILON)
+            {
+                return 1;
+            }
+            out[1] = a[0] + axis * high + across * 0.5f;
+            return 2;
+        }
+
+        // Keeps the four points that hold the most area: the deepest, the one furthest from it,
+        // the one making the biggest triangle with those two, and the one furthest outside that triangle.
+        uint32_t reducePoints(const glm::vec2 *points, const float *depths, uint32_t count, uint32_t *keep)
+        {
+            if (count <= VpeNarrowphase::MAX_POINTS)
+            {
+                for (uint32_t i = 0; i < count; i++)
+                {
+                    keep[i] = i;
+                }
+                return count;
+            }
+
+            uint32_t first = 0;
+            for (uint32_t i = 1; i < count; i++)
+            {
+                if (depths[i] > depths[first])
+                {
+                    first = i;
+                }
+            }
+            uint32_t second = first;
+            float best = -1.0f;
+            for (uint32_t i = 0; i < count; i++)
+            {
+                glm::vec2 delta = points[i] - points[first];
+                if (dot2(delta, delta) > best)
+                {
+                    best = dot2(delta, delta);
+                    second = i;
+                }
+            }
+            uint32_t third = first;
+            best = -1.0f;
+            glm::vec2 baseline = points[second] - points[first];
+            for (uint32_t i = 0; i < count; i++)
+            {
+                float area = std::abs(cross2(baseline, points[i] - points[first]));
+                if (area > best)
+                {
+                    best = area;
+                    third = i;
+                }
+            }
+
+            const uint32_t corners[3] = {first, second, third};
+            float winding = cross2(baseline, points[third] - points[first]) >= 0.0f ? 1.0f : -1.0f;
+            uint32_t fourth = count;
+            best = EPSILON;
+            for (uint32_t i = 0; i < count; i++)
+            {
+                for (uint32_t e = 0; e < 3; e++)
+                {
+                    const glm::vec2 &e0 = points[corners[e]];
+                    const glm::vec2 &e1 = points[corners[(e + 1) % 3]];
+                    float outside = -winding * cross2(e1 - e0, points[i] - e0);
+                    if (outside > best)
+                    {
+                        best = outside;
+                        fourth = i;
+                    }
+                }
+            }
+
+            keep[0] = first;
+            keep[1] = second;
+            keep[2] = third;
+            if (fourth == count)
+            {
+                return 3;
+            }
+            keep[3] = fourth;
+            return 4;
+        }
+
+        // Closest point to the origin on the simplex. Drops the vertices that don't take part
+        // and leaves the barycentric weights of the rest in lambda.
+        struct ClosestResult
+        {
+            glm::vec3 point;
+            uint32_t count;
+            uint32_t indices[3];
+            float lambda[3];
+        };
+
+        ClosestResult closestOnTriangle(const glm::vec3 *w, uint32_t i0, uint32_t i1, uint32_t i2)
+        {
+            const glm::vec3 &a = w[i0];
+            const glm::vec3 &b = w[i1];
+            const glm::vec3 &c = w[i2];
+            glm::vec3 ab = b - a;
+            glm::vec3 ac = c - a;
+            float d1 = glm::dot(ab, -a);
+            float d2 = glm::dot(ac, -a);
+            if (d1 <= 0.0f && d2 <= 0.0f)
+            {
+                return {a, 1, {i0}, {1.0f}};
+            }
+            float d3 = glm::dot(ab, -b);
+            float d4 = glm::dot(ac, -b);
+            if (d3 >= 0.0f && d4 <= d3)
+            {
+                return {b, 1, {i1}, {1.0f}};
+            }
+            float vc = d1 * d4 - d3 * d2;
+            if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+            {
+                float t = d1 / (d1 - d3);
+                return {a + ab * t, 2, {i0, i1}, {1.0f - t, t}};
+            }
+            float d5 = glm::dot(ab, -c);
+            float d6 = glm::dot(ac, -c);
+            if (d6 >= 0.0f && d5 <= d6)
+            {
+                return {c, 1, {i2}, {1.0f}};
+            }
+            float vb = d5 * d2 - d1 * d6;
+            if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+            {
+                float t = d2 / (d2 - d6);
+                return {a + ac * t, 2, {i0, i2}, {1.0f - t, t}};
+            }
+            float va = d3 * d6 - d5 * d4;
+            if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+            {
+                float t = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+                return {b + (c - b) * t, 2, {i1, i2}, {1.0f - t, t}};
+            }
+            float denominator = 1.0f / (va + vb + vc);
+            float v = vb * denominator;
+            float u = vc * denominator;
+            return {a + ab * v + ac * u, 3, {i0, i1, i2}, {1.0f - v - u, v, u}};
+        }
+    }
+
+    struct VpeNarrowphase::Simplex
+    {
+        SupportVertex vertices[4];
+        float lambda[4];
+        uint32_t count = 0;
+    };
+
+    void VpeNarrowphase::tangentBasis(const glm::vec3 &normal, glm::vec3 &tangent1, glm::vec3 &tangent2)
+    {
+        // Duff et al., no branches on the axis and continuous everywhere but the one seam.
+        float sign = std::copysign(1.0f, normal.z);
+        float a = -1.0f / (sign + normal.z);
+        float b = normal.x * normal.y * a;
+        tangent1 = glm::vec3{1.0f + sign * normal.x * normal.x * a, sign * b, -sign * normal.x};
+        tangent2 = glm::vec3{b, sign + normal.y * normal.y * a, -normal.y};
+    }
+
+    glm::vec3 VpeNarrowphase::support(const VpeConvex &convex, const glm::vec3 &direction)
+    {
+        uint32_t best = 0;
+        float bestDot = glm::dot(convex.points[0], direction);
+        for (uint32_t i = 1; i < convex.shape->pointCount; i++)
+        {
+            float d = glm::dot(convex.points[i], direction);
+            if (d > bestDot)
+            {
+                bestDot = d;
+                best = i;
+            }
+        }
+        return convex.position + convex.points[best];
+    }
+
+    float VpeNarrowphase::gjk(const VpeConvex &a, const VpeConvex &b, glm::vec3 &closestA, glm::vec3 &closestB, Simplex &simplex)
+    {
+        auto supportVertex = [&](const glm::vec3 &direction) -> SupportVertex
+        {
+            glm::vec3 pointA = support(a, direction);
+            glm::vec3 pointB = support(b, -direction);
+            return {pointA - pointB, pointA, pointB};
+        };
+
+        simplex.count = 0;
+        glm::vec3 v = a.position - b.position;
+        if (glm::dot(v, v) < EPSILON)
+        {
+            v = glm::vec3{1.0f, 0.0f, 0.0f};
+        }
+
+        for (uint32_t iteration = 0; iteration < MAX_GJK_ITERATIONS; iteration++)
+        {
+            SupportVertex vertex = supportVertex(-v);
+            float vv = glm::dot(v, v);
+            // No real progress towards the origin any more, v is as close as it gets.
+            if (simplex.count > 0 && vv - glm::dot(v, vertex.w) <= 1e-5f * vv)
+            {
+                break;
+            }
+            bool duplicate = false;
+            for (uint32_t i = 0; i < simplex.count; i++)
+            {
+                glm::vec3 delta = simplex.vertices[i].w - vertex.w;
+                duplicate = duplicate || glm::dot(delta, delta) < EPSILON * EPSILON;
+            }
+            if (duplicate)
+            {
+                break;
+            }
+            simplex.vertices[simplex.count] = vertex;
+            simplex.lambda[simplex.count] = 1.0f;
+            simplex.count++;
+
+            glm::vec3 w[4];
+            for (uint32_t i = 0; i < simplex.count; i++)
+            {
+                w[i] = simplex.vertices[i].w;
+            }
+
+            ClosestResult closest{};
+            if (simplex.count == 1)
+            {
+                closest = {w[0], 1, {0}, {1.0f}};
+            }
+            else if (simplex.count == 2)
+            {
+                glm::vec3 edge = w[1] - w[0];
+                float lengthSquared = glm::dot(edge, edge);
+                float t = lengthSquared > EPSILON * EPSILON ? std::clamp(-glm::dot(w[0], edge) / lengthSquared, 0.0f, 1.0f) : 0.0f;
+                if (t <= 0.0f)
+                {
+                    closest = {w[0], 1, {0}, {1.0f}};
+                }
+                else if (t >= 1.0f)
+                {
+                    closest = {w[1], 1, {1}, {1.0f}};
+                }
+                else
+                {
+                    closest = {w[0] + edge * t, 2, {0, 1}, {1.0f - t, t}};
+                }
+            }
+            else if (simplex.count == 3)
+            {
+                closest = closestOnTriangle(w, 0, 1, 2);
+            }
+            else
+            {
+                // The closest of the faces that have the origin on their outside. None of them means
+                // the origin is inside the tetrahedron and the cores overlap.
+                static constexpr uint32_t FACES[4][4] = {{0, 1, 2, 3}, {0, 3, 1, 2}, {0, 2, 3, 1}, {1, 3, 2, 0}};
+                float bestDistance = std::numeric_limits<float>::max();
+                bool outside = false;
+                for (const auto &face : FACES)
+                {
+                    glm::vec3 n = glm::cross(w[face[1]] - w[face[0]], w[face[2]] - w[face[0]]);
+                    float originSide = glm::dot(n, -w[face[0]]);
+                    float oppositeSide = glm::dot(n, w[face[3]] - w[face[0]]);
+                    // A flat tetrahedron has no inside, every face counts as outside then.
+                    bool flat = std::abs(oppositeSide) < EPSILON * EPSILON;
+                    if (!flat && originSide * oppositeSide >= 0.0f)
+                    {
+                        continue;
+                    }
+                    ClosestResult candidate = closestOnTriangle(w, face[0], face[1], face[2]);
+                    float distance = glm::dot(candidate.point, candidate.point);
+                    if (distance < bestDistance)
+                    {
+                        bestDistance = distance;
+                        closest = candidate;
+                        outside = true;
+                    }
+                }
+                if (!outside)
+                {
+                    return 0.0f;
+                }
+            }
+
+            Simplex reduced;
+            reduced.count = closest.count;
+            for (uint32_t i = 0; i < closest.count; i++)
+            {
+                reduced.vertices[i] = simplex.vertices[closest.indices[i]];
+                reduced.lambda[i] = closest.lambda[i];
+            }
+            simplex = reduced;
+            v = closest.point;
+            if (glm::dot(v, v) < EPSILON * EPSILON)
+            {
+                // Touching, the cores share a point.
+                return 0.0f;
+            }
+        }
+
+        closestA = glm::vec3{0.0f};
+        closestB = glm::vec3{0.0f};
+        for (uint32_t i = 0; i < simplex.count; i++)
+        {
+            closestA += simplex.vertices[i].a * simplex.lambda[i];
+            closestB += simplex.vertices[i].b * simplex.lambda[i];
+        }
+        return glm::length(closestA - closestB);
+    }
+
+    bool VpeNarrowphase::epa(const VpeConvex &a, const VpeConvex &b, Simplex &simplex, glm::vec3 &normal, float &depth)
+    {
+        auto supportPoint = [&](const glm::vec3 &direction)
+        {
+            return support(a, direction) - support(b, -direction);
+        };
+
+        glm::vec3 vertices[MAX_EPA_VERTICES];
+        uint32_t vertexCount = simplex.count;
+        for (uint32_t i = 0; i < simplex.count; i++)
+        {
+            vertices[i] = simplex.vertices[i].w;
+        }
+
+        // GJK stops early when the origin lands on an edge or face, so grow that into a
+        // tetrahedron first by searching away from what's there.
+        static const glm::vec3 AXES[3] = {glm::vec3{1.0f, 0.0f, 0.0f}, glm::vec3{0.0f, 1.0f, 0.0f}, glm::vec3{0.0f, 0.0f, 1.0f}};
+        if (vertexCount == 0)
+        {
+            return false;
+        }
+        if (vertexCount == 1)
+        {
+            for (uint32_t i = 0; i < 6 && vertexCount == 1; i++)
+            {
+                glm::vec3 w = supportPoint(i < 3 ? AXES[i] : -AXES[i - 3]);
+                glm::vec3 delta = w - vertices[0];
+                if (glm::dot(delta, delta) > EPSILON)
+                {
+                    vertices[vertexCount++] = w;
+                }
+            }
+        }
+        if (vertexCount == 2)
+        {
+            glm::vec3 line = vertices[1] - vertices[0];
+            for (uint32_t i = 0; i < 6 && vertexCount == 2; i++)
+            {
+                glm::vec3 direction = glm::cross(line, AXES[i % 3]) * (i < 3 ? 1.0f : -1.0f);
+                if (glm::dot(direction, direction) < EPSILON)
+                {
+                    continue;
+                }
+                glm::vec3 w = supportPoint(direction);
+                glm::vec3 offLine = glm::cross(w - vertices[0], line);
+                if (glm::dot(offLine, offLine) > EPSILON * glm::dot(line, line))
+                {
+                    vertices[vertexCount++] = w;
+                }
+            }
+        }
+        if (vertexCount == 3)
+        {
+            glm::vec3 n = glm::cross(vertices[1] - vertices[0], vertices[2] - vertices[0]);
+            for (float sign : {1.0f, -1.0f})
+            {
+                glm::vec3 w = supportPoint(n * sign);
+                if (vertexCount == 3 && std::abs(glm::dot(n, w - vertices[0])) > EPSILON * glm::length(n))
+                {
+                    vertices[vertexCount++] = w;
+                }
+            }
+        }
+        if (vertexCount < 4)
+        {
+            return false;
+        }
+
+        struct Face
+        {
+            uint32_t i;
+            uint32_t j;
+            uint32_t k;
+            glm::vec3 normal;
+            float distance;
+        };
+        Face faces[MAX_EPA_FACES];
+        uint32_t faceCount = 0;
+        auto addFace = [&](uint32_t i, uint32_t j, uint32_t k) -> bool
+        {
+            glm::vec3 n = glm::cross(vertices[j] - vertices[i], vertices[k] - vertices[i]);
+            float length = glm::length(n);
+            if (length < EPSILON * EPSILON || faceCount == MAX_EPA_FACES)
+            {
+                return false;
+            }
+            n /= length;
+            faces[faceCount++] = {i, j, k, n, glm::dot(n, vertices[i])};
+            return true;
+        };
+
+        // Wound so every normal points out of the tetrahedron.
+        static constexpr uint32_t TETRAHEDRON[4][4] = {{0, 1, 2, 3}, {0, 3, 1, 2}, {0, 2, 3, 1}, {1, 3, 2, 0}};
+        for (const auto &face : TETRAHEDRON)
+        {
+            glm::vec3 n = glm::cross(vertices[face[1]] - vertices[face[0]], vertices[face[2]] - vertices[face[0]]);
+            bool flipped = glm::dot(n, vertices[face[3]] - vertices[face[0]]) > 0.0f;
+            if (!(flipped ? addFace(face[0], face[2], face[1]) : addFace(face[0], face[1], face[2])))
+            {
+                return false;
+            }
+        }
+
+        uint32_t closest = 0;
+        for (uint32_t iteration = 0; iteration < MAX_EPA_ITERATIONS; iteration++)
+        {
+            closest = 0;
+            for (uint32_t f = 1; f < faceCount; f++)
+            {
+                if (faces[f].distance < faces[closest].distance)
+                {
+                    closest = f;
+                }
+            }
+
+            const Face &face = faces[closest];
+            glm::vec3 w = supportPoint(face.normal);
+            float distance = glm::dot(w, face.normal);
+            if (distance - face.distance < 1e-4f * std::max(1.0f, distance) || vertexCount == MAX_EPA_VERTICES)
+            {
+                break;
+            }
+
+            // Every face the new point can see goes, and the hole gets closed with new faces from
+            // its rim (the edges only one removed face had) to the new point.
+            uint32_t newVertex = vertexCount;
+            vertices[vertexCount++] = w;
+            uint32_t edges[MAX_EPA_FACES * 3][2];
+            uint32_t edgeCount = 0;
+            auto addEdge = [&](uint32_t from, uint32_t to)
+            {
+                for (uint32_t e = 0; e < edgeCount; e++)
+                {
+                    if (edges[e][0] == to && edges[e][1] == from)
+                    {
+                        edges[e][0] = edges[edgeCount - 1][0];
+                        edges[e][1] = edges[edgeCount - 1][1];
+                        edgeCount--;
+                        return;
+                    }
+                }
+                edges[edgeCount][0] = from;
+                edges[edgeCount][1] = to;
+                edgeCount++;
+            };
+            for (uint32_t f = 0; f < faceCount;)
+            {
+                if (glm::dot(faces[f].normal, w - vertices[faces[f].i]) > 0.0f)
+                {
+                    addEdge(faces[f].i, faces[f].j);
+                    addEdge(faces[f].j, faces[f].k);
+                    addEdge(faces[f].k, faces[f].i);
+                    faces[f] = faces[--faceCount];
+                }
+                else
+                {
+                    f++;
+                }
+            }
+            for (uint32_t e = 0; e < edgeCount; e++)
+            {
+                addFace(edges[e][0], edges[e][1], newVertex);
+            }
+            if (faceCount == 0)
+            {
+                return false;
+            }
+        }
+
+        closest = 0;
+        for (uint32_t f = 1; f < faceCount; f++)
+        {
+            if (faces[f].distance < faces[closest].distance)
+            {
+                closest = f;
+            }
+        }
+        // The face normal points out of A - B, A has to go the other way.
+        normal = -faces[closest].normal;
+        depth = std::max(faces[closest].distance, 0.0f);
+        return true;
+    }
+
+    bool VpeNarrowphase::sat(const VpeConvex &a, const VpeConvex &b, float margin, glm::vec3 &normal, float &depth)
+    {
+        const glm::mat3 &axesA = a.shape->axes;
+        const glm::mat3 &axesB = b.shape->axes;
+        const glm::vec3 &halfA = a.shape->halfExtents;
+        const glm::vec3 &halfB = b.shape->halfExtents;
+        glm::vec3 delta = a.position - b.position;
+        depth = std::numeric_limits<float>::max();
+
+        auto test = [&](glm::vec3 axis, bool edge)
+        {
+            float lengthSquared = glm::dot(axis, axis);
+            // Parallel edges make a zero cross product, a face axis already covers those.
+            if (lengthSquared < EPSILON)
+            {
+                return true;
+            }
+            axis /= std::sqrt(lengthSquared);
+            float reachA = 0.0f;
+            float reachB = 0.0f;
+            for (int i = 0; i < 3; i++)
+            {
+                reachA += halfA[i] * std::abs(glm::dot(axesA[i], axis));
+                reachB += halfB[i] * std::abs(glm::dot(axesB[i], axis));
+            }
+            float distance = glm::dot(delta, axis);
+            float overlap = reachA + reachB - std::abs(distance);
+            if (overlap < -margin)
+            {
+                return false;
+            }
+            // An edge axis has to be clearly better to win, faces make the nicer manifold.
+            if (edge ? overlap + 0.05f * std::abs(overlap) + 1e-4f < depth : overlap < depth)
+            {
+                depth = overlap;
+                normal = distance >= 0.0f ? axis : -axis;
+            }
+            return true;
+        };
+
+        for (int i = 0; i < 3; i++)
+        {
+            if (!test(axesA[i], false) || !test(axesB[i], false))
+            {
+                return false;
+            }
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            for (int j = 0; j < 3; j++)
+            {
+                if (!test(glm::cross(axesA[i], axesB[j]), true))
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    bool VpeNarrowphase::collideSegments(const VpeConvex &a, const VpeConvex &b, float margin, glm::vec3 &normal, float &depth)
+    {
+        // A sphere's core is one point, a capsule's two, either way it's a segment.
+        const glm::vec3 &a0 = a.points[0];
+        const glm::vec3 &a1 = a.points[a.shape->pointCount - 1];
+        const glm::vec3 &b0 = b.points[0];
+        const glm::vec3 &b1 = b.points[b.shape->pointCount - 1];
+        glm::vec3 closestA;
+        glm::vec3 closestB;
+        closestOnSegments(a.position + a0, a.position + a1, b.position + b0, b.position + b1, closestA, closestB);
+
+        float touching = a.shape->radius + b.shape->radius;
+        glm::vec3 delta = closestA - closestB;
+        float distanceSquared = glm::dot(delta, delta);
+        if (distanceSquared >= (touching + margin) * (touching + margin))
+        {
+            return false;
+        }
+        float distance = std::sqrt(distanceSquared);
+        if (distance > EPSILON)
+        {
+            normal = delta / distance;
+        }
+        else
+        {
+            // Cores cross each other. Out along both of them if that's a direction, otherwise up.
+            glm::vec3 across = glm::cross(a1 - a0, b1 - b0);
+            float acrossLength = glm::length(across);
+            if (acrossLength > EPSILON)
+            {
+                normal = across / acrossLength;
+                if (glm::dot(normal, a.position - b.position) < 0.0f)
+                {
+                    normal = -normal;
+                }
+            }
+            else
+            {
+                normal = glm::vec3{0.0f, 1.0f, 0.0f};
+            }
+        }
+        depth = touching - distance;
+        return true;
+    }
+
+    bool VpeNarrowphase::collide(const VpeConvex &a, const VpeConvex &b, Result &result, float margin)
+    {
+        using Type = VpeCollisionShape::Type;
+        Type typeA = a.shape->type;
+        Type typeB = b.shape->type;
+        bool roundA = typeA == Type::Sphere || typeA == Type::Capsule;
+        bool roundB = typeB == Type::Sphere || typeB == Type::Capsule;
+
+        glm::vec3 normal{0.0f, 1.0f, 0.0f};
+        float depth = 0.0f;
+        if (roundA && roundB)
+        {
+            if (!collideSegments(a, b, margin, normal, depth))
+            {
+                return false;
+            }
+        }
+        else if (typeA == Type::Box && typeB == Type::Box)
+        {
+            if (!sat(a, b, margin, normal, depth))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            Simplex simplex;
+            glm::vec3 closestA;
+            glm::vec3 closestB;
+            float radii = a.shape->radius + b.shape->radius;
+            float distance = gjk(a, b, closestA, closestB, simplex);
+            if (distance > EPSILON)
+            {
+                // Cores apart, only the radii (or the margin) can still make them touch.
+                if (distance >= radii + margin)
+                {
+                    return false;
+                }
+                normal = (closestA - closestB) / distance;
+                depth = radii - distance;
+            }
+            else
+            {
+                if (!epa(a, b, simplex, normal, depth))
+                {
+                    return false;
+                }
+                depth += radii;
+            }
+        }
+
+        buildManifold(a, b, normal, depth, result);
+        return result.pointCount > 0;
+    }
+
+    void VpeNarrowphase::buildManifold(const VpeConvex &a, const VpeConvex &b, const glm::vec3 &normal, float depth, Result &result)
+    {
+        glm::vec3 tangent1;
+        glm::vec3 tangent2;
+        tangentBasis(normal, tangent1, tangent2);
+
+        // Each side's feature is whatever of its core reaches furthest towards the other one,
+        // seen along the normal that's a point, an edge or a face.
+        auto feature = [&](const VpeConvex &convex, const glm::vec3 &towards, glm::vec2 *projected, float &reach)
+        {
+            const glm::vec3 *points = convex.points;
+            uint32_t count = convex.shape->pointCount;
+            reach = glm::dot(points[0], towards);
+            float size = std::abs(reach);
+            for (uint32_t i = 1; i < count; i++)
+            {
+                float d = glm::dot(points[i], towards);
+                reach = std::max(reach, d);
+                size = std::max(size, std::abs(d));
+            }
+            float tolerance = FEATURE_TOLERANCE * (size + convex.shape->radius) + EPSILON;
+            uint32_t featureCount = 0;
+            for (uint32_t i = 0; i < count && featureCount < MAX_FEATURE_POINTS; i++)
+            {
+                if (glm::dot(points[i], towards) >= reach - tolerance)
+                {
+                    glm::vec3 world = convex.position + points[i];
+                    projected[featureCount++] = glm::vec2{glm::dot(world, tangent1), glm::dot(world, tangent2)};
+                }
+            }
+            return featureCount;
+        };
+
+        glm::vec2 featureA[MAX_FEATURE_POINTS];
+        glm::vec2 featureB[MAX_FEATURE_POINTS];
+        float reachA;
+        float reachB;
+        uint32_t countA = feature(a, -normal, featureA, reachA);
+        uint32_t countB = feature(b, normal, featureB, reachB);
+
+        glm::vec2 polygonA[MAX_CLIP_POINTS];
+        glm::vec2 polygonB[MAX_CLIP_POINTS];
+        countA = convexHull2(featureA, countA, polygonA);
+        countB = convexHull2(featureB, countB, polygonB);
+
+        glm::vec2 clipped[MAX_CLIP_POINTS];
+        uint32_t clippedCount = 0;
+        if (countA == 1)
+        {
+            clipped[clippedCount++] = polygonA[0];
+        }
+        else if (countB == 1)
+        {
+            clipped[clippedCount++] = polygonB[0];
+        }
+        else if (countA == 2 && countB == 2)
+        {
+            clippedCount = clipSegments(polygonA, polygonB, clipped);
+        }
+        else if (countA == 2)
+        {
+            clippedCount = clipSegment(polygonA[0], polygonA[1], polygonB, countB, clipped);
+        }
+        else if (countB == 2)
+        {
+            clippedCount = clipSegment(polygonB[0], polygonB[1], polygonA, countA, clipped);
+        }
+        else
+        {
+            clippedCount = clipPolygon(polygonB, countB, polygonA, countA, clipped);
+        }
+        if (clippedCount == 0)
+        {
+            // Features that barely graze (rounding) or a speculative pair that's still off to the side
+            // get here, one point in the middle of A's will do.
+            glm::vec2 center{0.0f, 0.0f};
+            for (uint32_t i = 0; i < countA; i++)
+            {
+                center = center + polygonA[i];
+            }
+            clipped[clippedCount++] = center * (1.0f / static_cast<float>(countA));
+        }
+
+        float depths[MAX_CLIP_POINTS];
+        std::fill(depths, depths + clippedCount, depth);
+        uint32_t keep[MAX_POINTS];
+        uint32_t kept = reducePoints(clipped, depths, clippedCount, keep);
+
+        // Halfway between A's surface and B's along the normal.
+        float surfaceA = glm::dot(a.position, normal) - reachA - a.shape->radius;
+        float surfaceB = glm::dot(b.position, normal) + reachB + b.shape->radius;
+        float height = 0.5f * (surfaceA + surfaceB);
+        result.normal = normal;
+        result.pointCount = kept;
+        for (uint32_t i = 0; i < kept; i++)
+        {
+            const glm::vec2 &point = clipped[keep[i]];
+            result.points[i] = tangent1 * point.x + tangent2 * point.y + normal * height;
+            result.penetrations[i] = depth;
+        }
+    }
+
+    bool VpeNarrowphase::collideGround(const VpeConvex &a, float groundHeight, Result &result, float margin)
+    {
+        // Every core point below the floor (radius included) is its own contact, with its own depth.
+        // Within margin above it counts too, with a negative depth.
+        glm::vec2 points[MAX_CLIP_POINTS];
+        float depths[MAX_CLIP_POINTS];
+        uint32_t count = 0;
+        float radius = a.shape->radius;
+        for (uint32_t i = 0; i < a.shape->pointCount && count < MAX_CLIP_POINTS; i++)
+        {
+            glm::vec3 world = a.position + a.points[i];
+            float depth = groundHeight - (world.y - radius);
+            if (depth > -margin)
+            {
+                points[count] = glm::vec2{world.x, world.z};
+                depths[count] = depth;
+                count++;
+            }
+        }
+        if (count == 0)
+        {
+            return false;
+        }
+
+        uint32_t keep[MAX_POINTS];
+        uint32_t kept = reducePoints(points, depths, count, keep);
+        result.normal = glm::vec3{0.0f, 1.0f, 0.0f};
+        result.pointCount = kept;
+        for (uint32_t i = 0; i < kept; i++)
+        {
+            uint32_t k = keep[i];
+            result.points[i] = glm::vec3{points[k].x, groundHeight - 0.5f * depths[k], points[k].y};
+            result.penetrations[i] = depths[k];
+        }
+        return true;
+    }
+} // namespace vpe
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "VpeCollisionShape.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+namespace vpe
+{
+    // Exact contacts for a pair the broadphase let through. Spheres and capsules against each other
+    // are done directly, two boxes with SAT, and anything else with GJK (cores apart, the radii make
+    // up the overlap) or EPA (cores overlapping). Then the two features facing each other get clipped
+    // against each other, which gives up to MAX_POINTS points: one for a corner, two for an edge on
+    // a face, four for a face on a face.
+    //
+    // Everything is a plain function of the two shapes, no state, so pairs can go in parallel.
+    class VpeNarrowphase
+    {
+    public:
+        static constexpr uint32_t MAX_POINTS = 4;
+
+        struct Result
+        {
+            // Points from B to A, the way A has to move to get out.
+            glm::vec3 normal;
+            uint32_t pointCount;
+            // World positions, halfway between the two surfaces.
+            glm::vec3 points[MAX_POINTS];
+            float penetrations[MAX_POINTS];
+        };
+
+        // False if they don't touch, result is garbage then. Pairs up to margin apart still come back,
+        // with the gap as a negative penetration. Those are speculative contacts for fast bodies.
+        static bool collide(const VpeConvex &a, const VpeConvex &b, Result &result, float margin = 0.0f);
+        // Against the infinite floor at groundHeight, normal straight up.
+        static bool collideGround(const VpeConvex &a, float groundHeight, Result &result, float margin = 0.0f);
+
+        // Two directions across the normal. Always the same ones for the same normal, so friction
+        // impulses can carry over from one step to the next.
+        static void tangentBasis(const glm::vec3 &normal, glm::vec3 &tangent1, glm::vec3 &tangent2);
+
+    private:
+        struct Simplex;
+
+        static glm::vec3 support(const VpeConvex &convex, const glm::vec3 &direction);
+        // Closest points between the two cores. Returns the distance, zero if the cores overlap,
+        // and leaves the last simplex behind for EPA.
+        static float gjk(const VpeConvex &a, const VpeConvex &b, glm::vec3 &closestA, glm::vec3 &closestB, Simplex &simplex);
+        // How deep and which way for two overlapping cores. False if the simplex is too flat to start from.
+        static bool epa(const VpeConvex &a, const VpeConvex &b, Simplex &simplex, glm::vec3 &normal, float &depth);
+        // Smallest overlap over the 15 box axes. False if any of them separates by more than margin.
+        static bool sat(const VpeConvex &a, const VpeConvex &b, float margin, glm::vec3 &normal, float &depth);
+        static bool collideSegments(const VpeConvex &a, const VpeConvex &b, float margin, glm::vec3 &normal, float &depth);
+
+        // Clips the features of a and b facing each other along normal into the result points.
+        static void buildManifold(const VpeConvex &a, const VpeConvex &b, const glm::vec3 &normal, float depth, Result &result);
+    };
+} // namespace vpe
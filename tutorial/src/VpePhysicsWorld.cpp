@@ -0,0 +1,879 @@
+#include "VpePhysicsWorld.hpp"
+#include "VpeReplayLog.hpp"
+#include "VpeWorldSnapshot.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+#include <type_traits>
+
+namespace vpe
+{
+    namespace
+    {
+        // The core of every plain sphere body.
+        const glm::vec3 ORIGIN{0.0f};
+        // Manifold points closer than this (times body A's radius) to where one was last step
+        // count as the same point and keep its impulses.
+        constexpr float MATCH_DISTANCE = 0.1f;
+        // How much of last step's impulse a matched point starts with. All of it overshoots now and
+        // then, the Baumgarte push is in there too and tall stacks get punched into the floor.
+        constexpr float WARM_START = 0.9f;
+
+        float distanceSquaredToSegment(const glm::vec3 &point, const glm::vec3 &start, const glm::vec3 &delta)
+        {
+            float lengthSquared = glm::dot(delta, delta);
+            float t = lengthSquared > 0.0f ? std::clamp(glm::dot(point - start, delta) / lengthSquared, 0.0f, 1.0f) : 0.0f;
+            glm::vec3 offset = point - (start + delta * t);
+            return glm::dot(offset, offset);
+        }
+    }
+
+    VpePhysicsWorld::VpePhysicsWorld(VpeJobSystem &jobSystem, const VpePhysicsSettings &settings)
+        : jobSystem_{jobSystem}, settings_{settings}, grid_{jobSystem, 1.0f}
+    {
+    }
+
+    uint32_t VpePhysicsWorld::addBody(const glm::vec3 &position, float radius, float mass)
+    {
+        assert(radius > 0.0f && "Bodies need a positive radius.");
+        if (recorder_ != nullptr)
+        {
+            recorder_->recordAddBody(position, radius, mass);
+        }
+        return insertBody(position, radius, mass, NO_SHAPE);
+    }
+
+    uint32_t VpePhysicsWorld::addShapeBody(const glm::vec3 &position, uint32_t shape, float mass)
+    {
+        assert(shape < shapes_.size() && "Shape out of range.");
+        if (recorder_ != nullptr)
+        {
+            recorder_->recordAddShapeBody(position, shape, mass);
+        }
+        // The broadphase only knows spheres, so it gets the one around the whole shape.
+        const VpeCollisionShape &added = shapes_[shape];
+        float boundingRadius = 0.0f;
+        for (uint32_t i = 0; i < added.pointCount; i++)
+        {
+            boundingRadius = std::max(boundingRadius, glm::length(shapePoints_[added.firstPoint + i]));
+        }
+        return insertBody(position, boundingRadius + added.radius, mass, shape);
+    }
+
+    uint32_t VpePhysicsWorld::insertBody(const glm::vec3 &position, float radius, float mass, uint32_t shape)
+    {
+        uint32_t body = bodyCount();
+        positions_.push_back(position);
+        velocities_.push_back(glm::vec3{0.0f});
+        inverseMasses_.push_back(mass > 0.0f ? 1.0f / mass : 0.0f);
+        radii_.push_back(radius);
+        sleepTimers_.push_back(0.0f);
+        bodyShapes_.push_back(shape);
+        continuous_.push_back(0);
+        margins_.push_back(0.0f);
+        // Static bodies are never awake, they don't move so there's nothing to simulate.
+        awake_.push_back(mass > 0.0f ? 1 : 0);
+        if (mass > 0.0f)
+        {
+            awakeBodies_.push_back(body);
+        }
+
+        // Grid cells have to fit the biggest possible pair distance.
+        if (radius > maxRadius_)
+        {
+            maxRadius_ = radius;
+            grid_.setCellSize(2.0f * maxRadius_);
+        }
+        return body;
+    }
+
+    uint32_t VpePhysicsWorld::addShape(const VpeCollisionShape &shape, const std::vector<glm::vec3> &points)
+    {
+        assert(!points.empty() && "Shapes need at least one core point.");
+        assert(shape.radius > 0.0f || points.size() > 1);
+        if (recorder_ != nullptr)
+        {
+            recorder_->recordAddShape(shape, points);
+        }
+        VpeCollisionShape added = shape;
+        added.firstPoint = static_cast<uint32_t>(shapePoints_.size());
+        added.pointCount = static_cast<uint32_t>(points.size());
+        shapePoints_.insert(shapePoints_.end(), points.begin(), points.end());
+        shapes_.push_back(added);
+        return static_cast<uint32_t>(shapes_.size()) - 1;
+    }
+
+    uint32_t VpePhysicsWorld::addSphereShape(float radius)
+    {
+        VpeCollisionShape shape;
+        shape.type = VpeCollisionShape::Type::Sphere;
+        shape.radius = radius;
+        return addShape(shape, {glm::vec3{0.0f}});
+    }
+
+    uint32_t VpePhysicsWorld::addCapsuleShape(const glm::vec3 &halfSegment, float radius)
+    {
+        VpeCollisionShape shape;
+        shape.type = VpeCollisionShape::Type::Capsule;
+        shape.radius = radius;
+        return addShape(shape, {-halfSegment, halfSegment});
+    }
+
+    uint32_t VpePhysicsWorld::addBoxShape(const glm::vec3 &halfExtents, const glm::mat3 &orientation)
+    {
+        VpeCollisionShape shape;
+        shape.type = VpeCollisionShape::Type::Box;
+        shape.axes = orientation;
+        shape.halfExtents = halfExtents;
+        std::vector<glm::vec3> corners;
+        for (int corner = 0; corner < 8; corner++)
+        {
+            glm::vec3 sign{corner & 1 ? 1.0f : -1.0f, corner & 2 ? 1.0f : -1.0f, corner & 4 ? 1.0f : -1.0f};
+            corners.push_back(orientation[0] * (sign.x * halfExtents.x) +
+                              orientation[1] * (sign.y * halfExtents.y) +
+                              orientation[2] * (sign.z * halfExtents.z));
+        }
+        return addShape(shape, corners);
+    }
+
+    uint32_t VpePhysicsWorld::addConvexHullShape(const std::vector<glm::vec3> &points)
+    {
+        VpeCollisionShape shape;
+        shape.type = VpeCollisionShape::Type::ConvexHull;
+        return addShape(shape, points);
+    }
+
+    uint32_t VpePhysicsWorld::addDistanceConstraint(uint32_t bodyA, uint32_t bodyB, float length)
+    {
+        assert(bodyA < bodyCount() && bodyB < bodyCount() && "Constraint body out of range.");
+        if (recorder_ != nullptr)
+        {
+            recorder_->recordDistanceConstraint(bodyA, bodyB, length);
+        }
+        constraints_.push_back({bodyA, bodyB, length});
+        wakeBody(bodyA);
+        wakeBody(bodyB);
+        return static_cast<uint32_t>(constraints_.size()) - 1;
+    }
+
+    void VpePhysicsWorld::setVelocity(uint32_t body, const glm::vec3 &velocity)
+    {
+        if (recorder_ != nullptr)
+        {
+            recorder_->recordSetVelocity(body, velocity);
+        }
+        velocities_[body] = velocity;
+        wakeBody(body);
+    }
+
+    void VpePhysicsWorld::setContinuous(uint32_t body, bool continuous)
+    {
+        if (recorder_ != nullptr)
+        {
+            recorder_->recordSetContinuous(body, continuous);
+        }
+        continuous_[body] = continuous ? 1 : 0;
+    }
+
+    void VpePhysicsWorld::wake(uint32_t body)
+    {
+        if (recorder_ != nullptr)
+        {
+            recorder_->recordWake(body);
+        }
+        wakeBody(body);
+    }
+
+    void VpePhysicsWorld::wakeBody(uint32_t body)
+    {
+        if (awake_[body] || inverseMasses_[body] == 0.0f)
+        {
+            return;
+        }
+        awake_[body] = 1;
+        sleepTimers_[body] = 0.0f;
+        awakeBodies_.push_back(body);
+    }
+
+    void VpePhysicsWorld::step(float dt)
+    {
+        if (recorder_ == nullptr)
+        {
+            simulate(dt);
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        simulate(dt);
+        auto end = std::chrono::steady_clock::now();
+        recorder_->recordStep(dt, std::chrono::duration<float, std::milli>(end - start).count(), positions_, velocities_);
+    }
+
+    void VpePhysicsWorld::setRecorder(VpeReplayRecorder *recorder)
+    {
+        if (recorder != nullptr && bodyCount() > 0)
+        {
+            throw std::runtime_error("Recording has to start with an empty physics world.");
+        }
+        recorder_ = recorder;
+    }
+
+    void VpePhysicsWorld::saveSnapshot(const std::filesystem::path &path) const
+    {
+        // Only what carries over from one step to the next. Islands and the grid get rebuilt from
+        // scratch every step anyway. Manifolds do carry over (their impulses warm start the next
+        // step), so the live ones go in too, packed together.
+        using Section = VpeWorldSnapshot::Section;
+        auto section = [](Section id, const auto &values) -> VpeWorldSnapshot::SectionData
+        {
+            return {id, static_cast<uint32_t>(sizeof(values[0])), values.data(), values.size()};
+        };
+        std::vector<VpeContactManifold> liveManifolds;
+        liveManifolds.reserve(manifolds_.liveCount());
+        for (uint32_t index = 0; index < manifolds_.capacity(); index++)
+        {
+            if (manifolds_.isLive(index))
+            {
+                liveManifolds.push_back(manifolds_[index]);
+            }
+        }
+        VpeWorldSnapshot::write(path, settings_, bodyCount(), {
+            section(Section::Positions, positions_),
+            section(Section::Velocities, velocities_),
+            section(Section::InverseMasses, inverseMasses_),
+            section(Section::Radii, radii_),
+            section(Section::SleepTimers, sleepTimers_),
+            section(Section::Awake, awake_),
+            // The order of the awake list decides the solve order, so it has to come back exactly.
+            section(Section::AwakeBodies, awakeBodies_),
+            section(Section::Constraints, constraints_),
+            section(Section::BodyShapes, bodyShapes_),
+            section(Section::Shapes, shapes_),
+            section(Section::ShapePoints, shapePoints_),
+            section(Section::Manifolds, liveManifolds),
+            section(Section::Continuous, continuous_),
+        });
+    }
+
+    void VpePhysicsWorld::restoreSnapshot(const VpeWorldSnapshot &snapshot)
+    {
+        if (recorder_ != nullptr)
+        {
+            throw std::runtime_error("Can't restore a snapshot while recording, the log has to start from an empty world.");
+        }
+
+        using Section = VpeWorldSnapshot::Section;
+        uint32_t count = snapshot.bodyCount();
+        // One straight copy per array out of the mapping.
+        auto load = [&snapshot, count](Section id, auto &values, bool perBody)
+        {
+            using T = typename std::decay_t<decltype(values)>::value_type;
+            uint64_t length = 0;
+            const T *data = snapshot.section<T>(id, length);
+            if (perBody && length != count)
+            {
+                throw std::runtime_error("Snapshot arrays don't agree on the body count.");
+            }
+            values.assign(data, data + length);
+        };
+        load(Section::Positions, positions_, true);
+        load(Section::Velocities, velocities_, true);
+        load(Section::InverseMasses, inverseMasses_, true);
+        load(Section::Radii, radii_, true);
+        load(Section::SleepTimers, sleepTimers_, true);
+        load(Section::Awake, awake_, true);
+        load(Section::AwakeBodies, awakeBodies_, false);
+        load(Section::Constraints, constraints_, false);
+        load(Section::BodyShapes, bodyShapes_, true);
+        load(Section::Shapes, shapes_, false);
+        load(Section::ShapePoints, shapePoints_, false);
+        std::vector<VpeContactManifold> liveManifolds;
+        load(Section::Manifolds, liveManifolds, false);
+        load(Section::Continuous, continuous_, true);
+        // Margins get worked out again at the start of the next step.
+        margins_.assign(count, 0.0f);
+        maxMargin_ = 0.0f;
+        fastBodyCount_ = 0;
+
+        for (uint32_t body : awakeBodies_)
+        {
+            if (body >= count)
+            {
+                throw std::runtime_error("Snapshot awake list points past the last body.");
+            }
+        }
+        for (const auto &constraint : constraints_)
+        {
+            if (constraint.bodyA >= count || constraint.bodyB >= count)
+            {
+                throw std::runtime_error("Snapshot constraint points past the last body.");
+            }
+        }
+        for (const auto &shape : shapes_)
+        {
+            if (shape.pointCount == 0 || shape.firstPoint > shapePoints_.size() || shape.pointCount > shapePoints_.size() - shape.firstPoint)
+            {
+                throw std::runtime_error("Snapshot shape points past its core points.");
+            }
+        }
+        for (uint32_t shape : bodyShapes_)
+        {
+            if (shape != NO_SHAPE && shape >= shapes_.size())
+            {
+                throw std::runtime_error("Snapshot body points past the last shape.");
+            }
+        }
+
+        // Slots get handed out fresh, only the pairs and what's in them matter.
+        manifolds_.clear();
+        activeManifolds_.clear();
+        stepIndex_ = 0;
+        for (const auto &manifold : liveManifolds)
+        {
+            if (manifold.bodyA >= count || (manifold.bodyB >= count && manifold.bodyB != NO_BODY) ||
+                manifold.pointCount == 0 || manifold.pointCount > VpeNarrowphase::MAX_POINTS)
+            {
+                throw std::runtime_error("Snapshot manifold doesn't fit the bodies.");
+            }
+            uint32_t index = manifolds_.create(manifold.bodyA, manifold.bodyB);
+            manifolds_[index] = manifold;
+            manifolds_[index].lastStep = stepIndex_;
+        }
+
+        settings_ = snapshot.settings();
+        maxRadius_ = 0.0f;
+        for (float radius : radii_)
+        {
+            maxRadius_ = std::max(maxRadius_, radius);
+        }
+        if (maxRadius_ > 0.0f)
+        {
+            grid_.setCellSize(2.0f * maxRadius_);
+        }
+    }
+
+    void VpePhysicsWorld::simulate(float dt)
+    {
+        // Everything asleep, nothing can change until someone wakes a body up.
+        if (awakeBodies_.empty())
+        {
+            return;
+        }
+
+        integrateVelocities(dt);
+        // The grid still holds every body so awake ones can find sleeping ones.
+        // That's one linear counting sort, everything after this only touches awake bodies.
+        grid_.rebuild(positions_.data(), bodyCount());
+        findContacts(dt);
+        wakeTouchedBodies();
+        buildIslands();
+        solveIslands(dt);
+        updateAwakeList();
+    }
+
+    void VpePhysicsWorld::integrateVelocities(float dt)
+    {
+        // Also decides who's fast this step. Each chunk keeps its own count and biggest margin,
+        // they get merged after so nobody has to share a counter.
+        struct ChunkOutput
+        {
+            uint32_t fastCount = 0;
+            float maxMargin = 0.0f;
+        };
+
+        glm::vec3 deltaVelocity = settings_.gravity * dt;
+        float threshold = settings_.continuousThreshold;
+        uint32_t count = awakeBodyCount();
+        uint32_t chunks = jobSystem_.chunkCountFor(count, PARALLEL_THRESHOLD);
+        std::vector<ChunkOutput> chunkOutputs(chunks);
+        jobSystem_.parallelForChunks(count, chunks, [this, deltaVelocity, threshold, dt, &chunkOutputs](uint32_t chunk, uint32_t begin, uint32_t end)
+                                     {
+            auto &local = chunkOutputs[chunk];
+            for (uint32_t i = begin; i < end; i++)
+            {
+                uint32_t body = awakeBodies_[i];
+                glm::vec3 &velocity = velocities_[body];
+                velocity += deltaVelocity;
+
+                float travelSquared = glm::dot(velocity, velocity) * dt * dt;
+                float reach = threshold * radii_[body];
+                bool fast = continuous_[body] || (threshold > 0.0f && travelSquared > reach * reach);
+                margins_[body] = fast ? std::sqrt(travelSquared) : 0.0f;
+                if (fast)
+                {
+                    local.fastCount++;
+                    local.maxMargin = std::max(local.maxMargin, margins_[body]);
+                }
+            } });
+
+        fastBodyCount_ = 0;
+        maxMargin_ = 0.0f;
+        for (const auto &local : chunkOutputs)
+        {
+            fastBodyCount_ += local.fastCount;
+            maxMargin_ = std::max(maxMargin_, local.maxMargin);
+        }
+    }
+
+    void VpePhysicsWorld::findContacts(float dt)
+    {
+        // Pairs that already have a manifold get it updated right here in parallel, every pair
+        // shows up exactly once so nobody shares one. New pairs are only collected, the pool
+        // hands out their slots afterwards on one thread, in pair order, so it stays deterministic.
+        //
+        // Slow bodies look around where they are. Fast ones look along the line they sweep this step
+        // and take every pair on the way, with both bodies' travel as the narrowphase margin.
+        struct NewPair
+        {
+            uint32_t bodyA;
+            uint32_t bodyB;
+            VpeNarrowphase::Result result;
+        };
+        struct ChunkOutput
+        {
+            // Manifold index, or NEW_PAIR plus an index into created.
+            std::vector<uint32_t> found;
+            std::vector<NewPair> created;
+        };
+        constexpr uint32_t NEW_PAIR = 1u << 31;
+
+        stepIndex_++;
+        float queryRadius = 2.0f * maxRadius_;
+        uint32_t count = awakeBodyCount();
+        uint32_t chunks = jobSystem_.chunkCountFor(count, PARALLEL_THRESHOLD);
+        std::vector<ChunkOutput> chunkOutputs(chunks);
+
+        jobSystem_.parallelForChunks(count, chunks, [this, queryRadius, dt, &chunkOutputs](uint32_t chunk, uint32_t begin, uint32_t end)
+                                     {
+            auto &local = chunkOutputs[chunk];
+            VpeNarrowphase::Result result;
+            auto touch = [&](uint32_t bodyA, uint32_t bodyB)
+            {
+                uint32_t index = manifolds_.find(bodyA, bodyB);
+                if (index != VpeManifoldPool::NONE)
+                {
+                    updateManifold(manifolds_[index], result);
+                    local.found.push_back(index);
+                    return;
+                }
+                local.found.push_back(NEW_PAIR | static_cast<uint32_t>(local.created.size()));
+                local.created.push_back({bodyA, bodyB, result});
+            };
+
+            VpeCollisionShape sphereA;
+            VpeCollisionShape sphereB;
+            auto collide = [&](uint32_t a, uint32_t b, float distanceSquared, float margin)
+            {
+                float touching = radii_[a] + radii_[b];
+                if (distanceSquared >= (touching + margin) * (touching + margin))
+                {
+                    return;
+                }
+
+                // Lower id is always A, so a pair is the same pair whoever found it.
+                uint32_t lower = std::min(a, b);
+                uint32_t upper = std::max(a, b);
+                if (bodyShapes_[lower] == NO_SHAPE && bodyShapes_[upper] == NO_SHAPE)
+                {
+                    // Two plain spheres, their bounding spheres are the whole story.
+                    float distance = std::sqrt(distanceSquared);
+                    glm::vec3 normal = distance > 1e-6f ? (positions_[lower] - positions_[upper]) / distance : glm::vec3{0.0f, 1.0f, 0.0f};
+                    result.normal = normal;
+                    result.pointCount = 1;
+                    result.points[0] = 0.5f * (positions_[lower] - normal * radii_[lower] + positions_[upper] + normal * radii_[upper]);
+                    result.penetrations[0] = touching - distance;
+                }
+                else if (!VpeNarrowphase::collide(convexOf(lower, sphereA), convexOf(upper, sphereB), result, margin))
+                {
+                    return;
+                }
+                touch(lower, upper);
+            };
+
+            for (uint32_t k = begin; k < end; k++)
+            {
+                uint32_t a = awakeBodies_[k];
+                const glm::vec3 &positionA = positions_[a];
+                float radiusA = radii_[a];
+                float marginA = margins_[a];
+
+                if (marginA == 0.0f)
+                {
+                    grid_.forEachNeighbor(positionA, queryRadius, [&](uint32_t b, float distanceSquared)
+                                          {
+                        // Two awake bodies would both find each other, only the lower id keeps it.
+                        // Fast ones find their own pairs.
+                        if (b == a || (awake_[b] && (margins_[b] > 0.0f || b < a)))
+                        {
+                            return;
+                        }
+                        collide(a, b, distanceSquared, 0.0f); });
+                }
+                else
+                {
+                    // Everything whose center could end up touching somewhere along the sweep.
+                    glm::vec3 sweep = velocities_[a] * dt;
+                    glm::vec3 reach{radiusA + maxRadius_ + maxMargin_};
+                    glm::vec3 lower = glm::min(positionA, positionA + sweep) - reach;
+                    glm::vec3 upper = glm::max(positionA, positionA + sweep) + reach;
+                    auto sweepReaches = [&](uint32_t from, uint32_t to)
+                    {
+                        float touching = radii_[from] + radii_[to] + margins_[to];
+                        return distanceSquaredToSegment(positions_[to], positions_[from], velocities_[from] * dt) < touching * touching;
+                    };
+                    grid_.forEachInBounds(lower, upper, [&](uint32_t b, const glm::vec3 &positionB)
+                                          {
+                        if (b == a || !sweepReaches(a, b))
+                        {
+                            return;
+                        }
+                        // Two fast ones can both reach each other, then only the lower id keeps it.
+                        if (margins_[b] > 0.0f && b < a && sweepReaches(b, a))
+                        {
+                            return;
+                        }
+                        glm::vec3 delta = positionA - positionB;
+                        collide(a, b, glm::dot(delta, delta), marginA + margins_[b]); });
+                }
+
+                if (positionA.y - radiusA >= settings_.groundHeight + marginA)
+                {
+                    continue;
+                }
+                if (bodyShapes_[a] == NO_SHAPE)
+                {
+                    result.normal = glm::vec3{0.0f, 1.0f, 0.0f};
+                    result.pointCount = 1;
+                    result.penetrations[0] = settings_.groundHeight - (positionA.y - radiusA);
+                    result.points[0] = glm::vec3{positionA.x, settings_.groundHeight - 0.5f * result.penetrations[0], positionA.z};
+                }
+                else if (!VpeNarrowphase::collideGround(convexOf(a, sphereA), settings_.groundHeight, result, marginA))
+                {
+                    continue;
+                }
+                touch(a, NO_BODY);
+            } });
+
+        activeManifolds_.clear();
+        for (const auto &local : chunkOutputs)
+        {
+            for (uint32_t entry : local.found)
+            {
+                if ((entry & NEW_PAIR) == 0)
+                {
+                    activeManifolds_.push_back(entry);
+                    continue;
+                }
+                const NewPair &pair = local.created[entry & ~NEW_PAIR];
+                uint32_t index = manifolds_.create(pair.bodyA, pair.bodyB);
+                updateManifold(manifolds_[index], pair.result);
+                activeManifolds_.push_back(index);
+            }
+        }
+        // Pairs that stopped touching (or fell asleep) lose their manifold.
+        manifolds_.releaseOlderThan(stepIndex_);
+    }
+
+    VpeConvex VpePhysicsWorld::convexOf(uint32_t body, VpeCollisionShape &sphere) const
+    {
+        uint32_t shape = bodyShapes_[body];
+        if (shape == NO_SHAPE)
+        {
+            sphere.type = VpeCollisionShape::Type::Sphere;
+            sphere.radius = radii_[body];
+            sphere.firstPoint = 0;
+            sphere.pointCount = 1;
+            return {&sphere, &ORIGIN, positions_[body]};
+        }
+        const VpeCollisionShape &s = shapes_[shape];
+        return {&s, shapePoints_.data() + s.firstPoint, positions_[body]};
+    }
+
+    void VpePhysicsWorld::updateManifold(VpeContactManifold &manifold, const VpeNarrowphase::Result &result) const
+    {
+        // Old points only carry their impulses over if the normal stayed about the same.
+        VpeManifoldPoint previous[VpeNarrowphase::MAX_POINTS];
+        uint32_t previousCount = 0;
+        if (manifold.pointCount > 0 && glm::dot(manifold.normal, result.normal) > 0.95f)
+        {
+            previousCount = manifold.pointCount;
+            std::copy(manifold.points, manifold.points + previousCount, previous);
+        }
+
+        manifold.normal = result.normal;
+        VpeNarrowphase::tangentBasis(result.normal, manifold.tangent1, manifold.tangent2);
+        manifold.pointCount = result.pointCount;
+        manifold.lastStep = stepIndex_;
+
+        const glm::vec3 &origin = positions_[manifold.bodyA];
+        float matchDistance = MATCH_DISTANCE * radii_[manifold.bodyA];
+        bool taken[VpeNarrowphase::MAX_POINTS] = {};
+        for (uint32_t i = 0; i < result.pointCount; i++)
+        {
+            VpeManifoldPoint &point = manifold.points[i];
+            point.anchor = result.points[i] - origin;
+            point.penetration = result.penetrations[i];
+            point.normalImpulse = 0.0f;
+            point.tangentImpulse1 = 0.0f;
+            point.tangentImpulse2 = 0.0f;
+
+            uint32_t match = VpeNarrowphase::MAX_POINTS;
+            float best = matchDistance * matchDistance;
+            for (uint32_t j = 0; j < previousCount; j++)
+            {
+                glm::vec3 delta = previous[j].anchor - point.anchor;
+                if (!taken[j] && glm::dot(delta, delta) < best)
+                {
+                    best = glm::dot(delta, delta);
+                    match = j;
+                }
+            }
+            if (match != VpeNarrowphase::MAX_POINTS)
+            {
+                taken[match] = true;
+                point.normalImpulse = WARM_START * previous[match].normalImpulse;
+                point.tangentImpulse1 = WARM_START * previous[match].tangentImpulse1;
+                point.tangentImpulse2 = WARM_START * previous[match].tangentImpulse2;
+            }
+        }
+    }
+
+    void VpePhysicsWorld::wakeTouchedBodies()
+    {
+        // An awake body touching a sleeping one wakes it. The rest of the sleeping island
+        // follows over the next steps as the contacts spread.
+        for (uint32_t index : activeManifolds_)
+        {
+            const VpeContactManifold &manifold = manifolds_[index];
+            wakeBody(manifold.bodyA);
+            if (manifold.bodyB != NO_BODY)
+            {
+                wakeBody(manifold.bodyB);
+            }
+        }
+
+        // Constraints aren't in the grid, so we check them directly.
+        activeConstraints_.clear();
+        for (uint32_t i = 0; i < constraints_.size(); i++)
+        {
+            const auto &constraint = constraints_[i];
+            if (awake_[constraint.bodyA] || awake_[constraint.bodyB])
+            {
+                wakeBody(constraint.bodyA);
+                wakeBody(constraint.bodyB);
+                activeConstraints_.push_back(i);
+            }
+        }
+    }
+
+    void VpePhysicsWorld::buildIslands()
+    {
+        contactLinks_.resize(activeManifolds_.size());
+        for (size_t i = 0; i < activeManifolds_.size(); i++)
+        {
+            const VpeContactManifold &manifold = manifolds_[activeManifolds_[i]];
+            contactLinks_[i] = {manifold.bodyA, manifold.bodyB};
+        }
+
+        constraintLinks_.resize(activeConstraints_.size());
+        for (size_t i = 0; i < activeConstraints_.size(); i++)
+        {
+            const auto &constraint = constraints_[activeConstraints_[i]];
+            constraintLinks_[i] = {constraint.bodyA, constraint.bodyB};
+        }
+
+        islands_.build(bodyCount(), awakeBodies_, contactLinks_, constraintLinks_);
+    }
+
+    void VpePhysicsWorld::solveIslands(float dt)
+    {
+        // Islands share no dynamic bodies, so each one is a completely independent job.
+        // Lots of islands are a single falling body, so let the grain adapt instead of one job each.
+        uint32_t count = islands_.islandCount();
+        islandSleeps_.assign(count, 0);
+        // Small worlds stay on this thread like every other loop here, which is what lets
+        // VpeBatchSimulation run one whole world per worker without them forking off tasks.
+        if (awakeBodyCount() < PARALLEL_THRESHOLD)
+        {
+            for (uint32_t island = 0; island < count; island++)
+            {
+                solveIsland(island, dt);
+            }
+            return;
+        }
+        jobSystem_.parallelFor(count, [this, dt](uint32_t begin, uint32_t end)
+                               {
+            for (uint32_t island = begin; island < end; island++)
+            {
+                solveIsland(island, dt);
+            } }, 4);
+    }
+
+    void VpePhysicsWorld::solveIsland(uint32_t island, float dt)
+    {
+        const auto &bodies = islands_.bodies();
+        const auto &contactIndices = islands_.contacts();
+        const auto &constraintIndices = islands_.constraints();
+        uint32_t bodyBegin = islands_.bodyStart()[island];
+        uint32_t bodyEnd = islands_.bodyStart()[island + 1];
+        uint32_t contactBegin = islands_.contactStart()[island];
+        uint32_t contactEnd = islands_.contactStart()[island + 1];
+        uint32_t constraintBegin = islands_.constraintStart()[island];
+        uint32_t constraintEnd = islands_.constraintStart()[island + 1];
+
+        // Warm start: push with what the last step ended on, most of the work is done before the first iteration.
+        for (uint32_t c = contactBegin; c < contactEnd; c++)
+        {
+            const VpeContactManifold &manifold = manifolds_[activeManifolds_[contactIndices[c]]];
+            for (uint32_t p = 0; p < manifold.pointCount; p++)
+            {
+                const VpeManifoldPoint &point = manifold.points[p];
+                glm::vec3 impulse = manifold.normal * point.normalImpulse +
+                                    manifold.tangent1 * point.tangentImpulse1 +
+                                    manifold.tangent2 * point.tangentImpulse2;
+                applyImpulse(manifold.bodyA, impulse);
+                applyImpulse(manifold.bodyB, -impulse);
+            }
+        }
+
+        float biasFactor = settings_.baumgarte / dt;
+        for (uint32_t iteration = 0; iteration < settings_.solverIterations; iteration++)
+        {
+            for (uint32_t c = contactBegin; c < contactEnd; c++)
+            {
+                VpeContactManifold &manifold = manifolds_[activeManifolds_[contactIndices[c]]];
+                float massSum = inverseMassOf(manifold.bodyA) + inverseMassOf(manifold.bodyB);
+                if (massSum == 0.0f)
+                {
+                    continue;
+                }
+
+                for (uint32_t p = 0; p < manifold.pointCount; p++)
+                {
+                    VpeManifoldPoint &point = manifold.points[p];
+                    // Normal: stop them moving into each other, plus a little push to fix the overlap.
+                    glm::vec3 relative = velocityOf(manifold.bodyA) - velocityOf(manifold.bodyB);
+                    // A speculative point (still a gap) lets them close exactly the gap this step, no more.
+                    float target = point.penetration >= 0.0f
+                                       ? biasFactor * std::max(point.penetration - settings_.penetrationSlop, 0.0f)
+                                       : point.penetration / dt;
+                    float lambda = (target - glm::dot(relative, manifold.normal)) / massSum;
+                    // Accumulated impulse can only ever push.
+                    float previous = point.normalImpulse;
+                    point.normalImpulse = std::max(previous + lambda, 0.0f);
+                    glm::vec3 impulse = manifold.normal * (point.normalImpulse - previous);
+                    applyImpulse(manifold.bodyA, impulse);
+                    applyImpulse(manifold.bodyB, -impulse);
+
+                    // Friction along both tangents, the pair capped to a circle by how hard the normal is pushing.
+                    relative = velocityOf(manifold.bodyA) - velocityOf(manifold.bodyB);
+                    float previous1 = point.tangentImpulse1;
+                    float previous2 = point.tangentImpulse2;
+                    float tangent1 = previous1 - glm::dot(relative, manifold.tangent1) / massSum;
+                    float tangent2 = previous2 - glm::dot(relative, manifold.tangent2) / massSum;
+                    float limit = settings_.friction * point.normalImpulse;
+                    float length = std::sqrt(tangent1 * tangent1 + tangent2 * tangent2);
+                    if (length > limit)
+                    {
+                        float scale = length > 0.0f ? limit / length : 0.0f;
+                        tangent1 *= scale;
+                        tangent2 *= scale;
+                    }
+                    point.tangentImpulse1 = tangent1;
+                    point.tangentImpulse2 = tangent2;
+                    impulse = manifold.tangent1 * (tangent1 - previous1) + manifold.tangent2 * (tangent2 - previous2);
+                    applyImpulse(manifold.bodyA, impulse);
+                    applyImpulse(manifold.bodyB, -impulse);
+                }
+            }
+
+            for (uint32_t c = constraintBegin; c < constraintEnd; c++)
+            {
+                const auto &constraint = constraints_[activeConstraints_[constraintIndices[c]]];
+                float massSum = inverseMassOf(constraint.bodyA) + inverseMassOf(constraint.bodyB);
+                glm::vec3 delta = positions_[constraint.bodyA] - positions_[constraint.bodyB];
+                float distance = glm::length(delta);
+                if (massSum == 0.0f || distance < 1e-6f)
+                {
+                    continue;
+                }
+
+                glm::vec3 direction = delta / distance;
+                float error = distance - constraint.length;
+                glm::vec3 relative = velocities_[constraint.bodyA] - velocities_[constraint.bodyB];
+                float lambda = -(glm::dot(relative, direction) + biasFactor * error) / massSum;
+                applyImpulse(constraint.bodyA, direction * lambda);
+                applyImpulse(constraint.bodyB, -direction * lambda);
+            }
+        }
+
+        // Integrate and see whether the whole island has been slow for long enough.
+        float sleepSpeedSquared = settings_.sleepVelocity * settings_.sleepVelocity;
+        float minSleepTimer = settings_.timeToSleep;
+        for (uint32_t k = bodyBegin; k < bodyEnd; k++)
+        {
+            uint32_t body = bodies[k];
+            positions_[body] += velocities_[body] * dt;
+
+            if (glm::dot(velocities_[body], velocities_[body]) < sleepSpeedSquared)
+            {
+                sleepTimers_[body] += dt;
+            }
+            else
+            {
+                sleepTimers_[body] = 0.0f;
+            }
+            minSleepTimer = std::min(minSleepTimer, sleepTimers_[body]);
+        }
+
+        if (minSleepTimer >= settings_.timeToSleep)
+        {
+            for (uint32_t k = bodyBegin; k < bodyEnd; k++)
+            {
+                uint32_t body = bodies[k];
+                velocities_[body] = glm::vec3{0.0f};
+                margins_[body] = 0.0f;
+                awake_[body] = 0;
+            }
+            islandSleeps_[island] = 1;
+        }
+    }
+
+    void VpePhysicsWorld::updateAwakeList()
+    {
+        // Rebuilt from the islands that stayed awake, so it never has to look at sleeping bodies.
+        const auto &bodies = islands_.bodies();
+        const auto &bodyStart = islands_.bodyStart();
+        awakeBodies_.clear();
+        for (uint32_t island = 0; island < islands_.islandCount(); island++)
+        {
+            if (islandSleeps_[island])
+            {
+                continue;
+            }
+            awakeBodies_.insert(awakeBodies_.end(), bodies.begin() + bodyStart[island], bodies.begin() + bodyStart[island + 1]);
+        }
+    }
+
+    glm::vec3 VpePhysicsWorld::velocityOf(uint32_t body) const
+    {
+        return body == NO_BODY ? glm::vec3{0.0f} : velocities_[body];
+    }
+
+    void VpePhysicsWorld::applyImpulse(uint32_t body, const glm::vec3 &impulse)
+    {
+        // Static bodies can be in several islands at once, so they must never be written to.
+        if (body == NO_BODY || inverseMasses_[body] == 0.0f)
+        {
+            return;
+        }
+        velocities_[body] += impulse * inverseMasses_[body];
+    }
+
+    float VpePhysicsWorld::inverseMassOf(uint32_t body) const
+    {
+        return body == NO_BODY ? 0.0f : inverseMasses_[body];
+    }
+} // namespace vpe
@@ -0,0 +1,185 @@
+#pragma once
+
+#include "VpeCollisionShape.hpp"
+#include "VpeContactManifold.hpp"
+#include "VpeIslandBuilder.hpp"
+#include "VpeJobSystem.hpp"
+#include "VpeSpatialHashGrid.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace vpe
+{
+    class VpeReplayRecorder;
+    class VpeWorldSnapshot;
+
+    struct VpePhysicsSettings
+    {
+        glm::vec3 gravity{0.0f, -9.81f, 0.0f};
+        // There's always an infinite floor at this height.
+        float groundHeight = 0.0f;
+        uint32_t solverIterations = 8;
+        float friction = 0.5f;
+        // How much of the overlap gets pushed out per step, and how much overlap we just live with.
+        float baumgarte = 0.2f;
+        float penetrationSlop = 0.005f;
+        // Islands that stay slower than this for timeToSleep seconds go to sleep.
+        float sleepVelocity = 0.05f;
+        float timeToSleep = 0.5f;
+        // Bodies moving more than this much of their radius in one step count as fast and get
+        // speculative contacts, so they can't skip through things. Zero turns the check off,
+        // then only bodies flagged with setContinuous get them.
+        float continuousThreshold = 0.5f;
+    };
+
+    struct VpeDistanceConstraint
+    {
+        uint32_t bodyA;
+        uint32_t bodyB;
+        float length;
+    };
+
+    // Convex bodies (spheres, capsules, boxes, hulls), no rotation yet. Everything is stored as one
+    // array per field (SoA), indexed by the body id addBody gave back.
+    //
+    // A step goes: gravity, broadphase, narrowphase into the persistent manifolds, islands,
+    // solve islands in parallel, integrate.
+    // Fast bodies look for contacts along everything they sweep through this step, not just where
+    // they are. Contacts that aren't touching yet come back with a negative penetration (the gap),
+    // and the solver only stops the bodies from closing more than that gap in one step.
+    // Only awake bodies get integrated, look for contacts and get solved. Sleeping bodies just sit
+    // in the grid so awake ones can bump into them (which wakes them back up).
+    class VpePhysicsWorld
+    {
+    public:
+        static constexpr uint32_t NO_BODY = VpeIslandBuilder::NO_BODY;
+        // Bodies from the plain addBody are spheres of their radius and don't need a shape.
+        static constexpr uint32_t NO_SHAPE = ~0u;
+
+        VpePhysicsWorld(VpeJobSystem &jobSystem, const VpePhysicsSettings &settings = {});
+
+        VpePhysicsWorld(const VpePhysicsWorld &) = delete;
+        VpePhysicsWorld &operator=(const VpePhysicsWorld &) = delete;
+
+        // Zero mass makes a static body that never moves.
+        uint32_t addBody(const glm::vec3 &position, float radius, float mass);
+        // Same, with any shape from below. Shapes can be shared by as many bodies as you like.
+        uint32_t addShapeBody(const glm::vec3 &position, uint32_t shape, float mass);
+
+        // Core points relative to the body, see VpeCollisionShape.hpp. The ones below fill it in for you.
+        uint32_t addShape(const VpeCollisionShape &shape, const std::vector<glm::vec3> &points);
+        uint32_t addSphereShape(float radius);
+        // The core runs from -halfSegment to halfSegment.
+        uint32_t addCapsuleShape(const glm::vec3 &halfSegment, float radius);
+        // orientation has to be a pure rotation, its columns become the box axes.
+        uint32_t addBoxShape(const glm::vec3 &halfExtents, const glm::mat3 &orientation = glm::mat3{1.0f});
+        // Any points will do, only their convex hull counts.
+        uint32_t addConvexHullShape(const std::vector<glm::vec3> &points);
+
+        // Keeps two bodies exactly length apart, like a rigid rod.
+        uint32_t addDistanceConstraint(uint32_t bodyA, uint32_t bodyB, float length);
+
+        void setVelocity(uint32_t body, const glm::vec3 &velocity);
+        void wake(uint32_t body);
+        // Always treat this body as fast, however slow it goes. For thin things that tunnel
+        // below the continuousThreshold, or bullets you want to be sure about.
+        void setContinuous(uint32_t body, bool continuous);
+
+        void step(float dt);
+
+        // The whole world as one flat file, see VpeWorldSnapshot.hpp. Restoring throws away everything
+        // in this world and continues exactly where the snapshot left off (same steps, same bits).
+        void saveSnapshot(const std::filesystem::path &path) const;
+        void restoreSnapshot(const VpeWorldSnapshot &snapshot);
+
+        // Everything from here on goes into the recorder's log, see VpeReplayLog.hpp.
+        // Has to be set while the world is still empty, the log starts from nothing. Null stops recording.
+        void setRecorder(VpeReplayRecorder *recorder);
+
+        uint32_t bodyCount() const { return static_cast<uint32_t>(positions_.size()); }
+        uint32_t awakeBodyCount() const { return static_cast<uint32_t>(awakeBodies_.size()); }
+        bool isAwake(uint32_t body) const { return awake_[body] != 0; }
+        uint32_t islandCount() const { return islands_.islandCount(); }
+        // Awake bodies that got speculative contacts this step.
+        uint32_t fastBodyCount() const { return fastBodyCount_; }
+
+        const std::vector<glm::vec3> &positions() const { return positions_; }
+        const std::vector<glm::vec3> &velocities() const { return velocities_; }
+        // Bounding sphere radius for bodies with a shape.
+        const std::vector<float> &radii() const { return radii_; }
+        const std::vector<uint32_t> &bodyShapes() const { return bodyShapes_; }
+        const std::vector<VpeCollisionShape> &shapes() const { return shapes_; }
+        // The manifolds touching this step, indices into manifolds().
+        const std::vector<uint32_t> &activeManifolds() const { return activeManifolds_; }
+        const VpeManifoldPool &manifolds() const { return manifolds_; }
+        const VpePhysicsSettings &settings() const { return settings_; }
+
+    private:
+        // Below this many awake bodies a loop stays on the calling thread.
+        static constexpr uint32_t PARALLEL_THRESHOLD = 2048;
+
+        uint32_t insertBody(const glm::vec3 &position, float radius, float mass, uint32_t shape);
+        void simulate(float dt);
+        // wake() without the recording, for the wakes the world does on its own.
+        void wakeBody(uint32_t body);
+        void integrateVelocities(float dt);
+        void findContacts(float dt);
+        VpeConvex convexOf(uint32_t body, VpeCollisionShape &sphere) const;
+        // Moves the narrowphase result into the manifold, keeping the impulses of the points that are still there.
+        void updateManifold(VpeContactManifold &manifold, const VpeNarrowphase::Result &result) const;
+        void wakeTouchedBodies();
+        void buildIslands();
+        void solveIslands(float dt);
+        void solveIsland(uint32_t island, float dt);
+        void updateAwakeList();
+
+        glm::vec3 velocityOf(uint32_t body) const;
+        void applyImpulse(uint32_t body, const glm::vec3 &impulse);
+        float inverseMassOf(uint32_t body) const;
+
+        VpeJobSystem &jobSystem_;
+        VpePhysicsSettings settings_;
+        VpeSpatialHashGrid grid_;
+        float maxRadius_ = 0.0f;
+
+        // Body data.
+        std::vector<glm::vec3> positions_;
+        std::vector<glm::vec3> velocities_;
+        std::vector<float> inverseMasses_;
+        std::vector<float> radii_;
+        std::vector<float> sleepTimers_;
+        // uint8_t and not bool, vector<bool> packs bits and threads would trample each other.
+        std::vector<uint8_t> awake_;
+        std::vector<uint32_t> bodyShapes_;
+        std::vector<uint8_t> continuous_;
+        // How far each body gets this step if it's fast, zero otherwise (and while asleep).
+        std::vector<float> margins_;
+        float maxMargin_ = 0.0f;
+        uint32_t fastBodyCount_ = 0;
+
+        std::vector<VpeCollisionShape> shapes_;
+        // Every shape's core points, each shape owns a range.
+        std::vector<glm::vec3> shapePoints_;
+
+        std::vector<uint32_t> awakeBodies_;
+        VpeManifoldPool manifolds_;
+        std::vector<uint32_t> activeManifolds_;
+        // Counts steps, manifolds not found in the current one get dropped.
+        uint32_t stepIndex_ = 0;
+        std::vector<VpeDistanceConstraint> constraints_;
+
+        VpeIslandBuilder islands_;
+        std::vector<VpeIslandBuilder::Link> contactLinks_;
+        std::vector<VpeIslandBuilder::Link> constraintLinks_;
+        std::vector<uint32_t> activeConstraints_;
+        std::vector<uint8_t> islandSleeps_;
+
+        VpeReplayRecorder *recorder_ = nullptr;
+    };
+} // namespace vpe
@@ -1,13 +1,44 @@
 #include "VpePipeline.hpp"
 
 #include <fstream>
+#include <mutex>
 #include <stdexcept>
+#include <unordered_map>
 #include <spdlog/spdlog.h>
 
 namespace fs = std::filesystem;
 
 namespace vpe
 {
+    namespace
+    {
+        // Files read by preloadFile, each handed out to the first readFile that asks for it.
+        std::mutex preloadMutex;
+        std::unordered_map<std::string, std::vector<char>> preloadedFiles;
+
+        std::string preloadKey(const fs::path &filepath)
+        {
+            return filepath.lexically_normal().generic_string();
+        }
+
+        std::vector<char> readFromDisk(const fs::path &filepath)
+        {
+            std::ifstream file(filepath, std::ios::binary);
+
+            if (!file.is_open())
+            {
+                throw std::runtime_error("Failed to open file: " + filepath.string());
+            }
+
+            size_t fileSize = fs::file_size(filepath);
+            std::vector<char> buffer(fileSize);
+
+            file.read(buffer.data(), fileSize);
+            file.close();
+            return buffer;
+        }
+    }
+
     VpePipeline::VpePipeline(
         VpeDevice &device,
         const fs::path &vertFilePath,
@@ -123,19 +154,24 @@ namespace vpe
 
     std::vector<char> VpePipeline::readFile(const fs::path &filepath)
     {
-        std::ifstream file(filepath, std::ios::binary);
-
-        if (!file.is_open())
         {
-            throw std::runtime_error("Failed to open file: " + filepath.string());
+            std::lock_guard<std::mutex> lock(preloadMutex);
+            auto preloaded = preloadedFiles.find(preloadKey(filepath));
+            if (preloaded != preloadedFiles.end())
+            {
+                std::vector<char> buffer = std::move(preloaded->second);
+                preloadedFiles.erase(preloaded);
+                return buffer;
+            }
         }
+        return readFromDisk(filepath);
+    }
 
-        size_t fileSize = fs::file_size(filepath);
-        std::vector<char> buffer(fileSize);
-
-        file.read(buffer.data(), fileSize);
-        file.close();
-        return buffer;
+    void VpePipeline::preloadFile(const fs::path &filepath)
+    {
+        std::vector<char> buffer = readFromDisk(filepath);
+        std::lock_guard<std::mutex> lock(preloadMutex);
+        preloadedFiles[preloadKey(filepath)] = std::move(buffer);
     }
 
     void VpePipeline::createGraphicsPipeline(
@@ -148,8 +184,8 @@ namespace vpe
             configInfo.pipelineLayout != VK_NULL_HANDLE &&
             "configInfo needs a pipelineLayout.");
         assert(
-            configInfo.renderPass != VK_NULL_HANDLE &&
-            "configInfo needs a renderPass.");
+            (configInfo.renderPass != VK_NULL_HANDLE || !configInfo.colorAttachmentFormats.empty()) &&
+            "configInfo needs a renderPass or the attachment formats for dynamic rendering.");
 
         auto vertCode = readFile(vertFilePath);
         auto fragCode = readFile(fragFilepath);
@@ -177,13 +213,13 @@ namespace vpe
 
         VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
         vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        vertexInputInfo.vertexAttributeDescriptionCount = 0;
-        vertexInputInfo.vertexBindingDescriptionCount = 0;
-        vertexInputInfo.pVertexAttributeDescriptions = nullptr;
-        vertexInputInfo.pVertexBindingDescriptions = nullptr;
+        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(configInfo.attributeDescriptions.size());
+        vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(configInfo.bindingDescriptions.size());
+        vertexInputInfo.pVertexAttributeDescriptions = configInfo.attributeDescriptions.data();
+        vertexInputInfo.pVertexBindingDescriptions = configInfo.bindingDescriptions.data();
 
         // We set the viewportInfo to have the viewport and scissor.
-        VkPipelineViewportStateCreateInfo viewportInfo;
+        VkPipelineViewportStateCreateInfo viewportInfo{};
         viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
         viewportInfo.viewportCount = 1;
         viewportInfo.pViewports = &configInfo.viewport;
@@ -207,6 +243,18 @@ namespace vpe
         pipelineInfo.renderPass = configInfo.renderPass;
         pipelineInfo.subpass = configInfo.subpass;
 
+        // Without a render pass the formats are the only thing that has to match what we draw into.
+        VkPipelineRenderingCreateInfo renderingInfo{};
+        if (configInfo.renderPass == VK_NULL_HANDLE)
+        {
+            renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+            renderingInfo.colorAttachmentCount = static_cast<uint32_t>(configInfo.colorAttachmentFormats.size());
+            renderingInfo.pColorAttachmentFormats = configInfo.colorAttachmentFormats.data();
+            renderingInfo.depthAttachmentFormat = configInfo.depthAttachmentFormat;
+            pipelineInfo.pNext = &renderingInfo;
+            pipelineInfo.subpass = 0;
+        }
+
         pipelineInfo.basePipelineIndex = -1;
         pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
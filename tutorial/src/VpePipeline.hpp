@@ -20,9 +20,16 @@ namespace vpe
         VkPipelineColorBlendAttachmentState colorBlendAttachment;
         VkPipelineColorBlendStateCreateInfo colorBlendInfo;
         VkPipelineDepthStencilStateCreateInfo depthStencilInfo;
+        // Empty means the vertex shader makes up its own input (gl_VertexIndex and friends).
+        std::vector<VkVertexInputBindingDescription> bindingDescriptions;
+        std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
         VkPipelineLayout pipelineLayout = nullptr;
+        // Leave the render pass null to build the pipeline for dynamic rendering instead.
+        // Then all it needs to know about its targets are these formats.
         VkRenderPass renderPass = nullptr;
         uint32_t subpass = 0;
+        std::vector<VkFormat> colorAttachmentFormats;
+        VkFormat depthAttachmentFormat = VK_FORMAT_UNDEFINED;
     };
 
     class VpePipeline
@@ -41,9 +48,13 @@ namespace vpe
 
         void bind(VkCommandBuffer commandBuffer);
         static PipelineConfigInfo defaultPipelineConfigInfo(uint32_t width, uint32_t height);
+        // Public so the compute pipelines can load their SPIR-V the same way.
+        static std::vector<char> readFile(const fs::path &filepath);
+        // Reads the file ahead of time so a later readFile of it doesn't touch the disk.
+        // Meant for startup, where the shaders can load while the device is still being made. Any thread.
+        static void preloadFile(const fs::path &filepath);
 
     private:
-        static std::vector<char> readFile(const fs::path &filepath);
         void createGraphicsPipeline(
             const fs::path &vertFilePath,
             const fs::path &fragFilepath,
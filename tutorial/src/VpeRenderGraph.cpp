@@ -0,0 +1,874 @@
+#include "VpeRenderGraph.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <stdexcept>
+
+namespace vpe
+{
+    namespace
+    {
+        constexpr uint32_t NOT_USED = std::numeric_limits<uint32_t>::max();
+
+        constexpr VkAccessFlags WRITE_ACCESS =
+            VK_ACCESS_SHADER_WRITE_BIT |
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+            VK_ACCESS_TRANSFER_WRITE_BIT |
+            VK_ACCESS_HOST_WRITE_BIT |
+            VK_ACCESS_MEMORY_WRITE_BIT;
+
+        struct AccessInfo
+        {
+            VkPipelineStageFlags stages;
+            VkAccessFlags access;
+            VkImageLayout layout;
+            VkImageUsageFlags imageUsage;
+            VkBufferUsageFlags bufferUsage;
+        };
+
+        AccessInfo accessInfo(VpeRgAccess access, VpeRgPassType type, VkImageAspectFlags aspect)
+        {
+            bool shaderAccess = access == VpeRgAccess::SampledRead || access == VpeRgAccess::StorageRead ||
+                                access == VpeRgAccess::StorageWrite || access == VpeRgAccess::StorageReadWrite ||
+                                access == VpeRgAccess::UniformRead;
+            if (shaderAccess && type == VpeRgPassType::Transfer)
+            {
+                throw std::runtime_error("Transfer passes can't have shader accesses.");
+            }
+            VkPipelineStageFlags shaderStages = type == VpeRgPassType::Compute
+                                                    ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+                                                    : VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+            constexpr VkPipelineStageFlags FRAGMENT_TESTS =
+                VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+
+            switch (access)
+            {
+            case VpeRgAccess::ColorAttachmentWrite:
+                return {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                        VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, 0};
+            case VpeRgAccess::DepthAttachmentWrite:
+                return {FRAGMENT_TESTS,
+                        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                        VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 0};
+            case VpeRgAccess::DepthAttachmentRead:
+                return {FRAGMENT_TESTS, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+                        VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 0};
+            case VpeRgAccess::SampledRead:
+                return {shaderStages, VK_ACCESS_SHADER_READ_BIT,
+                        (aspect & VK_IMAGE_ASPECT_DEPTH_BIT) ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+                                                             : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                        VK_IMAGE_USAGE_SAMPLED_BIT, 0};
+            case VpeRgAccess::StorageRead:
+                return {shaderStages, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL,
+                        VK_IMAGE_USAGE_STORAGE_BIT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT};
+            case VpeRgAccess::StorageWrite:
+                return {shaderStages, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL,
+                        VK_IMAGE_USAGE_STORAGE_BIT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT};
+            case VpeRgAccess::StorageReadWrite:
+                return {shaderStages, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL,
+                        VK_IMAGE_USAGE_STORAGE_BIT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT};
+            case VpeRgAccess::UniformRead:
+                return {shaderStages, VK_ACCESS_UNIFORM_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+                        0, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT};
+            case VpeRgAccess::IndirectRead:
+                return {VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+                        0, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT};
+            case VpeRgAccess::VertexRead:
+                return {VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+                        0, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT};
+            case VpeRgAccess::IndexRead:
+                return {VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+                        0, VK_BUFFER_USAGE_INDEX_BUFFER_BIT};
+            case VpeRgAccess::TransferRead:
+                return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                        VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_BUFFER_USAGE_TRANSFER_SRC_BIT};
+            case VpeRgAccess::TransferWrite:
+                return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                        VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_BUFFER_USAGE_TRANSFER_DST_BIT};
+            }
+            throw std::runtime_error("Unknown render graph access.");
+        }
+
+        VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+        {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+    }
+
+    VpeRenderGraph::PassBuilder &VpeRenderGraph::PassBuilder::read(ResourceId resource, VpeRgAccess access)
+    {
+        graph_.addUse(pass_, resource, access, false);
+        return *this;
+    }
+
+    VpeRenderGraph::PassBuilder &VpeRenderGraph::PassBuilder::write(ResourceId resource, VpeRgAccess access)
+    {
+        graph_.addUse(pass_, resource, access, true);
+        return *this;
+    }
+
+    VpeRenderGraph::PassBuilder &VpeRenderGraph::PassBuilder::sideEffects()
+    {
+        graph_.passes_[pass_].sideEffects = true;
+        return *this;
+    }
+
+    VpeRenderGraph::VpeRenderGraph(VpeDevice &device) : vpeDevice_{device}
+    {
+    }
+
+    VpeRenderGraph::~VpeRenderGraph()
+    {
+        freeTransients();
+    }
+
+    void VpeRenderGraph::reset()
+    {
+        resources_.clear();
+        passes_.clear();
+    }
+
+    VpeRenderGraph::ResourceId VpeRenderGraph::importImage(
+        const std::string &name,
+        VkImage image,
+        VkImageView view,
+        VkImageAspectFlags aspect,
+        VkImageLayout initialLayout,
+        VkImageLayout finalLayout,
+        VkPipelineStageFlags lastStages,
+        VkAccessFlags lastAccess)
+    {
+        Resource resource{};
+        resource.name = name;
+        resource.isImage = true;
+        resource.imported = true;
+        resource.image = image;
+        resource.view = view;
+        resource.aspect = aspect;
+        resource.initialState.lastStages = lastStages;
+        resource.initialState.pendingAccess = lastAccess & WRITE_ACCESS;
+        resource.initialState.layout = initialLayout;
+        resource.finalLayout = finalLayout;
+        resources_.push_back(resource);
+        return static_cast<ResourceId>(resources_.size() - 1);
+    }
+
+    VpeRenderGraph::ResourceId VpeRenderGraph::importBuffer(
+        const std::string &name,
+        VkBuffer buffer,
+        VkPipelineStageFlags lastStages,
+        VkAccessFlags lastAccess)
+    {
+        Resource resource{};
+        resource.name = name;
+        resource.isImage = false;
+        resource.imported = true;
+        resource.buffer = buffer;
+        resource.initialState.lastStages = lastStages;
+        resource.initialState.pendingAccess = lastAccess & WRITE_ACCESS;
+        resources_.push_back(resource);
+        return static_cast<ResourceId>(resources_.size() - 1);
+    }
+
+    VpeRenderGraph::ResourceId VpeRenderGraph::createImage(const std::string &name, const VpeRgImageDesc &desc)
+    {
+        Resource resource{};
+        resource.name = name;
+        resource.isImage = true;
+        resource.imported = false;
+        resource.imageDesc = desc;
+        resource.aspect = desc.aspect;
+        resources_.push_back(resource);
+        return static_cast<ResourceId>(resources_.size() - 1);
+    }
+
+    VpeRenderGraph::ResourceId VpeRenderGraph::createBuffer(const std::string &name, const VpeRgBufferDesc &desc)
+    {
+        Resource resource{};
+        resource.name = name;
+        resource.isImage = false;
+        resource.imported = false;
+        resource.bufferDesc = desc;
+        resources_.push_back(resource);
+        return static_cast<ResourceId>(resources_.size() - 1);
+    }
+
+    VpeRenderGraph::PassBuilder VpeRenderGraph::addPass(const std::string &name, VpeRgPassType type, PassFunction function)
+    {
+        Pass pass{};
+        pass.name = name;
+        pass.type = type;
+        pass.function = std::move(function);
+        passes_.push_back(std::move(pass));
+        return PassBuilder{*this, static_cast<uint32_t>(passes_.size() - 1)};
+    }
+
+    void VpeRenderGraph::addUse(uint32_t pass, ResourceId resource, VpeRgAccess access, bool write)
+    {
+        if (resource >= resources_.size())
+        {
+            throw std::runtime_error("Render graph pass uses a resource that doesn't exist.");
+        }
+        const Resource &declared = resources_[resource];
+        AccessInfo info = accessInfo(access, passes_[pass].type, declared.aspect);
+        if (declared.isImage && info.layout == VK_IMAGE_LAYOUT_UNDEFINED)
+        {
+            throw std::runtime_error("Render graph access is for buffers only: " + declared.name);
+        }
+
+        Use use{resource, info.stages, info.access, info.layout, write, info.imageUsage, info.bufferUsage};
+        for (Use &existing : passes_[pass].uses)
+        {
+            if (existing.resource != resource)
+            {
+                continue;
+            }
+            if (declared.isImage && existing.layout != use.layout)
+            {
+                throw std::runtime_error("Render graph pass needs " + declared.name + " in two layouts at once.");
+            }
+            existing.stages |= use.stages;
+            existing.access |= use.access;
+            existing.write = existing.write || use.write;
+            existing.imageUsage |= use.imageUsage;
+            existing.bufferUsage |= use.bufferUsage;
+            return;
+        }
+        passes_[pass].uses.push_back(use);
+    }
+
+    std::vector<uint64_t> VpeRenderGraph::topologyKey() const
+    {
+        // Everything the plan depends on, and nothing it doesn't (names, imported handles).
+        std::vector<uint64_t> key;
+        key.push_back(resources_.size());
+        for (const Resource &resource : resources_)
+        {
+            key.push_back((resource.isImage ? 1u : 0u) | (resource.imported ? 2u : 0u));
+            key.push_back(resource.aspect);
+            if (resource.imported)
+            {
+                key.push_back(resource.initialState.layout);
+                key.push_back(resource.initialState.lastStages);
+                key.push_back(resource.initialState.pendingAccess);
+                key.push_back(resource.finalLayout);
+            }
+            else if (resource.isImage)
+            {
+                key.push_back(resource.imageDesc.format);
+                key.push_back((static_cast<uint64_t>(resource.imageDesc.extent.width) << 32) | resource.imageDesc.extent.height);
+                key.push_back(resource.imageDesc.extraUsage);
+            }
+            else
+            {
+                key.push_back(resource.bufferDesc.size);
+                key.push_back(resource.bufferDesc.extraUsage);
+            }
+        }
+        key.push_back(passes_.size());
+        for (const Pass &pass : passes_)
+        {
+            key.push_back(static_cast<uint64_t>(pass.type) | (pass.sideEffects ? 16u : 0u));
+            key.push_back(pass.uses.size());
+            for (const Use &use : pass.uses)
+            {
+                key.push_back((static_cast<uint64_t>(use.resource) << 32) | (use.write ? 1u : 0u));
+                key.push_back((static_cast<uint64_t>(use.stages) << 32) | use.access);
+                key.push_back(use.layout);
+            }
+        }
+        return key;
+    }
+
+    void VpeRenderGraph::compile()
+    {
+        std::vector<uint64_t> key = topologyKey();
+        if (!compiled_ || key != compiledKey_)
+        {
+            stats_ = Stats{};
+            std::vector<bool> live = findLivePasses();
+            plan_.order = schedule(live);
+            stats_.passCount = static_cast<uint32_t>(plan_.order.size());
+            stats_.culledPassCount = static_cast<uint32_t>(passes_.size() - plan_.order.size());
+
+            std::vector<uint32_t> firstUse(resources_.size(), NOT_USED);
+            std::vector<uint32_t> lastUse(resources_.size(), NOT_USED);
+            for (uint32_t position = 0; position < plan_.order.size(); position++)
+            {
+                for (const Use &use : passes_[plan_.order[position]].uses)
+                {
+                    if (firstUse[use.resource] == NOT_USED)
+                    {
+                        firstUse[use.resource] = position;
+                    }
+                    lastUse[use.resource] = position;
+                }
+            }
+
+            std::vector<std::vector<ResourceId>> predecessors;
+            allocateTransients(firstUse, lastUse, predecessors);
+            planBarriers(predecessors);
+
+            compiledKey_ = std::move(key);
+            compiled_ = true;
+
+            const double MB = 1024.0 * 1024.0;
+            spdlog::info(
+                "Render graph: {} passes ({} culled), {} barriers ({} image), transient memory {:.2f} MB in {:.2f} MB, aliasing saved {:.2f} MB",
+                stats_.passCount, stats_.culledPassCount, stats_.barrierCount, stats_.imageBarrierCount,
+                stats_.transientBytes / MB, stats_.allocatedBytes / MB,
+                (stats_.transientBytes - stats_.allocatedBytes) / MB);
+        }
+
+        // The declarations might be fresh from a reset, hand the transients their memory again.
+        for (size_t i = 0; i < resources_.size(); i++)
+        {
+            if (!resources_[i].imported)
+            {
+                resources_[i].image = allocations_[i].image;
+                resources_[i].view = allocations_[i].view;
+                resources_[i].buffer = allocations_[i].buffer;
+            }
+        }
+    }
+
+    std::vector<bool> VpeRenderGraph::findLivePasses() const
+    {
+        // Walk backwards from everything that leaves the graph, keeping whoever writes what a kept pass reads.
+        std::vector<bool> live(passes_.size(), false);
+        std::vector<bool> needed(resources_.size(), false);
+        for (size_t p = passes_.size(); p-- > 0;)
+        {
+            const Pass &pass = passes_[p];
+            bool keep = pass.sideEffects;
+            for (const Use &use : pass.uses)
+            {
+                if (use.write && (resources_[use.resource].imported || needed[use.resource]))
+                {
+                    keep = true;
+                }
+            }
+            if (!keep)
+            {
+                continue;
+            }
+            live[p] = true;
+            for (const Use &use : pass.uses)
+            {
+                // Read-modify-writes read too. Plain writes don't need anything from before.
+                if (!use.write || (use.access & ~WRITE_ACCESS) != 0)
+                {
+                    needed[use.resource] = true;
+                }
+            }
+        }
+        return live;
+    }
+
+    std::vector<uint32_t> VpeRenderGraph::schedule(const std::vector<bool> &live) const
+    {
+        // Declaration order says who comes first on each resource: reads after the write
+        // before them, writes after every read and write before them.
+        size_t passCount = passes_.size();
+        std::vector<std::vector<uint32_t>> dependents(passCount);
+        std::vector<std::vector<uint32_t>> dependencies(passCount);
+        std::vector<uint32_t> lastWriter(resources_.size(), NOT_USED);
+        std::vector<std::vector<uint32_t>> readers(resources_.size());
+        auto addEdge = [&](uint32_t from, uint32_t to)
+        {
+            if (from != NOT_USED && from != to &&
+                std::find(dependencies[to].begin(), dependencies[to].end(), from) == dependencies[to].end())
+            {
+                dependencies[to].push_back(from);
+                dependents[from].push_back(to);
+            }
+        };
+        for (uint32_t p = 0; p < passCount; p++)
+        {
+            if (!live[p])
+            {
+                continue;
+            }
+            for (const Use &use : passes_[p].uses)
+            {
+                addEdge(lastWriter[use.resource], p);
+                if (use.write)
+                {
+                    for (uint32_t reader : readers[use.resource])
+                    {
+                        addEdge(reader, p);
+                    }
+                    readers[use.resource].clear();
+                    lastWriter[use.resource] = p;
+                }
+                else
+                {
+                    readers[use.resource].push_back(p);
+                }
+            }
+        }
+
+        // Out of whatever is ready, run the pass whose inputs were finished longest ago.
+        // That keeps dependent passes apart and gives the GPU something else to do in between.
+        std::vector<uint32_t> remaining(passCount, 0);
+        std::vector<uint32_t> position(passCount, NOT_USED);
+        std::vector<uint32_t> ready;
+        for (uint32_t p = 0; p < passCount; p++)
+        {
+            remaining[p] = static_cast<uint32_t>(dependencies[p].size());
+            if (live[p] && remaining[p] == 0)
+            {
+                ready.push_back(p);
+            }
+        }
+        std::vector<uint32_t> order;
+        while (!ready.empty())
+        {
+            size_t best = 0;
+            int64_t bestInputs = std::numeric_limits<int64_t>::max();
+            for (size_t r = 0; r < ready.size(); r++)
+            {
+                int64_t inputs = -1;
+                for (uint32_t dependency : dependencies[ready[r]])
+                {
+                    inputs = std::max<int64_t>(inputs, position[dependency]);
+                }
+                if (inputs < bestInputs || (inputs == bestInputs && ready[r] < ready[best]))
+                {
+                    best = r;
+                    bestInputs = inputs;
+                }
+            }
+            uint32_t pass = ready[best];
+            ready.erase(ready.begin() + static_cast<std::ptrdiff_t>(best));
+            position[pass] = static_cast<uint32_t>(order.size());
+            order.push_back(pass);
+            for (uint32_t dependent : dependents[pass])
+            {
+                if (--remaining[dependent] == 0)
+                {
+                    ready.push_back(dependent);
+                }
+            }
+        }
+        return order;
+    }
+
+    void VpeRenderGraph::allocateTransients(
+        const std::vector<uint32_t> &firstUse,
+        const std::vector<uint32_t> &lastUse,
+        std::vector<std::vector<ResourceId>> &predecessors)
+    {
+        freeTransients();
+        allocations_.assign(resources_.size(), Allocation{});
+        predecessors.assign(resources_.size(), {});
+
+        // Usage is whatever the passes do with it.
+        std::vector<VkImageUsageFlags> imageUsage(resources_.size(), 0);
+        std::vector<VkBufferUsageFlags> bufferUsage(resources_.size(), 0);
+        for (uint32_t pass : plan_.order)
+        {
+            for (const Use &use : passes_[pass].uses)
+            {
+                imageUsage[use.resource] |= use.imageUsage;
+                bufferUsage[use.resource] |= use.bufferUsage;
+            }
+        }
+
+        struct Placement
+        {
+            ResourceId resource;
+            VkMemoryRequirements requirements;
+            VkDeviceSize offset;
+        };
+        // Resources only share memory with others of the same memory type.
+        std::map<uint32_t, std::vector<Placement>> heaps;
+
+        for (ResourceId id = 0; id < resources_.size(); id++)
+        {
+            const Resource &resource = resources_[id];
+            if (resource.imported || firstUse[id] == NOT_USED)
+            {
+                continue;
+            }
+            Allocation &allocation = allocations_[id];
+            VkMemoryRequirements requirements;
+            if (resource.isImage)
+            {
+                VkImageCreateInfo imageInfo{};
+                imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+                imageInfo.imageType = VK_IMAGE_TYPE_2D;
+                imageInfo.format = resource.imageDesc.format;
+                imageInfo.extent = {resource.imageDesc.extent.width, resource.imageDesc.extent.height, 1};
+                imageInfo.mipLevels = 1;
+                imageInfo.arrayLayers = 1;
+                imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+                imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+                imageInfo.usage = imageUsage[id] | resource.imageDesc.extraUsage;
+                imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+                imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+                if (vkCreateImage(vpeDevice_.device(), &imageInfo, nullptr, &allocation.image) != VK_SUCCESS)
+                {
+                    throw std::runtime_error("Failed to create render graph image " + resource.name + ".");
+                }
+                vkGetImageMemoryRequirements(vpeDevice_.device(), allocation.image, &requirements);
+            }
+            else
+            {
+                VkBufferCreateInfo bufferInfo{};
+                bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+                bufferInfo.size = resource.bufferDesc.size;
+                bufferInfo.usage = bufferUsage[id] | resource.bufferDesc.extraUsage;
+                bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+                if (vkCreateBuffer(vpeDevice_.device(), &bufferInfo, nullptr, &allocation.buffer) != VK_SUCCESS)
+                {
+                    throw std::runtime_error("Failed to create render graph buffer " + resource.name + ".");
+                }
+                vkGetBufferMemoryRequirements(vpeDevice_.device(), allocation.buffer, &requirements);
+            }
+            stats_.transientBytes += requirements.size;
+            uint32_t memoryType = vpeDevice_.findMemoryType(requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            heaps[memoryType].push_back(Placement{id, requirements, 0});
+        }
+
+        // Images and buffers sit next to each other in the same heap, so keep them a granularity apart.
+        VkDeviceSize granularity = std::max<VkDeviceSize>(vpeDevice_.properties.limits.bufferImageGranularity, 1);
+        auto livesOverlap = [&](ResourceId a, ResourceId b)
+        {
+            return firstUse[a] <= lastUse[b] && firstUse[b] <= lastUse[a];
+        };
+
+        for (auto &[memoryType, placements] : heaps)
+        {
+            // Biggest first, each at the lowest offset that doesn't collide with anything alive at the same time.
+            std::sort(placements.begin(), placements.end(), [](const Placement &a, const Placement &b)
+                      { return a.requirements.size > b.requirements.size; });
+            VkDeviceSize heapSize = 0;
+            for (size_t i = 0; i < placements.size(); i++)
+            {
+                Placement &placement = placements[i];
+                VkDeviceSize alignment = std::max(placement.requirements.alignment, granularity);
+                std::vector<VkDeviceSize> candidates{0};
+                for (size_t j = 0; j < i; j++)
+                {
+                    if (livesOverlap(placement.resource, placements[j].resource))
+                    {
+                        candidates.push_back(alignUp(placements[j].offset + placements[j].requirements.size, alignment));
+                    }
+                }
+                std::sort(candidates.begin(), candidates.end());
+                for (VkDeviceSize candidate : candidates)
+                {
+                    bool fits = true;
+                    for (size_t j = 0; j < i && fits; j++)
+                    {
+                        const Placement &other = placements[j];
+                        fits = !livesOverlap(placement.resource, other.resource) ||
+                               candidate + placement.requirements.size <= other.offset ||
+                               other.offset + other.requirements.size <= candidate;
+                    }
+                    if (fits)
+                    {
+                        placement.offset = candidate;
+                        break;
+                    }
+                }
+                heapSize = std::max(heapSize, placement.offset + placement.requirements.size);
+            }
+
+            VkMemoryAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            allocInfo.allocationSize = heapSize;
+            allocInfo.memoryTypeIndex = memoryType;
+            VkDeviceMemory heap;
+            if (vkAllocateMemory(vpeDevice_.device(), &allocInfo, nullptr, &heap) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to allocate render graph memory.");
+            }
+            heaps_.push_back(heap);
+            stats_.allocatedBytes += heapSize;
+
+            for (const Placement &placement : placements)
+            {
+                Allocation &allocation = allocations_[placement.resource];
+                const Resource &resource = resources_[placement.resource];
+                if (resource.isImage)
+                {
+                    vkBindImageMemory(vpeDevice_.device(), allocation.image, heap, placement.offset);
+
+                    VkImageViewCreateInfo viewInfo{};
+                    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+                    viewInfo.image = allocation.image;
+                    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+                    viewInfo.format = resource.imageDesc.format;
+                    viewInfo.subresourceRange = {resource.aspect, 0, 1, 0, 1};
+                    if (vkCreateImageView(vpeDevice_.device(), &viewInfo, nullptr, &allocation.view) != VK_SUCCESS)
+                    {
+                        throw std::runtime_error("Failed to create render graph image view " + resource.name + ".");
+                    }
+                }
+                else
+                {
+                    vkBindBufferMemory(vpeDevice_.device(), allocation.buffer, heap, placement.offset);
+                }
+                allocation.heap = static_cast<uint32_t>(heaps_.size() - 1);
+                allocation.offset = placement.offset;
+                allocation.size = placement.requirements.size;
+            }
+
+            // Whoever had a resource's bytes before it has to be done with them first. That's the ones
+            // that finished earlier in the frame, or for the first one in there, whoever was last in the
+            // previous frame (itself included).
+            for (const Placement &placement : placements)
+            {
+                std::vector<ResourceId> &before = predecessors[placement.resource];
+                for (const Placement &other : placements)
+                {
+                    bool bytesOverlap = placement.offset < other.offset + other.requirements.size &&
+                                        other.offset < placement.offset + placement.requirements.size;
+                    if (bytesOverlap && lastUse[other.resource] < firstUse[placement.resource])
+                    {
+                        before.push_back(other.resource);
+                    }
+                }
+                if (before.empty())
+                {
+                    for (const Placement &other : placements)
+                    {
+                        bool bytesOverlap = placement.offset < other.offset + other.requirements.size &&
+                                            other.offset < placement.offset + placement.requirements.size;
+                        if (bytesOverlap)
+                        {
+                            before.push_back(other.resource);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    void VpeRenderGraph::planBarriers(const std::vector<std::vector<ResourceId>> &predecessors)
+    {
+        auto simulate = [this](std::vector<State> states, std::vector<Barrier> *barriers)
+        {
+            for (uint32_t pass : plan_.order)
+            {
+                Barrier barrier;
+                for (const Use &use : passes_[pass].uses)
+                {
+                    State &state = states[use.resource];
+                    bool image = resources_[use.resource].isImage;
+                    if (image && use.layout != state.layout)
+                    {
+                        // Layout transitions are writes, they wait for everything before and everything after waits for them.
+                        VkPipelineStageFlags src = state.lastStages | state.readStages;
+                        barrier.srcStages |= src != 0 ? src : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+                        barrier.dstStages |= use.stages;
+                        barrier.images.push_back({use.resource, state.layout, use.layout, state.pendingAccess, use.access});
+                        state.lastStages = use.stages;
+                        state.layout = use.layout;
+                        state.pendingAccess = use.write ? (use.access & WRITE_ACCESS) : state.pendingAccess;
+                        state.readStages = use.write ? 0 : use.stages;
+                        state.visibleStages = use.write ? 0 : use.stages;
+                        state.visibleAccess = use.write ? 0 : use.access;
+                    }
+                    else if (use.write)
+                    {
+                        // After writes the data has to be flushed, after reads just waiting is enough.
+                        VkPipelineStageFlags src = state.lastStages | state.readStages;
+                        if (src != 0)
+                        {
+                            barrier.srcStages |= src;
+                            barrier.dstStages |= use.stages;
+                            barrier.srcAccess |= state.pendingAccess;
+                            barrier.dstAccess |= state.pendingAccess != 0 ? use.access : 0;
+                        }
+                        state.lastStages = use.stages;
+                        state.pendingAccess = use.access & WRITE_ACCESS;
+                        state.readStages = 0;
+                        state.visibleStages = 0;
+                        state.visibleAccess = 0;
+                    }
+                    else
+                    {
+                        bool visible = (state.visibleStages & use.stages) == use.stages &&
+                                       (state.visibleAccess & use.access) == use.access;
+                        if (state.lastStages != 0 && !visible)
+                        {
+                            // The writes stay pending, a reader in another stage later on needs them made visible too.
+                            barrier.srcStages |= state.lastStages;
+                            barrier.dstStages |= use.stages;
+                            barrier.srcAccess |= state.pendingAccess;
+                            barrier.dstAccess |= use.access;
+                            state.visibleStages |= use.stages;
+                            state.visibleAccess |= use.access;
+                        }
+                        state.readStages |= use.stages;
+                    }
+                }
+                if (barriers != nullptr)
+                {
+                    barriers->push_back(std::move(barrier));
+                }
+            }
+
+            // Hand imported images back in the layout the outside world wants.
+            Barrier final;
+            for (ResourceId id = 0; id < resources_.size(); id++)
+            {
+                const Resource &resource = resources_[id];
+                State &state = states[id];
+                if (!resource.imported || !resource.isImage || resource.finalLayout == VK_IMAGE_LAYOUT_UNDEFINED ||
+                    resource.finalLayout == state.layout)
+                {
+                    continue;
+                }
+                VkPipelineStageFlags src = state.lastStages | state.readStages;
+                final.srcStages |= src != 0 ? src : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+                final.dstStages |= VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+                final.images.push_back({id, state.layout, resource.finalLayout, state.pendingAccess, 0});
+            }
+            if (barriers != nullptr)
+            {
+                barriers->push_back(std::move(final));
+            }
+            return states;
+        };
+
+        std::vector<State> initial(resources_.size());
+        for (ResourceId id = 0; id < resources_.size(); id++)
+        {
+            if (resources_[id].imported)
+            {
+                initial[id] = resources_[id].initialState;
+            }
+        }
+
+        // A first run to see how every transient is left, then the real one with each transient
+        // starting from whatever its memory was last used for.
+        std::vector<State> finalStates = simulate(initial, nullptr);
+        for (ResourceId id = 0; id < resources_.size(); id++)
+        {
+            for (ResourceId before : predecessors[id])
+            {
+                initial[id].lastStages |= finalStates[before].lastStages | finalStates[before].readStages;
+                initial[id].pendingAccess |= finalStates[before].pendingAccess;
+            }
+        }
+        plan_.barriers.clear();
+        simulate(initial, &plan_.barriers);
+
+        for (const Barrier &barrier : plan_.barriers)
+        {
+            if (!barrier.empty())
+            {
+                stats_.barrierCount++;
+                stats_.imageBarrierCount += static_cast<uint32_t>(barrier.images.size());
+            }
+        }
+    }
+
+    void VpeRenderGraph::execute(VkCommandBuffer commandBuffer) const
+    {
+        auto record = [&](const Barrier &barrier)
+        {
+            if (barrier.empty())
+            {
+                return;
+            }
+            VkMemoryBarrier memoryBarrier{};
+            memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            memoryBarrier.srcAccessMask = barrier.srcAccess;
+            memoryBarrier.dstAccessMask = barrier.dstAccess;
+            bool needsMemoryBarrier = barrier.srcAccess != 0 || barrier.dstAccess != 0;
+
+            std::vector<VkImageMemoryBarrier> imageBarriers(barrier.images.size());
+            for (size_t i = 0; i < barrier.images.size(); i++)
+            {
+                const ImageBarrier &planned = barrier.images[i];
+                VkImageMemoryBarrier &imageBarrier = imageBarriers[i];
+                imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+                imageBarrier.srcAccessMask = planned.srcAccess;
+                imageBarrier.dstAccessMask = planned.dstAccess;
+                imageBarrier.oldLayout = planned.oldLayout;
+                imageBarrier.newLayout = planned.newLayout;
+                imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                imageBarrier.image = resources_[planned.resource].image;
+                imageBarrier.subresourceRange = {
+                    resources_[planned.resource].aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS};
+            }
+
+            vkCmdPipelineBarrier(
+                commandBuffer,
+                barrier.srcStages,
+                barrier.dstStages,
+                0,
+                needsMemoryBarrier ? 1 : 0, needsMemoryBarrier ? &memoryBarrier : nullptr,
+                0, nullptr,
+                static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+        };
+
+        for (size_t i = 0; i < plan_.order.size(); i++)
+        {
+            record(plan_.barriers[i]);
+            passes_[plan_.order[i]].function(commandBuffer);
+        }
+        record(plan_.barriers.back());
+    }
+
+    std::vector<std::string> VpeRenderGraph::passOrder() const
+    {
+        std::vector<std::string> names;
+        for (uint32_t pass : plan_.order)
+        {
+            names.push_back(passes_[pass].name);
+        }
+        return names;
+    }
+
+    bool VpeRenderGraph::sharesMemory(ResourceId a, ResourceId b) const
+    {
+        if (a >= allocations_.size() || b >= allocations_.size() || a == b)
+        {
+            return false;
+        }
+        const Allocation &first = allocations_[a];
+        const Allocation &second = allocations_[b];
+        if (first.size == 0 || second.size == 0 || first.heap != second.heap)
+        {
+            return false;
+        }
+        return first.offset < second.offset + second.size && second.offset < first.offset + first.size;
+    }
+
+    void VpeRenderGraph::freeTransients()
+    {
+        for (const Allocation &allocation : allocations_)
+        {
+            if (allocation.view != VK_NULL_HANDLE)
+            {
+                vkDestroyImageView(vpeDevice_.device(), allocation.view, nullptr);
+            }
+            if (allocation.image != VK_NULL_HANDLE)
+            {
+                vkDestroyImage(vpeDevice_.device(), allocation.image, nullptr);
+            }
+            if (allocation.buffer != VK_NULL_HANDLE)
+            {
+                vkDestroyBuffer(vpeDevice_.device(), allocation.buffer, nullptr);
+            }
+        }
+        allocations_.clear();
+        for (VkDeviceMemory heap : heaps_)
+        {
+            vkFreeMemory(vpeDevice_.device(), heap, nullptr);
+        }
+        heaps_.clear();
+    }
+} // namespace vpe
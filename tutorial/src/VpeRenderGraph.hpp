@@ -0,0 +1,264 @@
+#pragma once
+
+#include "VpeDevice.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace vpe
+{
+    // How a pass touches a resource. Each one maps to a pipeline stage, an access mask and
+    // (for images) a layout, which is everything the graph needs to work out the barriers.
+    enum class VpeRgAccess
+    {
+        ColorAttachmentWrite,
+        DepthAttachmentWrite,
+        DepthAttachmentRead,
+        SampledRead,
+        StorageRead,
+        StorageWrite,
+        StorageReadWrite,
+        UniformRead,
+        IndirectRead,
+        VertexRead,
+        IndexRead,
+        TransferRead,
+        TransferWrite,
+    };
+
+    // Which shader stages the shader accesses of a pass happen in.
+    enum class VpeRgPassType
+    {
+        Graphics,
+        Compute,
+        Transfer,
+    };
+
+    struct VpeRgImageDesc
+    {
+        VkFormat format;
+        VkExtent2D extent;
+        VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+        // On top of whatever the accesses need.
+        VkImageUsageFlags extraUsage = 0;
+    };
+
+    struct VpeRgBufferDesc
+    {
+        VkDeviceSize size;
+        VkBufferUsageFlags extraUsage = 0;
+    };
+
+    // Passes declare what they read and write, the graph works out the rest:
+    // - passes whose results nobody uses are dropped,
+    // - the rest are put in an order that respects every dependency and keeps producers
+    //   and their consumers as far apart as it can, so barriers have less to wait for,
+    // - each pass gets at most one vkCmdPipelineBarrier, only with what its hazards need
+    //   (reads after reads and repeated reads of the same data need nothing),
+    // - transient images and buffers whose lifetimes don't overlap share memory.
+    //
+    // Declare everything again each frame (reset, then the same calls) or once up front.
+    // compile() only redoes the work, and only reallocates, when the topology changed.
+    // Imported handles may change between frames without that counting as a change.
+    class VpeRenderGraph
+    {
+    public:
+        using ResourceId = uint32_t;
+        using PassFunction = std::function<void(VkCommandBuffer)>;
+
+        class PassBuilder
+        {
+        public:
+            PassBuilder &read(ResourceId resource, VpeRgAccess access);
+            PassBuilder &write(ResourceId resource, VpeRgAccess access);
+            // Keep the pass even if nothing in the graph reads what it writes.
+            PassBuilder &sideEffects();
+
+        private:
+            friend class VpeRenderGraph;
+            PassBuilder(VpeRenderGraph &graph, uint32_t pass) : graph_{graph}, pass_{pass} {}
+
+            VpeRenderGraph &graph_;
+            uint32_t pass_;
+        };
+
+        struct ImageBarrier
+        {
+            ResourceId resource;
+            VkImageLayout oldLayout;
+            VkImageLayout newLayout;
+            VkAccessFlags srcAccess;
+            VkAccessFlags dstAccess;
+        };
+
+        // All of one pass' barriers, recorded as a single vkCmdPipelineBarrier.
+        struct Barrier
+        {
+            VkPipelineStageFlags srcStages = 0;
+            VkPipelineStageFlags dstStages = 0;
+            VkAccessFlags srcAccess = 0;
+            VkAccessFlags dstAccess = 0;
+            std::vector<ImageBarrier> images;
+
+            bool empty() const { return srcStages == 0 && images.empty(); }
+        };
+
+        struct Stats
+        {
+            uint32_t passCount = 0;
+            uint32_t culledPassCount = 0;
+            uint32_t barrierCount = 0;
+            uint32_t imageBarrierCount = 0;
+            // Every transient resource in its own allocation vs. what the aliased heaps take.
+            VkDeviceSize transientBytes = 0;
+            VkDeviceSize allocatedBytes = 0;
+        };
+
+        explicit VpeRenderGraph(VpeDevice &device);
+        ~VpeRenderGraph();
+
+        VpeRenderGraph(const VpeRenderGraph &) = delete;
+        VpeRenderGraph &operator=(const VpeRenderGraph &) = delete;
+
+        // Forget the declarations, but keep the compiled plan and the memory around for
+        // when the same graph gets declared again.
+        void reset();
+
+        // Images from outside the graph (swapchain image, depth buffer). initialLayout, stage and access
+        // are how the image was last used before the graph runs. If finalLayout isn't UNDEFINED the image
+        // is moved there at the end, for the swapchain that's PRESENT_SRC.
+        ResourceId importImage(
+            const std::string &name,
+            VkImage image,
+            VkImageView view,
+            VkImageAspectFlags aspect,
+            VkImageLayout initialLayout,
+            VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            VkPipelineStageFlags lastStages = 0,
+            VkAccessFlags lastAccess = 0);
+        ResourceId importBuffer(
+            const std::string &name,
+            VkBuffer buffer,
+            VkPipelineStageFlags lastStages = 0,
+            VkAccessFlags lastAccess = 0);
+        ResourceId createImage(const std::string &name, const VpeRgImageDesc &desc);
+        ResourceId createBuffer(const std::string &name, const VpeRgBufferDesc &desc);
+
+        PassBuilder addPass(const std::string &name, VpeRgPassType type, PassFunction function);
+
+        // Cheap when nothing changed. With a changed topology the old transient resources are freed,
+        // so the GPU must be done with anything recorded from the previous plan.
+        void compile();
+        void execute(VkCommandBuffer commandBuffer) const;
+
+        // Valid after compile for transient resources, any time for imported ones.
+        VkImage image(ResourceId resource) const { return resources_[resource].image; }
+        VkImageView imageView(ResourceId resource) const { return resources_[resource].view; }
+        VkBuffer buffer(ResourceId resource) const { return resources_[resource].buffer; }
+
+        const Stats &stats() const { return stats_; }
+        // Pass names in the order they run, culled ones left out.
+        std::vector<std::string> passOrder() const;
+        // What compile() planned, barriers()[i] goes before passOrder()[i], the last one after everything.
+        const std::vector<Barrier> &barriers() const { return plan_.barriers; }
+        // Whether two transients got overlapping bytes, which they only do when their lifetimes don't overlap.
+        bool sharesMemory(ResourceId a, ResourceId b) const;
+
+    private:
+        // Where a resource is at, sync wise.
+        struct State
+        {
+            // Whatever last changed it (a write or a layout transition), the next barrier chains on these.
+            VkPipelineStageFlags lastStages = 0;
+            // Writes that no barrier has made available yet.
+            VkAccessFlags pendingAccess = 0;
+            // Readers since the last change. A write has to wait for them.
+            VkPipelineStageFlags readStages = 0;
+            // Where the last change is already visible, so more reads there need no barrier.
+            VkPipelineStageFlags visibleStages = 0;
+            VkAccessFlags visibleAccess = 0;
+            VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        };
+
+        // A pass touching the same resource twice is merged into one use.
+        struct Use
+        {
+            ResourceId resource;
+            VkPipelineStageFlags stages;
+            VkAccessFlags access;
+            VkImageLayout layout;
+            bool write;
+            VkImageUsageFlags imageUsage;
+            VkBufferUsageFlags bufferUsage;
+        };
+
+        struct Resource
+        {
+            std::string name;
+            bool isImage;
+            bool imported;
+            VpeRgImageDesc imageDesc;
+            VpeRgBufferDesc bufferDesc;
+            VkImage image = VK_NULL_HANDLE;
+            VkImageView view = VK_NULL_HANDLE;
+            VkBuffer buffer = VK_NULL_HANDLE;
+            VkImageAspectFlags aspect = 0;
+            State initialState;
+            VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        };
+
+        struct Pass
+        {
+            std::string name;
+            VpeRgPassType type;
+            PassFunction function;
+            std::vector<Use> uses;
+            bool sideEffects = false;
+        };
+
+        // The compiled graph. Indices are into the declared passes and resources.
+        struct Plan
+        {
+            std::vector<uint32_t> order;
+            // barriers[i] goes before order[i], the last one after everything.
+            std::vector<Barrier> barriers;
+        };
+
+        // Transient resources that got memory, kept until the topology changes.
+        struct Allocation
+        {
+            VkImage image = VK_NULL_HANDLE;
+            VkImageView view = VK_NULL_HANDLE;
+            VkBuffer buffer = VK_NULL_HANDLE;
+            // Where in heaps_ it sits.
+            uint32_t heap = 0;
+            VkDeviceSize offset = 0;
+            VkDeviceSize size = 0;
+        };
+
+        void addUse(uint32_t pass, ResourceId resource, VpeRgAccess access, bool write);
+        std::vector<uint64_t> topologyKey() const;
+
+        std::vector<bool> findLivePasses() const;
+        std::vector<uint32_t> schedule(const std::vector<bool> &live) const;
+        void allocateTransients(
+            const std::vector<uint32_t> &firstUse,
+            const std::vector<uint32_t> &lastUse,
+            std::vector<std::vector<ResourceId>> &predecessors);
+        void planBarriers(const std::vector<std::vector<ResourceId>> &predecessors);
+        void freeTransients();
+
+        VpeDevice &vpeDevice_;
+        std::vector<Resource> resources_;
+        std::vector<Pass> passes_;
+
+        std::vector<uint64_t> compiledKey_;
+        bool compiled_ = false;
+        Plan plan_;
+        Stats stats_;
+        std::vector<Allocation> allocations_;
+        std::vector<VkDeviceMemory> heaps_;
+    };
+} // namespace vpe
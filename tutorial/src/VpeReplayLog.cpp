@@ -0,0 +1,457 @@
+#include "VpeReplayLog.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+namespace vpe
+{
+    namespace
+    {
+        // Per body: position xyz then velocity xyz. Interleaved per body so a body added later
+        // just appends words and doesn't shift anyone else's.
+        constexpr size_t WORDS_PER_BODY = 6;
+
+        uint32_t bitsOf(float value)
+        {
+            uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            return bits;
+        }
+
+        float floatOf(uint32_t bits)
+        {
+            float value;
+            std::memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+
+        // Velocities are guessed to pick up gravity, the same way the integrator does it, except
+        // for ones that are exactly zero: those are asleep and stay put. Positions are guessed to
+        // move by the new velocity over dt. What gets stored is the XOR between the guess and the
+        // real bits, so sleeping and free flying bodies come out as zeros.
+        glm::vec3 predictVelocity(const glm::vec3 &previousVelocity, const glm::vec3 &gravity, float dt)
+        {
+            return previousVelocity == glm::vec3{0.0f} ? previousVelocity : previousVelocity + gravity * dt;
+        }
+
+        glm::vec3 predictPosition(const glm::vec3 &previousPosition, const glm::vec3 &velocity, float dt)
+        {
+            return previousPosition + velocity * dt;
+        }
+
+        void encodeState(
+            const std::vector<glm::vec3> &positions,
+            const std::vector<glm::vec3> &velocities,
+            const glm::vec3 &gravity,
+            float dt,
+            std::vector<glm::vec3> &previousPositions,
+            std::vector<glm::vec3> &previousVelocities,
+            std::vector<uint32_t> &residual)
+        {
+            // New bodies since last time get an all zero previous state.
+            previousPositions.resize(positions.size(), glm::vec3{0.0f});
+            previousVelocities.resize(positions.size(), glm::vec3{0.0f});
+            residual.resize(positions.size() * WORDS_PER_BODY);
+            for (size_t body = 0; body < positions.size(); body++)
+            {
+                glm::vec3 predicted = predictPosition(previousPositions[body], velocities[body], dt);
+                glm::vec3 predictedVelocity = predictVelocity(previousVelocities[body], gravity, dt);
+                uint32_t *words = &residual[body * WORDS_PER_BODY];
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    words[axis] = bitsOf(positions[body][axis]) ^ bitsOf(predicted[axis]);
+                    words[3 + axis] = bitsOf(velocities[body][axis]) ^ bitsOf(predictedVelocity[axis]);
+                }
+                previousPositions[body] = positions[body];
+                previousVelocities[body] = velocities[body];
+            }
+        }
+
+        // The other way around: turns the previous state into the recorded one.
+        void decodeState(
+            const std::vector<uint32_t> &residual,
+            const glm::vec3 &gravity,
+            float dt,
+            std::vector<glm::vec3> &positions,
+            std::vector<glm::vec3> &velocities)
+        {
+            size_t bodyCount = residual.size() / WORDS_PER_BODY;
+            positions.resize(bodyCount, glm::vec3{0.0f});
+            velocities.resize(bodyCount, glm::vec3{0.0f});
+            for (size_t body = 0; body < bodyCount; body++)
+            {
+                const uint32_t *words = &residual[body * WORDS_PER_BODY];
+                glm::vec3 predictedVelocity = predictVelocity(velocities[body], gravity, dt);
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    velocities[body][axis] = floatOf(bitsOf(predictedVelocity[axis]) ^ words[3 + axis]);
+                }
+                glm::vec3 predicted = predictPosition(positions[body], velocities[body], dt);
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    positions[body][axis] = floatOf(bitsOf(predicted[axis]) ^ words[axis]);
+                }
+            }
+        }
+    }
+
+    void VpeReplayFormat::packWords(const uint32_t *words, size_t count, std::vector<uint8_t> &out)
+    {
+        for (size_t group = 0; group < count; group += 4)
+        {
+            size_t controlIndex = out.size();
+            out.push_back(0);
+            uint8_t control = 0;
+            for (size_t k = 0; k < 4 && group + k < count; k++)
+            {
+                uint32_t word = words[group + k];
+                // A single byte is rare for float bits, so 1 rounds up to 2 and the 2 bits cover 0, 2, 3 and 4.
+                uint32_t code = word == 0 ? 0 : word <= 0xFFFFu ? 1 : word <= 0xFFFFFFu ? 2 : 3;
+                control |= static_cast<uint8_t>(code << (2 * k));
+                uint32_t bytes = code == 0 ? 0 : code + 1;
+                for (uint32_t b = 0; b < bytes; b++)
+                {
+                    out.push_back(static_cast<uint8_t>(word >> (8 * b)));
+                }
+            }
+            out[controlIndex] = control;
+        }
+    }
+
+    size_t VpeReplayFormat::unpackWords(const uint8_t *in, size_t size, uint32_t *words, size_t count)
+    {
+        size_t position = 0;
+        for (size_t group = 0; group < count; group += 4)
+        {
+            if (position >= size)
+            {
+                throw std::runtime_error("Replay log state is cut short.");
+            }
+            uint8_t control = in[position++];
+            for (size_t k = 0; k < 4 && group + k < count; k++)
+            {
+                uint32_t code = (control >> (2 * k)) & 3u;
+                uint32_t bytes = code == 0 ? 0 : code + 1;
+                if (position + bytes > size)
+                {
+                    throw std::runtime_error("Replay log state is cut short.");
+                }
+                uint32_t word = 0;
+                for (uint32_t b = 0; b < bytes; b++)
+                {
+                    word |= static_cast<uint32_t>(in[position++]) << (8 * b);
+                }
+                words[group + k] = word;
+            }
+        }
+        return position;
+    }
+
+    VpeReplayRecorder::VpeReplayRecorder(const std::filesystem::path &path, const VpePhysicsSettings &settings)
+        : file_{path, std::ios::binary | std::ios::trunc}, gravity_{settings.gravity}
+    {
+        if (!file_.is_open())
+        {
+            throw std::runtime_error("Failed to open replay log: " + path.string());
+        }
+        buffer_.reserve(FLUSH_SIZE + 4096);
+
+        for (char c : VpeReplayFormat::MAGIC)
+        {
+            put(c);
+        }
+        put(VpeReplayFormat::VERSION);
+        put(settings.gravity);
+        put(settings.groundHeight);
+        put(settings.solverIterations);
+        put(settings.friction);
+        put(settings.baumgarte);
+        put(settings.penetrationSlop);
+        put(settings.sleepVelocity);
+        put(settings.timeToSleep);
+        put(settings.continuousThreshold);
+    }
+
+    VpeReplayRecorder::~VpeReplayRecorder()
+    {
+        flush();
+    }
+
+    template <typename T>
+    void VpeReplayRecorder::put(const T &value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Only plain data goes into the log");
+        const auto *bytes = reinterpret_cast<const uint8_t *>(&value);
+        buffer_.insert(buffer_.end(), bytes, bytes + sizeof(T));
+    }
+
+    void VpeReplayRecorder::recordAddBody(const glm::vec3 &position, float radius, float mass)
+    {
+        put(VpeReplayFormat::Record::AddBody);
+        put(position);
+        put(radius);
+        put(mass);
+    }
+
+    void VpeReplayRecorder::recordAddShape(const VpeCollisionShape &shape, const std::vector<glm::vec3> &points)
+    {
+        put(VpeReplayFormat::Record::AddShape);
+        put(shape.type);
+        put(shape.radius);
+        put(shape.axes);
+        put(shape.halfExtents);
+        put(static_cast<uint32_t>(points.size()));
+        for (const auto &point : points)
+        {
+            put(point);
+        }
+    }
+
+    void VpeReplayRecorder::recordAddShapeBody(const glm::vec3 &position, uint32_t shape, float mass)
+    {
+        put(VpeReplayFormat::Record::AddShapeBody);
+        put(position);
+        put(shape);
+        put(mass);
+    }
+
+    void VpeReplayRecorder::recordDistanceConstraint(uint32_t bodyA, uint32_t bodyB, float length)
+    {
+        put(VpeReplayFormat::Record::AddDistanceConstraint);
+        put(bodyA);
+        put(bodyB);
+        put(length);
+    }
+
+    void VpeReplayRecorder::recordSetVelocity(uint32_t body, const glm::vec3 &velocity)
+    {
+        put(VpeReplayFormat::Record::SetVelocity);
+        put(body);
+        put(velocity);
+    }
+
+    void VpeReplayRecorder::recordWake(uint32_t body)
+    {
+        put(VpeReplayFormat::Record::Wake);
+        put(body);
+    }
+
+    void VpeReplayRecorder::recordSetContinuous(uint32_t body, bool continuous)
+    {
+        put(VpeReplayFormat::Record::SetContinuous);
+        put(body);
+        put(static_cast<uint8_t>(continuous ? 1 : 0));
+    }
+
+    void VpeReplayRecorder::recordStep(
+        float dt,
+        float stepMilliseconds,
+        const std::vector<glm::vec3> &positions,
+        const std::vector<glm::vec3> &velocities)
+    {
+        encodeState(positions, velocities, gravity_, dt, previousPositions_, previousVelocities_, residual_);
+        packed_.clear();
+        VpeReplayFormat::packWords(residual_.data(), residual_.size(), packed_);
+
+        put(VpeReplayFormat::Record::Step);
+        put(dt);
+        put(stepMilliseconds);
+        put(static_cast<uint32_t>(positions.size()));
+        put(static_cast<uint32_t>(packed_.size()));
+        buffer_.insert(buffer_.end(), packed_.begin(), packed_.end());
+        stepCount_++;
+
+        if (buffer_.size() >= FLUSH_SIZE)
+        {
+            flush();
+        }
+    }
+
+    void VpeReplayRecorder::flush()
+    {
+        if (buffer_.empty())
+        {
+            return;
+        }
+        file_.write(reinterpret_cast<const char *>(buffer_.data()), static_cast<std::streamsize>(buffer_.size()));
+        file_.flush();
+        bytesWritten_ += buffer_.size();
+        buffer_.clear();
+    }
+
+    VpeReplayPlayer::VpeReplayPlayer(const std::filesystem::path &path, VpeJobSystem &jobSystem) : file_{path}
+    {
+        char magic[sizeof(VpeReplayFormat::MAGIC)];
+        for (char &c : magic)
+        {
+            c = get<char>();
+        }
+        if (std::memcmp(magic, VpeReplayFormat::MAGIC, sizeof(magic)) != 0)
+        {
+            throw std::runtime_error("Not a replay log: " + path.string());
+        }
+        uint32_t version = get<uint32_t>();
+        if (version != VpeReplayFormat::VERSION)
+        {
+            throw std::runtime_error("Replay log version " + std::to_string(version) + " isn't supported.");
+        }
+        settings_.gravity = get<glm::vec3>();
+        settings_.groundHeight = get<float>();
+        settings_.solverIterations = get<uint32_t>();
+        settings_.friction = get<float>();
+        settings_.baumgarte = get<float>();
+        settings_.penetrationSlop = get<float>();
+        settings_.sleepVelocity = get<float>();
+        settings_.timeToSleep = get<float>();
+        settings_.continuousThreshold = get<float>();
+
+        world_ = std::make_unique<VpePhysicsWorld>(jobSystem, settings_);
+    }
+
+    template <typename T>
+    T VpeReplayPlayer::get()
+    {
+        if (position_ + sizeof(T) > file_.size())
+        {
+            throw std::runtime_error("Replay log is cut short.");
+        }
+        T value;
+        std::memcpy(&value, file_.data() + position_, sizeof(T));
+        position_ += sizeof(T);
+        return value;
+    }
+
+    uint32_t VpeReplayPlayer::getBody()
+    {
+        uint32_t body = get<uint32_t>();
+        if (body >= world_->bodyCount())
+        {
+            throw std::runtime_error("Replay log uses a body it never added.");
+        }
+        return body;
+    }
+
+    bool VpeReplayPlayer::stepFrame()
+    {
+        while (position_ < file_.size())
+        {
+            auto record = get<VpeReplayFormat::Record>();
+            switch (record)
+            {
+            case VpeReplayFormat::Record::AddBody:
+            {
+                auto position = get<glm::vec3>();
+                float radius = get<float>();
+                float mass = get<float>();
+                world_->addBody(position, radius, mass);
+                break;
+            }
+            case VpeReplayFormat::Record::AddShape:
+            {
+                VpeCollisionShape shape;
+                shape.type = get<VpeCollisionShape::Type>();
+                shape.radius = get<float>();
+                shape.axes = get<glm::mat3>();
+                shape.halfExtents = get<glm::vec3>();
+                uint32_t pointCount = get<uint32_t>();
+                if (shape.type > VpeCollisionShape::Type::ConvexHull)
+                {
+                    throw std::runtime_error("Unknown shape in replay log.");
+                }
+                if (pointCount == 0 || pointCount > (file_.size() - position_) / sizeof(glm::vec3))
+                {
+                    throw std::runtime_error("Replay log is cut short.");
+                }
+                std::vector<glm::vec3> points(pointCount);
+                for (auto &point : points)
+                {
+                    point = get<glm::vec3>();
+                }
+                world_->addShape(shape, points);
+                break;
+            }
+            case VpeReplayFormat::Record::AddShapeBody:
+            {
+                auto position = get<glm::vec3>();
+                uint32_t shape = get<uint32_t>();
+                float mass = get<float>();
+                if (shape >= world_->shapes().size())
+                {
+                    throw std::runtime_error("Replay log body uses a shape it never added.");
+                }
+                world_->addShapeBody(position, shape, mass);
+                break;
+            }
+            case VpeReplayFormat::Record::AddDistanceConstraint:
+            {
+                uint32_t bodyA = getBody();
+                uint32_t bodyB = getBody();
+                float length = get<float>();
+                world_->addDistanceConstraint(bodyA, bodyB, length);
+                break;
+            }
+            case VpeReplayFormat::Record::SetVelocity:
+            {
+                uint32_t body = getBody();
+                auto velocity = get<glm::vec3>();
+                world_->setVelocity(body, velocity);
+                break;
+            }
+            case VpeReplayFormat::Record::Wake:
+                world_->wake(getBody());
+                break;
+            case VpeReplayFormat::Record::SetContinuous:
+            {
+                uint32_t body = getBody();
+                world_->setContinuous(body, get<uint8_t>() != 0);
+                break;
+            }
+            case VpeReplayFormat::Record::Step:
+            {
+                lastDt_ = get<float>();
+                recordedStepMs_ = get<float>();
+                uint32_t bodyCount = get<uint32_t>();
+                uint32_t packedSize = get<uint32_t>();
+                if (position_ + packedSize > file_.size())
+                {
+                    throw std::runtime_error("Replay log is cut short.");
+                }
+                if (bodyCount != world_->bodyCount())
+                {
+                    throw std::runtime_error("Replay log body count doesn't match its own inputs.");
+                }
+
+                auto start = std::chrono::steady_clock::now();
+                world_->step(lastDt_);
+                auto end = std::chrono::steady_clock::now();
+                replayedStepMs_ = std::chrono::duration<float, std::milli>(end - start).count();
+
+                // Rebuild the recorded state from the one before it, then compare bit for bit.
+                residual_.resize(static_cast<size_t>(bodyCount) * WORDS_PER_BODY);
+                VpeReplayFormat::unpackWords(file_.data() + position_, packedSize, residual_.data(), residual_.size());
+                position_ += packedSize;
+                decodeState(residual_, settings_.gravity, lastDt_, recordedPositions_, recordedVelocities_);
+                const auto &positions = world_->positions();
+                const auto &velocities = world_->velocities();
+                mismatchBody_ = NO_MISMATCH;
+                for (uint32_t body = 0; body < bodyCount; body++)
+                {
+                    if (std::memcmp(&positions[body], &recordedPositions_[body], sizeof(glm::vec3)) != 0 ||
+                        std::memcmp(&velocities[body], &recordedVelocities_[body], sizeof(glm::vec3)) != 0)
+                    {
+                        mismatchBody_ = body;
+                        break;
+                    }
+                }
+                frame_++;
+                return true;
+            }
+            default:
+                throw std::runtime_error("Unknown record in replay log.");
+            }
+        }
+        return false;
+    }
+} // namespace vpe
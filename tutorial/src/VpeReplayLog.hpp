@@ -0,0 +1,151 @@
+#pragma once
+
+#include "VpeJobSystem.hpp"
+#include "VpeMappedFile.hpp"
+#include "VpePhysicsWorld.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+namespace vpe
+{
+    // Binary log of everything that went into a VpePhysicsWorld: the settings, every input
+    // (shapes, bodies, constraints, velocities, wakes, continuous flags) in the order it happened, and every step with its dt,
+    // how long it took, and the body states it ended with.
+    //
+    // The step is deterministic (same inputs, same build, same bits out, whatever the thread count),
+    // so replaying the inputs gives back exactly the run that was recorded. The recorded states are
+    // there to prove that, and to point at the first body that went a different way if it doesn't.
+    //
+    // States are stored as the XOR against a guess made from the state one step earlier (velocity
+    // plus gravity, or still zero if it was asleep, and the position moved by that). Sleeping and
+    // flying bodies XOR to zero, bodies in contact to mostly zero bytes, and the packing below drops
+    // those. A step costs a few bytes per body instead of 24.
+    class VpeReplayFormat
+    {
+    public:
+        static constexpr char MAGIC[8] = {'V', 'P', 'E', 'R', 'P', 'L', 'A', 'Y'};
+        static constexpr uint32_t VERSION = 4;
+
+        enum class Record : uint8_t
+        {
+            AddBody = 1,
+            AddDistanceConstraint = 2,
+            SetVelocity = 3,
+            Wake = 4,
+            Step = 5,
+            AddShape = 6,
+            AddShapeBody = 7,
+            SetContinuous = 8,
+        };
+
+        // Packs words as control bytes (2 bits per word, 4 words per byte) followed by each word's
+        // low bytes: 0, 2, 3 or 4 of them, whatever's needed to hold its set bits.
+        static void packWords(const uint32_t *words, size_t count, std::vector<uint8_t> &out);
+        // Returns how many bytes of in it used. Throws if it runs off the end.
+        static size_t unpackWords(const uint8_t *in, size_t size, uint32_t *words, size_t count);
+    };
+
+    // Writes the log as the world runs. Hook it up with VpePhysicsWorld::setRecorder before the
+    // first body goes in, everything after that gets recorded by the world itself.
+    // Writes are buffered and go to disk in big chunks, so recording doesn't stall a step on IO.
+    class VpeReplayRecorder
+    {
+    public:
+        VpeReplayRecorder(const std::filesystem::path &path, const VpePhysicsSettings &settings);
+        ~VpeReplayRecorder();
+
+        VpeReplayRecorder(const VpeReplayRecorder &) = delete;
+        VpeReplayRecorder &operator=(const VpeReplayRecorder &) = delete;
+
+        void recordAddBody(const glm::vec3 &position, float radius, float mass);
+        void recordAddShape(const VpeCollisionShape &shape, const std::vector<glm::vec3> &points);
+        void recordAddShapeBody(const glm::vec3 &position, uint32_t shape, float mass);
+        void recordDistanceConstraint(uint32_t bodyA, uint32_t bodyB, float length);
+        void recordSetVelocity(uint32_t body, const glm::vec3 &velocity);
+        void recordWake(uint32_t body);
+        void recordSetContinuous(uint32_t body, bool continuous);
+        void recordStep(float dt, float stepMilliseconds,
+                        const std::vector<glm::vec3> &positions, const std::vector<glm::vec3> &velocities);
+
+        void flush();
+        uint64_t stepCount() const { return stepCount_; }
+        // Everything written so far, header included.
+        uint64_t bytesWritten() const { return bytesWritten_ + buffer_.size(); }
+
+    private:
+        static constexpr size_t FLUSH_SIZE = 1 << 20;
+
+        template <typename T>
+        void put(const T &value);
+
+        std::ofstream file_;
+        std::vector<uint8_t> buffer_;
+        uint64_t bytesWritten_ = 0;
+        uint64_t stepCount_ = 0;
+
+        // The state from the last recorded step, what the next one gets predicted from.
+        glm::vec3 gravity_;
+        std::vector<glm::vec3> previousPositions_;
+        std::vector<glm::vec3> previousVelocities_;
+        std::vector<uint32_t> residual_;
+        std::vector<uint8_t> packed_;
+    };
+
+    // Reads a log back through a memory mapping and runs it again in a fresh world, headless
+    // and as fast as it'll go. stepFrame() applies the inputs up to the next step and runs it.
+    class VpeReplayPlayer
+    {
+    public:
+        VpeReplayPlayer(const std::filesystem::path &path, VpeJobSystem &jobSystem);
+
+        VpeReplayPlayer(const VpeReplayPlayer &) = delete;
+        VpeReplayPlayer &operator=(const VpeReplayPlayer &) = delete;
+
+        // False once the log is used up, nothing was stepped then.
+        bool stepFrame();
+
+        VpePhysicsWorld &world() { return *world_; }
+        const VpePhysicsSettings &settings() const { return settings_; }
+        // Steps done so far, the one stepFrame() just did is frame() - 1.
+        uint64_t frame() const { return frame_; }
+        float lastDt() const { return lastDt_; }
+        // What the last step took when it was recorded, and now.
+        float recordedStepMilliseconds() const { return recordedStepMs_; }
+        float replayedStepMilliseconds() const { return replayedStepMs_; }
+
+        // Whether the last step ended in exactly the recorded state. If not, the first body that's off.
+        bool matchesRecording() const { return mismatchBody_ == NO_MISMATCH; }
+        uint32_t firstMismatchBody() const { return mismatchBody_; }
+
+        static constexpr uint32_t NO_MISMATCH = ~0u;
+
+    private:
+        template <typename T>
+        T get();
+        // A body index, checked against the world. The world only asserts, which release builds don't.
+        uint32_t getBody();
+
+        VpeMappedFile file_;
+        size_t position_ = 0;
+        VpePhysicsSettings settings_;
+        std::unique_ptr<VpePhysicsWorld> world_;
+
+        uint64_t frame_ = 0;
+        float lastDt_ = 0.0f;
+        float recordedStepMs_ = 0.0f;
+        float replayedStepMs_ = 0.0f;
+        uint32_t mismatchBody_ = NO_MISMATCH;
+
+        std::vector<glm::vec3> recordedPositions_;
+        std::vector<glm::vec3> recordedVelocities_;
+        std::vector<uint32_t> residual_;
+    };
+} // namespace vpe
@@ -0,0 +1,357 @@
+#include "VpeSceneBvh.hpp"
+
+#include <algorithm>
+
+#if defined(VPE_ENABLE_AVX2) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define VPE_BVH_SSE
+#endif
+
+namespace vpe
+{
+    namespace
+    {
+        // How many subtrees per thread the top of the tree gets cut into before going parallel.
+        // More than one so a thread that drew an empty corner of the scene can go help the others.
+        constexpr uint32_t SUBTREES_PER_THREAD = 4;
+
+        // Bigger than any scene, used for lanes that aren't there.
+        constexpr float EMPTY_BOUNDS = 3.4e38f;
+
+#if defined(VPE_BVH_SSE)
+        inline __m128 multiplyAdd(__m128 a, __m128 b, __m128 c)
+        {
+            return _mm_add_ps(_mm_mul_ps(a, b), c);
+        }
+#endif
+    }
+
+    void VpeSceneBvh::build(const VpeAabb *boxes, const uint32_t *ids, uint32_t count)
+    {
+        nodes_.clear();
+        ids_.resize(count);
+        order_.resize(count);
+        if (count == 0)
+        {
+            return;
+        }
+
+        std::vector<BuildItem> items(count);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            items[i] = BuildItem{(boxes[i].min + boxes[i].max) * 0.5f, i};
+        }
+
+        // Roughly one node per seven objects once the tree is full.
+        nodes_.reserve(count / (WIDTH - 1) + 1);
+        buildNode(0, count, boxes, items);
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            order_[i] = items[i].index;
+            ids_[i] = ids[order_[i]];
+        }
+    }
+
+    // Cuts items[first, first + count) into runs of at most capacity objects, splitting at the
+    // median of the longest axis each time. The split points are rounded to whole runs,
+    // so all runs but the last are exactly capacity long and the nodes come out full.
+    void VpeSceneBvh::splitGroups(std::vector<BuildItem> &items, uint32_t first, uint32_t count, uint32_t capacity, Group *groups, uint32_t &groupCount)
+    {
+        if (count <= capacity)
+        {
+            groups[groupCount++] = Group{first, count};
+            return;
+        }
+
+        glm::vec3 low = items[first].centroid;
+        glm::vec3 high = low;
+        for (uint32_t i = first + 1; i < first + count; i++)
+        {
+            low = glm::min(low, items[i].centroid);
+            high = glm::max(high, items[i].centroid);
+        }
+        glm::vec3 extent = high - low;
+        int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+        uint32_t runs = (count + capacity - 1) / capacity;
+        uint32_t leftCount = runs / 2 * capacity;
+        auto begin = items.begin() + first;
+        std::nth_element(begin, begin + leftCount, begin + count, [axis](const BuildItem &a, const BuildItem &b)
+                         { return a.centroid[axis] < b.centroid[axis]; });
+
+        splitGroups(items, first, leftCount, capacity, groups, groupCount);
+        splitGroups(items, first + leftCount, count - leftCount, capacity, groups, groupCount);
+    }
+
+    uint32_t VpeSceneBvh::buildNode(uint32_t first, uint32_t count, const VpeAabb *boxes, std::vector<BuildItem> &items)
+    {
+        uint32_t nodeIndex = static_cast<uint32_t>(nodes_.size());
+        nodes_.emplace_back();
+        for (uint32_t lane = 0; lane < WIDTH; lane++)
+        {
+            setLane(nodes_[nodeIndex], lane, VpeAabb{glm::vec3{EMPTY_BOUNDS}, glm::vec3{-EMPTY_BOUNDS}});
+        }
+
+        // Every child gets a power of eight worth of objects, the smallest one where eight children are enough.
+        uint32_t capacity = 1;
+        while (capacity * WIDTH < count)
+        {
+            capacity *= WIDTH;
+        }
+
+        Group groups[WIDTH];
+        uint32_t groupCount = 0;
+        splitGroups(items, first, count, capacity, groups, groupCount);
+
+        // Children go after their parent in nodes_, refit relies on that.
+        // nodes_ can grow while building them, so no references into it across the recursion.
+        for (uint32_t lane = 0; lane < groupCount; lane++)
+        {
+            const Group &group = groups[lane];
+            uint32_t child = NO_CHILD;
+            VpeAabb box;
+            if (group.count == 1)
+            {
+                box = boxes[items[group.first].index];
+            }
+            else
+            {
+                child = buildNode(group.first, group.count, boxes, items);
+                box = nodeBounds(nodes_[child]);
+            }
+
+            Node &node = nodes_[nodeIndex];
+            setLane(node, lane, box);
+            node.child[lane] = child;
+            node.first[lane] = group.first;
+            node.count[lane] = group.count;
+            node.laneMask |= 1u << lane;
+        }
+        return nodeIndex;
+    }
+
+    void VpeSceneBvh::refit(const VpeAabb *boxes)
+    {
+        // Backwards, so children are always done before their parent.
+        for (size_t i = nodes_.size(); i-- > 0;)
+        {
+            Node &node = nodes_[i];
+            for (uint32_t lane = 0; lane < WIDTH; lane++)
+            {
+                if ((node.laneMask & (1u << lane)) == 0)
+                {
+                    continue;
+                }
+                if (node.child[lane] == NO_CHILD)
+                {
+                    setLane(node, lane, boxes[order_[node.first[lane]]]);
+                }
+                else
+                {
+                    setLane(node, lane, nodeBounds(nodes_[node.child[lane]]));
+                }
+            }
+        }
+    }
+
+    void VpeSceneBvh::setLane(Node &node, uint32_t lane, const VpeAabb &box)
+    {
+        node.bounds[0][lane] = box.min.x;
+        node.bounds[1][lane] = box.min.y;
+        node.bounds[2][lane] = box.min.z;
+        node.bounds[3][lane] = box.max.x;
+        node.bounds[4][lane] = box.max.y;
+        node.bounds[5][lane] = box.max.z;
+    }
+
+    VpeAabb VpeSceneBvh::nodeBounds(const Node &node)
+    {
+        // Unused lanes are inside out, so all eight can go in without looking at the mask.
+        float bounds[6];
+        for (uint32_t axis = 0; axis < 3; axis++)
+        {
+            bounds[axis] = *std::min_element(node.bounds[axis], node.bounds[axis] + WIDTH);
+            bounds[axis + 3] = *std::max_element(node.bounds[axis + 3], node.bounds[axis + 3] + WIDTH);
+        }
+        return VpeAabb{glm::vec3{bounds[0], bounds[1], bounds[2]}, glm::vec3{bounds[3], bounds[4], bounds[5]}};
+    }
+
+    void VpeSceneBvh::testNode(const Node &node, const PlaneSelect *planes, uint32_t &visibleMask, uint32_t &insideMask)
+    {
+        // For every plane, the box corner farthest along the normal tells if the box is completely
+        // outside, and the nearest corner if it's completely inside. The normal is the same for all
+        // eight lanes, so which corner that is was picked once per cull and is just an array index here.
+        uint32_t outside = 0;
+        uint32_t crossing = 0;
+#if defined(VPE_BVH_SSE)
+        const __m128 zero = _mm_setzero_ps();
+        for (int i = 0; i < 6; i++)
+        {
+            const PlaneSelect &select = planes[i];
+            __m128 nx = _mm_set1_ps(select.plane[0]);
+            __m128 ny = _mm_set1_ps(select.plane[1]);
+            __m128 nz = _mm_set1_ps(select.plane[2]);
+            __m128 w = _mm_set1_ps(select.plane[3]);
+
+            for (uint32_t half = 0; half < WIDTH; half += 4)
+            {
+                __m128 farDistance = multiplyAdd(nx, _mm_load_ps(node.bounds[select.farAxis[0]] + half),
+                                                 multiplyAdd(ny, _mm_load_ps(node.bounds[select.farAxis[1]] + half),
+                                                             multiplyAdd(nz, _mm_load_ps(node.bounds[select.farAxis[2]] + half), w)));
+                __m128 nearDistance = multiplyAdd(nx, _mm_load_ps(node.bounds[select.nearAxis[0]] + half),
+                                                  multiplyAdd(ny, _mm_load_ps(node.bounds[select.nearAxis[1]] + half),
+                                                              multiplyAdd(nz, _mm_load_ps(node.bounds[select.nearAxis[2]] + half), w)));
+
+                outside |= static_cast<uint32_t>(_mm_movemask_ps(_mm_cmplt_ps(farDistance, zero))) << half;
+                crossing |= static_cast<uint32_t>(_mm_movemask_ps(_mm_cmplt_ps(nearDistance, zero))) << half;
+            }
+            if ((outside & node.laneMask) == node.laneMask)
+            {
+                break;
+            }
+        }
+#else
+        for (int i = 0; i < 6; i++)
+        {
+            const PlaneSelect &select = planes[i];
+            for (uint32_t lane = 0; lane < WIDTH; lane++)
+            {
+                float farDistance = select.plane[0] * node.bounds[select.farAxis[0]][lane] +
+                                    select.plane[1] * node.bounds[select.farAxis[1]][lane] +
+                                    select.plane[2] * node.bounds[select.farAxis[2]][lane] + select.plane[3];
+                float nearDistance = select.plane[0] * node.bounds[select.nearAxis[0]][lane] +
+                                     select.plane[1] * node.bounds[select.nearAxis[1]][lane] +
+                                     select.plane[2] * node.bounds[select.nearAxis[2]][lane] + select.plane[3];
+                outside |= (farDistance < 0.0f ? 1u : 0u) << lane;
+                crossing |= (nearDistance < 0.0f ? 1u : 0u) << lane;
+            }
+        }
+#endif
+        visibleMask = node.laneMask & ~outside;
+        insideMask = visibleMask & ~crossing;
+    }
+
+    bool VpeSceneBvh::hasAvx2()
+    {
+#if defined(VPE_ENABLE_AVX2)
+        static const bool available = []
+        {
+#if defined(_MSC_VER)
+            int info[4];
+            __cpuid(info, 1);
+            bool fma = (info[2] & (1 << 12)) != 0;
+            bool osSavesYmm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+            __cpuidex(info, 7, 0);
+            return fma && osSavesYmm && (info[1] & (1 << 5)) != 0;
+#else
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+        }();
+        return available;
+#else
+        return false;
+#endif
+    }
+
+    void VpeSceneBvh::cullNode(uint32_t nodeIndex, NodeTest test, const PlaneSelect *planes, std::vector<uint32_t> &visible, std::vector<uint32_t> &pending) const
+    {
+        const Node &node = nodes_[nodeIndex];
+        uint32_t visibleMask;
+        uint32_t insideMask;
+        test(node, planes, visibleMask, insideMask);
+
+        for (uint32_t lane = 0; lane < WIDTH; lane++)
+        {
+            uint32_t bit = 1u << lane;
+            if ((visibleMask & bit) == 0)
+            {
+                continue;
+            }
+            if ((insideMask & bit) != 0 || node.child[lane] == NO_CHILD)
+            {
+                auto begin = ids_.begin() + node.first[lane];
+                visible.insert(visible.end(), begin, begin + node.count[lane]);
+            }
+            else
+            {
+                pending.push_back(node.child[lane]);
+            }
+        }
+    }
+
+    void VpeSceneBvh::cull(VpeJobSystem &jobSystem, const VpeFrustum &frustum, std::vector<uint32_t> &visible) const
+    {
+        if (nodes_.empty())
+        {
+            return;
+        }
+
+        PlaneSelect planes[6];
+        for (int i = 0; i < 6; i++)
+        {
+            const glm::vec4 &plane = frustum.planes[i];
+            PlaneSelect &select = planes[i];
+            for (uint32_t axis = 0; axis < 3; axis++)
+            {
+                select.plane[axis] = plane[axis];
+                select.farAxis[axis] = plane[axis] >= 0.0f ? axis + 3 : axis;
+                select.nearAxis[axis] = plane[axis] >= 0.0f ? axis : axis + 3;
+            }
+            select.plane[3] = plane.w;
+        }
+        NodeTest test = hasAvx2() ? &VpeSceneBvh::testNodeAvx2 : &VpeSceneBvh::testNode;
+
+        // Breadth first from the root until there's enough independent subtrees to go around.
+        uint32_t targetSubtrees = jobSystem.threadCount() > 1 ? jobSystem.threadCount() * SUBTREES_PER_THREAD : 1;
+        std::vector<uint32_t> frontier{0};
+        std::vector<uint32_t> next;
+        while (!frontier.empty() && frontier.size() < targetSubtrees)
+        {
+            next.clear();
+            for (uint32_t nodeIndex : frontier)
+            {
+                cullNode(nodeIndex, test, planes, visible, next);
+            }
+            frontier.swap(next);
+        }
+
+        auto cullSubtrees = [this, test, &planes](const uint32_t *roots, size_t rootCount, std::vector<uint32_t> &out)
+        {
+            std::vector<uint32_t> stack(roots, roots + rootCount);
+            while (!stack.empty())
+            {
+                uint32_t nodeIndex = stack.back();
+                stack.pop_back();
+                cullNode(nodeIndex, test, planes, out, stack);
+            }
+        };
+
+        if (frontier.size() <= 1)
+        {
+            cullSubtrees(frontier.data(), frontier.size(), visible);
+            return;
+        }
+
+        uint32_t subtreeCount = static_cast<uint32_t>(frontier.size());
+        uint32_t chunkCount = std::min(subtreeCount, targetSubtrees);
+        std::vector<std::vector<uint32_t>> chunkVisible(chunkCount);
+        jobSystem.parallelForChunks(subtreeCount, chunkCount, [&](uint32_t chunk, uint32_t begin, uint32_t end)
+                                    { cullSubtrees(frontier.data() + begin, end - begin, chunkVisible[chunk]); });
+
+        size_t total = visible.size();
+        for (const auto &chunk : chunkVisible)
+        {
+            total += chunk.size();
+        }
+        visible.reserve(total);
+        for (const auto &chunk : chunkVisible)
+        {
+            visible.insert(visible.end(), chunk.begin(), chunk.end());
+        }
+    }
+} // namespace vpe
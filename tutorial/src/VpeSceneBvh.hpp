@@ -0,0 +1,108 @@
+#pragma once
+
+#include "VpeFrustum.hpp"
+#include "VpeJobSystem.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace vpe
+{
+    struct VpeAabb
+    {
+        glm::vec3 min;
+        glm::vec3 max;
+    };
+
+    // Bounding volume hierarchy with eight children per node, built over object AABBs.
+    // Eight because that's one AVX register: the frustum test for a node checks all
+    // of its children at once, so the whole cull is one SIMD test per visited node.
+    //
+    // The bounds of a node's children are stored per axis (all eight min x, then all
+    // eight min y, ...) so a lane is a child and nothing has to be shuffled around.
+    // A child is either another node or a single object, and every child knows the range
+    // of objects below it. When a child ends up completely inside the frustum that range
+    // is copied out as is without looking any further down.
+    //
+    // The AVX2 test is built on its own (VpeSceneBvhAvx.cpp) and only used when the CPU has it,
+    // otherwise the same code runs on two SSE halves, and without SSE on plain floats.
+    class VpeSceneBvh
+    {
+    public:
+        static constexpr uint32_t WIDTH = 8;
+
+        // ids[i] is what cull reports for boxes[i].
+        void build(const VpeAabb *boxes, const uint32_t *ids, uint32_t count);
+        // Same objects as the last build, just moved. Keeps the tree and only grows or shrinks
+        // the bounds, which is a lot cheaper but gets worse the further things travel.
+        void refit(const VpeAabb *boxes);
+
+        // Appends the ids of every object whose box touches the frustum. The top of the tree
+        // gets tested here, the subtrees below that are split over the job system.
+        void cull(VpeJobSystem &jobSystem, const VpeFrustum &frustum, std::vector<uint32_t> &visible) const;
+
+        uint32_t objectCount() const { return static_cast<uint32_t>(ids_.size()); }
+        uint32_t nodeCount() const { return static_cast<uint32_t>(nodes_.size()); }
+
+    private:
+        static constexpr uint32_t NO_CHILD = ~0u;
+
+        struct alignas(32) Node
+        {
+            // minX, minY, minZ, maxX, maxY, maxZ, eight lanes each.
+            float bounds[6][WIDTH];
+            // Node index, or NO_CHILD if the lane is a single object.
+            uint32_t child[WIDTH];
+            // The objects under each lane are ids_[first, first + count).
+            uint32_t first[WIDTH];
+            uint32_t count[WIDTH];
+            // Bit per lane that is in use. The bounds of unused lanes are inside out, so they never grow a parent.
+            uint32_t laneMask;
+        };
+
+        // Which half of Node::bounds each plane compares against, worked out once per cull.
+        struct PlaneSelect
+        {
+            float plane[4];
+            uint32_t farAxis[3];
+            uint32_t nearAxis[3];
+        };
+
+        // Only used while building. Sorting these instead of indices keeps the centroids next to each other in memory.
+        struct BuildItem
+        {
+            glm::vec3 centroid;
+            uint32_t index;
+        };
+
+        struct Group
+        {
+            uint32_t first;
+            uint32_t count;
+        };
+
+        uint32_t buildNode(uint32_t first, uint32_t count, const VpeAabb *boxes, std::vector<BuildItem> &items);
+        static void splitGroups(std::vector<BuildItem> &items, uint32_t first, uint32_t count, uint32_t capacity, Group *groups, uint32_t &groupCount);
+        static void setLane(Node &node, uint32_t lane, const VpeAabb &box);
+        static VpeAabb nodeBounds(const Node &node);
+        // Bit per lane that is inside or touching, and bit per lane that is completely inside.
+        using NodeTest = void (*)(const Node &node, const PlaneSelect *planes, uint32_t &visibleMask, uint32_t &insideMask);
+        static void testNode(const Node &node, const PlaneSelect *planes, uint32_t &visibleMask, uint32_t &insideMask);
+        // Only there with VPE_ENABLE_AVX2, and only to be called when hasAvx2() says so.
+        static void testNodeAvx2(const Node &node, const PlaneSelect *planes, uint32_t &visibleMask, uint32_t &insideMask);
+        // Asks the CPU once, false when the AVX2 test wasn't built.
+        static bool hasAvx2();
+        // Tests nodeIndex alone. Objects that are decided go to visible, children that still need work to pending.
+        void cullNode(uint32_t nodeIndex, NodeTest test, const PlaneSelect *planes, std::vector<uint32_t> &visible, std::vector<uint32_t> &pending) const;
+
+        std::vector<Node> nodes_;
+        // Object ids in tree order, so every subtree is one contiguous run.
+        std::vector<uint32_t> ids_;
+        // Index into the boxes passed to build, in the same order as ids_.
+        std::vector<uint32_t> order_;
+    };
+} // namespace vpe
@@ -0,0 +1,63 @@
+// The AVX2 node test of VpeSceneBvh. This is the only file built with -mavx2 -mfma (/arch:AVX2),
+// so nothing else picks up instructions an older CPU doesn't have, and VpeSceneBvh only calls
+// in here after asking the CPU.
+#include "VpeSceneBvh.hpp"
+
+#if defined(VPE_ENABLE_AVX2)
+#if !defined(__AVX2__)
+#error "VpeSceneBvhAvx.cpp has to be built with AVX2 enabled, see VPE_ENABLE_AVX2 in CMakeLists.txt"
+#endif
+#include <immintrin.h>
+
+namespace vpe
+{
+    namespace
+    {
+        inline __m256 multiplyAdd(__m256 a, __m256 b, __m256 c)
+        {
+            return _mm256_fmadd_ps(a, b, c);
+        }
+    }
+
+    void VpeSceneBvh::testNodeAvx2(const Node &node, const PlaneSelect *planes, uint32_t &visibleMask, uint32_t &insideMask)
+    {
+        // Same as testNode, all eight lanes in one register.
+        uint32_t outside = 0;
+        uint32_t crossing = 0;
+        const __m256 zero = _mm256_setzero_ps();
+        for (int i = 0; i < 6; i++)
+        {
+            const PlaneSelect &select = planes[i];
+            __m256 nx = _mm256_set1_ps(select.plane[0]);
+            __m256 ny = _mm256_set1_ps(select.plane[1]);
+            __m256 nz = _mm256_set1_ps(select.plane[2]);
+            __m256 w = _mm256_set1_ps(select.plane[3]);
+
+            __m256 farDistance = multiplyAdd(nx, _mm256_load_ps(node.bounds[select.farAxis[0]]),
+                                             multiplyAdd(ny, _mm256_load_ps(node.bounds[select.farAxis[1]]),
+                                                         multiplyAdd(nz, _mm256_load_ps(node.bounds[select.farAxis[2]]), w)));
+            __m256 nearDistance = multiplyAdd(nx, _mm256_load_ps(node.bounds[select.nearAxis[0]]),
+                                              multiplyAdd(ny, _mm256_load_ps(node.bounds[select.nearAxis[1]]),
+                                                          multiplyAdd(nz, _mm256_load_ps(node.bounds[select.nearAxis[2]]), w)));
+
+            outside |= static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(farDistance, zero, _CMP_LT_OQ)));
+            crossing |= static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(nearDistance, zero, _CMP_LT_OQ)));
+            if ((outside & node.laneMask) == node.laneMask)
+            {
+                break;
+            }
+        }
+        visibleMask = node.laneMask & ~outside;
+        insideMask = visibleMask & ~crossing;
+    }
+} // namespace vpe
+#else
+namespace vpe
+{
+    // Never picked, hasAvx2() is false without VPE_ENABLE_AVX2.
+    void VpeSceneBvh::testNodeAvx2(const Node &node, const PlaneSelect *planes, uint32_t &visibleMask, uint32_t &insideMask)
+    {
+        testNode(node, planes, visibleMask, insideMask);
+    }
+} // namespace vpe
+#endif
@@ -0,0 +1,112 @@
+#include "VpeSimulationThread.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <exception>
+#include <thread>
+
+namespace vpe
+{
+    void VpeTransformSnapshot::interpolate(float alpha, std::vector<glm::vec4> &out) const
+    {
+        out.resize(positions.size());
+        // Bodies added during the step have no before state, they just sit where they are.
+        size_t blended = std::min(previousPositions.size(), positions.size());
+        for (size_t i = 0; i < blended; i++)
+        {
+            glm::vec3 position = previousPositions[i] + (positions[i] - previousPositions[i]) * alpha;
+            out[i] = glm::vec4{position, radii[i]};
+        }
+        for (size_t i = blended; i < positions.size(); i++)
+        {
+            out[i] = glm::vec4{positions[i], radii[i]};
+        }
+    }
+
+    VpeSimulationThread::VpeSimulationThread(VpeJobSystem &jobSystem, const VpePhysicsSettings &settings, float dt, const PopulateFn &populate)
+        : world_{std::make_unique<VpePhysicsWorld>(jobSystem, settings)}, dt_{dt}
+    {
+        populate(*world_);
+        start_ = Clock::now();
+        thread_ = std::thread{[this]()
+                              { run(); }};
+    }
+
+    VpeSimulationThread::~VpeSimulationThread()
+    {
+        stopping_.store(true, std::memory_order_relaxed);
+        thread_.join();
+    }
+
+    uint32_t VpeSimulationThread::poolThreadCount()
+    {
+        uint32_t cores = std::max(1u, std::thread::hardware_concurrency());
+        return std::max(1u, cores - 1);
+    }
+
+    float VpeSimulationThread::alpha() const
+    {
+        const VpeTransformSnapshot &latest = snapshot();
+        if (latest.dt <= 0.0f)
+        {
+            return 1.0f;
+        }
+        double into = (clock() - latest.time) / static_cast<double>(latest.dt);
+        return static_cast<float>(std::clamp(into, 0.0, 1.0));
+    }
+
+    double VpeSimulationThread::clock() const
+    {
+        return std::chrono::duration<double>(Clock::now() - start_).count();
+    }
+
+    void VpeSimulationThread::run()
+    {
+        // Steps started so far. Step n starts once the clock reaches n * dt and its result is due at (n + 1) * dt,
+        // so there's always a whole step of time to get it done before anyone wants to see it.
+        uint64_t tick = 0;
+        while (!stopping_.load(std::memory_order_relaxed))
+        {
+            auto due = start_ + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(static_cast<double>(tick) * dt_));
+            auto now = Clock::now();
+            if (now < due)
+            {
+                std::this_thread::sleep_until(due);
+                continue;
+            }
+            double behind = std::chrono::duration<double>(now - due).count() / dt_;
+            if (behind > static_cast<double>(MAX_CATCH_UP))
+            {
+                uint64_t skip = static_cast<uint64_t>(behind);
+                tick += skip;
+                skippedSteps_.fetch_add(skip, std::memory_order_relaxed);
+            }
+
+            VpeTransformSnapshot &out = snapshots_.writeBuffer();
+            try
+            {
+                out.previousPositions.assign(world_->positions().begin(), world_->positions().end());
+                world_->step(dt_);
+            }
+            catch (const std::exception &e)
+            {
+                spdlog::error("Simulation thread stopped, step {} threw: {}", tick, e.what());
+                failed_.store(true, std::memory_order_release);
+                return;
+            }
+            out.positions.assign(world_->positions().begin(), world_->positions().end());
+            out.radii.assign(world_->radii().begin(), world_->radii().end());
+            tick++;
+            // Stamped with when it goes out, not when the step was due. Steps start on the tick, so
+            // they go out about dt apart, and alpha gets from 0 to 1 just as the next one arrives.
+            // The next one's before state is this one's after state, so nothing jumps at the handover.
+            auto finished = Clock::now();
+            out.step = stepCount_.fetch_add(1, std::memory_order_relaxed) + 1;
+            out.time = std::chrono::duration<double>(finished - start_).count();
+            out.dt = dt_;
+            out.stepMilliseconds = static_cast<float>(std::chrono::duration<double, std::milli>(finished - now).count());
+            snapshots_.publish();
+        }
+    }
+} // namespace vpe
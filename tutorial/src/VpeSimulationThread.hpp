@@ -0,0 +1,100 @@
+#pragma once
+
+#include "VpeJobSystem.hpp"
+#include "VpePhysicsWorld.hpp"
+#include "VpeTripleBuffer.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace vpe
+{
+    // What the simulation thread hands the renderer after every step: where every body was before
+    // and after it, so a frame that lands between two steps can blend them.
+    struct VpeTransformSnapshot
+    {
+        // Steps the world has done, and when (on the simulation clock) the snapshot was published.
+        uint64_t step = 0;
+        double time = 0.0;
+        float dt = 0.0f;
+        float stepMilliseconds = 0.0f;
+        std::vector<glm::vec3> previousPositions;
+        std::vector<glm::vec3> positions;
+        std::vector<float> radii;
+
+        // Position and radius per body, alpha 0 is the before state and 1 the after one.
+        // Same layout as the GPU particles, so they can be drawn the same way.
+        void interpolate(float alpha, std::vector<glm::vec4> &out) const;
+    };
+
+    // Steps a VpePhysicsWorld at a fixed rate on its own thread, and publishes a VpeTransformSnapshot
+    // through a triple buffer after every step. The render thread picks up the newest one whenever it
+    // likes and never waits, so a slow step doesn't drop a frame and a slow frame doesn't hold up physics.
+    //
+    // Step n is due at n * dt on the simulation clock. The thread sleeps until the next one is due, and
+    // if it falls more than MAX_CATCH_UP steps behind it skips ahead instead of trying to catch up
+    // (physics runs slow motion for a moment rather than spiralling). The world's inner loops still go
+    // to the job system, the thread just submits them from outside the pool and helps run them while it
+    // waits. That makes it one thread more than the pool has, so a pool made with poolThreadCount()
+    // keeps the total at one per core. A bigger pool works too, it just shares a core with this thread.
+    class VpeSimulationThread
+    {
+    public:
+        // Fills the world before the thread starts, on the calling thread.
+        using PopulateFn = std::function<void(VpePhysicsWorld &world)>;
+
+        VpeSimulationThread(VpeJobSystem &jobSystem, const VpePhysicsSettings &settings, float dt, const PopulateFn &populate);
+        // Stops and joins.
+        ~VpeSimulationThread();
+
+        VpeSimulationThread(const VpeSimulationThread &) = delete;
+        VpeSimulationThread &operator=(const VpeSimulationThread &) = delete;
+
+        // Render thread. Takes the newest snapshot if there's one it hasn't seen, returns whether there was.
+        bool acquire() { return snapshots_.acquire(); }
+        // Render thread. What the last acquire() got, empty before the first step.
+        const VpeTransformSnapshot &snapshot() const { return snapshots_.readBuffer(); }
+        // How far between the snapshot's before and after state the simulation clock is right now, 0..1.
+        // It's 0 when the snapshot came out and 1 a step later, about when the next one does. Rendering
+        // that far in runs a step behind the simulation, but it's smooth whatever the frame rate.
+        float alpha() const;
+
+        // Threads for a job system that this thread will share, one less than the cores (at least one).
+        static uint32_t poolThreadCount();
+
+        // Seconds since the thread started.
+        double clock() const;
+        uint64_t stepCount() const { return stepCount_.load(std::memory_order_relaxed); }
+        uint64_t skippedSteps() const { return skippedSteps_.load(std::memory_order_relaxed); }
+        // Set if a step threw. The thread stops then, and the last snapshot stays as it was.
+        bool failed() const { return failed_.load(std::memory_order_acquire); }
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        static constexpr uint64_t MAX_CATCH_UP = 4;
+
+        void run();
+
+        std::unique_ptr<VpePhysicsWorld> world_;
+        float dt_;
+        Clock::time_point start_;
+        VpeTripleBuffer<VpeTransformSnapshot> snapshots_;
+
+        std::atomic<bool> stopping_{false};
+        std::atomic<bool> failed_{false};
+        std::atomic<uint64_t> stepCount_{0};
+        std::atomic<uint64_t> skippedSteps_{0};
+        // Last, so everything above is set up before it starts.
+        std::thread thread_;
+    };
+} // namespace vpe
@@ -0,0 +1,239 @@
+#include "VpeSpatialHashGrid.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace vpe
+{
+    namespace
+    {
+        // Half of the 26 neighbor offsets, the ones that come "after" (0, 0, 0) in z, y, x order.
+        constexpr int FORWARD_OFFSETS[13][3] = {
+            {1, 0, 0},
+            {-1, 1, 0},
+            {0, 1, 0},
+            {1, 1, 0},
+            {-1, -1, 1},
+            {0, -1, 1},
+            {1, -1, 1},
+            {-1, 0, 1},
+            {0, 0, 1},
+            {1, 0, 1},
+            {-1, 1, 1},
+            {0, 1, 1},
+            {1, 1, 1}};
+
+        uint32_t nextPowerOfTwo(uint32_t value)
+        {
+            uint32_t result = 1;
+            while (result < value)
+            {
+                result <<= 1;
+            }
+            return result;
+        }
+    }
+
+    VpeSpatialHashGrid::VpeSpatialHashGrid(VpeJobSystem &jobSystem, float cellSize)
+        : jobSystem_{jobSystem}, cellSize_{cellSize}, inverseCellSize_{1.0f / cellSize}
+    {
+        assert(cellSize > 0.0f && "Cell size must be positive.");
+        resizeTable(MIN_TABLE_SIZE);
+    }
+
+    void VpeSpatialHashGrid::setCellSize(float cellSize)
+    {
+        assert(cellSize > 0.0f && "Cell size must be positive.");
+        cellSize_ = cellSize;
+        inverseCellSize_ = 1.0f / cellSize;
+    }
+
+    void VpeSpatialHashGrid::rebuild(const glm::vec3 *positions, uint32_t count)
+    {
+        particleCount_ = count;
+        // Roughly one slot per particle keeps collisions rare without wasting much memory.
+        resizeTable(count);
+        uint32_t tableSize = tableMask_ + 1;
+
+        particleSlot_.resize(count);
+        sortedIndices_.resize(count);
+        sortedPositions_.resize(count);
+        sortedCells_.resize(count);
+
+        uint32_t tableChunks = jobSystem_.chunkCountFor(tableSize, PARALLEL_THRESHOLD);
+        uint32_t particleChunks = jobSystem_.chunkCountFor(count, PARALLEL_THRESHOLD);
+
+        jobSystem_.parallelForChunks(tableSize, tableChunks, [this](uint32_t, uint32_t begin, uint32_t end)
+                       {
+            for (uint32_t h = begin; h < end; h++)
+            {
+                slotCounts_[h].store(0, std::memory_order_relaxed);
+            } });
+
+        // Pass 1: hash every particle and count how many land in each slot.
+        jobSystem_.parallelForChunks(count, particleChunks, [this, positions](uint32_t, uint32_t begin, uint32_t end)
+                       {
+            for (uint32_t i = begin; i < end; i++)
+            {
+                uint32_t slot = hashCell(cellCoord(positions[i]));
+                particleSlot_[i] = slot;
+                slotCounts_[slot].fetch_add(1, std::memory_order_relaxed);
+            } });
+
+        // Pass 2: exclusive prefix sum of the counts gives each slot its start.
+        // Done as sum per chunk, scan the chunk sums, then fill in each chunk.
+        std::vector<uint32_t> chunkOffsets(tableChunks + 1, 0);
+        jobSystem_.parallelForChunks(tableSize, tableChunks, [this, &chunkOffsets](uint32_t chunk, uint32_t begin, uint32_t end)
+                       {
+            uint32_t sum = 0;
+            for (uint32_t h = begin; h < end; h++)
+            {
+                sum += slotCounts_[h].load(std::memory_order_relaxed);
+            }
+            chunkOffsets[chunk + 1] = sum; });
+        for (uint32_t c = 0; c < tableChunks; c++)
+        {
+            chunkOffsets[c + 1] += chunkOffsets[c];
+        }
+        jobSystem_.parallelForChunks(tableSize, tableChunks, [this, &chunkOffsets](uint32_t chunk, uint32_t begin, uint32_t end)
+                       {
+            uint32_t running = chunkOffsets[chunk];
+            for (uint32_t h = begin; h < end; h++)
+            {
+                cellStart_[h] = running;
+                running += slotCounts_[h].load(std::memory_order_relaxed);
+                // The counters now become write cursors for the scatter.
+                slotCounts_[h].store(cellStart_[h], std::memory_order_relaxed);
+            } });
+        cellStart_[tableSize] = count;
+
+        // Pass 3: scatter indices into their slot's range.
+        jobSystem_.parallelForChunks(count, particleChunks, [this](uint32_t, uint32_t begin, uint32_t end)
+                       {
+            for (uint32_t i = begin; i < end; i++)
+            {
+                uint32_t destination = slotCounts_[particleSlot_[i]].fetch_add(1, std::memory_order_relaxed);
+                sortedIndices_[destination] = i;
+            } });
+
+        // Pass 4: the scatter order depends on thread timing, so sort each (tiny) range to make
+        // the result deterministic, and copy the positions and cells over in sorted order.
+        jobSystem_.parallelForChunks(tableSize, tableChunks, [this, positions](uint32_t, uint32_t begin, uint32_t end)
+                       {
+            for (uint32_t h = begin; h < end; h++)
+            {
+                uint32_t first = cellStart_[h];
+                uint32_t last = cellStart_[h + 1];
+                // Insertion sort, the ranges are only a handful of entries long.
+                for (uint32_t k = first + 1; k < last; k++)
+                {
+                    uint32_t value = sortedIndices_[k];
+                    uint32_t j = k;
+                    while (j > first && sortedIndices_[j - 1] > value)
+                    {
+                        sortedIndices_[j] = sortedIndices_[j - 1];
+                        j--;
+                    }
+                    sortedIndices_[j] = value;
+                }
+                for (uint32_t k = first; k < last; k++)
+                {
+                    sortedPositions_[k] = positions[sortedIndices_[k]];
+                    sortedCells_[k] = cellCoord(sortedPositions_[k]);
+                }
+            } });
+    }
+
+    void VpeSpatialHashGrid::findPairs(float radius, std::vector<Pair> &pairs) const
+    {
+        assert(radius <= cellSize_ && "Pair radius can't be bigger than the cell size.");
+        pairs.clear();
+        if (particleCount_ == 0)
+        {
+            return;
+        }
+
+        // Walk particles in sorted order, so neighbors are already warm in cache.
+        // Each particle only looks at its own cell plus the 13 "forward" neighbors,
+        // the other 13 are covered when the particle over there does its own lookup.
+        // Every chunk collects into its own list and we glue them together in chunk order.
+        float radiusSquared = radius * radius;
+        uint32_t chunks = jobSystem_.chunkCountFor(particleCount_, PARALLEL_THRESHOLD);
+        std::vector<std::vector<Pair>> chunkPairs(chunks);
+        jobSystem_.parallelForChunks(particleCount_, chunks, [this, radiusSquared, &chunkPairs](uint32_t chunk, uint32_t begin, uint32_t end)
+                       {
+            auto &local = chunkPairs[chunk];
+            for (uint32_t k = begin; k < end; k++)
+            {
+                uint32_t i = sortedIndices_[k];
+                const glm::vec3 &position = sortedPositions_[k];
+                const glm::ivec3 &center = sortedCells_[k];
+
+                auto test = [&](uint32_t other)
+                {
+                    glm::vec3 delta = sortedPositions_[other] - position;
+                    if (glm::dot(delta, delta) <= radiusSquared)
+                    {
+                        uint32_t j = sortedIndices_[other];
+                        local.emplace_back(std::min(i, j), std::max(i, j));
+                    }
+                };
+
+                // Own cell, only the entries after us so every pair shows up once.
+                uint32_t cellEnd = cellStart_[hashCell(center) + 1];
+                for (uint32_t other = k + 1; other < cellEnd; other++)
+                {
+                    if (sortedCells_[other] == center)
+                    {
+                        test(other);
+                    }
+                }
+
+                for (const auto &offset : FORWARD_OFFSETS)
+                {
+                    forEachInCell(glm::ivec3{center.x + offset[0], center.y + offset[1], center.z + offset[2]}, test);
+                }
+            } });
+
+        size_t total = 0;
+        for (const auto &local : chunkPairs)
+        {
+            total += local.size();
+        }
+        pairs.reserve(total);
+        for (const auto &local : chunkPairs)
+        {
+            pairs.insert(pairs.end(), local.begin(), local.end());
+        }
+    }
+
+    glm::ivec3 VpeSpatialHashGrid::cellCoord(const glm::vec3 &position) const
+    {
+        return glm::ivec3{
+            static_cast<int>(std::floor(position.x * inverseCellSize_)),
+            static_cast<int>(std::floor(position.y * inverseCellSize_)),
+            static_cast<int>(std::floor(position.z * inverseCellSize_))};
+    }
+
+    uint32_t VpeSpatialHashGrid::hashCell(const glm::ivec3 &cell) const
+    {
+        // The usual three big primes xor hash (Teschner et al.), masked down to the table.
+        uint32_t hash = (static_cast<uint32_t>(cell.x) * 73856093u) ^
+                        (static_cast<uint32_t>(cell.y) * 19349663u) ^
+                        (static_cast<uint32_t>(cell.z) * 83492791u);
+        return hash & tableMask_;
+    }
+
+    void VpeSpatialHashGrid::resizeTable(uint32_t count)
+    {
+        uint32_t tableSize = nextPowerOfTwo(std::max(count, MIN_TABLE_SIZE));
+        if (tableSize == tableMask_ + 1 && slotCounts_)
+        {
+            return;
+        }
+
+        tableMask_ = tableSize - 1;
+        slotCounts_ = std::make_unique<std::atomic<uint32_t>[]>(tableSize);
+        cellStart_.assign(tableSize + 1, 0);
+    }
+} // namespace vpe
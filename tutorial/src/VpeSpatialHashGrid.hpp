@@ -0,0 +1,180 @@
+#pragma once
+
+#include "VpeJobSystem.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace vpe
+{
+    // Broadphase for lots of small, equal sized spheres (particles).
+    // Space is cut into cubes of cellSize, and each cube is hashed into a fixed size table.
+    // Rebuilding is a counting sort, so every table slot is just a [start, end) range
+    // into one flat array of particle indices. No per cell vectors, no allocations once warmed up.
+    class VpeSpatialHashGrid
+    {
+    public:
+        using Pair = std::pair<uint32_t, uint32_t>;
+
+        // cellSize should be at least the largest query radius (2 * particle radius for collisions).
+        // Then every neighbor is at most one cell away and a query never looks at more than 27 cells.
+        VpeSpatialHashGrid(VpeJobSystem &jobSystem, float cellSize);
+
+        VpeSpatialHashGrid(const VpeSpatialHashGrid &) = delete;
+        VpeSpatialHashGrid &operator=(const VpeSpatialHashGrid &) = delete;
+
+        // Sorts all particles into the grid. Big counts get split across the job system.
+        void rebuild(const glm::vec3 *positions, uint32_t count);
+
+        // Calls fn(index, distanceSquared) for every particle within radius of position.
+        // This is what the fluid style neighbor search wants.
+        template <typename Fn>
+        void forEachNeighbor(const glm::vec3 &position, float radius, Fn &&fn) const;
+
+        // Calls fn(index, position) for every particle whose center is inside the box lower..upper.
+        // For the odd query much bigger than a cell, like everything a fast body sweeps through in a step.
+        // Once the box covers more cells than there are particles, it just walks all of them instead.
+        template <typename Fn>
+        void forEachInBounds(const glm::vec3 &lower, const glm::vec3 &upper, Fn &&fn) const;
+
+        // Every (i, j) with i < j closer than radius, each pair once.
+        // The order only depends on the input positions, so it's the same every run.
+        void findPairs(float radius, std::vector<Pair> &pairs) const;
+
+        // Takes effect on the next rebuild.
+        void setCellSize(float cellSize);
+        float cellSize() const { return cellSize_; }
+        uint32_t particleCount() const { return particleCount_; }
+        uint32_t tableSize() const { return tableMask_ + 1; }
+
+        // These are the raw flat arrays, handy if something wants to walk cells directly.
+        // Slot h holds sortedIndices()[cellStart()[h] .. cellStart()[h + 1]).
+        const std::vector<uint32_t> &cellStart() const { return cellStart_; }
+        const std::vector<uint32_t> &sortedIndices() const { return sortedIndices_; }
+
+    private:
+        static constexpr uint32_t MIN_TABLE_SIZE = 1024;
+        // Below this it's cheaper to just do it on the calling thread.
+        static constexpr uint32_t PARALLEL_THRESHOLD = 16384;
+
+        glm::ivec3 cellCoord(const glm::vec3 &position) const;
+        uint32_t hashCell(const glm::ivec3 &cell) const;
+        // Calls fn(sortedSlot) for every entry that really lives in cell.
+        template <typename Fn>
+        void forEachInCell(const glm::ivec3 &cell, Fn &&fn) const;
+        void resizeTable(uint32_t count);
+
+        VpeJobSystem &jobSystem_;
+        float cellSize_;
+        float inverseCellSize_;
+        uint32_t tableMask_ = 0;
+        uint32_t particleCount_ = 0;
+
+        // Per slot counters, only used while rebuilding. Atomics can't live in a std::vector.
+        std::unique_ptr<std::atomic<uint32_t>[]> slotCounts_;
+        std::vector<uint32_t> cellStart_;
+        std::vector<uint32_t> particleSlot_;
+        std::vector<uint32_t> sortedIndices_;
+        // Positions copied into sorted order so a query reads memory in a straight line.
+        std::vector<glm::vec3> sortedPositions_;
+        // The real cell of each sorted entry. Different cells can share a slot,
+        // so a query only takes entries whose cell matches the one it asked for.
+        // That also stops a particle from being reported twice when two neighbor cells collide.
+        std::vector<glm::ivec3> sortedCells_;
+    };
+
+    template <typename Fn>
+    void VpeSpatialHashGrid::forEachNeighbor(const glm::vec3 &position, float radius, Fn &&fn) const
+    {
+        assert(radius <= cellSize_ && "Query radius can't be bigger than the cell size.");
+        if (particleCount_ == 0)
+        {
+            return;
+        }
+
+        glm::ivec3 center = cellCoord(position);
+        float radiusSquared = radius * radius;
+
+        // 3x3x3 block of cells around the query, never more.
+        for (int dz = -1; dz <= 1; dz++)
+        {
+            for (int dy = -1; dy <= 1; dy++)
+            {
+                for (int dx = -1; dx <= 1; dx++)
+                {
+                    forEachInCell(glm::ivec3{center.x + dx, center.y + dy, center.z + dz}, [&](uint32_t k)
+                                  {
+                        glm::vec3 delta = sortedPositions_[k] - position;
+                        float distanceSquared = glm::dot(delta, delta);
+                        if (distanceSquared <= radiusSquared)
+                        {
+                            fn(sortedIndices_[k], distanceSquared);
+                        } });
+                }
+            }
+        }
+    }
+
+    template <typename Fn>
+    void VpeSpatialHashGrid::forEachInBounds(const glm::vec3 &lower, const glm::vec3 &upper, Fn &&fn) const
+    {
+        if (particleCount_ == 0)
+        {
+            return;
+        }
+
+        auto visit = [&](uint32_t k)
+        {
+            const glm::vec3 &p = sortedPositions_[k];
+            if (p.x >= lower.x && p.y >= lower.y && p.z >= lower.z && p.x <= upper.x && p.y <= upper.y && p.z <= upper.z)
+            {
+                fn(sortedIndices_[k], p);
+            }
+        };
+
+        glm::ivec3 low = cellCoord(lower);
+        glm::ivec3 high = cellCoord(upper);
+        uint64_t cells = static_cast<uint64_t>(high.x - low.x + 1) * static_cast<uint64_t>(high.y - low.y + 1) *
+                         static_cast<uint64_t>(high.z - low.z + 1);
+        if (cells > particleCount_)
+        {
+            for (uint32_t k = 0; k < particleCount_; k++)
+            {
+                visit(k);
+            }
+            return;
+        }
+        for (int z = low.z; z <= high.z; z++)
+        {
+            for (int y = low.y; y <= high.y; y++)
+            {
+                for (int x = low.x; x <= high.x; x++)
+                {
+                    forEachInCell(glm::ivec3{x, y, z}, visit);
+                }
+            }
+        }
+    }
+
+    template <typename Fn>
+    void VpeSpatialHashGrid::forEachInCell(const glm::ivec3 &cell, Fn &&fn) const
+    {
+        uint32_t slot = hashCell(cell);
+        uint32_t end = cellStart_[slot + 1];
+        for (uint32_t k = cellStart_[slot]; k < end; k++)
+        {
+            if (sortedCells_[k] == cell)
+            {
+                fn(k);
+            }
+        }
+    }
+} // namespace vpe
@@ -0,0 +1,105 @@
+#include "VpeStartupTrace.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+
+namespace vpe
+{
+    VpeStartupTrace::Scope::Scope(VpeStartupTrace *trace, std::string name)
+        : trace_{trace}, name_{std::move(name)}, start_{Clock::now()}
+    {
+    }
+
+    VpeStartupTrace::Scope::~Scope()
+    {
+        if (trace_ != nullptr)
+        {
+            trace_->addPhase(name_, start_, Clock::now());
+        }
+    }
+
+    VpeStartupTrace::VpeStartupTrace(bool printTimeline) : start_{Clock::now()}, printTimeline_{printTimeline}
+    {
+        threads_.push_back(std::this_thread::get_id());
+    }
+
+    void VpeStartupTrace::addPhase(const std::string &name, Clock::time_point start, Clock::time_point end)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        phases_.push_back(Phase{name, threadNumber(std::this_thread::get_id()),
+                                millisecondsSinceStart(start), millisecondsSinceStart(end)});
+    }
+
+    void VpeStartupTrace::markFirstFrame()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (firstFrameMs_ >= 0.0)
+            {
+                return;
+            }
+            firstFrameMs_ = millisecondsSinceStart(Clock::now());
+        }
+        spdlog::info("First frame presented {:.1f} ms after start", firstFrameMs_);
+        if (printTimeline_)
+        {
+            printTimeline();
+        }
+    }
+
+    double VpeStartupTrace::firstFrameMilliseconds() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return firstFrameMs_;
+    }
+
+    void VpeStartupTrace::printTimeline() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<Phase> phases = phases_;
+        std::sort(phases.begin(), phases.end(), [](const Phase &a, const Phase &b)
+                  { return a.startMs < b.startMs; });
+
+        double totalMs = std::max(firstFrameMs_, 0.0);
+        for (const Phase &phase : phases)
+        {
+            totalMs = std::max(totalMs, phase.endMs);
+        }
+
+        // One row per phase with a bar for where it sits on the timeline, so the overlap is easy to see.
+        constexpr int BAR_WIDTH = 50;
+        spdlog::info("Startup timeline, {:.1f} ms in total:", totalMs);
+        for (const Phase &phase : phases)
+        {
+            int from = totalMs > 0.0 ? static_cast<int>(phase.startMs / totalMs * BAR_WIDTH) : 0;
+            int to = totalMs > 0.0 ? static_cast<int>(phase.endMs / totalMs * BAR_WIDTH) : 0;
+            from = std::min(from, BAR_WIDTH - 1);
+            to = std::clamp(to, from + 1, BAR_WIDTH);
+            std::string bar(BAR_WIDTH, '.');
+            std::fill(bar.begin() + from, bar.begin() + to, '#');
+            spdlog::info("  thread {:2} |{}| {:8.1f} - {:8.1f} ms ({:7.1f} ms) {}",
+                         phase.thread, bar, phase.startMs, phase.endMs, phase.endMs - phase.startMs, phase.name);
+        }
+        if (firstFrameMs_ >= 0.0)
+        {
+            spdlog::info("  first frame at {:.1f} ms", firstFrameMs_);
+        }
+    }
+
+    double VpeStartupTrace::millisecondsSinceStart(Clock::time_point time) const
+    {
+        return std::chrono::duration<double, std::milli>(time - start_).count();
+    }
+
+    uint32_t VpeStartupTrace::threadNumber(std::thread::id id)
+    {
+        auto found = std::find(threads_.begin(), threads_.end(), id);
+        if (found != threads_.end())
+        {
+            return static_cast<uint32_t>(found - threads_.begin());
+        }
+        threads_.push_back(id);
+        return static_cast<uint32_t>(threads_.size() - 1);
+    }
+} // namespace vpe
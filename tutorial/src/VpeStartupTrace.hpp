@@ -0,0 +1,71 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace vpe
+{
+    // Wall clock timeline of how the app starts up: which phase ran on which thread and when,
+    // measured from when the trace was made (so make it first thing in main).
+    // The time until the first frame is presented is the number to keep an eye on.
+    class VpeStartupTrace
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        // Marks one phase from construction to destruction. A null trace is fine and does nothing,
+        // so code that's also used outside of startup doesn't need to care.
+        class Scope
+        {
+        public:
+            Scope(VpeStartupTrace *trace, std::string name);
+            ~Scope();
+
+            Scope(const Scope &) = delete;
+            Scope &operator=(const Scope &) = delete;
+
+        private:
+            VpeStartupTrace *trace_;
+            std::string name_;
+            Clock::time_point start_;
+        };
+
+        // With printTimeline the whole timeline gets logged once the first frame is out (--startup-trace).
+        explicit VpeStartupTrace(bool printTimeline = false);
+
+        VpeStartupTrace(const VpeStartupTrace &) = delete;
+        VpeStartupTrace &operator=(const VpeStartupTrace &) = delete;
+
+        void addPhase(const std::string &name, Clock::time_point start, Clock::time_point end);
+        // Call once the first frame has been handed to present. Only the first call counts.
+        void markFirstFrame();
+
+        // Negative until there's been a first frame.
+        double firstFrameMilliseconds() const;
+        void printTimeline() const;
+
+    private:
+        struct Phase
+        {
+            std::string name;
+            uint32_t thread;
+            double startMs;
+            double endMs;
+        };
+
+        double millisecondsSinceStart(Clock::time_point time) const;
+        uint32_t threadNumber(std::thread::id id);
+
+        const Clock::time_point start_;
+        const bool printTimeline_;
+
+        mutable std::mutex mutex_;
+        std::vector<Phase> phases_;
+        // Threads are numbered in the order they first show up, the main thread is usually 0.
+        std::vector<std::thread::id> threads_;
+        double firstFrameMs_ = -1.0;
+    };
+} // namespace vpe
@@ -19,15 +19,33 @@ namespace vpe
   public:
     static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
 
-    VpeSwapChain(VpeDevice &deviceRef, VkExtent2D windowExtent);
+    // Whether anything reads the depth buffer after drawing. If not, it never needs to leave the
+    // tile on tiled GPUs: it's transient, lazily allocated where the device has that, and not stored.
+    enum class DepthUsage
+    {
+      AttachmentOnly,
+      Sampled
+    };
+
+    VpeSwapChain(
+        VpeDevice &deviceRef,
+        VkExtent2D windowExtent,
+        DepthUsage depthUsage = DepthUsage::AttachmentOnly,
+        VpeStartupTrace *startupTrace = nullptr);
     ~VpeSwapChain();
 
     VpeSwapChain(const VpeSwapChain &) = delete;
     void operator=(const VpeSwapChain &) = delete;
 
+    // Both only exist on the render pass path, with dynamic rendering the render pass is VK_NULL_HANDLE.
     VkFramebuffer getFrameBuffer(int index) { return swapChainFramebuffers[index]; }
     VkRenderPass getRenderPass() { return renderPass; }
+    bool usesDynamicRendering() { return device.hasDynamicRendering(); }
     VkImageView getImageView(int index) { return swapChainImageViews[index]; }
+    // One depth buffer shared by all images. Depth only view, it can be sampled after
+    // the render pass when the swap chain was made with DepthUsage::Sampled.
+    VkImage getDepthImage() { return depthImage; }
+    VkImageView getDepthImageView() { return depthImageView; }
     size_t imageCount() { return swapChainImages.size(); }
     VkFormat getSwapChainImageFormat() { return swapChainImageFormat; }
     VkExtent2D getSwapChainExtent() { return swapChainExtent; }
@@ -40,8 +58,23 @@ namespace vpe
     }
     VkFormat findDepthFormat();
 
+    // Starts drawing into the image and its depth buffer (cleared to 1), with a render pass or
+    // dynamic rendering depending on the device. Afterwards the image is ready to present and
+    // the depth is left in DEPTH_STENCIL_ATTACHMENT_OPTIMAL for the depth pyramid, either way.
+    void beginRendering(VkCommandBuffer commandBuffer, int imageIndex, const VkClearColorValue &clearColor);
+    void endRendering(VkCommandBuffer commandBuffer, int imageIndex);
+
     VkResult acquireNextImage(uint32_t *imageIndex);
-    VkResult submitCommandBuffers(const VkCommandBuffer *buffers, uint32_t *imageIndex);
+    // extraWaits/extraWaitStages and extraSignals get added to the graphics submit,
+    // that's how other queues (async compute) hook into the frame.
+    VkResult submitCommandBuffers(
+        const VkCommandBuffer *buffers,
+        uint32_t *imageIndex,
+        const std::vector<VkSemaphore> &extraWaits = {},
+        const std::vector<VkPipelineStageFlags> &extraWaitStages = {},
+        const std::vector<VkSemaphore> &extraSignals = {});
+    // Which of the MAX_FRAMES_IN_FLIGHT slots the next submit uses.
+    size_t currentFrameIndex() { return currentFrame; }
 
   private:
     void createSwapChain();
@@ -50,6 +83,10 @@ namespace vpe
     void createRenderPass();
     void createFramebuffers();
     void createSyncObjects();
+    VkAttachmentStoreOp depthStoreOp()
+    {
+      return depthUsage == DepthUsage::Sampled ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    }
 
     // Helper functions
     VkSurfaceFormatKHR chooseSwapSurfaceFormat(
@@ -62,11 +99,13 @@ namespace vpe
     VkExtent2D swapChainExtent;
 
     std::vector<VkFramebuffer> swapChainFramebuffers;
-    VkRenderPass renderPass;
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    VkFormat depthFormat;
+    DepthUsage depthUsage;
 
-    std::vector<VkImage> depthImages;
-    std::vector<VkDeviceMemory> depthImageMemorys;
-    std::vector<VkImageView> depthImageViews;
+    VkImage depthImage;
+    VkDeviceMemory depthImageMemory;
+    VkImageView depthImageView;
     std::vector<VkImage> swapChainImages;
     std::vector<VkImageView> swapChainImageViews;
 
@@ -0,0 +1,142 @@
+#include "VpeTransformStream.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define VPE_STREAM_SSE
+#endif
+
+namespace vpe
+{
+    namespace
+    {
+        VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+        {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+    }
+
+    VpeTransformStream::VpeTransformStream(VpeDevice &device, uint32_t capacity, uint32_t slotCount)
+        : vpeDevice_{device}, capacity_{capacity}
+    {
+        // Flushes have to start and end on atom boundaries, so every slot starts on one. A cache line
+        // at least, so the streaming stores always get whole lines.
+        atomSize_ = std::max<VkDeviceSize>(vpeDevice_.properties.limits.nonCoherentAtomSize, 64);
+        slotStride_ = alignUp(std::max<VkDeviceSize>(capacity_, 1) * sizeof(glm::vec4), atomSize_);
+        VkDeviceSize size = slotStride_ * slotCount;
+
+        memoryFlags_ = vpeDevice_.createBuffer(
+            size,
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+            buffer_,
+            memory_,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        void *data;
+        if (vkMapMemory(vpeDevice_.device(), memory_, 0, VK_WHOLE_SIZE, 0, &data) != VK_SUCCESS)
+        {
+            vkDestroyBuffer(vpeDevice_.device(), buffer_, nullptr);
+            vkFreeMemory(vpeDevice_.device(), memory_, nullptr);
+            throw std::runtime_error("Failed to map transform stream memory.");
+        }
+        mapped_ = static_cast<uint8_t *>(data);
+
+        // Nothing's been written yet, zero radius draws nothing.
+        memset(mapped_, 0, static_cast<size_t>(size));
+        if (!isCoherent())
+        {
+            VkMappedMemoryRange range{};
+            range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+            range.memory = memory_;
+            range.offset = 0;
+            range.size = VK_WHOLE_SIZE;
+            vkFlushMappedMemoryRanges(vpeDevice_.device(), 1, &range);
+        }
+    }
+
+    VpeTransformStream::~VpeTransformStream()
+    {
+        vkUnmapMemory(vpeDevice_.device(), memory_);
+        vkDestroyBuffer(vpeDevice_.device(), buffer_, nullptr);
+        vkFreeMemory(vpeDevice_.device(), memory_, nullptr);
+    }
+
+    void VpeTransformStream::write(uint32_t slot, const glm::vec4 *instances, uint32_t count)
+    {
+        assert(count <= capacity_ && "More instances than the stream was made for.");
+        count = std::min(count, capacity_);
+        if (count == 0)
+        {
+            return;
+        }
+        VkDeviceSize bytes = static_cast<VkDeviceSize>(count) * sizeof(glm::vec4);
+        streamCopy(mapped_ + offset(slot), instances, static_cast<size_t>(bytes));
+
+        // Coherent memory is visible to the device as of the submit, anything else needs a flush first.
+        if (!isCoherent())
+        {
+            VkMappedMemoryRange range{};
+            range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+            range.memory = memory_;
+            range.offset = offset(slot);
+            // Rounding up stays inside the slot, slots are whole atoms.
+            range.size = alignUp(bytes, atomSize_);
+            vkFlushMappedMemoryRanges(vpeDevice_.device(), 1, &range);
+        }
+    }
+
+    void VpeTransformStream::streamCopy(void *destination, const void *source, size_t bytes)
+    {
+#if defined(__AVX__) || defined(VPE_STREAM_SSE)
+#if defined(__AVX__)
+        constexpr size_t LANE = 32;
+#else
+        constexpr size_t LANE = 16;
+#endif
+        auto *out = static_cast<uint8_t *>(destination);
+        const auto *in = static_cast<const uint8_t *>(source);
+        // Streaming stores need an aligned address, the bit before that goes the normal way.
+        size_t head = std::min(bytes, (LANE - reinterpret_cast<uintptr_t>(out) % LANE) % LANE);
+        memcpy(out, in, head);
+        out += head;
+        in += head;
+        bytes -= head;
+
+        // Four lanes at a time, so every store fills (part of) a whole cache line in one go.
+        for (; bytes >= 4 * LANE; bytes -= 4 * LANE, out += 4 * LANE, in += 4 * LANE)
+        {
+#if defined(__AVX__)
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + LANE));
+            __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + 2 * LANE));
+            __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + 3 * LANE));
+            _mm256_stream_si256(reinterpret_cast<__m256i *>(out), a);
+            _mm256_stream_si256(reinterpret_cast<__m256i *>(out + LANE), b);
+            _mm256_stream_si256(reinterpret_cast<__m256i *>(out + 2 * LANE), c);
+            _mm256_stream_si256(reinterpret_cast<__m256i *>(out + 3 * LANE), d);
+#else
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + LANE));
+            __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 2 * LANE));
+            __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 3 * LANE));
+            _mm_stream_si128(reinterpret_cast<__m128i *>(out), a);
+            _mm_stream_si128(reinterpret_cast<__m128i *>(out + LANE), b);
+            _mm_stream_si128(reinterpret_cast<__m128i *>(out + 2 * LANE), c);
+            _mm_stream_si128(reinterpret_cast<__m128i *>(out + 3 * LANE), d);
+#endif
+        }
+        memcpy(out, in, bytes);
+        // Streaming stores aren't ordered with anything else, this makes sure they're all out.
+        _mm_sfence();
+#else
+        memcpy(destination, source, bytes);
+#endif
+    }
+} // namespace vpe
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "VpeDevice.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace vpe
+{
+    // One big host visible buffer for instance data that changes every frame (xyz + radius per body,
+    // like the particles), cut into one region per frame slot. It's mapped once when it's made and stays
+    // mapped, so a frame's upload is one streaming copy and at most one flush, however many bodies.
+    //
+    // It goes into device local memory when the host can see some (resizable BAR, or an integrated GPU),
+    // so the draw reads it at full speed, otherwise into plain host visible memory. Either way the CPU
+    // side is usually write-combined: never read it back, and write it front to back in big pieces.
+    // The copy uses non-temporal stores for that, which also keeps it from pushing the simulation out
+    // of the cache on its way through.
+    class VpeTransformStream
+    {
+    public:
+        // capacity instances per slot.
+        VpeTransformStream(VpeDevice &device, uint32_t capacity, uint32_t slotCount);
+        ~VpeTransformStream();
+
+        VpeTransformStream(const VpeTransformStream &) = delete;
+        VpeTransformStream &operator=(const VpeTransformStream &) = delete;
+
+        // Host side, once per frame before submitting slot. The slot must not be in flight.
+        // Instances past count keep whatever was there last (zeros to start with, so they draw nothing).
+        void write(uint32_t slot, const glm::vec4 *instances, uint32_t count);
+
+        // Bind buffer() at offset(slot) as the instance buffer.
+        VkBuffer buffer() const { return buffer_; }
+        VkDeviceSize offset(uint32_t slot) const { return slot * slotStride_; }
+        uint32_t capacity() const { return capacity_; }
+        bool isDeviceLocal() const { return (memoryFlags_ & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0; }
+        // Without this every write gets flushed by hand.
+        bool isCoherent() const { return (memoryFlags_ & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0; }
+
+        // memcpy with non-temporal stores, fenced at the end so everything's out of the write-combining
+        // buffers before anyone flushes or submits. Plain memcpy on CPUs without SSE2.
+        static void streamCopy(void *destination, const void *source, size_t bytes);
+
+    private:
+        VpeDevice &vpeDevice_;
+        uint32_t capacity_;
+        VkDeviceSize slotStride_;
+        VkDeviceSize atomSize_;
+        VkBuffer buffer_;
+        VkDeviceMemory memory_;
+        VkMemoryPropertyFlags memoryFlags_;
+        uint8_t *mapped_ = nullptr;
+    };
+} // namespace vpe
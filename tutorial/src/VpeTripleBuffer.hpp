@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace vpe
+{
+    // Hands whole values from one writer thread to one reader thread without either one ever waiting.
+    // There are three slots: the writer owns one, the reader owns one, and the third sits in the middle
+    // holding the newest finished value. Publishing swaps the writer's slot into the middle, acquiring
+    // swaps the middle out to the reader. Both are one atomic exchange.
+    //
+    // The reader always gets the latest value and skips the ones it was too slow for. The writer never
+    // waits for the reader, it just overwrites whatever the reader didn't pick up in time.
+    template <typename T>
+    class VpeTripleBuffer
+    {
+    public:
+        VpeTripleBuffer() = default;
+
+        VpeTripleBuffer(const VpeTripleBuffer &) = delete;
+        VpeTripleBuffer &operator=(const VpeTripleBuffer &) = delete;
+
+        // Writer only. Whatever was in there is two publishes old (or untouched), fill it in completely.
+        T &writeBuffer() { return slots_[back_].value; }
+        // Writer only. The write buffer becomes the newest value, and the writer gets a new one.
+        void publish()
+        {
+            // Release so the reader sees everything written, acquire so we don't start writing into
+            // the slot before the reader is done with it.
+            uint8_t previous = middle_.exchange(static_cast<uint8_t>(back_ | FRESH), std::memory_order_acq_rel);
+            back_ = previous & INDEX_MASK;
+        }
+
+        // Reader only. Takes the newest value if there's one it hasn't seen, returns whether there was.
+        bool acquire()
+        {
+            if ((middle_.load(std::memory_order_relaxed) & FRESH) == 0)
+            {
+                return false;
+            }
+            uint8_t previous = middle_.exchange(front_, std::memory_order_acq_rel);
+            front_ = previous & INDEX_MASK;
+            return true;
+        }
+        // Reader only. A default constructed T until the first acquire() that returned true.
+        const T &readBuffer() const { return slots_[front_].value; }
+
+    private:
+        static constexpr uint8_t INDEX_MASK = 3;
+        // Set on the middle slot when the writer put it there, cleared when the reader takes it.
+        static constexpr uint8_t FRESH = 4;
+
+        // A cache line each, the writer filling its slot shouldn't keep stealing the reader's line.
+        struct alignas(64) Slot
+        {
+            T value{};
+        };
+
+        Slot slots_[3];
+        alignas(64) std::atomic<uint8_t> middle_{1};
+        // Each of these only ever gets touched by its own side.
+        alignas(64) uint8_t back_ = 0;
+        alignas(64) uint8_t front_ = 2;
+    };
+} // namespace vpe
@@ -4,14 +4,21 @@
 
 namespace vpe
 {
-    VpeWindow::VpeWindow(int w, int h, std::string name) : width_{w}, height_{h}, windowName_{name}
+    VpeWindow::VpeWindow(int w, int h, std::string name, bool openNow) : width_{w}, height_{h}, windowName_{name}
     {
         initWindow();
+        if (openNow)
+        {
+            open();
+        }
     }
 
     VpeWindow::~VpeWindow()
     {
-        glfwDestroyWindow(window_);
+        if (window_ != nullptr)
+        {
+            glfwDestroyWindow(window_);
+        }
         glfwTerminate();
     }
 
@@ -33,7 +40,18 @@ namespace vpe
         glfwInit();
         glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
         glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+    }
 
+    void VpeWindow::open()
+    {
+        if (window_ != nullptr)
+        {
+            return;
+        }
         window_ = glfwCreateWindow(width_, height_, windowName_.c_str(), nullptr, nullptr);
+        if (window_ == nullptr)
+        {
+            throw std::runtime_error("Failed to create window");
+        }
     }
 }
\ No newline at end of file
@@ -10,13 +10,17 @@ namespace vpe
     class VpeWindow
     {
     public:
-        VpeWindow(int w, int h, std::string name);
+        // Without openNow only GLFW gets set up, and the window itself waits for open().
+        // That way the Vulkan instance can be made on another thread while the window opens.
+        VpeWindow(int w, int h, std::string name, bool openNow = true);
         ~VpeWindow();
 
         // Disallow copy constructor. We're using a raw pointer, don't want a dangling pointer from a copy getting deleted.
         VpeWindow(const VpeWindow &) = delete;
         VpeWindow &operator=(const VpeWindow &) = delete;
 
+        // Has to be called from the main thread. Does nothing if the window is already open.
+        void open();
         bool shouldClose();
         VkExtent2D getExtent()
         {
@@ -32,6 +36,6 @@ namespace vpe
         const int height_;
 
         std::string windowName_;
-        GLFWwindow *window_;
+        GLFWwindow *window_ = nullptr;
     };
 }
\ No newline at end of file
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+
+namespace vpe
+{
+    // Chase-Lev work stealing deque, with the memory orders from
+    // "Correct and Efficient Work-Stealing for Weak Memory Models" (Le et al. 2013).
+    // One owner thread pushes and pops at the bottom (LIFO, so it stays cache hot),
+    // any other thread can steal from the top (FIFO, so thieves take the big old chunks).
+    // The ring buffer is fixed size. When it's full push() says no and the caller has to put the item somewhere else.
+    template <typename T>
+    class VpeWorkStealingDeque
+    {
+    public:
+        explicit VpeWorkStealingDeque(uint32_t capacity = 4096)
+            : mask_{capacity - 1}, buffer_{std::make_unique<std::atomic<T *>[]>(capacity)}
+        {
+            // The indices wrap with a mask, so the capacity has to be a power of two.
+            assert(capacity > 0 && (capacity & (capacity - 1)) == 0 && "Deque capacity must be a power of two.");
+        }
+
+        VpeWorkStealingDeque(const VpeWorkStealingDeque &) = delete;
+        VpeWorkStealingDeque &operator=(const VpeWorkStealingDeque &) = delete;
+
+        // Owner only.
+        bool push(T *item)
+        {
+            int64_t bottom = bottom_.load(std::memory_order_relaxed);
+            int64_t top = top_.load(std::memory_order_acquire);
+            if (bottom - top > static_cast<int64_t>(mask_))
+            {
+                return false;
+            }
+            buffer_[bottom & mask_].store(item, std::memory_order_relaxed);
+            // Release so a thief that sees the new bottom also sees the item.
+            bottom_.store(bottom + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Owner only. Returns nullptr when empty, or when a thief won the race for the last item.
+        T *pop()
+        {
+            int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+            bottom_.store(bottom, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t top = top_.load(std::memory_order_relaxed);
+
+            if (top > bottom)
+            {
+                // Was already empty, put bottom back.
+                bottom_.store(bottom + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+
+            T *item = buffer_[bottom & mask_].load(std::memory_order_relaxed);
+            if (top == bottom)
+            {
+                // Last item, we have to race the thieves for it.
+                if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                {
+                    item = nullptr;
+                }
+                bottom_.store(bottom + 1, std::memory_order_relaxed);
+            }
+            return item;
+        }
+
+        // Any thread. Returns nullptr when empty or when we lost a race, just try again somewhere else.
+        T *steal()
+        {
+            int64_t top = top_.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t bottom = bottom_.load(std::memory_order_acquire);
+            if (top >= bottom)
+            {
+                return nullptr;
+            }
+
+            T *item = buffer_[top & mask_].load(std::memory_order_relaxed);
+            if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                return nullptr;
+            }
+            return item;
+        }
+
+        // Only a hint, it can be stale by the time you look at it.
+        int64_t size() const
+        {
+            int64_t bottom = bottom_.load(std::memory_order_relaxed);
+            int64_t top = top_.load(std::memory_order_relaxed);
+            return bottom > top ? bottom - top : 0;
+        }
+
+    private:
+        // top and bottom get hammered by different threads, keep them on their own cache lines.
+        alignas(64) std::atomic<int64_t> top_{0};
+        alignas(64) std::atomic<int64_t> bottom_{0};
+        alignas(64) const uint32_t mask_;
+        std::unique_ptr<std::atomic<T *>[]> buffer_;
+    };
+} // namespace vpe
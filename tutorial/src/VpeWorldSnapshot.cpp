@@ -0,0 +1,130 @@
+#include "VpeWorldSnapshot.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+namespace vpe
+{
+    namespace
+    {
+        uint64_t alignUp(uint64_t value, uint64_t alignment)
+        {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+    }
+
+    void VpeWorldSnapshot::write(
+        const std::filesystem::path &path,
+        const VpePhysicsSettings &settings,
+        uint32_t bodyCount,
+        const std::vector<SectionData> &sections)
+    {
+        static_assert(std::is_trivially_copyable<VpePhysicsSettings>::value, "Settings go into the snapshot as raw bytes");
+
+        // Lay everything out first, so the header can say where each section ends up.
+        std::vector<SectionEntry> entries;
+        uint64_t offset = alignUp(sizeof(Header) + sections.size() * sizeof(SectionEntry), ALIGNMENT);
+        for (const SectionData &section : sections)
+        {
+            entries.push_back({section.id, section.elementSize, offset, section.count});
+            offset = alignUp(offset + section.count * section.elementSize, ALIGNMENT);
+        }
+
+        Header header{};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.headerSize = sizeof(Header);
+        header.settingsSize = sizeof(VpePhysicsSettings);
+        header.sectionCount = static_cast<uint32_t>(sections.size());
+        header.fileSize = offset;
+        header.bodyCount = bodyCount;
+        header.settings = settings;
+
+        // Written to a temporary and renamed at the end, so a crash halfway never leaves a broken
+        // snapshot where a good one used to be.
+        std::filesystem::path temporaryPath = path;
+        temporaryPath += ".partial";
+        {
+            std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+            if (!file.is_open())
+            {
+                throw std::runtime_error("Failed to open snapshot: " + temporaryPath.string());
+            }
+
+            const char padding[ALIGNMENT] = {};
+            uint64_t written = 0;
+            auto writeBytes = [&](const void *data, uint64_t size)
+            {
+                file.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+                written += size;
+            };
+            auto padTo = [&](uint64_t target)
+            {
+                writeBytes(padding, target - written);
+            };
+
+            writeBytes(&header, sizeof(header));
+            writeBytes(entries.data(), entries.size() * sizeof(SectionEntry));
+            // Big arrays go straight from the vectors to the file, no staging copy in between.
+            for (size_t i = 0; i < sections.size(); i++)
+            {
+                padTo(entries[i].offset);
+                writeBytes(sections[i].data, sections[i].count * sections[i].elementSize);
+            }
+            padTo(offset);
+
+            if (!file.good())
+            {
+                throw std::runtime_error("Failed to write snapshot: " + temporaryPath.string());
+            }
+        }
+        std::filesystem::rename(temporaryPath, path);
+    }
+
+    VpeWorldSnapshot::VpeWorldSnapshot(const std::filesystem::path &path) : file_{path}
+    {
+        if (file_.size() < sizeof(Header))
+        {
+            throw std::runtime_error("Not a world snapshot: " + path.string());
+        }
+        const Header &head = header();
+        if (std::memcmp(head.magic, MAGIC, sizeof(MAGIC)) != 0)
+        {
+            throw std::runtime_error("Not a world snapshot: " + path.string());
+        }
+        if (head.version != VERSION || head.headerSize != sizeof(Header) || head.settingsSize != sizeof(VpePhysicsSettings))
+        {
+            throw std::runtime_error("World snapshot was written by a different build: " + path.string());
+        }
+        if (head.fileSize != file_.size() ||
+            sizeof(Header) + static_cast<uint64_t>(head.sectionCount) * sizeof(SectionEntry) > file_.size())
+        {
+            throw std::runtime_error("World snapshot is cut short: " + path.string());
+        }
+
+        const auto *entries = reinterpret_cast<const SectionEntry *>(file_.data() + sizeof(Header));
+        for (uint32_t i = 0; i < head.sectionCount; i++)
+        {
+            const SectionEntry &entry = entries[i];
+            if (entry.offset % ALIGNMENT != 0 || entry.offset > file_.size() || entry.elementSize == 0 ||
+                entry.count > (file_.size() - entry.offset) / entry.elementSize)
+            {
+                throw std::runtime_error("World snapshot section runs off the end: " + path.string());
+            }
+        }
+    }
+
+    const VpeWorldSnapshot::SectionEntry *VpeWorldSnapshot::findSection(Section id) const
+    {
+        const auto *entries = reinterpret_cast<const SectionEntry *>(file_.data() + sizeof(Header));
+        for (uint32_t i = 0; i < header().sectionCount; i++)
+        {
+            if (entries[i].id == id)
+            {
+                return &entries[i];
+            }
+        }
+        return nullptr;
+    }
+} // namespace vpe
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "VpeMappedFile.hpp"
+#include "VpePhysicsWorld.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace vpe
+{
+    // A whole VpePhysicsWorld on disk as a flat image of its arrays. There's a header with the
+    // settings, a table of sections, then every SoA array as raw bytes, each starting on a 64 byte
+    // boundary. Nothing gets parsed field by field: saving is one write per array, and reading maps
+    // the file and hands out pointers straight into it.
+    //
+    // Raw bytes means the file only makes sense to the same build on the same kind of machine
+    // (endianness, glm layout). The version and the size checks catch the obvious mismatches.
+    //
+    // One snapshot can seed any number of worlds. They all restore from the same mapping,
+    // which the OS only reads from disk once.
+    class VpeWorldSnapshot
+    {
+    public:
+        enum class Section : uint32_t
+        {
+            Positions = 1,
+            Velocities = 2,
+            InverseMasses = 3,
+            Radii = 4,
+            SleepTimers = 5,
+            Awake = 6,
+            AwakeBodies = 7,
+            Constraints = 8,
+            BodyShapes = 9,
+            Shapes = 10,
+            ShapePoints = 11,
+            Manifolds = 12,
+            Continuous = 13,
+        };
+
+        // What the writer gets handed per section, pointing at the live arrays.
+        struct SectionData
+        {
+            Section id;
+            uint32_t elementSize;
+            const void *data;
+            uint64_t count;
+        };
+
+        static constexpr uint32_t VERSION = 3;
+        static constexpr uint64_t ALIGNMENT = 64;
+
+        // Writes the header, the table and then each array in one go. VpePhysicsWorld::saveSnapshot is the usual way in.
+        static void write(
+            const std::filesystem::path &path,
+            const VpePhysicsSettings &settings,
+            uint32_t bodyCount,
+            const std::vector<SectionData> &sections);
+
+        // Maps the file and checks the header and that every section fits. Throws if anything's off.
+        explicit VpeWorldSnapshot(const std::filesystem::path &path);
+
+        VpeWorldSnapshot(const VpeWorldSnapshot &) = delete;
+        VpeWorldSnapshot &operator=(const VpeWorldSnapshot &) = delete;
+
+        const VpePhysicsSettings &settings() const { return header().settings; }
+        uint32_t bodyCount() const { return header().bodyCount; }
+
+        // The array straight out of the mapping, valid as long as the snapshot is. count gets
+        // its length. Throws if the section is missing or wasn't written with elements of type T.
+        template <typename T>
+        const T *section(Section id, uint64_t &count) const;
+
+    private:
+        struct Header
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t headerSize;
+            uint32_t settingsSize;
+            uint32_t sectionCount;
+            uint64_t fileSize;
+            uint32_t bodyCount;
+            uint32_t reserved;
+            VpePhysicsSettings settings;
+        };
+
+        struct SectionEntry
+        {
+            Section id;
+            uint32_t elementSize;
+            uint64_t offset;
+            uint64_t count;
+        };
+
+        static constexpr char MAGIC[8] = {'V', 'P', 'E', 'S', 'N', 'A', 'P', '1'};
+
+        const Header &header() const { return *reinterpret_cast<const Header *>(file_.data()); }
+        const SectionEntry *findSection(Section id) const;
+
+        VpeMappedFile file_;
+    };
+
+    template <typename T>
+    const T *VpeWorldSnapshot::section(Section id, uint64_t &count) const
+    {
+        const SectionEntry *entry = findSection(id);
+        if (entry == nullptr || entry->elementSize != sizeof(T))
+        {
+            throw std::runtime_error("Snapshot section " + std::to_string(static_cast<uint32_t>(id)) + " is missing or the wrong type.");
+        }
+        count = entry->count;
+        return reinterpret_cast<const T *>(file_.data() + entry->offset);
+    }
+} // namespace vpe
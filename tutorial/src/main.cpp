@@ -1,12 +1,87 @@
 #include "BasicApp.hpp"
+#include "VpeBatchSimulation.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <stdexcept>
 #include <spdlog/spdlog.h>
 
-int main()
+namespace
 {
+    // Headless parameter sweep: worldCount small worlds, each a pile of spheres dropped on the floor
+    // with its own friction, all stepped side by side. No window, no GPU.
+    int runBatchPhysics(uint32_t worldCount, uint32_t bodiesPerWorld, uint32_t steps)
+    {
+        vpe::VpeJobSystem jobSystem{};
+        auto settingsFor = [worldCount](uint32_t world)
+        {
+            vpe::VpePhysicsSettings settings;
+            settings.friction = worldCount > 1 ? static_cast<float>(world) / static_cast<float>(worldCount - 1) : 0.5f;
+            return settings;
+        };
+        auto populate = [bodiesPerWorld](vpe::VpePhysicsWorld &world, uint32_t index)
+        {
+            constexpr float RADIUS = 0.1f;
+            constexpr uint32_t SIDE = 8;
+            for (uint32_t i = 0; i < bodiesPerWorld; i++)
+            {
+                // Every world gets its pile nudged a little differently, so they don't all agree.
+                float jitter = 0.01f * static_cast<float>((i * 7 + index * 13) % 5);
+                world.addBody(
+                    glm::vec3{(i % SIDE) * 2.5f * RADIUS + jitter,
+                              RADIUS + 0.2f + (i / (SIDE * SIDE)) * 2.5f * RADIUS,
+                              ((i / SIDE) % SIDE) * 2.5f * RADIUS},
+                    RADIUS, 1.0f);
+            }
+        };
+
+        auto start = std::chrono::steady_clock::now();
+        vpe::VpeBatchSimulation batch{jobSystem, worldCount, settingsFor, populate};
+        auto built = std::chrono::steady_clock::now();
+        batch.step(1.0f / 60.0f, steps);
+        auto end = std::chrono::steady_clock::now();
+
+        double seconds = std::chrono::duration<double>(end - built).count();
+        spdlog::info("{} worlds of {} bodies built in {:.1f} ms on {} threads",
+                     worldCount, bodiesPerWorld, std::chrono::duration<double, std::milli>(built - start).count(), jobSystem.threadCount());
+        spdlog::info("{} world steps in {:.2f} s, {:.0f} world steps per second",
+                     batch.worldSteps(), seconds, static_cast<double>(batch.worldSteps()) / seconds);
+
+        // A few points of the sweep, to see the friction actually did something.
+        uint32_t shown = std::min(worldCount, 5u);
+        for (uint32_t k = 0; k < shown; k++)
+        {
+            uint32_t index = shown > 1 ? k * (worldCount - 1) / (shown - 1) : 0;
+            const auto &world = batch.world(index);
+            float spread = 0.0f;
+            for (const auto &position : world.positions())
+            {
+                spread = std::max(spread, std::max(std::abs(position.x), std::abs(position.z)));
+            }
+            spdlog::info("  world {:5}: friction {:.2f}, pile spread {:.2f}, {} awake, {} islands",
+                         index, world.settings().friction, spread, world.awakeBodyCount(), world.islandCount());
+        }
+        return EXIT_SUCCESS;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    // First thing, everything in the startup timeline is measured from here.
+    bool printStartupTrace = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--startup-trace") == 0)
+        {
+            printStartupTrace = true;
+        }
+    }
+    vpe::VpeStartupTrace startupTrace{printStartupTrace};
+
     spdlog::set_pattern("[%H:%M:%S] [%^--%L--%$] [thread %t] %v");
 #ifdef NDEBUG
     spdlog::set_level(spdlog::level::info);
@@ -14,10 +89,58 @@ int main()
     spdlog::set_level(spdlog::level::debug);
 #endif
 
-    vpe::BasicApp app{};
+    bool validateGpuPhysics = false;
+    uint32_t batchWorlds = 0;
+    uint32_t batchBodies = 256;
+    uint32_t batchSteps = 600;
+    uint32_t simulationBodies = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--validate-gpu-physics") == 0)
+        {
+            validateGpuPhysics = true;
+        }
+        else if (std::strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+        {
+            batchWorlds = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+        }
+        else if (std::strcmp(argv[i], "--batch-bodies") == 0 && i + 1 < argc)
+        {
+            batchBodies = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+        }
+        else if (std::strcmp(argv[i], "--batch-steps") == 0 && i + 1 < argc)
+        {
+            batchSteps = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+        }
+        else if (std::strcmp(argv[i], "--simulation-thread") == 0 && i + 1 < argc)
+        {
+            simulationBodies = static_cast<uint32_t>(std::max(0, std::atoi(argv[++i])));
+        }
+    }
+
+    // Batch mode never opens a window, the renderer would only get in the way of the sweep.
+    if (batchWorlds > 0)
+    {
+        try
+        {
+            return runBatchPhysics(batchWorlds, batchBodies, batchSteps);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    vpe::BasicApp app{startupTrace, simulationBodies};
 
     try
     {
+        // Runs the compute shaders against the CPU version and quits, handy on lavapipe in CI.
+        if (validateGpuPhysics)
+        {
+            return app.validateGpuPhysics() ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
         app.run();
     }
     catch (const std::exception &e)
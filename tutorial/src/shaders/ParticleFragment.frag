@@ -0,0 +1,14 @@
+#version 450
+
+layout(location = 0) in vec2 fragOffset;
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    // Cut the quad down to a circle, and fake some sphere shading from the offset.
+    float distanceSquared = dot(fragOffset, fragOffset);
+    if (distanceSquared > 1.0) {
+        discard;
+    }
+    float facing = sqrt(1.0 - distanceSquared);
+    outColor = vec4(vec3(0.2, 0.5, 1.0) * (0.3 + 0.7 * facing), 1.0);
+}
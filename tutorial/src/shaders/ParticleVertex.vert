@@ -0,0 +1,25 @@
+#version 450
+
+// One camera facing quad per particle. The quad corners come from gl_VertexIndex,
+// and the particle itself comes straight out of the simulation buffer as instance data.
+layout(location = 0) in vec4 particle;
+
+layout(push_constant) uniform Push {
+    mat4 viewProjection;
+    vec4 cameraRight;
+    vec4 cameraUp;
+} push;
+
+layout(location = 0) out vec2 fragOffset;
+
+const vec2 CORNERS[6] = vec2[](
+    vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0),
+    vec2(-1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0)
+);
+
+void main() {
+    vec2 corner = CORNERS[gl_VertexIndex];
+    fragOffset = corner;
+    vec3 world = particle.xyz + (push.cameraRight.xyz * corner.x + push.cameraUp.xyz * corner.y) * particle.w;
+    gl_Position = push.viewProjection * vec4(world, 1.0);
+}
@@ -0,0 +1,25 @@
+#version 450
+#extension GL_EXT_buffer_reference : require
+
+// Vertex pulling. The pipeline has no vertex input at all, the positions come straight out of
+// the model's vertex buffer through its address. Has to match VpeModel::Vertex, a tightly packed vec3.
+// That's why it's read as floats, a vec3 array would get padded out to 16 bytes.
+layout(buffer_reference, std430, buffer_reference_align = 4) readonly buffer Vertices
+{
+    float values[];
+};
+
+// Has to match VpeModel::PullConstants.
+layout(push_constant) uniform Push
+{
+    mat4 transform;
+    Vertices vertices;
+} push;
+
+void main()
+{
+    // Indexed draws still bind their index buffer, so gl_VertexIndex already went through it.
+    uint base = uint(gl_VertexIndex) * 3u;
+    vec3 position = vec3(push.vertices.values[base], push.vertices.values[base + 1u], push.vertices.values[base + 2u]);
+    gl_Position = push.transform * vec4(position, 1.0);
+}